@@ -13,6 +13,12 @@ DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
 CONFIG += link_pkgconfig
 PKGCONFIG += opencv4 gstreamer-1.0 gstreamer-video-1.0 gstreamer-app-1.0 glib-2.0 gstreamer-gl-1.0 gstreamer-rtsp-server-1.0
 
+# io_uring writes in ArchiveBatchSink when liburing is installed (pwrite otherwise)
+packagesExist(liburing) {
+    PKGCONFIG += liburing
+    DEFINES += CAMVIGIL_HAVE_URING
+}
+
 # Added linker flags for libudev (required for hotplug support)
 LIBS += -Wl,--no-as-needed -ludev -Wl,--as-needed
 
@@ -25,6 +31,13 @@ LIBS += -lgstrtspserver-1.0
 QT += dbus concurrent
 
 SOURCES += \
+    archive_batch_sink.cpp \
+    archive_compactor.cpp \
+    archive_purger.cpp \
+    archive_recovery.cpp \
+    archive_roots.cpp \
+    archive_segment_index.cpp \
+    archive_thinner.cpp \
     archivemanager.cpp \
     archivewidget.cpp \
     archiveworker.cpp \
@@ -37,11 +50,17 @@ SOURCES += \
     node_core_service.cpp \
     node_api_server.cpp \
     node_services_bootstrap.cpp \
+    db_read_pool.cpp \
     db_reader.cpp \
     db_writer.cpp \
+    purge_planner.cpp \
+    recording_coverage.cpp \
+    recording_schedule.cpp \
+    segment_journal.cpp \
     fullscreenviewer.cpp \
     hik_osd.cpp \
     hik_time.cpp \
+    io_policy.cpp \
     layoutmanager.cpp \
     main.cpp \
     mainwindow.cpp \
@@ -74,6 +93,14 @@ SOURCES += \
     camera_grouping_widget.cpp
 
 HEADERS += \
+    archive_batch_sink.h \
+    archive_compactor.h \
+    archive_limits.h \
+    archive_purger.h \
+    archive_recovery.h \
+    archive_roots.h \
+    archive_segment_index.h \
+    archive_thinner.h \
     archivemanager.h \
     archivewidget.h \
     archiveworker.h \
@@ -87,12 +114,19 @@ HEADERS += \
     node_api_server.h \
     node_services_bootstrap.h \
     clickablelabel.h \
+    db_read_pool.h \
     db_reader.h \
     db_writer.h \
+    purge_planner.h \
+    recording_coverage.h \
+    recording_schedule.h \
+    segment_journal.h \
+    segment_queries.h \
     fullscreenviewer.h \
     glcontainerwidget.h \
     hik_osd.h \
     hik_time.h \
+    io_policy.h \
     layoutmanager.h \
     mainwindow.h \
     navbar.h \
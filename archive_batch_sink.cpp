@@ -0,0 +1,566 @@
+#include "archive_batch_sink.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#if defined(CAMVIGIL_HAVE_URING)
+#include <liburing.h>
+#endif
+
+static int envInt(const char* name, int fallback, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return (ok && v > 0) ? qBound(lo, v, hi) : fallback;
+}
+
+bool ArchiveBatchSink::enabled() {
+    return qEnvironmentVariableIntValue("CAMVIGIL_BATCHED_SINK") == 1;
+}
+
+namespace {
+
+const qint64 kFlushAgeMs = 500;   // partial chunk reaches the file within this
+
+// One bounded pool per device: a slow or full disk only stalls the cameras
+// recording to it.
+QThreadPool* writerPool(dev_t dev) {
+    static std::mutex mu;
+    static QHash<quint64, QThreadPool*> pools;
+    std::lock_guard<std::mutex> lk(mu);
+    QThreadPool*& p = pools[quint64(dev)];
+    if (!p) {
+        p = new QThreadPool;
+        p->setMaxThreadCount(envInt("CAMVIGIL_SINK_THREADS", 2, 1, 32));
+        p->setExpiryTimeout(-1);
+    }
+    return p;
+}
+
+// Process-wide counters for the periodic report; latency in log2(µs) buckets.
+struct Stats {
+    std::atomic<qint64> files{0}, writes{0}, bytes{0}, ringEnters{0};
+    std::atomic<qint64> latency[32] = {};
+
+    void record(qint64 us) {
+        int b = 0;
+        while (b < 31 && (qint64(1) << (b + 1)) <= us) ++b;
+        latency[b].fetch_add(1, std::memory_order_relaxed);
+        writes.fetch_add(1, std::memory_order_relaxed);
+    }
+    qint64 p99Us() const {
+        qint64 total = 0;
+        for (const auto& l : latency) total += l.load();
+        qint64 seen = 0;
+        for (int b = 0; b < 32; ++b) {
+            seen += latency[b].load();
+            if (total > 0 && seen * 100 >= total * 99) return qint64(1) << (b + 1);
+        }
+        return 0;
+    }
+};
+Stats g_stats;
+
+struct Job {
+    QByteArray data;
+    qint64     offset = 0;
+};
+
+class UringDevice;
+
+// Per-file state. Chunks are written in submission order by at most one
+// pool task at a time (`draining`), so a header rewrite after a seek always
+// lands after the data it overwrites.
+struct Impl {
+    QString  location;
+    quint64  preallocBytes = 0;
+    int      fd = -1;
+    QThreadPool* pool = nullptr; // the device's writers
+    qint64   pos = 0;            // stream position (next byte from the muxer)
+    qint64   fileEnd = 0;        // highest byte written + 1
+    QByteArray pending;          // gathered, not yet submitted
+    qint64   pendingOffset = 0;
+    QElapsedTimer pendingAge;
+    int      chunkBytes = 1024 * 1024;
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    qint64   queuedBytes = 0;
+    bool     draining = false;
+    int      error = 0;          // first errno from a writer task
+
+    UringDevice* ring = nullptr; // the device's io_uring, or null: pwrite on `pool`
+
+    // Next chunk to write. False, and draining cleared, when there is none or
+    // a write failed; `this` may be gone as soon as it returns false.
+    bool takeJob(Job& job) {
+        std::lock_guard<std::mutex> lk(mu);
+        if (jobs.empty() || error) {
+            draining = false;
+            cv.notify_all();
+            return false;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        return true;
+    }
+
+    // Accounts a written chunk; true while this file has more to write
+    // (still draining). Same lifetime rule as takeJob().
+    bool finished(const Job& job, qint64 written, qint64 us, int err) {
+        g_stats.record(us);
+        g_stats.bytes.fetch_add(written, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(mu);
+        queuedBytes -= job.data.size();
+        if (err && !error) error = err;
+        cv.notify_all();
+        if (jobs.empty() || error) {
+            draining = false;
+            return false;
+        }
+        return true;
+    }
+
+    void kick();
+
+    // pwrite path. Writes one chunk, then queues itself behind the other
+    // files' chunks on the same device: a file with a backlog cannot hold a
+    // writer thread.
+    void drain() {
+        Job job;
+        if (!takeJob(job)) return;
+        QElapsedTimer t; t.start();
+        const char* p = job.data.constData();
+        qint64 left = job.data.size(), off = job.offset;
+        int err = 0;
+        while (left > 0) {
+            const ssize_t n = ::pwrite(fd, p, size_t(left), off);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                err = errno;
+                break;
+            }
+            p += n; off += n; left -= n;
+        }
+        if (finished(job, job.data.size() - left, t.nsecsElapsed() / 1000, err))
+            pool->start([this]{ drain(); });   // still draining: this Impl stays alive
+    }
+
+    // Hand the gathered bytes to the device's writers; blocks only while this
+    // file already has 8 chunks queued.
+    int submit() {
+        if (pending.isEmpty()) {
+            std::lock_guard<std::mutex> lk(mu);
+            return error;
+        }
+        Job job{ pending, pendingOffset };
+        pending.clear();
+        pendingAge.invalidate();
+        std::unique_lock<std::mutex> lk(mu);
+        cv.wait(lk, [this]{ return error || queuedBytes < 8LL * chunkBytes; });
+        if (error) return error;
+        queuedBytes += job.data.size();
+        jobs.push_back(std::move(job));
+        if (!draining) {
+            draining = true;
+            lk.unlock();
+            kick();
+        }
+        return 0;
+    }
+
+    int waitIdle() {
+        const int err = submit();
+        std::unique_lock<std::mutex> lk(mu);
+        cv.wait(lk, [this]{ return !draining; });
+        return err ? err : error;
+    }
+};
+
+#if defined(CAMVIGIL_HAVE_URING)
+// io_uring path: one ring and one submitter thread per device instead of the
+// pwrite pool. Files still have at most one write in flight (ordering), but a
+// single io_uring_enter submits the next chunk of every ready file on the
+// device and reaps whatever has completed. A file that becomes ready while
+// writes are in flight is picked up at the next completion.
+class UringDevice {
+public:
+    // Null when io_uring is off or the kernel refuses a ring: use the pool.
+    static UringDevice* forDevice(dev_t dev) {
+        if (qEnvironmentVariable("CAMVIGIL_SINK_URING", QStringLiteral("1")) == QLatin1String("0"))
+            return nullptr;
+        static std::mutex mu;
+        static QHash<quint64, UringDevice*> devices;
+        std::lock_guard<std::mutex> lk(mu);
+        auto it = devices.constFind(quint64(dev));
+        if (it != devices.constEnd()) return *it;
+        auto* u = new UringDevice;
+        const int rc = io_uring_queue_init(kDepth, &u->ring_, 0);
+        if (rc < 0) {
+            qWarning() << "[BatchSink] io_uring unavailable, using pwrite:" << std::strerror(-rc);
+            delete u;
+            u = nullptr;
+        } else {
+            std::thread([u]{ u->run_(); }).detach();
+        }
+        devices.insert(quint64(dev), u);
+        return u;
+    }
+
+    // Called with the file's draining flag just set.
+    void schedule(Impl* f) {
+        std::lock_guard<std::mutex> lk(mu_);
+        ready_.push_back(f);
+        cv_.notify_one();
+    }
+
+private:
+    static const unsigned kDepth = 64;
+
+    struct Write {
+        Impl* f;
+        Job   job;
+        qint64 done = 0;
+        QElapsedTimer t;
+    };
+
+    void queue_(Write* w) {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring_);   // kDepth bounds what is queued
+        io_uring_prep_write(sqe, w->f->fd, w->job.data.constData() + w->done,
+                            unsigned(w->job.data.size() - w->done), __u64(w->job.offset + w->done));
+        io_uring_sqe_set_data(sqe, w);
+    }
+
+    void run_() {
+        unsigned inflight = 0;
+        for (;;) {
+            std::deque<Impl*> batch;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                if (inflight == 0) cv_.wait(lk, [this]{ return !ready_.empty(); });
+                while (!ready_.empty() && inflight + batch.size() < kDepth) {
+                    batch.push_back(ready_.front());
+                    ready_.pop_front();
+                }
+            }
+            for (Impl* f : batch) {
+                auto* w = new Write{ f, {}, 0, {} };
+                if (!f->takeJob(w->job)) { delete w; continue; }
+                w->t.start();
+                queue_(w);
+                ++inflight;
+            }
+            if (inflight == 0) continue;
+
+            // Submits everything queued and waits for at least one completion.
+            const int rc = io_uring_submit_and_wait(&ring_, 1);
+            g_stats.ringEnters.fetch_add(1, std::memory_order_relaxed);
+            if (rc < 0 && rc != -EINTR) {
+                qWarning() << "[BatchSink] io_uring_submit_and_wait:" << std::strerror(-rc);
+                QThread::msleep(10);
+                continue;
+            }
+
+            io_uring_cqe* cqe = nullptr;
+            while (io_uring_peek_cqe(&ring_, &cqe) == 0) {
+                auto* w = static_cast<Write*>(io_uring_cqe_get_data(cqe));
+                const int res = cqe->res;
+                io_uring_cqe_seen(&ring_, cqe);
+                --inflight;
+
+                int err = 0;
+                if (res == -EINTR || res == -EAGAIN) {
+                    queue_(w); ++inflight;         // retry as is
+                    continue;
+                }
+                if (res < 0) err = -res;
+                else if (res == 0) err = EIO;
+                else {
+                    w->done += res;
+                    if (w->done < w->job.data.size()) {
+                        queue_(w); ++inflight;     // short write: the rest
+                        continue;
+                    }
+                }
+                Impl* f = w->f;
+                const bool more = f->finished(w->job, w->done, w->t.nsecsElapsed() / 1000, err);
+                delete w;
+                if (more) {
+                    std::lock_guard<std::mutex> lk(mu_);
+                    ready_.push_back(f);
+                }
+            }
+        }
+    }
+
+    io_uring ring_ {};
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<Impl*> ready_;
+};
+#endif
+
+void Impl::kick() {
+#if defined(CAMVIGIL_HAVE_URING)
+    if (ring) {
+        ring->schedule(this);
+        return;
+    }
+#endif
+    pool->start([this]{ drain(); });
+}
+
+} // namespace
+
+// ---------- GObject boilerplate ----------
+
+typedef struct {
+    GstBaseSink parent;
+    Impl* d;
+} CvBatchSink;
+
+typedef struct {
+    GstBaseSinkClass parent_class;
+} CvBatchSinkClass;
+
+enum { PROP_0, PROP_LOCATION, PROP_PREALLOC_BYTES };
+
+G_DEFINE_TYPE(CvBatchSink, cv_batch_sink, GST_TYPE_BASE_SINK)
+
+static GstStaticPadTemplate sinkTemplate =
+    GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static CvBatchSink* cvSink(gpointer obj) { return reinterpret_cast<CvBatchSink*>(obj); }
+
+static void postWriteError(GstBaseSink* bsink, int err) {
+    Impl* d = cvSink(bsink)->d;
+    if (err == ENOSPC) {
+        GST_ELEMENT_ERROR(bsink, RESOURCE, NO_SPACE_LEFT,
+                          (nullptr), ("%s: %s", d->location.toUtf8().constData(), std::strerror(err)));
+    } else {
+        GST_ELEMENT_ERROR(bsink, RESOURCE, WRITE,
+                          (nullptr), ("%s: %s", d->location.toUtf8().constData(), std::strerror(err)));
+    }
+}
+
+static void cv_batch_sink_set_property(GObject* obj, guint id, const GValue* value, GParamSpec* pspec) {
+    Impl* d = cvSink(obj)->d;
+    switch (id) {
+    case PROP_LOCATION:       d->location = QString::fromUtf8(g_value_get_string(value)); break;
+    case PROP_PREALLOC_BYTES: d->preallocBytes = g_value_get_uint64(value); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, id, pspec);
+    }
+}
+
+static void cv_batch_sink_get_property(GObject* obj, guint id, GValue* value, GParamSpec* pspec) {
+    Impl* d = cvSink(obj)->d;
+    switch (id) {
+    case PROP_LOCATION:       g_value_set_string(value, d->location.toUtf8().constData()); break;
+    case PROP_PREALLOC_BYTES: g_value_set_uint64(value, d->preallocBytes); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, id, pspec);
+    }
+}
+
+static gboolean cv_batch_sink_start(GstBaseSink* bsink) {
+    Impl* d = cvSink(bsink)->d;
+    d->fd = ::open(d->location.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (d->fd < 0) {
+        GST_ELEMENT_ERROR(bsink, RESOURCE, OPEN_WRITE, (nullptr),
+                          ("%s: %s", d->location.toUtf8().constData(), std::strerror(errno)));
+        return FALSE;
+    }
+    struct stat st {};
+    const dev_t dev = ::fstat(d->fd, &st) == 0 ? st.st_dev : 0;
+    d->pool = writerPool(dev);
+#if defined(CAMVIGIL_HAVE_URING)
+    d->ring = UringDevice::forDevice(dev);
+#endif
+#if defined(Q_OS_LINUX)
+    // Unsupported filesystems just skip the preallocation.
+    if (d->preallocBytes > 0)
+        ::fallocate(d->fd, FALLOC_FL_KEEP_SIZE, 0, off_t(d->preallocBytes));
+#endif
+    d->pos = d->fileEnd = 0;
+    d->pending.clear();
+    d->pending.reserve(d->chunkBytes);
+    d->pendingAge.invalidate();
+    d->error = 0;
+    return TRUE;
+}
+
+static gboolean cv_batch_sink_stop(GstBaseSink* bsink) {
+    Impl* d = cvSink(bsink)->d;
+    if (d->fd < 0) return TRUE;
+    const int err = d->waitIdle();
+#if defined(Q_OS_LINUX)
+    // Give back what the preallocation reserved past the real end.
+    if (d->preallocBytes > quint64(d->fileEnd))
+        ::fallocate(d->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    d->fileEnd, off_t(d->preallocBytes) - d->fileEnd);
+#endif
+    ::close(d->fd);
+    d->fd = -1;
+
+    const qint64 n = ++g_stats.files;
+    if (n % 100 == 0) {
+        qInfo() << "[BatchSink] files=" << n << "writes=" << g_stats.writes.load()
+                << "bytes=" << g_stats.bytes.load() << "p99_write_us=" << g_stats.p99Us()
+                << "ring_enters=" << g_stats.ringEnters.load();
+    }
+    if (err) {
+        postWriteError(bsink, err);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static GstFlowReturn cv_batch_sink_render(GstBaseSink* bsink, GstBuffer* buf) {
+    Impl* d = cvSink(bsink)->d;
+    GstMapInfo map;
+    if (!gst_buffer_map(buf, &map, GST_MAP_READ)) return GST_FLOW_ERROR;
+
+    if (d->pending.isEmpty()) {
+        d->pendingOffset = d->pos;
+        d->pendingAge.start();
+    }
+    d->pending.append(reinterpret_cast<const char*>(map.data), int(map.size));
+    d->pos += qint64(map.size);
+    d->fileEnd = qMax(d->fileEnd, d->pos);
+    gst_buffer_unmap(buf, &map);
+
+    int err = 0;
+    if (d->pending.size() >= d->chunkBytes || d->pendingAge.elapsed() >= kFlushAgeMs)
+        err = d->submit();
+    if (err) {
+        postWriteError(bsink, err);
+        return GST_FLOW_ERROR;
+    }
+    return GST_FLOW_OK;
+}
+
+static gboolean cv_batch_sink_event(GstBaseSink* bsink, GstEvent* event) {
+    Impl* d = cvSink(bsink)->d;
+    int err = 0;
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_SEGMENT: {
+        // matroskamux seeks back to rewrite its header with a bytes segment.
+        const GstSegment* seg = nullptr;
+        gst_event_parse_segment(event, &seg);
+        if (seg->format == GST_FORMAT_BYTES && qint64(seg->start) != d->pos) {
+            err = d->submit();
+            d->pos = qint64(seg->start);
+        }
+        break;
+    }
+    case GST_EVENT_EOS:
+        err = d->waitIdle();   // on the file before splitmuxsink finalizes it
+        break;
+    default:
+        break;
+    }
+    if (err) {
+        postWriteError(bsink, err);
+        gst_event_unref(event);
+        return FALSE;
+    }
+    return GST_BASE_SINK_CLASS(cv_batch_sink_parent_class)->event(bsink, event);
+}
+
+static gboolean cv_batch_sink_query(GstBaseSink* bsink, GstQuery* query) {
+    Impl* d = cvSink(bsink)->d;
+    switch (GST_QUERY_TYPE(query)) {
+    case GST_QUERY_POSITION: {
+        GstFormat fmt;
+        gst_query_parse_position(query, &fmt, nullptr);
+        if (fmt == GST_FORMAT_BYTES || fmt == GST_FORMAT_DEFAULT) {
+            gst_query_set_position(query, GST_FORMAT_BYTES, d->pos);
+            return TRUE;
+        }
+        break;
+    }
+    case GST_QUERY_FORMATS:
+        gst_query_set_formats(query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+        return TRUE;
+    case GST_QUERY_SEEKING: {
+        GstFormat fmt;
+        gst_query_parse_seeking(query, &fmt, nullptr, nullptr, nullptr);
+        const gboolean bytes = fmt == GST_FORMAT_BYTES || fmt == GST_FORMAT_DEFAULT;
+        gst_query_set_seeking(query, GST_FORMAT_BYTES, bytes, 0, -1);
+        return TRUE;
+    }
+    default:
+        break;
+    }
+    return GST_BASE_SINK_CLASS(cv_batch_sink_parent_class)->query(bsink, query);
+}
+
+static void cv_batch_sink_finalize(GObject* obj) {
+    CvBatchSink* self = cvSink(obj);
+    if (self->d->fd >= 0) { self->d->waitIdle(); ::close(self->d->fd); }
+    delete self->d;
+    self->d = nullptr;
+    G_OBJECT_CLASS(cv_batch_sink_parent_class)->finalize(obj);
+}
+
+static void cv_batch_sink_class_init(CvBatchSinkClass* klass) {
+    GObjectClass* gobj = G_OBJECT_CLASS(klass);
+    gobj->set_property = cv_batch_sink_set_property;
+    gobj->get_property = cv_batch_sink_get_property;
+    gobj->finalize     = cv_batch_sink_finalize;
+    g_object_class_install_property(gobj, PROP_LOCATION,
+        g_param_spec_string("location", "File Location", "Segment file to write", nullptr,
+                            GParamFlags(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobj, PROP_PREALLOC_BYTES,
+        g_param_spec_uint64("prealloc-bytes", "Preallocation", "Expected file size (0 = none)",
+                            0, G_MAXUINT64, 0,
+                            GParamFlags(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    GstElementClass* eclass = GST_ELEMENT_CLASS(klass);
+    gst_element_class_set_static_metadata(eclass, "CamVigil batched file sink", "Sink/File",
+        "Writes segment files in large chunks from per-device writer threads", "CamVigil");
+    gst_element_class_add_static_pad_template(eclass, &sinkTemplate);
+
+    GstBaseSinkClass* bclass = GST_BASE_SINK_CLASS(klass);
+    bclass->start  = cv_batch_sink_start;
+    bclass->stop   = cv_batch_sink_stop;
+    bclass->render = cv_batch_sink_render;
+    bclass->event  = cv_batch_sink_event;
+    bclass->query  = cv_batch_sink_query;
+}
+
+static void cv_batch_sink_init(CvBatchSink* self) {
+    self->d = new Impl;
+    self->d->chunkBytes = envInt("CAMVIGIL_SINK_CHUNK_KB", 1024, 64, 16384) * 1024;
+    gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
+
+ArchiveBatchSink::Stats ArchiveBatchSink::stats() {
+    Stats s;
+    s.files      = g_stats.files.load();
+    s.writes     = g_stats.writes.load();
+    s.bytes      = g_stats.bytes.load();
+    s.p99WriteUs = g_stats.p99Us();
+    s.ringEnters = g_stats.ringEnters.load();
+    return s;
+}
+
+bool ArchiveBatchSink::registerElement() {
+    static const bool ok = gst_element_register(nullptr, factoryName(), GST_RANK_NONE,
+                                                cv_batch_sink_get_type()) == TRUE;
+    return ok;
+}
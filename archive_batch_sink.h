@@ -0,0 +1,52 @@
+#pragma once
+#include <QtGlobal>
+
+/**
+ * ArchiveBatchSink
+ * ----------------
+ * Segment file sink for splitmuxsink's `sink-factory` ("camvigilbatchsink"),
+ * an optional replacement for filesink on the recording path.
+ * - Gathers the muxer's small buffers into large chunks, so one write
+ *   replaces dozens of write(2) calls.
+ * - Built with liburing (CAMVIGIL_HAVE_URING), each device gets one
+ *   io_uring: a single io_uring_enter submits the next chunk of every file
+ *   ready on that device. Otherwise, or when the kernel refuses a ring,
+ *   chunks are written with pwrite(2) from the device's writer pool.
+ * - Chunks are written by a small pool of writer threads per device, not by
+ *   the camera's streaming thread; one slow write no longer stalls the
+ *   camera, and a slow disk only delays the cameras recording to it.
+ *   Each file keeps its own ordered queue (bounded, then back-pressure) and
+ *   gives its thread up after every chunk.
+ * - On Linux, preallocates the expected segment size with
+ *   fallocate(KEEP_SIZE) and releases the unused tail on close.
+ * - Seekable for matroskamux (header/Cues rewrite); a partial chunk is
+ *   written after 500 ms so live-tail readers stay within a cluster or two.
+ * - Write errors surface as GST_RESOURCE_ERROR (ENOSPC → NO_SPACE_LEFT), so
+ *   ArchiveWorker's failure classification is unchanged.
+ * Logs write count, bytes, p99 write latency and io_uring_enter calls every
+ * 100 files; tests/batch_sink_bench compares it with filesink.
+ *
+ * Env:
+ *   CAMVIGIL_BATCHED_SINK   1 = use this sink (default 0 = filesink)
+ *   CAMVIGIL_SINK_CHUNK_KB  bytes gathered per write (default 1024)
+ *   CAMVIGIL_SINK_THREADS   pwrite threads per device (default 2)
+ *   CAMVIGIL_SINK_URING     0 = pwrite even when built with liburing (default 1)
+ */
+class ArchiveBatchSink final {
+public:
+    static bool enabled();
+    static const char* factoryName() { return "camvigilbatchsink"; }
+
+    // Process-wide totals since start.
+    struct Stats {
+        qint64 files = 0;
+        qint64 writes = 0;       // chunks written
+        qint64 bytes = 0;
+        qint64 p99WriteUs = 0;   // per chunk, log2 bucket upper bound
+        qint64 ringEnters = 0;   // io_uring_enter calls (0 on the pwrite path)
+    };
+    static Stats stats();
+
+    // Registers the element with GStreamer once; false if that failed.
+    static bool registerElement();
+};
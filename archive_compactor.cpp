@@ -0,0 +1,234 @@
+#include "archive_compactor.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QDebug>
+#include <QtGlobal>
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
+#include "io_policy.h"
+
+static int envInt(const char* name, int fallback, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return (ok && v >= 0) ? qBound(lo, v, hi) : fallback;
+}
+
+int ArchiveCompactor::smallSegmentSec() {
+    return envInt("CAMVIGIL_COMPACT_SMALL_SEC", 60, 0, 3600);
+}
+
+QVector<QVector<CompactPiece>> ArchiveCompactor::planRuns(const QVector<CompactPiece>& pieces,
+                                                          qint64 maxGapNs, qint64 maxRunNs) {
+    QVector<QVector<CompactPiece>> runs;
+    QVector<CompactPiece> cur;
+    auto flush = [&]{
+        if (cur.size() >= 2) runs.push_back(cur);
+        cur.clear();
+    };
+    for (const CompactPiece& p : pieces) {
+        if (!cur.isEmpty()) {
+            const CompactPiece& prev = cur.last();
+            const bool joins = p.cameraUrl == prev.cameraUrl && p.codec == prev.codec
+                            && p.startUtcNs >= prev.endUtcNs - 1000000000LL   // tolerate 1 s overlap
+                            && p.startUtcNs - prev.endUtcNs <= maxGapNs
+                            && p.endUtcNs - cur.first().startUtcNs <= maxRunNs;
+            if (!joins) flush();
+        }
+        cur.push_back(p);
+    }
+    flush();
+    return runs;
+}
+
+// Drain a pipeline's bus for an ERROR; logs and returns true if there was one.
+static bool busError(GstElement* pipeline, const QString& what) {
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+    gst_object_unref(bus);
+    if (!msg) return false;
+    GError* err = nullptr; gchar* dbg = nullptr;
+    gst_message_parse_error(msg, &err, &dbg);
+    qWarning() << "[Compact]" << what << (err ? err->message : "unknown");
+    g_clear_error(&err); g_free(dbg);
+    gst_message_unref(msg);
+    return true;
+}
+
+int ArchiveCompactor::concat(const QVector<CompactPiece>& run, const QString& dst,
+                             qint64 bytesPerSec, const std::atomic<bool>& abort) {
+    gst_init(nullptr, nullptr);
+    QFile::remove(dst);
+
+    GError* err = nullptr;
+    GstElement* writer = gst_parse_launch(
+        "appsrc name=src format=time block=true max-bytes=16777216 ! matroskamux ! filesink name=sink", &err);
+    if (!writer) {
+        qWarning() << "[Compact] writer:" << (err ? err->message : "unknown");
+        g_clear_error(&err);
+        return -1;
+    }
+    g_clear_error(&err);
+    GstElement* src  = gst_bin_get_by_name(GST_BIN(writer), "src");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(writer), "sink");
+    g_object_set(sink, "location", dst.toUtf8().constData(), nullptr);
+    gst_object_unref(sink);
+
+    GstCaps* runCaps = nullptr;
+    GstClockTime lastDts = GST_CLOCK_TIME_NONE;
+    qint64 bytesRead = 0;
+    QElapsedTimer clock; clock.start();
+    int consumed = 0;
+    bool ok = true;
+    bool writerStarted = false;
+
+    for (const CompactPiece& piece : run) {
+        if (abort.load()) { ok = false; break; }
+        GstElement* reader = gst_parse_launch(
+            "filesrc name=src ! matroskademux ! appsink name=sink sync=false", &err);
+        g_clear_error(&err);
+        if (!reader) { ok = false; break; }
+        GstElement* fsrc = gst_bin_get_by_name(GST_BIN(reader), "src");
+        GstElement* as   = gst_bin_get_by_name(GST_BIN(reader), "sink");
+        g_object_set(fsrc, "location", piece.path.toUtf8().constData(), nullptr);
+        gst_object_unref(fsrc);
+        gst_element_set_state(reader, GST_STATE_PLAYING);
+
+        // Keep the piece's wall-clock offset inside the merged file.
+        qint64 offsetNs = piece.startUtcNs - run.first().startUtcNs;
+        GstClockTime firstTs = GST_CLOCK_TIME_NONE;
+        bool capsChanged = false;
+        while (GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(as), 10 * GST_SECOND)) {
+            GstCaps* caps = gst_sample_get_caps(sample);
+            if (!runCaps) {
+                runCaps = gst_caps_ref(caps);
+                g_object_set(src, "caps", runCaps, nullptr);
+                gst_element_set_state(writer, GST_STATE_PLAYING);
+                writerStarted = true;
+            } else if (caps && !gst_caps_is_equal(caps, runCaps)) {
+                gst_sample_unref(sample);
+                capsChanged = true;
+                break;
+            }
+
+            GstBuffer* buf = gst_buffer_copy(gst_sample_get_buffer(sample));
+            gst_sample_unref(sample);
+            if (firstTs == GST_CLOCK_TIME_NONE)
+                firstTs = GST_BUFFER_DTS_IS_VALID(buf) ? GST_BUFFER_DTS(buf) : GST_BUFFER_PTS(buf);
+            if (firstTs == GST_CLOCK_TIME_NONE) firstTs = 0;
+
+            auto rebase = [&](GstClockTime t) -> GstClockTime {
+                if (t == GST_CLOCK_TIME_NONE) return t;
+                return GstClockTime(qMax<qint64>(0, qint64(t) - qint64(firstTs) + offsetNs));
+            };
+            GstClockTime dts = rebase(GST_BUFFER_DTS_IS_VALID(buf) ? GST_BUFFER_DTS(buf) : GST_BUFFER_PTS(buf));
+            if (lastDts != GST_CLOCK_TIME_NONE && dts != GST_CLOCK_TIME_NONE && dts <= lastDts) {
+                // Wall clocks of neighbours overlap slightly; shift this piece forward.
+                offsetNs += qint64(lastDts - dts) + 1000000;
+                dts = rebase(GST_BUFFER_DTS_IS_VALID(buf) ? GST_BUFFER_DTS(buf) : GST_BUFFER_PTS(buf));
+            }
+            GST_BUFFER_PTS(buf) = rebase(GST_BUFFER_PTS(buf));
+            GST_BUFFER_DTS(buf) = rebase(GST_BUFFER_DTS(buf));
+            if (dts != GST_CLOCK_TIME_NONE) lastDts = dts;
+
+            bytesRead += gst_buffer_get_size(buf);
+            if (gst_app_src_push_buffer(GST_APP_SRC(src), buf) != GST_FLOW_OK) { ok = false; break; }
+
+            // Throttle: never read faster than bytesPerSec on average.
+            const qint64 dueMs = bytesRead * 1000 / qMax<qint64>(1, bytesPerSec);
+            if (dueMs > clock.elapsed()) QThread::msleep(quint64(dueMs - clock.elapsed()));
+        }
+        const bool eos = gst_app_sink_is_eos(GST_APP_SINK(as));
+        const bool readErr = busError(reader, piece.path);
+        gst_object_unref(as);
+        gst_element_set_state(reader, GST_STATE_NULL);
+        gst_object_unref(reader);
+
+        if (capsChanged) break;                       // merge what we have so far
+        if (!ok || !eos || readErr) { ok = false; break; }
+        ++consumed;
+    }
+
+    if (writerStarted) {
+        gst_app_src_end_of_stream(GST_APP_SRC(src));
+        GstBus* bus = gst_element_get_bus(writer);
+        GstMessage* msg = gst_bus_timed_pop_filtered(
+            bus, 60 * GST_SECOND, (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+        if (!msg || GST_MESSAGE_TYPE(msg) != GST_MESSAGE_EOS) ok = false;
+        if (msg) gst_message_unref(msg);
+        gst_object_unref(bus);
+    }
+    gst_object_unref(src);
+    gst_element_set_state(writer, GST_STATE_NULL);
+    gst_object_unref(writer);
+    if (runCaps) gst_caps_unref(runCaps);
+
+    if (!ok || consumed < 2 || QFileInfo(dst).size() <= 0) {
+        QFile::remove(dst);
+        return -1;
+    }
+    return consumed;
+}
+
+ArchiveCompactor::Report ArchiveCompactor::run(DbWriter* db, const std::atomic<bool>& abort) {
+    Report rep;
+    QElapsedTimer t; t.start();
+
+    // Pieces of earlier runs, once an open playlist has had time to move on.
+    const qint64 delayMs = envInt("CAMVIGIL_COMPACT_UNLINK_DELAY_SEC", 1800, 0, 86400) * 1000LL;
+    QStringList retired;
+    QMetaObject::invokeMethod(db, [&]{
+        retired = db->takeRetiredFiles((QDateTime::currentMSecsSinceEpoch() - delayMs) * 1000000LL);
+    }, Qt::BlockingQueuedConnection);
+    for (const QString& path : qAsConst(retired)) QFile::remove(path);
+
+    const int smallSec = smallSegmentSec();
+    if (smallSec <= 0) return rep;
+
+    const qint64 maxGapNs = envInt("CAMVIGIL_COMPACT_MAX_GAP_MS", 2000, 0, 60000) * 1000000LL;
+    const qint64 maxRunNs = envInt("CAMVIGIL_COMPACT_TARGET_SEC", 300, 60, 3600) * 1000000000LL;
+    const qint64 rate     = envInt("CAMVIGIL_COMPACT_MBPS", 8, 1, 1000) * 1024LL * 1024LL;
+    // Leave the last few minutes alone: playback and the live tail still use them.
+    const qint64 beforeNs = QDateTime::currentDateTimeUtc().addSecs(-600).toMSecsSinceEpoch() * 1000000LL;
+
+    QVector<CompactPiece> pieces;
+    QMetaObject::invokeMethod(db, [&]{ pieces = db->compactionCandidates(smallSec * 1000LL, beforeNs, 500); },
+                              Qt::BlockingQueuedConnection);
+    const auto runs = planRuns(pieces, maxGapNs, maxRunNs);
+
+    for (const auto& run : runs) {
+        if (abort.load()) break;
+        QFileInfo first(run.first().path);
+        const QString dst = first.absolutePath() + "/" + first.completeBaseName() + "_c.mkv";
+        const int n = concat(run, dst, rate, abort);
+        if (n < 2) { ++rep.failed; continue; }
+        // The merged file must be on disk before the pieces' rows go.
+        if (!IoPolicy::syncFile(dst)) {
+            qWarning() << "[Compact] could not sync" << dst;
+            QFile::remove(dst);
+            ++rep.failed;
+            continue;
+        }
+
+        QVector<qint64> ids;
+        for (int i = 0; i < n; ++i) ids.push_back(run[i].id);
+        const qint64 size = QFileInfo(dst).size();
+        qint64 newId = 0;
+        QMetaObject::invokeMethod(db, [&]{
+            newId = db->replaceWithCompacted(ids, dst, run.first().startUtcNs, run[n - 1].endUtcNs, size);
+        }, Qt::BlockingQueuedConnection);
+        if (newId <= 0) { QFile::remove(dst); ++rep.failed; continue; }
+
+        IoPolicy::dropWritten(dst);
+        ++rep.runs;
+        rep.rowsRemoved += n;
+        rep.bytes += size;
+    }
+    rep.elapsedMs = t.elapsed();
+    return rep;
+}
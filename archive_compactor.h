@@ -0,0 +1,55 @@
+#pragma once
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include "db_writer.h"   // CompactPiece
+
+/**
+ * ArchiveCompactor
+ * ----------------
+ * Merges runs of short segments (reconnect churn, split-now) into one file.
+ * - A run is consecutive segments of one camera and codec, each shorter than
+ *   CAMVIGIL_COMPACT_SMALL_SEC, with at most CAMVIGIL_COMPACT_MAX_GAP_MS
+ *   between them, up to CAMVIGIL_COMPACT_TARGET_SEC in total.
+ * - Lossless: demux → appsrc → matroskamux; every piece keeps its wall-clock
+ *   offset from the run start, so the merged file seeks like the originals.
+ * - The merged file is fsynced, then DbWriter::replaceWithCompacted() swaps
+ *   the rows in one transaction. Pieces pinned meanwhile abort the run.
+ * - The pieces' files are retired, not unlinked: a playback playlist built
+ *   earlier may still open them. A later pass removes them after
+ *   CAMVIGIL_COMPACT_UNLINK_DELAY_SEC.
+ * - Candidates are paged per camera, so one camera's churn cannot starve
+ *   the others.
+ * - Reads are throttled to CAMVIGIL_COMPACT_MBPS (default 8 MB/s) so live
+ *   recording keeps the disk.
+ * Blocking; run it via QtConcurrent, never concurrently with ArchivePurger.
+ *
+ * Env: CAMVIGIL_COMPACT_SMALL_SEC (default 60, 0 = off),
+ *      CAMVIGIL_COMPACT_MAX_GAP_MS (default 2000),
+ *      CAMVIGIL_COMPACT_TARGET_SEC (default 300),
+ *      CAMVIGIL_COMPACT_UNLINK_DELAY_SEC (default 1800).
+ */
+class ArchiveCompactor final {
+public:
+    struct Report {
+        int    runs        = 0;
+        int    rowsRemoved = 0;
+        int    failed      = 0;
+        qint64 bytes       = 0;
+        qint64 elapsedMs   = 0;
+    };
+
+    static int smallSegmentSec();
+
+    static Report run(DbWriter* db, const std::atomic<bool>& abort);
+
+    // Groups time-ordered pieces (per camera) into mergeable runs of ≥ 2.
+    static QVector<QVector<CompactPiece>> planRuns(const QVector<CompactPiece>& pieces,
+                                                   qint64 maxGapNs, qint64 maxRunNs);
+
+private:
+    // Writes the run into dst. Returns how many leading pieces made it in
+    // (a caps change stops the run early), or -1 on failure.
+    static int concat(const QVector<CompactPiece>& run, const QString& dst,
+                      qint64 bytesPerSec, const std::atomic<bool>& abort);
+};
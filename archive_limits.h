@@ -0,0 +1,15 @@
+#pragma once
+#include <QtGlobal>
+
+// Time constants shared by the archive database's writer and readers.
+namespace ArchiveLimits {
+
+// Longest span a segment row may have (recorder, compactor or a stale open
+// row). Range queries look back this far from their start, so they stay a
+// single range over the (camera_id, start_utc_ns, eff_end_ns) index.
+constexpr qint64 kMaxSpanNs = 24LL * 3600 * 1000000000LL;
+
+// events.bucket = t_ns / kEventBucketNs; event indexes lead with it.
+constexpr qint64 kEventBucketNs = 3600LL * 1000000000LL;
+
+} // namespace ArchiveLimits
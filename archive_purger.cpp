@@ -0,0 +1,123 @@
+#include "archive_purger.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QDebug>
+
+#include "db_writer.h"
+
+static int unlinkThreads() {
+    bool ok = false;
+    const int env = qEnvironmentVariable("CAMVIGIL_PURGE_UNLINK_THREADS").toInt(&ok);
+    if (ok && env > 0) return qBound(1, env, 8);
+    return 2;
+}
+
+ArchivePurger::Report ArchivePurger::run(DbWriter* db, const RootNeeds& needs, int minDays,
+                                         bool applyQuotas, int batchFiles,
+                                         const std::atomic<bool>& abort) {
+    Report rep;
+    QElapsedTimer t; t.start();
+
+    PurgePlan plan;
+    if (!QMetaObject::invokeMethod(db, [&]{ plan = db->planPurge(needs, minDays, applyQuotas); },
+                                   Qt::BlockingQueuedConnection)) {
+        return rep;
+    }
+    rep.planned    = plan.victims.size();
+    rep.quotaBytes = plan.quotaBytes;
+    rep.spaceBytes = plan.spaceBytes;
+    rep.shortBytes = plan.shortBytes;
+    if (plan.victims.isEmpty()) { rep.elapsedMs = t.elapsed(); return rep; }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(unlinkThreads());
+    std::atomic<int> failed{0};
+
+    QHash<qint64, int> byId;
+    QVector<qint64> all;
+    all.reserve(plan.victims.size());
+    for (int i = 0; i < plan.victims.size(); ++i) {
+        all.push_back(plan.victims[i].id);
+        byId.insert(plan.victims[i].id, i);
+    }
+    auto unlinkRows = [&](const QVector<qint64>& gone) {
+        for (qint64 id : gone) {
+            const PurgeVictim& v = plan.victims[byId.value(id)];
+            rep.freedBytes += v.sizeBytes;
+            const QString path = v.path;
+            pool.start([path, &failed]{
+                QFile f(path);
+                if (f.exists() && !f.remove()) {
+                    qWarning() << "[Purge] unlink failed:" << path << f.errorString();
+                    failed.fetch_add(1);
+                }
+            });
+        }
+        rep.rowsDeleted += gone.size();
+    };
+
+    // Rows before a root's horizon go by time: whole months as one DROP
+    // TABLE, the rest as one range DELETE per table and root.
+    QVector<qint64> dropped;
+    QMetaObject::invokeMethod(db, [&]{ dropped = db->purgeBefore(plan.horizons, plan.victims); },
+                              Qt::BlockingQueuedConnection);
+    unlinkRows(dropped);
+    const QSet<qint64> droppedSet(dropped.cbegin(), dropped.cend());
+    QVector<qint64> left;
+    for (qint64 id : all) if (!droppedSet.contains(id)) left.push_back(id);
+
+    const int batch = qMax(1, batchFiles);
+    for (int off = 0; off < left.size() && !abort.load(); off += batch) {
+        // Rows go first so playback never lists a file that is being removed.
+        const QVector<qint64> ids = left.mid(off, batch);
+        QVector<qint64> gone;
+        QMetaObject::invokeMethod(db, [&]{ gone = db->deleteSegmentRows(ids); },
+                                  Qt::BlockingQueuedConnection);
+        unlinkRows(gone);
+    }
+
+    // Sub-stream (scrub) files follow their main-stream footage out.
+    while (!abort.load()) {
+        QStringList subs;
+        QMetaObject::invokeMethod(db, [&]{ subs = db->expireSubSegments(batch); },
+                                  Qt::BlockingQueuedConnection);
+        if (subs.isEmpty()) break;
+        for (const QString& path : subs) {
+            const qint64 size = QFileInfo(path).size();
+            rep.freedBytes += size;
+            pool.start([path, &failed]{
+                QFile f(path);
+                if (f.exists() && !f.remove()) {
+                    qWarning() << "[Purge] unlink failed:" << path << f.errorString();
+                    failed.fetch_add(1);
+                }
+            });
+        }
+        rep.subFilesDeleted += subs.size();
+    }
+    pool.waitForDone();
+
+    rep.unlinkFailed = failed.load();
+    rep.elapsedMs = t.elapsed();
+    return rep;
+}
+
+// Logged events follow the footage they describe (DbWriter::expireEvents),
+// 5000 rows per transaction.
+int ArchivePurger::expireEvents(DbWriter* db, const std::atomic<bool>& abort) {
+    int deleted = 0;
+    while (!abort.load()) {
+        int n = 0;
+        if (!QMetaObject::invokeMethod(db, [&]{ n = db->expireEvents(5000); },
+                                       Qt::BlockingQueuedConnection))
+            break;
+        deleted += n;
+        if (n < 5000) break;
+    }
+    return deleted;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <QtGlobal>
+#include <atomic>
+#include "purge_planner.h"   // RootNeeds
+
+class DbWriter;
+
+/**
+ * ArchivePurger
+ * -------------
+ * Executes a retention purge off the GUI thread.
+ * - Asks DbWriter for a PurgePlan (one round-trip).
+ * - Planned rows older than their root's horizon are removed by time first:
+ *   month partitions every horizon passes are dropped whole, the rest
+ *   range-deleted.
+ * - Per batch of purgeBatchFiles rows: one DELETE transaction on the DB
+ *   thread, then the matching files are unlinked on a small pool.
+ * - Then sub-stream (scrub track) files older than their camera's oldest
+ *   remaining segment are removed too.
+ * - expireEvents() trims the events table separately, on the caller's
+ *   clock: the age cap applies even when no purge is needed.
+ * - Freed bytes are summed from segments.size_bytes; the filesystem is not
+ *   re-queried per file.
+ * Blocking; run it via QtConcurrent. The caller's DbWriter thread must stay
+ * alive until run() returns.
+ *
+ * Unlink pool size: CAMVIGIL_PURGE_UNLINK_THREADS (default 2).
+ */
+class ArchivePurger final {
+public:
+    struct Report {
+        int    planned      = 0;
+        int    rowsDeleted  = 0;
+        int    subFilesDeleted = 0;   // scrub-track files whose main footage is gone
+        int    unlinkFailed = 0;
+        qint64 freedBytes   = 0;
+        qint64 quotaBytes   = 0;
+        qint64 spaceBytes   = 0;
+        qint64 shortBytes   = 0;
+        qint64 elapsedMs    = 0;
+    };
+
+    static Report run(DbWriter* db, const RootNeeds& needs, int minDays, bool applyQuotas,
+                      int batchFiles, const std::atomic<bool>& abort);
+    // Events older than their camera's footage or the age cap; returns rows deleted.
+    static int expireEvents(DbWriter* db, const std::atomic<bool>& abort);
+};
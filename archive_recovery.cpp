@@ -0,0 +1,206 @@
+#include "archive_recovery.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+#include <QtGlobal>
+#include <gst/gst.h>
+
+static int recoveryThreads() {
+    bool ok = false;
+    const int env = qEnvironmentVariable("CAMVIGIL_RECOVERY_THREADS").toInt(&ok);
+    if (ok && env > 0) return qBound(1, env, 16);
+    return qBound(1, QThread::idealThreadCount() / 2, 4);
+}
+
+// Run a pipeline until EOS/ERROR (or timeout). Returns true on EOS.
+static bool runToEos(GstElement* pipeline, GstClockTime timeout) {
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(
+        bus, timeout, (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    bool eos = false;
+    if (msg) {
+        eos = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+        if (!eos) {
+            GError* err = nullptr; gchar* dbg = nullptr;
+            gst_message_parse_error(msg, &err, &dbg);
+            qWarning() << "[Recovery] pipeline error:" << (err ? err->message : "unknown");
+            g_clear_error(&err); g_free(dbg);
+        }
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    return eos;
+}
+
+qint64 ArchiveRecovery::probeDurationNs(const QString& path) {
+    gst_init(nullptr, nullptr);
+    GError* err = nullptr;
+    GstElement* pipeline = gst_parse_launch(
+        "filesrc name=src ! matroskademux ! fakesink sync=false", &err);
+    if (!pipeline) {
+        qWarning() << "[Recovery] probe pipeline:" << (err ? err->message : "unknown");
+        g_clear_error(&err);
+        return -1;
+    }
+    g_clear_error(&err);
+
+    GstElement* src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    g_object_set(src, "location", path.toUtf8().constData(), nullptr);
+    gst_object_unref(src);
+
+    qint64 durNs = -1;
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    if (gst_element_get_state(pipeline, nullptr, nullptr, 5 * GST_SECOND) == GST_STATE_CHANGE_SUCCESS) {
+        gint64 d = 0;
+        if (gst_element_query_duration(pipeline, GST_FORMAT_TIME, &d) && d > 0) durNs = d;
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return durNs;
+}
+
+namespace {
+struct PtsSpan {
+    std::atomic<qint64> first{-1};
+    std::atomic<qint64> last{-1};
+};
+}
+
+qint64 ArchiveRecovery::remuxTail(const QString& path) {
+    gst_init(nullptr, nullptr);
+    const QString tmpPath = path + ".recover";
+    QFile::remove(tmpPath);
+
+    GError* err = nullptr;
+    GstElement* pipeline = gst_parse_launch(
+        "filesrc name=src ! matroskademux ! identity name=tap ! matroskamux ! filesink name=sink", &err);
+    if (!pipeline) {
+        qWarning() << "[Recovery] remux pipeline:" << (err ? err->message : "unknown");
+        g_clear_error(&err);
+        return -1;
+    }
+    g_clear_error(&err);
+
+    GstElement* src  = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstElement* tap  = gst_bin_get_by_name(GST_BIN(pipeline), "tap");
+    g_object_set(src,  "location", path.toUtf8().constData(), nullptr);
+    g_object_set(sink, "location", tmpPath.toUtf8().constData(), nullptr);
+
+    // Track first/last PTS passing through to measure the real duration.
+    PtsSpan span;
+    GstPad* tapSrc = gst_element_get_static_pad(tap, "src");
+    gst_pad_add_probe(tapSrc, GST_PAD_PROBE_TYPE_BUFFER,
+        +[](GstPad*, GstPadProbeInfo* info, gpointer user) -> GstPadProbeReturn {
+            auto* s = static_cast<PtsSpan*>(user);
+            GstBuffer* buf = GST_PAD_PROBE_INFO_BUFFER(info);
+            if (buf && GST_BUFFER_PTS_IS_VALID(buf)) {
+                const qint64 pts = qint64(GST_BUFFER_PTS(buf));
+                const qint64 end = pts + (GST_BUFFER_DURATION_IS_VALID(buf) ? qint64(GST_BUFFER_DURATION(buf)) : 0);
+                if (s->first.load() < 0) s->first.store(pts);
+                if (end > s->last.load()) s->last.store(end);
+            }
+            return GST_PAD_PROBE_OK;
+        }, &span, nullptr);
+    gst_object_unref(tapSrc);
+    gst_object_unref(tap);
+    gst_object_unref(sink);
+    gst_object_unref(src);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    const bool eos = runToEos(pipeline, 120 * GST_SECOND);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    const qint64 first = span.first.load();
+    const qint64 last  = span.last.load();
+    const qint64 durNs = (first >= 0 && last > first) ? (last - first) : -1;
+
+    if (eos && durNs > 0 && QFileInfo(tmpPath).size() > 0) {
+        // Swap in the rewritten file; keep the original if the rename fails.
+        const QString bakPath = path + ".bak";
+        QFile::remove(bakPath);
+        if (QFile::rename(path, bakPath) && QFile::rename(tmpPath, path)) {
+            QFile::remove(bakPath);
+        } else {
+            qWarning() << "[Recovery] could not replace" << path << "with remuxed copy";
+            if (!QFileInfo::exists(path)) QFile::rename(bakPath, path);
+        }
+    }
+    QFile::remove(tmpPath);
+    return durNs;
+}
+
+void ArchiveRecovery::repairOne(SegmentRepair& r, bool& remuxed) {
+    remuxed = false;
+    QFileInfo fi(r.path);
+    if (!fi.exists() || fi.size() <= 0) {
+        r.drop = true;
+        return;
+    }
+
+    qint64 durNs = probeDurationNs(r.path);
+    if (durNs <= 0) {
+        durNs = remuxTail(r.path);
+        remuxed = durNs > 0;
+    }
+    if (durNs <= 0) {
+        // Unreadable container: last write time still bounds the recording.
+        const qint64 mtimeNs = fi.lastModified().toUTC().toMSecsSinceEpoch() * 1000000LL;
+        durNs = qMax<qint64>(0, mtimeNs - r.startUtcNs);
+    }
+    if (durNs <= 0) {
+        r.drop = true;
+        return;
+    }
+
+    fi.refresh();
+    r.durationMs = durNs / 1000000LL;
+    r.endUtcNs   = r.startUtcNs + durNs;
+    r.sizeBytes  = fi.size();
+}
+
+ArchiveRecovery::Report ArchiveRecovery::repair(QVector<SegmentRepair>& rows,
+                                                const std::atomic<bool>& abort) {
+    Report rep;
+    QElapsedTimer t; t.start();
+    rep.scanned = rows.size();
+
+    QVector<char> remuxed(rows.size(), 0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(recoveryThreads());
+    qInfo() << "[Recovery] probing" << rows.size() << "open segments on"
+            << pool.maxThreadCount() << "threads";
+
+    for (int i = 0; i < rows.size(); ++i) {
+        // Each task touches only its own slot; no locking needed.
+        pool.start([&rows, &remuxed, &abort, i]{
+            if (abort.load()) { rows[i].drop = false; rows[i].endUtcNs = 0; return; }
+            bool rm = false;
+            repairOne(rows[i], rm);
+            remuxed[i] = rm ? 1 : 0;
+        });
+    }
+    pool.waitForDone();
+
+    // Rows skipped on abort keep endUtcNs=0 and are left open for the next run.
+    QVector<SegmentRepair> done;
+    done.reserve(rows.size());
+    for (int i = 0; i < rows.size(); ++i) {
+        const auto& r = rows[i];
+        if (r.drop) { ++rep.dropped; done.push_back(r); continue; }
+        if (r.endUtcNs <= 0) continue;
+        ++rep.finalized;
+        if (remuxed[i]) ++rep.remuxed;
+        done.push_back(r);
+    }
+    rows = done;
+    rep.elapsedMs = t.elapsed();
+    return rep;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include <atomic>
+#include "db_writer.h"   // SegmentRepair
+
+/**
+ * ArchiveRecovery
+ * ---------------
+ * Startup pass for segments a crashed run left at status=0.
+ * - Probes each file's real duration on a bounded thread pool.
+ * - Files matroskamux never finalized (no duration/cues) are remuxed in place.
+ * - Missing or empty files are marked for row removal.
+ * Blocking; run it off the GUI thread and hand the result to
+ * DbWriter::applySegmentRepairs() for a single-transaction commit.
+ *
+ * Pool size: CAMVIGIL_RECOVERY_THREADS (default min(4, cores/2)).
+ */
+class ArchiveRecovery final {
+public:
+    struct Report {
+        int    scanned   = 0;
+        int    finalized = 0;
+        int    remuxed   = 0;
+        int    dropped   = 0;
+        qint64 elapsedMs = 0;
+    };
+
+    // Fills endUtcNs/durationMs/sizeBytes/drop on every entry.
+    static Report repair(QVector<SegmentRepair>& rows, const std::atomic<bool>& abort);
+
+    // Duration from the container index; -1 if the file has none (unfinalized).
+    static qint64 probeDurationNs(const QString& path);
+
+    // Demux → mux copy that rewrites a finalized tail. Returns the scanned
+    // duration (last PTS end − first PTS) or -1 on failure; the original is
+    // replaced only when the remux reached EOS.
+    static qint64 remuxTail(const QString& path);
+
+private:
+    static void repairOne(SegmentRepair& r, bool& remuxed);
+};
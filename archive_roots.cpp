@@ -0,0 +1,134 @@
+#include "archive_roots.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QDebug>
+#include <algorithm>
+#include <numeric>
+
+#include "archivemanager.h"   // defaultStorageRoot()
+
+static const char* kArchiveSubdir = "CamVigilArchives";
+
+QStringList ArchiveRoots::configured() {
+    QStringList bases;
+    const QString env = qEnvironmentVariable("CAMVIGIL_ARCHIVE_ROOTS");
+    for (const QString& r : env.split(':', Qt::SkipEmptyParts)) {
+        const QString clean = QDir::cleanPath(r.trimmed());
+        if (!clean.isEmpty() && !bases.contains(clean)) bases << clean;
+    }
+    if (bases.isEmpty()) bases << ArchiveManager::defaultStorageRoot();  // CAMVIGIL_ARCHIVE_ROOT / home
+
+    QStringList dirs;
+    for (const QString& b : bases) {
+        const QString d = b + "/" + kArchiveSubdir;
+        QDir().mkpath(d);
+        dirs << d;
+    }
+    return dirs;
+}
+
+QVector<ArchiveRoots::Root> ArchiveRoots::probe() {
+    QVector<Root> out;
+    for (const QString& d : configured()) {
+        Root r;
+        r.dir = d;
+        QStorageInfo si(d);
+        if (si.isValid()) {
+            r.totalBytes = si.bytesTotal();
+            r.availBytes = si.bytesAvailable();
+        }
+        out.push_back(r);
+    }
+    return out;
+}
+
+int ArchiveRoots::rootOf(const QVector<Root>& roots, const QString& path) {
+    for (int i = 0; i < roots.size(); ++i)
+        if (path.startsWith(roots[i].dir + "/")) return i;
+    return -1;
+}
+
+QString ArchiveRoots::resolve(const QString& path) {
+    static const QStringList dirs = configured();
+    for (const QString& d : dirs)
+        if (path.startsWith(d + "/")) return path;
+
+    const QString marker = QString("/%1/").arg(kArchiveSubdir);
+    const int at = path.lastIndexOf(marker);
+    if (at < 0) return path;
+    const QString rel = path.mid(at + marker.size());
+    for (const QString& d : dirs) {
+        const QString cand = d + "/" + rel;
+        if (QFileInfo::exists(cand)) return cand;
+    }
+    return path;
+}
+
+QVector<int> ArchiveRoots::place(const QVector<qint64>& cameraBps,
+                                 const QVector<int>& lastRoot,
+                                 QVector<Root>& roots) {
+    QVector<int> out(cameraBps.size(), 0);
+    if (roots.size() <= 1) {
+        if (!roots.isEmpty()) {
+            roots[0].cameras = cameraBps.size();
+            roots[0].assignedBps = std::accumulate(cameraBps.cbegin(), cameraBps.cend(), qint64(0));
+        }
+        return out;
+    }
+
+    auto healthy = [](const Root& r) { return r.availBytes > r.minFreeBytes; };
+    const bool anyHealthy = std::any_of(roots.cbegin(), roots.cend(), healthy);
+
+    // Fair share of the total bitrate, proportional to free space.
+    qint64 freeSum = 0;
+    for (const Root& r : roots) freeSum += qMax<qint64>(0, r.availBytes);
+    const qint64 bpsSum = std::accumulate(cameraBps.cbegin(), cameraBps.cend(), qint64(0));
+    auto fairShare = [&](const Root& r) -> double {
+        if (freeSum <= 0) return double(bpsSum) / roots.size();
+        return double(bpsSum) * double(qMax<qint64>(0, r.availBytes)) / double(freeSum);
+    };
+
+    QVector<int> order(cameraBps.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return cameraBps[a] > cameraBps[b]; });
+
+    QVector<bool> placed(cameraBps.size(), false);
+
+    // 1) Sticky: keep a camera where its recordings already are.
+    for (int cam : order) {
+        const int r = lastRoot.value(cam, -1);
+        if (r < 0 || r >= roots.size()) continue;
+        Root& root = roots[r];
+        if (anyHealthy && !healthy(root)) continue;
+        if (root.assignedBps + cameraBps[cam] > fairShare(root) * 1.25) continue;
+        root.assignedBps += cameraBps[cam];
+        ++root.cameras;
+        out[cam] = r;
+        placed[cam] = true;
+    }
+
+    // 2) Greedy: heaviest remaining camera onto the least loaded root per free byte.
+    for (int cam : order) {
+        if (placed[cam]) continue;
+        int best = -1;
+        double bestScore = 0.0;
+        for (int r = 0; r < roots.size(); ++r) {
+            if (anyHealthy && !healthy(roots[r])) continue;
+            const double score = double(roots[r].assignedBps + cameraBps[cam])
+                               / double(qMax<qint64>(1, roots[r].availBytes));
+            if (best < 0 || score < bestScore) { best = r; bestScore = score; }
+        }
+        if (best < 0) best = 0;
+        roots[best].assignedBps += cameraBps[cam];
+        ++roots[best].cameras;
+        out[cam] = best;
+    }
+
+    for (const Root& r : roots)
+        qInfo() << "[ArchiveRoots]" << r.dir << "cameras=" << r.cameras
+                << "load_Bps=" << r.assignedBps << "avail=" << r.availBytes;
+    return out;
+}
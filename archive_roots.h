@@ -0,0 +1,46 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * ArchiveRoots
+ * ------------
+ * Archive spanning across several disks without RAID.
+ * - CAMVIGIL_ARCHIVE_ROOTS lists storage roots separated by ':'; each gets a
+ *   CamVigilArchives/ directory. Unset = ArchiveManager::defaultStorageRoot().
+ * - The first root is primary and holds camvigil.sqlite.
+ * - segments.file_path stays absolute; resolve() rebases a path whose root
+ *   is no longer mounted where it was (disk remounted / reordered).
+ */
+class ArchiveRoots final {
+public:
+    struct Root {
+        QString dir;                  // <storage root>/CamVigilArchives
+        qint64  totalBytes      = 0;
+        qint64  availBytes      = 0;
+        qint64  minFreeBytes    = 0;  // per-root watermarks
+        qint64  targetFreeBytes = 0;
+        qint64  assignedBps     = 0;  // placement load (bytes/s)
+        int     cameras         = 0;
+    };
+
+    // Archive directories (…/CamVigilArchives), primary first; created if missing.
+    static QStringList configured();
+    static QVector<Root> probe();     // configured() + QStorageInfo numbers
+
+    // Index of the root containing `path`, or -1.
+    static int rootOf(const QVector<Root>& roots, const QString& path);
+
+    // Same file under the first configured root that has it; `path` itself
+    // when it already lives under a configured root or nothing matches.
+    static QString resolve(const QString& path);
+
+    // Load-balanced camera → root assignment. Cameras keep the root of their
+    // last segment (lastRoot, -1 = none) while it stays within its fair share
+    // and above its minFree watermark; the rest go heaviest-first to the root
+    // with the lowest (assigned + bps) / free bytes.
+    static QVector<int> place(const QVector<qint64>& cameraBps,
+                              const QVector<int>& lastRoot,
+                              QVector<Root>& roots);
+};
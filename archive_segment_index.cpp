@@ -0,0 +1,199 @@
+#include "archive_segment_index.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QDebug>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include "archive_limits.h"
+
+static const qint64 kDayNs = 24LL * 3600 * 1000000000LL;
+
+static int envInt(const char* name, int def, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return ok ? qBound(lo, v, hi) : def;
+}
+
+namespace {
+
+using Day    = QVector<IndexedSegment>;              // sorted by startNs
+using DayPtr = std::shared_ptr<const Day>;
+struct Camera {
+    QMap<qint64, DayPtr> days;                        // by startNs / kDayNs
+};
+using CameraPtr = std::shared_ptr<const Camera>;
+
+// Immutable once published; writers build the next one.
+struct Snapshot {
+    QString dbFile;
+    QHash<int, CameraPtr> cameras;
+    qint64 coveredFromNs = 0;                         // every row starting here or later is held
+};
+using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+SnapshotPtr gSnapshot;                                // null until load()
+std::mutex  gWriteMutex;                              // writers only
+
+SnapshotPtr current() { return std::atomic_load(&gSnapshot); }
+void publish(SnapshotPtr s) { std::atomic_store(&gSnapshot, std::move(s)); }
+
+QString internCodec(const QString& c) {
+    static const QString h264 = QStringLiteral("h264"), h265 = QStringLiteral("h265");
+    return c == h264 ? h264 : c == h265 ? h265 : c;
+}
+
+qint64 horizonNs() {
+    const qint64 nowNs = QDateTime::currentMSecsSinceEpoch() * 1000000LL;
+    return nowNs - envInt("CAMVIGIL_SEGMENT_INDEX_DAYS", 31, 1, 3660) * kDayNs;
+}
+
+// Drops whole days that fell behind the horizon.
+void trim(Snapshot& s) {
+    const qint64 cutKey = horizonNs() / kDayNs;
+    if (s.coveredFromNs >= cutKey * kDayNs) return;
+    for (auto it = s.cameras.begin(); it != s.cameras.end(); ++it) {
+        if ((*it)->days.isEmpty() || (*it)->days.firstKey() >= cutKey) continue;
+        auto cam = std::make_shared<Camera>(**it);
+        while (!cam->days.isEmpty() && cam->days.firstKey() < cutKey) cam->days.erase(cam->days.begin());
+        *it = cam;
+    }
+    s.coveredFromNs = cutKey * kDayNs;
+}
+
+// Copy-on-write of the one day holding startNs.
+template <typename Fn>
+void editDay(int cameraId, qint64 startNs, Fn&& fn) {
+    std::lock_guard<std::mutex> lock(gWriteMutex);
+    const SnapshotPtr snap = current();
+    if (!snap || cameraId <= 0 || startNs < snap->coveredFromNs) return;
+
+    const qint64 key = startNs / kDayNs;
+    const CameraPtr oldCam = snap->cameras.value(cameraId);
+    auto cam = oldCam ? std::make_shared<Camera>(*oldCam) : std::make_shared<Camera>();
+    const DayPtr oldDay = cam->days.value(key);
+    const bool newDay = !oldDay;
+    Day day = oldDay ? *oldDay : Day();
+    fn(day);
+    if (day.isEmpty()) cam->days.remove(key);
+    else cam->days.insert(key, std::make_shared<const Day>(std::move(day)));
+
+    auto next = std::make_shared<Snapshot>(*snap);
+    next->cameras.insert(cameraId, cam);
+    if (newDay) trim(*next);
+    publish(std::move(next));
+}
+
+} // namespace
+
+bool ArchiveSegmentIndex::enabled() {
+    static const bool on = qEnvironmentVariable("CAMVIGIL_SEGMENT_INDEX", QStringLiteral("1")) != QLatin1String("0");
+    return on;
+}
+
+void ArchiveSegmentIndex::load(const QSqlDatabase& db) {
+    if (!enabled()) return;
+    QElapsedTimer t; t.start();
+    const qint64 fromNs = horizonNs();
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, camera_id, start_utc_ns, eff_end_ns, COALESCE(duration_ms,0),"
+              "       COALESCE(size_bytes,0), file_path, COALESCE(codec,'h264'), status, COALESCE(tier,0)"
+              " FROM segments_all"
+              " WHERE camera_id > 0 AND start_utc_ns >= ? AND status IN (0,1)"
+              " ORDER BY camera_id, start_utc_ns;");
+    q.addBindValue(fromNs);
+    if (!q.exec()) {
+        qWarning() << "[SegIndex] load:" << q.lastError().text();
+        return;
+    }
+
+    QHash<int, QMap<qint64, Day>> rows;
+    int n = 0;
+    while (q.next()) {
+        IndexedSegment s;
+        s.id         = q.value(0).toLongLong();
+        s.startNs    = q.value(2).toLongLong();
+        s.effEndNs   = q.value(3).toLongLong();
+        s.durationMs = q.value(4).toLongLong();
+        s.sizeBytes  = q.value(5).toLongLong();
+        s.path       = q.value(6).toString();
+        s.codec      = internCodec(q.value(7).toString());
+        s.open       = q.value(8).toInt() == 0;
+        s.tier       = q.value(9).toInt();
+        rows[q.value(1).toInt()][s.startNs / kDayNs].push_back(std::move(s));
+        ++n;
+    }
+
+    auto snap = std::make_shared<Snapshot>();
+    snap->dbFile = QFileInfo(db.databaseName()).absoluteFilePath();
+    snap->coveredFromNs = fromNs;
+    for (auto c = rows.begin(); c != rows.end(); ++c) {
+        auto cam = std::make_shared<Camera>();
+        for (auto d = c->begin(); d != c->end(); ++d)
+            cam->days.insert(d.key(), std::make_shared<const Day>(std::move(*d)));
+        snap->cameras.insert(c.key(), cam);
+    }
+    {
+        std::lock_guard<std::mutex> lock(gWriteMutex);
+        publish(std::move(snap));
+    }
+    qInfo() << "[SegIndex] loaded" << n << "segments of" << rows.size() << "cameras in"
+            << t.elapsed() << "ms";
+}
+
+void ArchiveSegmentIndex::upsert(int cameraId, const IndexedSegment& seg) {
+    if (!enabled()) return;
+    IndexedSegment s = seg;
+    s.codec = internCodec(s.codec);
+    editDay(cameraId, s.startNs, [&s](Day& day) {
+        auto same = std::find_if(day.begin(), day.end(),
+                                 [&s](const IndexedSegment& x) { return x.id == s.id; });
+        if (same != day.end()) day.erase(same);
+        auto at = std::upper_bound(day.begin(), day.end(), s.startNs,
+                                   [](qint64 v, const IndexedSegment& x) { return v < x.startNs; });
+        day.insert(at, s);
+    });
+}
+
+void ArchiveSegmentIndex::remove(int cameraId, qint64 startNs, qint64 id) {
+    if (!enabled()) return;
+    editDay(cameraId, startNs, [id](Day& day) {
+        day.erase(std::remove_if(day.begin(), day.end(),
+                                 [id](const IndexedSegment& x) { return x.id == id; }),
+                  day.end());
+    });
+}
+
+bool ArchiveSegmentIndex::query(const QString& dbFile, int cameraId, qint64 fromNs, qint64 toNs,
+                                QVector<IndexedSegment>& out) {
+    const SnapshotPtr snap = current();
+    // A row may start up to kMaxSpanNs before the range and still overlap it.
+    const qint64 lo = fromNs - ArchiveLimits::kMaxSpanNs;
+    if (!snap || lo < snap->coveredFromNs || toNs <= fromNs
+        || QFileInfo(dbFile).absoluteFilePath() != snap->dbFile)
+        return false;
+
+    out.clear();
+    const CameraPtr cam = snap->cameras.value(cameraId);
+    if (!cam) return true;
+    const qint64 lastKey = (toNs - 1) / kDayNs;
+    for (auto it = cam->days.lowerBound(lo / kDayNs); it != cam->days.cend() && it.key() <= lastKey; ++it) {
+        const Day& day = **it;
+        auto s = std::lower_bound(day.cbegin(), day.cend(), lo,
+                                  [](const IndexedSegment& x, qint64 v) { return x.startNs < v; });
+        for (; s != day.cend() && s->startNs < toNs; ++s)
+            if (s->overlaps(fromNs, toNs)) out.push_back(*s);
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+#include "archive_limits.h"
+
+// One main-stream segment row as the index holds it (raw DB path).
+struct IndexedSegment {
+    qint64  id = 0;
+    qint64  startNs = 0;
+    qint64  effEndNs = 0;     // segments.eff_end_ns: open rows hold their cap
+    qint64  durationMs = 0;
+    qint64  sizeBytes = 0;
+    QString path;
+    QString codec;
+    bool    open = false;     // status=0, still being written
+    int     tier = 0;
+
+    // Overlaps [fromNs, toNs) by the rule of the SQL range queries: starts at
+    // most kMaxSpanNs before the range and its eff_end_ns is past fromNs.
+    bool overlaps(qint64 fromNs, qint64 toNs) const {
+        return startNs >= fromNs - ArchiveLimits::kMaxSpanNs && startNs < toNs && effEndNs > fromNs;
+    }
+    // End a listing reports (the CASE in SegmentQueries): finalized rows their
+    // eff_end_ns; open rows grow to liveNs, capped by it, never before start.
+    qint64 shownEndNs(qint64 liveNs) const {
+        return open ? qMax(startNs, qMin(liveNs, effEndNs)) : effEndNs;
+    }
+};
+
+/**
+ * ArchiveSegmentIndex
+ * -------------------
+ * Process-wide, read-mostly copy of the recent main-stream segment rows, per
+ * camera, so day loads (DbReader::listSegments) and /api/v1/recordings
+ * answer from memory instead of SQLite.
+ * - Loaded by DbWriter when it opens the database, then updated by DbWriter
+ *   after each commit that opens, finalizes, purges, thins, compacts or
+ *   repairs segments, so it never shows rows the database does not have.
+ * - Per camera, rows are kept in per-day arrays sorted by start. Writers
+ *   copy the one day they change and publish a new snapshot; readers take
+ *   the current snapshot without locking.
+ * - Only the last CAMVIGIL_SEGMENT_INDEX_DAYS days are held. query() returns
+ *   false for older ranges (and before load), and the caller falls back to SQL.
+ *
+ * Env:
+ *   CAMVIGIL_SEGMENT_INDEX       1 = on (default), 0 = always use SQL
+ *   CAMVIGIL_SEGMENT_INDEX_DAYS  days kept in memory (default 31)
+ */
+class ArchiveSegmentIndex final {
+public:
+    static bool enabled();
+
+    // Writer side (DbWriter's thread). load() reads the last
+    // CAMVIGIL_SEGMENT_INDEX_DAYS of `db` and replaces the index.
+    static void load(const QSqlDatabase& db);
+    static void upsert(int cameraId, const IndexedSegment& seg);
+    static void remove(int cameraId, qint64 startNs, qint64 id);
+
+    // Rows of cameraId in database `dbFile` overlapping [fromNs, toNs) by
+    // eff_end_ns, in start order. false: not covered, ask SQLite.
+    static bool query(const QString& dbFile, int cameraId, qint64 fromNs, qint64 toNs,
+                      QVector<IndexedSegment>& out);
+};
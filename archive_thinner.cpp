@@ -0,0 +1,179 @@
+#include "archive_thinner.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QDebug>
+#include <QtGlobal>
+#include <cstdio>
+#include <gst/gst.h>
+
+#include "db_writer.h"
+#include "io_policy.h"
+
+static int envInt(const char* name, int fallback, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return (ok && v > 0) ? qBound(lo, v, hi) : fallback;
+}
+
+int ArchiveThinner::thinAfterDays() {
+    return envInt("CAMVIGIL_THIN_AFTER_DAYS", 0, 1, 3650);
+}
+
+namespace {
+struct KeyFilter {
+    int keepEvery = 1;
+    int keys = 0;
+    std::atomic<int> kept{0};
+};
+}
+
+qint64 ArchiveThinner::thinFile(const QString& src, const QString& dst, int keepEvery) {
+    gst_init(nullptr, nullptr);
+    QFile::remove(dst);
+
+    GError* err = nullptr;
+    GstElement* pipeline = gst_parse_launch(
+        "filesrc name=src ! matroskademux ! identity name=tap ! matroskamux ! filesink name=sink", &err);
+    if (!pipeline) {
+        qWarning() << "[Thin] pipeline:" << (err ? err->message : "unknown");
+        g_clear_error(&err);
+        return -1;
+    }
+    g_clear_error(&err);
+
+    GstElement* fsrc = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstElement* tap  = gst_bin_get_by_name(GST_BIN(pipeline), "tap");
+    g_object_set(fsrc, "location", src.toUtf8().constData(), nullptr);
+    g_object_set(sink, "location", dst.toUtf8().constData(), nullptr);
+
+    // Drop delta units (and all but every Nth keyframe) before the muxer.
+    KeyFilter filter;
+    filter.keepEvery = qMax(1, keepEvery);
+    GstPad* tapSink = gst_element_get_static_pad(tap, "sink");
+    gst_pad_add_probe(tapSink, GST_PAD_PROBE_TYPE_BUFFER,
+        +[](GstPad*, GstPadProbeInfo* info, gpointer user) -> GstPadProbeReturn {
+            auto* f = static_cast<KeyFilter*>(user);
+            GstBuffer* buf = GST_PAD_PROBE_INFO_BUFFER(info);
+            if (!buf || GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT))
+                return GST_PAD_PROBE_DROP;
+            if (f->keys++ % f->keepEvery != 0) return GST_PAD_PROBE_DROP;
+            f->kept.fetch_add(1);
+            return GST_PAD_PROBE_OK;
+        }, &filter, nullptr);
+    gst_object_unref(tapSink);
+    gst_object_unref(tap);
+    gst_object_unref(sink);
+    gst_object_unref(fsrc);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(
+        bus, 300 * GST_SECOND, (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    bool eos = false;
+    if (msg) {
+        eos = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+        if (!eos) {
+            GError* e = nullptr; gchar* dbg = nullptr;
+            gst_message_parse_error(msg, &e, &dbg);
+            qWarning() << "[Thin]" << src << (e ? e->message : "unknown");
+            g_clear_error(&e); g_free(dbg);
+        }
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    const qint64 size = QFileInfo(dst).size();
+    if (!eos || filter.kept.load() == 0 || size <= 0) {
+        QFile::remove(dst);
+        return -1;
+    }
+    return size;
+}
+
+ArchiveThinner::Report ArchiveThinner::run(DbWriter* db, int afterDays,
+                                           const std::atomic<bool>& abort) {
+    Report rep;
+    QElapsedTimer t; t.start();
+    if (afterDays <= 0) return rep;
+
+    const int keepEvery = envInt("CAMVIGIL_THIN_KEEP_EVERY", 1, 1, 100);
+    const qint64 budgetMs = envInt("CAMVIGIL_THIN_PASS_SEC", 120, 10, 3600) * 1000LL;
+    const qint64 cutoffNs =
+        QDateTime::currentDateTimeUtc().addDays(-afterDays).toMSecsSinceEpoch() * 1000000LL;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(envInt("CAMVIGIL_THIN_THREADS", 1, 1, 8));
+    const int batch = pool.maxThreadCount() * 4;
+
+    while (!abort.load() && t.elapsed() < budgetMs) {
+        QVector<ThinCandidate> todo;
+        QMetaObject::invokeMethod(db, [&]{ todo = db->thinCandidates(cutoffNs, batch); },
+                                  Qt::BlockingQueuedConnection);
+        if (todo.isEmpty()) break;
+
+        // Each task writes only its own slots: on-disk size and thinned size (or -1).
+        QVector<qint64> origSize(todo.size(), 0), thinSize(todo.size(), -1);
+        for (int i = 0; i < todo.size(); ++i) {
+            pool.start([&todo, &origSize, &thinSize, &abort, keepEvery, i]{
+                if (abort.load()) return;
+                origSize[i] = QFileInfo(todo[i].path).size();
+                if (origSize[i] > 0)
+                    thinSize[i] = thinFile(todo[i].path, todo[i].path + ".thin", keepEvery);
+            });
+        }
+        pool.waitForDone();
+        if (abort.load()) {
+            for (const auto& c : todo) QFile::remove(c.path + ".thin");
+            break;
+        }
+
+        // Rows first, then files: a row without tier=1 must never point at a
+        // thinned file. Keep the original when the copy does not save ≥10 %;
+        // the copy must be on disk before it replaces the original.
+        QVector<ThinCandidate> done, skipped;
+        QVector<bool> replace(todo.size(), false);
+        for (int i = 0; i < todo.size(); ++i) {
+            replace[i] = thinSize[i] > 0 && thinSize[i] < origSize[i] * 9 / 10 &&
+                         IoPolicy::syncFile(todo[i].path + ".thin");
+            ThinCandidate c = todo[i];
+            c.sizeBytes = replace[i] ? thinSize[i] : origSize[i];
+            (replace[i] ? done : skipped).push_back(c);
+        }
+        QVector<qint64> applied;
+        QMetaObject::invokeMethod(db, [&]{ applied = db->applyThinned(done); },
+                                  Qt::BlockingQueuedConnection);
+
+        for (int i = 0; i < todo.size(); ++i) {
+            const QString tmp = todo[i].path + ".thin";
+            if (replace[i] && applied.contains(todo[i].id)) {
+                // rename(2) replaces atomically; open readers keep the old inode.
+                if (std::rename(QFile::encodeName(tmp).constData(),
+                                QFile::encodeName(todo[i].path).constData()) == 0) {
+                    IoPolicy::dropWritten(todo[i].path);
+                    ++rep.thinned;
+                    rep.bytesBefore += origSize[i];
+                    rep.bytesAfter  += thinSize[i];
+                    continue;
+                }
+                qWarning() << "[Thin] could not replace" << todo[i].path;
+                ThinCandidate c = todo[i];
+                c.sizeBytes = origSize[i];   // the row claimed the thinned size
+                skipped.push_back(c);
+            } else if (!replace[i]) {
+                ++rep.kept;
+            }
+            QFile::remove(tmp);
+        }
+        QMetaObject::invokeMethod(db, [&]{ db->markThinSkipped(skipped); },
+                                  Qt::BlockingQueuedConnection);
+    }
+    rep.elapsedMs = t.elapsed();
+    return rep;
+}
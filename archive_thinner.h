@@ -0,0 +1,43 @@
+#pragma once
+#include <QString>
+#include <atomic>
+
+class DbWriter;
+
+/**
+ * ArchiveThinner
+ * --------------
+ * Long-term tier: rewrites old segments as keyframe-only copies.
+ * - Demux → mux copy that drops every non-keyframe access unit; nothing is
+ *   decoded, timestamps are kept, so the timeline and seeking are unchanged.
+ * - Oldest full-rate, finalized, unpinned segments first; per batch one
+ *   DbWriter::applyThinned() transaction, then each file is replaced by an
+ *   atomic rename.
+ * - Segments that fail, would not shrink or could not be replaced stay
+ *   full-rate and are flagged thin_skipped, so they are not retried.
+ * Blocking; run it via QtConcurrent, never concurrently with ArchivePurger.
+ *
+ * Env:
+ *   CAMVIGIL_THIN_AFTER_DAYS  age before thinning (default 0 = off)
+ *   CAMVIGIL_THIN_KEEP_EVERY  keep every Nth keyframe (default 1 = all)
+ *   CAMVIGIL_THIN_THREADS     parallel rewrites (default 1)
+ *   CAMVIGIL_THIN_PASS_SEC    time budget per pass (default 120)
+ */
+class ArchiveThinner final {
+public:
+    struct Report {
+        int    thinned     = 0;
+        int    kept        = 0;   // not smaller / unreadable; flagged thin_skipped
+        qint64 bytesBefore = 0;
+        qint64 bytesAfter  = 0;
+        qint64 elapsedMs   = 0;
+    };
+
+    static int thinAfterDays();
+
+    static Report run(DbWriter* db, int afterDays, const std::atomic<bool>& abort);
+
+    // Writes the keyframe-only copy of src to dst. Returns dst's size, or -1
+    // on failure (dst is removed).
+    static qint64 thinFile(const QString& src, const QString& dst, int keepEvery);
+};
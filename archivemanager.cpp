@@ -9,12 +9,22 @@
 #include <QUuid>
 #include <QThread>
 #include <QtGlobal>
-
+#include <QtConcurrent>
+#include <algorithm>
+
+#include "archive_compactor.h"
+#include "archive_purger.h"
+#include "archive_recovery.h"
+#include "archive_roots.h"
+#include "archive_thinner.h"
 #include "db_writer.h"
 #include "group_repository.h"
+#include "recording_schedule.h"
 
-// Resolve storage root. Env override supported.
+// Resolve storage root. Env override supported; with several roots the first is primary.
 QString ArchiveManager::defaultStorageRoot() {
+    const QStringList roots = qEnvironmentVariable("CAMVIGIL_ARCHIVE_ROOTS").split(':', Qt::SkipEmptyParts);
+    if (!roots.isEmpty()) return QDir::cleanPath(roots.first().trimmed());
     const QString env = qEnvironmentVariable("CAMVIGIL_ARCHIVE_ROOT");
     if (!env.isEmpty()) return env;
     return QDir::homePath() + "/CamVigil_StoragePartition";
@@ -24,8 +34,7 @@ ArchiveManager::ArchiveManager(QObject *parent)
     : QObject(parent),
       defaultDuration(300)  // 5 min
 {
-    archiveDir = defaultStorageRoot() + "/CamVigilArchives";
-    QDir().mkpath(archiveDir);
+    archiveDir = ArchiveRoots::configured().first();
 
     // Initial compute of dynamic watermarks
     refreshRetentionWatermarks();
@@ -36,6 +45,7 @@ ArchiveManager::ArchiveManager(QObject *parent)
         cleanupArchive();
     });
     cleanupTimer.start(5 * 60 * 1000);  // every 5 minutes
+    repairPool_.setMaxThreadCount(1);
 
     qDebug() << "[ArchiveManager] Initialized. archiveDir=" << archiveDir;
 }
@@ -43,6 +53,13 @@ ArchiveManager::ArchiveManager(QObject *parent)
 ArchiveManager::~ArchiveManager()
 {
     stopRecording();
+    recoveryAbort_.store(true);
+    recoveryFuture_.waitForFinished();
+    repairPool_.waitForDone();
+    purgeAbort_.store(true);
+    purgeFuture_.waitForFinished();
+    // Commit the recorders' last batched events before the DB thread goes.
+    if (db && dbThread) QMetaObject::invokeMethod(db, "flush", Qt::BlockingQueuedConnection);
     if (dbThread) { dbThread->quit(); dbThread->wait(); dbThread = nullptr; }
     qDebug() << "[ArchiveManager] Destroyed.";
 }
@@ -50,8 +67,7 @@ ArchiveManager::~ArchiveManager()
 void ArchiveManager::startRecording(const std::vector<CamHWProfile> &camProfiles)
 {
     cameraProfiles = camProfiles;
-    archiveDir = defaultStorageRoot() + "/CamVigilArchives";
-    QDir().mkpath(archiveDir);
+    archiveDir = ArchiveRoots::configured().first();   // primary root holds the DB
 
     const QString dbPath = archiveDir + "/camvigil.sqlite";
 
@@ -87,45 +103,56 @@ void ArchiveManager::startRecording(const std::vector<CamHWProfile> &camProfiles
             Q_ARG(QString, QString::fromStdString(p.displayName)));
     }
 
+    // Journal the downtime of an unclean exit before any new segment closes it.
+    QMetaObject::invokeMethod(db, "openRecorderDownGaps", Qt::QueuedConnection);
+
     sessionId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    startCrashRecovery_();
     QMetaObject::invokeMethod(db, "beginSession", Qt::QueuedConnection,
         Q_ARG(QString, sessionId), Q_ARG(QString, archiveDir), Q_ARG(int, defaultDuration));
 
-    const QDateTime masterStart = QDateTime::currentDateTime();
-    qDebug() << "[ArchiveManager] Master start:" << masterStart.toString("yyyyMMdd_HHmmss");
-
-    for (size_t i = 0; i < camProfiles.size(); ++i) {
-        const auto &profile = camProfiles[i];
-        auto* worker = new ArchiveWorker(profile.url, static_cast<int>(i),
-                                         archiveDir, defaultDuration, masterStart);
-
-        connect(worker, &ArchiveWorker::recordingError, [](const std::string &err){
-            qDebug() << "[ArchiveManager] ArchiveWorker error:" << QString::fromStdString(err);
-        });
+    // Spread cameras over the archive roots by recent bitrate and free space.
+    QHash<QString, CameraWriteStat> stats;
+    QMetaObject::invokeMethod(db, [&]{ stats = db->cameraWriteStats(); },
+                              Qt::BlockingQueuedConnection);
+    refreshRetentionWatermarks();
+    for (auto& r : roots_) { r.assignedBps = 0; r.cameras = 0; }
 
-        connect(worker, &ArchiveWorker::segmentOpened, this,
-            [this, camProfiles](int camIdx, const QString& path, qint64 startNs){
-                const QString camUrl = QString::fromStdString(camProfiles[camIdx].url);
-                QMetaObject::invokeMethod(db, "addSegmentOpened", Qt::QueuedConnection,
-                    Q_ARG(QString, sessionId), Q_ARG(QString, camUrl),
-                    Q_ARG(QString, path), Q_ARG(qint64, startNs));
-            });
-
-        connect(worker, &ArchiveWorker::segmentClosed, this,
-            [this](int camIdx, const QString& path, qint64 endNs, qint64 durMs){
-                Q_UNUSED(camIdx);
-                QMetaObject::invokeMethod(db, "finalizeSegmentByPath", Qt::QueuedConnection,
-                    Q_ARG(QString, path), Q_ARG(qint64, endNs), Q_ARG(qint64, durMs));
-            });
-
-        // Trigger purge after each finalized segment
-        connect(worker, &ArchiveWorker::segmentFinalized, this, &ArchiveManager::segmentWritten);
-        connect(this, &ArchiveManager::segmentWritten, this, &ArchiveManager::cleanupArchive);
-
-        workers.push_back(worker);
-        worker->start();
-        qDebug() << "[ArchiveManager] Started ArchiveWorker for cam" << i;
+    QVector<qint64> camBps;
+    QVector<int>    lastRoot;
+    qint64 knownSum = 0; int known = 0;
+    for (const auto& p : camProfiles) {
+        const CameraWriteStat st = stats.value(QString::fromStdString(p.url));
+        camBps   << st.bytesPerSec;
+        lastRoot << ArchiveRoots::rootOf(roots_, st.lastPath);
+        if (st.bytesPerSec > 0) { knownSum += st.bytesPerSec; ++known; }
     }
+    // Cameras without history count as the average camera (512 KiB/s if none).
+    const qint64 fallbackBps = known > 0 ? knownSum / known : 512 * 1024;
+    for (auto& b : camBps) if (b <= 0) b = fallbackBps;
+    const QVector<int> placement = ArchiveRoots::place(camBps, lastRoot, roots_);
+
+    camDirs_.clear();
+    for (size_t i = 0; i < camProfiles.size(); ++i)
+        camDirs_ << (roots_.isEmpty() ? archiveDir : roots_[placement[int(i)]].dir);
+
+    recordSubAll_ = qEnvironmentVariableIntValue("CAMVIGIL_RECORD_SUBSTREAM") == 1;
+    workers.assign(camProfiles.size(), nullptr);
+    subWorkers_.assign(camProfiles.size(), nullptr);
+    schedState_.assign(camProfiles.size(), SchedState::None);
+
+    // Trigger purge after each finalized segment
+    connect(this, &ArchiveManager::segmentWritten, this, &ArchiveManager::cleanupArchive,
+            Qt::UniqueConnection);
+
+    // Schedules decide which cameras start now; the timer keeps them in step.
+    QHash<QString, CameraSchedule> schedules;
+    QMetaObject::invokeMethod(db, [&]{ schedules = db->recordingSchedules(); },
+                              Qt::BlockingQueuedConnection);
+    applySchedules_(schedules);
+    connect(&scheduleTimer_, &QTimer::timeout, this, &ArchiveManager::refreshSchedules_,
+            Qt::UniqueConnection);
+    armScheduleTimer_();
 
     qDebug() << "[ArchiveManager] Recording at" << archiveDir;
 
@@ -133,21 +160,321 @@ void ArchiveManager::startRecording(const std::vector<CamHWProfile> &camProfiles
     QTimer::singleShot(0, this, [this]{ refreshRetentionWatermarks(); cleanupArchive(); });
 }
 
+void ArchiveManager::startWorker_(int camIndex, bool eventMode, const QDateTime& start)
+{
+    const CamHWProfile& profile = cameraProfiles[size_t(camIndex)];
+    const QString camDir = camDirs_.value(camIndex, archiveDir);
+    const QString camUrl = QString::fromStdString(profile.url);
+    auto* worker = new ArchiveWorker(profile.url, camIndex, camDir, defaultDuration, start);
+    if (eventMode)
+        worker->setEventMode(profile.preEventSec, profile.postEventSec);
+
+    // Direct: emitted on the recorder thread; addEvent is queued to the DB thread.
+    connect(worker, &ArchiveWorker::recordingError, [this, camUrl](const std::string &err){
+        qDebug() << "[ArchiveManager] ArchiveWorker error:" << QString::fromStdString(err);
+        QMetaObject::invokeMethod(db, "addEvent", Qt::QueuedConnection,
+            Q_ARG(QString, camUrl), Q_ARG(qint64, QDateTime::currentMSecsSinceEpoch() * 1000000LL),
+            Q_ARG(QString, QStringLiteral("pipeline_error")), Q_ARG(QString, QStringLiteral("recorder")),
+            Q_ARG(QString, QString::fromStdString(err)));
+    });
+
+    // Recorder → DB events run on the DB thread (context = db), in the order
+    // the recorder emitted them, and ahead of the flush ~ArchiveManager
+    // queues after stopping the recorders.
+    DbWriter* writer = db;
+    const QString sid = sessionId;
+    connect(worker, &ArchiveWorker::segmentOpened, writer,
+        [writer, sid, camUrl](int, const QString& path, qint64 startNs, const QString& codec){
+            writer->addSegmentOpened(sid, camUrl, path, startNs, codec);
+        });
+
+    connect(worker, &ArchiveWorker::recordingInterrupted, writer,
+        [writer, camUrl](int, qint64 sinceNs, const QString& reason, const QString& detail){
+            writer->openGap(camUrl, sinceNs, reason, detail);
+            writer->addEvent(camUrl, sinceNs, QStringLiteral("recording_interrupted"), reason, detail);
+        });
+
+    connect(worker, &ArchiveWorker::segmentClosed, writer,
+        [writer](int, const QString& path, qint64 endNs, qint64 durMs){
+            writer->finalizeSegmentByPath(path, endNs, durMs);
+        });
+
+    connect(worker, &ArchiveWorker::segmentAbandoned, this,
+        [this](int, const QString& path, qint64 startNs){ repairAbandoned_(path, startNs); });
+
+    // Scheduled event-only hours: between events the camera is not recording.
+    connect(worker, &ArchiveWorker::eventWriterClosed, this,
+        [this, camUrl](int camIdx, qint64 endNs){
+            if (size_t(camIdx) >= schedState_.size() || schedState_[size_t(camIdx)] != SchedState::EventOnly)
+                return;
+            QMetaObject::invokeMethod(db, "openGap", Qt::QueuedConnection,
+                Q_ARG(QString, camUrl), Q_ARG(qint64, endNs),
+                Q_ARG(QString, QStringLiteral("schedule_event_only")), Q_ARG(QString, QString()));
+        });
+
+    connect(worker, &ArchiveWorker::segmentFinalized, this, &ArchiveManager::segmentWritten);
+
+    workers[size_t(camIndex)] = worker;
+    worker->start();
+    qDebug() << "[ArchiveManager] Started ArchiveWorker for cam" << camIndex << "at" << camDir
+             << (eventMode ? "(event mode)" : "");
+
+    if (!eventMode && (recordSubAll_ || profile.recordSub))
+        startSubWorker_(profile, camIndex, camDir, start);
+}
+
+// Schedule boundaries run on the GUI thread: signal the camera's recorders
+// and let them finalize on their own threads. Each is deleted when its
+// thread finishes; stopRecording() collects any still running.
+void ArchiveManager::stopCamera_(int camIndex)
+{
+    for (auto* list : { &workers, &subWorkers_ }) {
+        ArchiveWorker*& w = (*list)[size_t(camIndex)];
+        if (!w) continue;
+        ArchiveWorker* stopping = w;
+        w = nullptr;
+        stopping_.push_back(stopping);
+        // Context = the worker: the call is dropped if stopRecording() deletes it first.
+        connect(stopping, &QThread::finished, stopping, [this, stopping]{
+            stopping_.erase(std::remove(stopping_.begin(), stopping_.end(), stopping), stopping_.end());
+            stopping->deleteLater();
+        });
+        stopping->stop();
+    }
+}
+
+// Signal every recorder first, then collect them: the EOS finalizes run in
+// parallel, each bounded by ArchiveWorker::stopEosTimeoutMs().
+qint64 ArchiveManager::stopWorkers_(const std::vector<ArchiveWorker*>& list)
+{
+    QElapsedTimer t; t.start();
+    for (auto* w : list) w->stop();
+    for (auto* w : list) { w->wait(); delete w; }
+    return t.elapsed();
+}
+
+// Scrub track: the camera's suburl recorded next to the main stream. No gap
+// journaling; its files follow the main stream's retention.
+void ArchiveManager::startSubWorker_(const CamHWProfile& profile, int camIndex,
+                                     const QString& camDir, const QDateTime& masterStart)
+{
+    if (profile.suburl.empty() || profile.eventRecording()) return;
+    auto* worker = new ArchiveWorker(profile.suburl, camIndex, camDir, defaultDuration, masterStart);
+    worker->setSubStream(true);
+
+    const QString camUrl = QString::fromStdString(profile.url);
+    connect(worker, &ArchiveWorker::recordingError, [camIndex](const std::string& err){
+        qDebug() << "[ArchiveManager] sub-stream worker error for cam" << camIndex
+                 << QString::fromStdString(err);
+    });
+    DbWriter* writer = db;
+    connect(worker, &ArchiveWorker::segmentOpened, writer,
+        [writer, camUrl](int, const QString& path, qint64 startNs, const QString& codec){
+            writer->addSubSegmentOpened(camUrl, path, startNs, codec);
+        });
+    connect(worker, &ArchiveWorker::segmentClosed, writer,
+        [writer](int, const QString& path, qint64 endNs, qint64 durMs){
+            writer->finalizeSubSegmentByPath(path, endNs, durMs);
+        });
+    connect(worker, &ArchiveWorker::segmentAbandoned, this,
+        [this](int, const QString& path, qint64 startNs){ repairAbandoned_(path, startNs, true); });
+
+    subWorkers_[size_t(camIndex)] = worker;
+    worker->start();
+    qDebug() << "[ArchiveManager] Started sub-stream ArchiveWorker for cam" << camIndex;
+}
+
+// ---------- Crash recovery ----------
+
+// Snapshot status=0 rows from earlier sessions (before any worker opens a new
+// one), then probe/repair files on a pool and finalize them in one transaction.
+void ArchiveManager::startCrashRecovery_()
+{
+    if (recoveryStarted_ || !db) return;
+    recoveryStarted_ = true;
+
+    QVector<SegmentRepair> rows;
+    const QString exclude = sessionId;
+    QMetaObject::invokeMethod(db, [&]{ rows = db->openSegmentsForRecovery(exclude); },
+                              Qt::BlockingQueuedConnection);
+    if (rows.isEmpty()) {
+        qInfo() << "[Recovery] no open segments from previous runs";
+        return;
+    }
+
+    DbWriter* writer = db;
+    recoveryFuture_ = QtConcurrent::run([this, writer, rows]() mutable {
+        const ArchiveRecovery::Report rep = ArchiveRecovery::repair(rows, recoveryAbort_);
+        if (recoveryAbort_.load()) return;
+        QMetaObject::invokeMethod(writer, [writer, rows]{
+            const int n = writer->applySegmentRepairs(rows);
+            qInfo() << "[Recovery] committed" << n << "row updates";
+        }, Qt::QueuedConnection);
+
+        qInfo() << "[Recovery] scanned=" << rep.scanned
+                << "finalized=" << rep.finalized
+                << "remuxed=" << rep.remuxed
+                << "dropped=" << rep.dropped
+                << "elapsed_ms=" << rep.elapsedMs;
+        QMetaObject::invokeMethod(this, [this, rep]{
+            emit recoveryFinished(rep.finalized, rep.dropped, rep.elapsedMs);
+        }, Qt::QueuedConnection);
+    });
+}
+
+// A recorder whose pipeline failed left its file without cues or duration.
+// Repair it now, the same way startup recovery would, so it is playable and
+// finalized in this session. The row is looked up when the result is applied:
+// its insert is queued ahead of this on the DB thread.
+void ArchiveManager::repairAbandoned_(const QString& path, qint64 startNs, bool sub)
+{
+    if (!db || recoveryAbort_.load()) return;
+    DbWriter* writer = db;
+    QtConcurrent::run(&repairPool_, [this, writer, path, startNs, sub]{
+        QVector<SegmentRepair> rows(1);
+        rows[0].path = path;
+        rows[0].startUtcNs = startNs;
+        rows[0].sub = sub;
+        const ArchiveRecovery::Report rep = ArchiveRecovery::repair(rows, recoveryAbort_);
+        if (recoveryAbort_.load() || (!rows[0].drop && rows[0].endUtcNs <= 0)) return;   // next run's
+        QMetaObject::invokeMethod(writer, [writer, r = rows[0]]() mutable {
+            r.id = writer->openSegmentId(r.path, r.sub);
+            if (r.id > 0) writer->applySegmentRepairs({ r });
+        }, Qt::QueuedConnection);
+        qInfo() << "[Recovery] abandoned segment" << path
+                << (rows[0].drop ? "dropped" : rep.remuxed ? "remuxed" : "finalized");
+    });
+}
+
 // -----------------------------------------------
 
 void ArchiveManager::stopRecording()
 {
-    for (auto* worker : workers) { worker->stop(); worker->wait(); delete worker; }
+    // A clean stop is a gap too; the next session's first segment closes it.
+    if (db && !workers.empty()) {
+        const qint64 nowNs = QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() * 1000000LL;
+        for (const auto& p : cameraProfiles) {
+            QMetaObject::invokeMethod(db, "openGap", Qt::QueuedConnection,
+                Q_ARG(QString, QString::fromStdString(p.url)), Q_ARG(qint64, nowNs),
+                Q_ARG(QString, QStringLiteral("recorder_stopped")), Q_ARG(QString, QString()));
+        }
+    }
+    scheduleTimer_.stop();
+    std::vector<ArchiveWorker*> all;
+    for (auto* list : { &workers, &subWorkers_, &stopping_ })
+        for (auto* w : *list) if (w) all.push_back(w);
     workers.clear();
-    qDebug() << "[ArchiveManager] All ArchiveWorkers stopped.";
+    subWorkers_.clear();
+    stopping_.clear();
+    schedState_.clear();
+    if (all.empty()) return;
+
+    const qint64 ms = stopWorkers_(all);
+    qInfo() << "[ArchiveManager] All ArchiveWorkers stopped:" << all.size()
+            << "recorders in" << ms << "ms";
+    emit recordersStopped(int(all.size()), ms);
+}
+
+bool ArchiveManager::triggerEvent(const QString& cameraUrl, const QString& reason)
+{
+    for (size_t i = 0; i < workers.size() && i < cameraProfiles.size(); ++i) {
+        if (QString::fromStdString(cameraProfiles[i].url) != cameraUrl) continue;
+        if (db)
+            QMetaObject::invokeMethod(db, "addEvent", Qt::QueuedConnection,
+                Q_ARG(QString, cameraUrl), Q_ARG(qint64, QDateTime::currentMSecsSinceEpoch() * 1000000LL),
+                Q_ARG(QString, QStringLiteral("alarm")), Q_ARG(QString, reason), Q_ARG(QString, QString()));
+        if (!workers[i] || !workers[i]->eventMode()) return false;
+        workers[i]->triggerEvent(reason);
+        return true;
+    }
+    return false;
 }
 
 void ArchiveManager::updateSegmentDuration(int seconds)
 {
     qDebug() << "[ArchiveManager] Update segment duration to" << seconds << "s";
-    for (auto *worker : workers)
-        QMetaObject::invokeMethod(worker, "updateSegmentDuration", Qt::QueuedConnection,
-                                  Q_ARG(int, seconds));
+    defaultDuration = seconds;   // recorders started later by a schedule
+    for (auto* list : { &workers, &subWorkers_ }) {
+        for (auto *worker : *list) {
+            if (!worker) continue;
+            QMetaObject::invokeMethod(worker, "updateSegmentDuration", Qt::QueuedConnection,
+                                      Q_ARG(int, seconds));
+        }
+    }
+}
+
+// ---------- Recording schedules ----------
+
+void ArchiveManager::armScheduleTimer_()
+{
+    // Just past the next minute boundary, where schedule windows change.
+    const qint64 ms = QDateTime::currentMSecsSinceEpoch() % 60000;
+    scheduleTimer_.setSingleShot(true);
+    scheduleTimer_.start(int(60000 - ms + 500));
+}
+
+// Reload off the GUI thread so schedule edits apply without a restart.
+void ArchiveManager::refreshSchedules_()
+{
+    armScheduleTimer_();
+    if (!db || workers.empty()) return;
+    DbWriter* writer = db;
+    QMetaObject::invokeMethod(writer, [this, writer]{
+        const QHash<QString, CameraSchedule> schedules = writer->recordingSchedules();
+        QMetaObject::invokeMethod(this, [this, schedules]{ applySchedules_(schedules); },
+                                  Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+// Bring each camera to its scheduled state. Outside its windows a camera is
+// stopped (gap "schedule_off") or kept in event-only mode (gap
+// "schedule_event_only" between events); the gap ends with the next segment.
+void ArchiveManager::applySchedules_(const QHash<QString, CameraSchedule>& schedules)
+{
+    if (schedState_.size() != cameraProfiles.size()) return;   // stopped meanwhile
+    const QDateTime now = QDateTime::currentDateTime();
+    const qint64 nowNs = now.toUTC().toMSecsSinceEpoch() * 1000000LL;
+
+    for (size_t i = 0; i < cameraProfiles.size(); ++i) {
+        const CamHWProfile& p = cameraProfiles[i];
+        const QString url = QString::fromStdString(p.url);
+        const CameraSchedule cs = schedules.value(url);
+        const RecordingSchedule sched = RecordingSchedule::parse(cs.spec);
+
+        SchedState want = SchedState::Record;
+        if (!sched.activeAt(now))
+            want = cs.offMode == QLatin1String("event") ? SchedState::EventOnly : SchedState::Off;
+        if (want == SchedState::EventOnly && p.eventRecording())
+            want = SchedState::Record;                  // records on events anyway
+        if (want == schedState_[i]) continue;
+
+        const SchedState was = schedState_[i];
+        stopCamera_(int(i));
+        schedState_[i] = want;
+        switch (want) {
+        case SchedState::Record:
+            startWorker_(int(i), p.eventRecording(), now);
+            break;
+        case SchedState::EventOnly:
+            startWorker_(int(i), true, now);
+            QMetaObject::invokeMethod(db, "reopenGap", Qt::QueuedConnection,
+                Q_ARG(QString, url), Q_ARG(qint64, nowNs),
+                Q_ARG(QString, QStringLiteral("schedule_event_only")), Q_ARG(QString, cs.spec));
+            break;
+        case SchedState::Off:
+        case SchedState::None:
+            QMetaObject::invokeMethod(db, "reopenGap", Qt::QueuedConnection,
+                Q_ARG(QString, url), Q_ARG(qint64, nowNs),
+                Q_ARG(QString, QStringLiteral("schedule_off")), Q_ARG(QString, cs.spec));
+            break;
+        }
+        if (was != SchedState::None || want != SchedState::Record) {
+            const QDateTime next = sched.nextChange(now);
+            static const char* names[] = { "none", "record", "event_only", "off" };
+            qInfo() << "[Schedule] cam" << i << names[int(was)] << "->" << names[int(want)]
+                    << "next change" << (next.isValid() ? next.toString(Qt::ISODate) : QStringLiteral("never"));
+        }
+    }
 }
 
 // ---------- Dynamic watermarks ----------
@@ -166,89 +493,65 @@ static double envPct(const char* name, double fallbackPct)
 
 void ArchiveManager::refreshRetentionWatermarks()
 {
-    QStorageInfo si(archiveDir);
-    if (!si.isValid() || si.bytesTotal() <= 0) return;
-
-    const qint64 total = si.bytesTotal();
-
     // Defaults: start at 10% free, recover to 12% free. Overridable via env.
     const double minPct    = envPct("CAMVIGIL_MIN_FREE_PCT",    70.0);
     const double targetPct = envPct("CAMVIGIL_TARGET_FREE_PCT", 72.0);
 
-    rcfg_.minFreeBytes    = static_cast<qint64>(total * minPct);
-    rcfg_.targetFreeBytes = static_cast<qint64>(total * targetPct);
-    rcfg_.highWaterPct    = 90; // 90% used is an alternate trigger
+    // Each root gets its own watermarks; placement load survives a refresh.
+    QVector<ArchiveRoots::Root> fresh = ArchiveRoots::probe();
+    for (auto& r : fresh) {
+        for (const auto& old : roots_) {
+            if (old.dir == r.dir) { r.assignedBps = old.assignedBps; r.cameras = old.cameras; }
+        }
+        r.minFreeBytes    = static_cast<qint64>(r.totalBytes * minPct);
+        r.targetFreeBytes = static_cast<qint64>(r.totalBytes * targetPct);
+    }
+    roots_ = fresh;
+    if (roots_.isEmpty() || roots_[0].totalBytes <= 0) return;
 
-    qInfo() << "[Purge] watermarks set:"
-            << "total=" << total
-            << "minFreeBytes=" << rcfg_.minFreeBytes
-            << "targetFreeBytes=" << rcfg_.targetFreeBytes
-            << "highWater%=" << rcfg_.highWaterPct;
+    // rcfg_ mirrors the primary root for existing callers.
+    rcfg_.minFreeBytes    = roots_[0].minFreeBytes;
+    rcfg_.targetFreeBytes = roots_[0].targetFreeBytes;
+    rcfg_.highWaterPct    = 90; // 90% used is an alternate trigger
+    rcfg_.perCameraMinDays = qMax(0, qEnvironmentVariableIntValue("CAMVIGIL_MIN_RETENTION_DAYS"));
+
+    for (const auto& r : roots_) {
+        qInfo() << "[Purge] watermarks set:" << r.dir
+                << "total=" << r.totalBytes
+                << "minFreeBytes=" << r.minFreeBytes
+                << "targetFreeBytes=" << r.targetFreeBytes
+                << "highWater%=" << rcfg_.highWaterPct
+                << "minDays=" << rcfg_.perCameraMinDays;
+    }
 }
 
 // ---------- Ring-buffer helpers ----------
 
-bool ArchiveManager::shouldPurge_(qint64& needBytes, qint64& availBytes) {
-    QStorageInfo si(archiveDir);
-    if (!si.isValid()) return false;
-    const qint64 total = si.bytesTotal();
-    availBytes = si.bytesAvailable();
-    if (total <= 0) return false;
-    const int usedPct = int((total - availBytes) * 100 / total);
-
-    const bool trigger = (availBytes < rcfg_.minFreeBytes) || (usedPct >= rcfg_.highWaterPct);
-    qInfo() << "[Purge] check avail=" << availBytes
-            << "total=" << total
-            << "used%=" << usedPct
-            << "minFree=" << rcfg_.minFreeBytes
-            << "targetFree=" << rcfg_.targetFreeBytes
-            << "trigger=" << trigger;
-
-    if (trigger) {
-        needBytes = qMax<qint64>(rcfg_.targetFreeBytes - availBytes, 0);
-        return needBytes > 0;
-    }
-    return false;
-}
-
-bool ArchiveManager::purgeOnce_(qint64& freedBytes) {
-    freedBytes = 0;
-    QVector<QPair<qint64, QString>> victims;
-    const bool okFetch = QMetaObject::invokeMethod(
-        db, [&]{ victims = db->oldestFinalizedUnpinned(rcfg_.purgeBatchFiles, 0, rcfg_.perCameraMinDays); },
-        Qt::BlockingQueuedConnection);
-    if (!okFetch || victims.isEmpty()) return false;
-
-    qInfo() << "[Purge] batch candidates=" << victims.size()
-            << "batch_limit=" << rcfg_.purgeBatchFiles;
-
-    for (const auto& v : victims) {
-        const qint64 id = v.first;
-        const QString path = v.second;
-
-        QFile f(path);
-        const qint64 sz = f.exists() ? f.size() : 0;
-
-        bool ok = !f.exists() || f.remove();
-        if (!ok) { QThread::msleep(50); ok = !f.exists() || f.remove(); }
-        if (!ok) { qWarning() << "[Purge] unlink failed:" << path; continue; }
-
-        bool rowOk = false;
-        QMetaObject::invokeMethod(db, [&]{ rowOk = db->deleteSegmentRow(id); },
-                                  Qt::BlockingQueuedConnection);
-        if (!rowOk) { qWarning() << "[Purge] DB row delete failed id=" << id; continue; }
-
-        freedBytes += sz;
-
-        QStorageInfo si(archiveDir);
-        if (si.isValid()) {
-            const qint64 freeNow = si.bytesAvailable();
-            qInfo() << "[Purge] deleted" << path << "size=" << sz
-                    << "free_now=" << freeNow;
-            if (freeNow >= rcfg_.targetFreeBytes) break;
+bool ArchiveManager::shouldPurge_(RootNeeds& needs) {
+    needs.clear();
+    for (const auto& r : roots_) {
+        QStorageInfo si(r.dir);
+        if (!si.isValid()) continue;
+        const qint64 total = si.bytesTotal();
+        const qint64 availBytes = si.bytesAvailable();
+        if (total <= 0) continue;
+        const int usedPct = int((total - availBytes) * 100 / total);
+
+        const bool trigger = (availBytes < r.minFreeBytes) || (usedPct >= rcfg_.highWaterPct);
+        qInfo() << "[Purge] check" << r.dir
+                << "avail=" << availBytes
+                << "total=" << total
+                << "used%=" << usedPct
+                << "minFree=" << r.minFreeBytes
+                << "targetFree=" << r.targetFreeBytes
+                << "trigger=" << trigger;
+
+        if (trigger) {
+            const qint64 need = qMax<qint64>(r.targetFreeBytes - availBytes, 0);
+            if (need > 0) needs.push_back({ r.dir, need });
         }
     }
-    return true;
+    return !needs.isEmpty();
 }
 
 // ---------- Purge entry point ----------
@@ -257,31 +560,81 @@ void ArchiveManager::cleanupArchive()
 {
     if (archiveDir.isEmpty()) return;
     if (!QDir(archiveDir).exists()) return;
+    if (!db) return;
     if (purgeRunning_.fetchAndStoreOrdered(1) == 1) return;
 
-    qint64 need=0, avail=0;
-    if (!shouldPurge_(need, avail)) {
+    RootNeeds needs;
+    const bool lowSpace = shouldPurge_(needs);
+
+    // Quotas need a per-camera usage sum; evaluate them at most once a minute
+    // rather than on every finalized segment.
+    const bool quotasDue = !quotaClock_.isValid() || quotaClock_.elapsed() >= 60 * 1000;
+    // Keyframe-only tier: one time-boxed pass every 10 minutes, sharing the
+    // purge slot so the two never touch the same files at once.
+    const int thinDays = ArchiveThinner::thinAfterDays();
+    const bool thinDue = thinDays > 0 && (!thinClock_.isValid() || thinClock_.elapsed() >= 10 * 60 * 1000);
+    // Short-segment compaction (reconnect churn): every 15 minutes, same slot.
+    const bool compactDue = ArchiveCompactor::smallSegmentSec() > 0 &&
+        (!compactClock_.isValid() || compactClock_.elapsed() >= 15 * 60 * 1000);
+    // Event retention: hourly, whether or not anything was purged.
+    const bool eventsDue = !eventsClock_.isValid() || eventsClock_.elapsed() >= 60 * 60 * 1000;
+    if (!lowSpace && !quotasDue && !thinDue && !compactDue && !eventsDue) {
         purgeRunning_.storeRelease(0);
         return;
     }
-
-    qint64 totalFreed = 0;
-    while (true) {
-        qint64 freed = 0;
-        const bool any = purgeOnce_(freed);
-        totalFreed += freed;
-
-        QStorageInfo si(archiveDir);
-        const bool done = !si.isValid()
-                       || si.bytesAvailable() >= rcfg_.targetFreeBytes
-                       || !any;
-        if (done) break;
-
-        QThread::msleep(20);
-    }
-
-    QStorageInfo si2(archiveDir);
-    qInfo() << "[Purge] exit freed_total=" << totalFreed
-            << "free_now=" << (si2.isValid() ? si2.bytesAvailable() : -1);
-    purgeRunning_.storeRelease(0);
+    if (quotasDue) quotaClock_.start();
+    if (thinDue) thinClock_.start();
+    if (compactDue) compactClock_.start();
+    if (eventsDue) eventsClock_.start();
+
+    // Plan, row deletes and unlinks all run off this (GUI) thread.
+    DbWriter* writer = db;
+    const int minDays = rcfg_.perCameraMinDays;
+    const int batch   = rcfg_.purgeBatchFiles;
+    purgeFuture_ = QtConcurrent::run([this, writer, needs, lowSpace, minDays, quotasDue, batch,
+                                      thinDue, thinDays, compactDue, eventsDue]{
+        ArchivePurger::Report rep;
+        if (lowSpace || quotasDue)
+            rep = ArchivePurger::run(writer, needs, minDays, quotasDue, batch, purgeAbort_);
+        if (lowSpace && rep.planned == 0) {
+            qWarning() << "[Purge] nothing eligible; roots_low=" << needs.size()
+                       << "short=" << rep.shortBytes << "(pinned or within min-days)";
+            QMetaObject::invokeMethod(writer, "addEvent", Qt::QueuedConnection,
+                Q_ARG(QString, QString()), Q_ARG(qint64, QDateTime::currentMSecsSinceEpoch() * 1000000LL),
+                Q_ARG(QString, QStringLiteral("disk_alarm")), Q_ARG(QString, QStringLiteral("purge")),
+                Q_ARG(QString, QStringLiteral("short_bytes=%1").arg(rep.shortBytes)));
+        }
+        else if (rep.planned > 0)
+            qInfo() << "[Purge] exit planned=" << rep.planned
+                    << "rows_deleted=" << rep.rowsDeleted
+                    << "unlink_failed=" << rep.unlinkFailed
+                    << "freed_total=" << rep.freedBytes
+                    << "quota_bytes=" << rep.quotaBytes
+                    << "space_bytes=" << rep.spaceBytes
+                    << "elapsed_ms=" << rep.elapsedMs;
+        if (compactDue && !lowSpace && !purgeAbort_.load()) {
+            const ArchiveCompactor::Report cr = ArchiveCompactor::run(writer, purgeAbort_);
+            if (cr.runs + cr.failed > 0)
+                qInfo() << "[Compact] runs=" << cr.runs << "rows_removed=" << cr.rowsRemoved
+                        << "failed=" << cr.failed << "bytes=" << cr.bytes
+                        << "elapsed_ms=" << cr.elapsedMs;
+        }
+        if (thinDue && !purgeAbort_.load()) {
+            const ArchiveThinner::Report th = ArchiveThinner::run(writer, thinDays, purgeAbort_);
+            if (th.thinned + th.kept > 0)
+                qInfo() << "[Thin] thinned=" << th.thinned << "kept=" << th.kept
+                        << "bytes_before=" << th.bytesBefore << "bytes_after=" << th.bytesAfter
+                        << "elapsed_ms=" << th.elapsedMs;
+        }
+        if (eventsDue && !purgeAbort_.load()) {
+            const int n = ArchivePurger::expireEvents(writer, purgeAbort_);
+            if (n > 0) qInfo() << "[Purge] events_deleted=" << n;
+        }
+        purgeRunning_.storeRelease(0);
+        if (rep.rowsDeleted > 0) {
+            QMetaObject::invokeMethod(this, [this, rep]{
+                emit purgeFinished(rep.rowsDeleted, rep.freedBytes);
+            }, Qt::QueuedConnection);
+        }
+    });
 }
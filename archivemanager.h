@@ -5,19 +5,32 @@
 #include <QTimer>
 #include <QThread>
 #include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QHash>
+#include <QThreadPool>
+#include <atomic>
 #include <vector>
 #include <string>
 
+#include "archive_roots.h"
 #include "archiveworker.h"
 #include "camerastreams.h" // CamHWProfile
+#include "purge_planner.h"  // RootNeeds
 
 class DbWriter;
+struct CameraSchedule;
 
 // Dynamic, size-based ring buffer config.
 // minFreeBytes/targetFreeBytes are computed from total capacity by refreshRetentionWatermarks().
 // Override percentages via env:
 //   CAMVIGIL_MIN_FREE_PCT    (default 10)
 //   CAMVIGIL_TARGET_FREE_PCT (default 12)
+//   CAMVIGIL_MIN_RETENTION_DAYS (default 0; floor for every camera)
+// With several archive roots (CAMVIGIL_ARCHIVE_ROOTS) each root gets its own watermarks.
+// Per-camera/group byte quotas and min-days live in the retention_policies table.
+// Weekly recording windows live in recording_schedules (see RecordingSchedule);
+// recorders are started/stopped on the boundaries, checked once a minute.
 struct RetentionCfg {
     qint64 minFreeBytes     = 0;   // computed each refresh
     qint64 targetFreeBytes  = 0;   // computed each refresh
@@ -35,6 +48,9 @@ public:
     QString archiveRoot() const { return archiveDir; }
     QString getArchiveDir() const { return archiveDir; }
     QString databasePath() const { return archiveDir + "/camvigil.sqlite"; }
+    QStringList archiveRoots() const {            // every root, primary first
+        QStringList l; for (const auto& r : roots_) l << r.dir; return l;
+    }
 
     void startRecording(const std::vector<CamHWProfile>& cameraProfiles);
     void stopRecording();
@@ -44,14 +60,24 @@ public:
 
 public slots:
     void cleanupArchive(); // ring-buffer purge
+    // Event-mode cameras: write the pre-event ring plus post_event_sec.
+    // False if the camera is unknown or records continuously.
+    bool triggerEvent(const QString& cameraUrl, const QString& reason);
 
 signals:
     void segmentWritten(); // emitted after a segment finalizes
+    void recoveryFinished(int finalized, int dropped, qint64 elapsedMs); // crash-recovery report
+    void purgeFinished(int segments, qint64 freedBytes);                  // retention purge report
+    void recordersStopped(int recorders, qint64 elapsedMs);               // stopRecording() duration
 
 private:
     // timers/workers
     QTimer cleanupTimer;
-    std::vector<ArchiveWorker*> workers;
+    std::vector<ArchiveWorker*> workers;       // index = camera profile index; null while scheduled off
+    std::vector<ArchiveWorker*> subWorkers_;   // scrub-track recorders (suburl), same index
+    std::vector<ArchiveWorker*> stopping_;     // stopped by a schedule, still finalizing
+    QStringList camDirs_;                      // archive root per camera (placement)
+    bool recordSubAll_ = false;                // CAMVIGIL_RECORD_SUBSTREAM=1
     QString archiveDir;
     int defaultDuration;  // seconds
     std::vector<CamHWProfile> cameraProfiles;
@@ -61,14 +87,41 @@ private:
     DbWriter* db       = nullptr;
     QString   sessionId;
 
-    // retention
+    // crash recovery (segments left open by a previous run)
+    QFuture<void>     recoveryFuture_;
+    std::atomic<bool> recoveryAbort_{false};
+    bool              recoveryStarted_ = false;
+    QThreadPool       repairPool_;   // segments abandoned by a failed pipeline, one at a time
+    void startCrashRecovery_();
+    void repairAbandoned_(const QString& path, qint64 startNs, bool sub = false);
+    void startWorker_(int camIndex, bool eventMode, const QDateTime& start);
+    void startSubWorker_(const CamHWProfile& profile, int camIndex,
+                         const QString& camDir, const QDateTime& masterStart);
+    void stopCamera_(int camIndex);
+    qint64 stopWorkers_(const std::vector<ArchiveWorker*>& list);   // concurrent stop, ms
+
+    // recording schedules
+    enum class SchedState { None, Record, EventOnly, Off };
+    std::vector<SchedState> schedState_;        // per camera; None = not started yet
+    QTimer scheduleTimer_;                      // fires just after each minute boundary
+    void refreshSchedules_();                   // async reload, then applySchedules_()
+    void applySchedules_(const QHash<QString, CameraSchedule>& schedules);
+    void armScheduleTimer_();
+
+    // retention (rcfg_ watermarks mirror roots_[0])
+    QVector<ArchiveRoots::Root> roots_;
     RetentionCfg rcfg_;
     QAtomicInt   purgeRunning_{0}; // 0=idle,1=running
+    QElapsedTimer quotaClock_;     // last quota evaluation
+    QElapsedTimer thinClock_;      // last keyframe-tier pass (CAMVIGIL_THIN_AFTER_DAYS)
+    QElapsedTimer compactClock_;   // last short-segment compaction pass
+    QElapsedTimer eventsClock_;    // last event-retention pass
+    QFuture<void>     purgeFuture_;
+    std::atomic<bool> purgeAbort_{false};
 
     // helpers
-    void refreshRetentionWatermarks();     // compute bytes from % of total
-    bool shouldPurge_(qint64& needBytes, qint64& availBytes);
-    bool purgeOnce_(qint64& freedBytes);
+    void refreshRetentionWatermarks();     // per-root bytes from % of total
+    bool shouldPurge_(RootNeeds& needs);   // per-root shortfall below target
 };
 
 #endif // ARCHIVEMANAGER_H
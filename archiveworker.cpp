@@ -1,9 +1,23 @@
 #include "archiveworker.h"
 #include <QDir>
+#include <QFileInfo>
 #include <QDebug>
 #include <QThread>
 #include <QMutexLocker>
+#include <QElapsedTimer>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
 #include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
+#include "archive_batch_sink.h"
+#include "io_policy.h"
+
+// Hard cap on the pre-event ring, whatever preEventSec asks for.
+static const qint64 kRingMaxBytes = 64LL * 1024 * 1024;
 
 ArchiveWorker::ArchiveWorker(const std::string& url,
                              int camIndex,
@@ -24,24 +38,105 @@ ArchiveWorker::ArchiveWorker(const std::string& url,
              << "with masterStart:" << masterStart.toString("yyyyMMdd_HHmmss");
 }
 
+ArchiveWorker::~ArchiveWorker() {
+    QMutexLocker lk(&ringMutex_);
+    clearRing_();
+}
+
+void ArchiveWorker::setEventMode(int preEventSec, int postEventSec) {
+    eventMode_    = true;
+    preEventSec_  = qBound(0, preEventSec, 120);
+    postEventSec_ = qBound(1, postEventSec, 3600);
+    qDebug() << "[ArchiveWorker] Event mode for cam" << cameraIndex
+             << "pre=" << preEventSec_ << "s post=" << postEventSec_ << "s";
+}
+
+// Start (or extend) an event recording: the writer opens with the buffered
+// pre-roll and stays open until postEventSec after the latest trigger.
+void ArchiveWorker::triggerEvent(const QString& reason) {
+    if (!eventMode_) return;
+    eventUntilMs_.store(QDateTime::currentMSecsSinceEpoch() + postEventSec_ * 1000LL);
+    eventPending_.store(true);
+    qDebug() << "[ArchiveWorker] Event" << reason << "for cam" << cameraIndex;
+}
+
+// Max matroska cluster length for the segment being written (CAMVIGIL_LIVE_TAIL_CLUSTER_MS).
+int ArchiveWorker::liveTailClusterMs() {
+    bool ok = false;
+    const int v = qEnvironmentVariable("CAMVIGIL_LIVE_TAIL_CLUSTER_MS").toInt(&ok);
+    return (ok && v > 0) ? qBound(250, v, 60000) : 2000;
+}
+
+int ArchiveWorker::stallTimeoutMs() {
+    bool ok = false;
+    const int v = qEnvironmentVariable("CAMVIGIL_STALL_TIMEOUT_MS").toInt(&ok);
+    return (ok && v > 0) ? qBound(2000, v, 300000) : 10000;
+}
+
+int ArchiveWorker::stopEosTimeoutMs() {
+    bool ok = false;
+    const int v = qEnvironmentVariable("CAMVIGIL_STOP_EOS_MS").toInt(&ok);
+    return (ok && v > 0) ? qBound(100, v, 60000) : 3000;
+}
+
 QString ArchiveWorker::generateSegmentPrefix() const {
     QString timestamp = masterStart.toString("yyyyMMdd_HHmmss");
     return QString("archive_cam%1_%2").arg(cameraIndex).arg(timestamp);
 }
 
+void ArchiveWorker::configureSplit_(GstElement* sink) {
+    qint64 maxSizeTimeNs = static_cast<qint64>(segmentDurationSec.load()) * 1000000000LL;
+    g_object_set(sink,
+                 "send-keyframe-requests", TRUE,
+                 "max-size-time",     maxSizeTimeNs,
+                 nullptr);
+
+    // Live tail: bound the matroska cluster length so the open segment is
+    // readable (and cluster-seekable) within a couple of seconds of capture,
+    // instead of only after finalize writes the cues.
+    const gint64 clusterNs = static_cast<gint64>(liveTailClusterMs()) * 1000000LL;
+    GstStructure* muxProps = gst_structure_new("properties",
+        "min-cluster-duration", G_TYPE_INT64, qMin<gint64>(clusterNs, 500000000LL),
+        "max-cluster-duration", G_TYPE_INT64, clusterNs,
+        nullptr);
+    g_object_set(sink,
+                 "async-finalize",    TRUE,
+                 "muxer-factory",    "matroskamux",
+                 "muxer-properties",  muxProps,
+                 nullptr);
+    gst_structure_free(muxProps);
+
+    // Optional batched writer in place of filesink (one file per fragment).
+    if (ArchiveBatchSink::enabled() && ArchiveBatchSink::registerElement())
+        g_object_set(sink, "sink-factory", ArchiveBatchSink::factoryName(), nullptr);
+
+    g_signal_connect(sink,
+                     "format-location-full",
+                     G_CALLBACK(ArchiveWorker::formatLocationFullCallback),
+                     this);
+}
+
 void ArchiveWorker::createPipeline() {
     gst_init(nullptr, nullptr);
-    qint64 maxSizeTimeNs = static_cast<qint64>(segmentDurationSec.load()) * 1000000000LL;
 
-    // 1) Create pipeline and elements
+    // 1) Create pipeline and elements. depay/parse are chosen once rtspsrc
+    //    exposes its pad, from the SDP encoding-name (H264 or H265).
+    //    Continuous mode records straight into splitmuxsink; event mode feeds
+    //    an appsink that keeps the pre-event ring (see startWriter_()).
     pipeline = gst_pipeline_new(nullptr);
-    GstElement* src    = gst_element_factory_make("rtspsrc",      "source");
-    GstElement* depay  = gst_element_factory_make("rtph264depay", "depay");
-    GstElement* parse  = gst_element_factory_make("h264parse",    "parse");
-    GstElement* split  = gst_element_factory_make("splitmuxsink","split");
+    GstElement* src = gst_element_factory_make("rtspsrc", "source");
+    GstElement* sink = nullptr;
+    if (eventMode_) {
+        ringSink_ = gst_element_factory_make("appsink", "ring");
+        sink = ringSink_;
+    } else {
+        split = gst_element_factory_make("splitmuxsink", "split");
+        sink = split;
+    }
 
-    if (!pipeline || !src || !depay || !parse || !split) {
+    if (!pipeline || !src || !sink) {
         emit recordingError("Failed to create one or more GStreamer elements");
+        if (pipeline) { gst_object_unref(pipeline); pipeline = nullptr; }
         return;
     }
 
@@ -51,103 +146,515 @@ void ArchiveWorker::createPipeline() {
                  "latency", 300,
                  nullptr);
 
-    g_object_set(split,
-                 "name",            "split",
-                 "send-keyframe-requests", TRUE,
-                 "max-size-time",     maxSizeTimeNs,
-                 "async-finalize",    TRUE,
-                 "muxer-factory",    "matroskamux",
-                 nullptr);
+    if (eventMode_) {
+        g_object_set(ringSink_, "sync", FALSE, "emit-signals", FALSE, nullptr);
+        GstAppSinkCallbacks cbs = {};
+        cbs.new_sample = &ArchiveWorker::onRingSample;
+        gst_app_sink_set_callbacks(GST_APP_SINK(ringSink_), &cbs, this, nullptr);
+    } else {
+        configureSplit_(split);
+        qDebug() << "[ArchiveWorker] Connected format-location-full on splitmuxsink for cam"
+                 << cameraIndex;
+    }
 
     // 3) Add to pipeline
-    gst_bin_add_many(GST_BIN(pipeline), src, depay, parse, split, nullptr);
+    gst_bin_add_many(GST_BIN(pipeline), src, sink, nullptr);
 
-    // 4) Link static pads
-    if (!gst_element_link(depay, parse) ||
-        !gst_element_link(parse, split)) {
-        emit recordingError("Failed to link depay → parse → splitmuxsink");
-        gst_object_unref(pipeline);
-        pipeline = nullptr;
-        return;
-    }
-
-    // 5) Handle dynamic pad from rtspsrc → depay
+    // 4) Handle dynamic pad from rtspsrc → depay ! parse ! splitmuxsink/appsink
     g_signal_connect(src, "pad-added",
-                     G_CALLBACK(+[](GstElement* src, GstPad* pad, gpointer user_data){
-        GstElement* depay = static_cast<GstElement*>(user_data);
-        GstPad* sinkpad = gst_element_get_static_pad(depay, "sink");
-        if (gst_pad_is_linked(sinkpad) == FALSE) {
-            gst_pad_link(pad, sinkpad);
-        }
-        gst_object_unref(sinkpad);
-    }), depay);
+                     G_CALLBACK(ArchiveWorker::onRtspPadAdded), this);
 
-    // 6) Bus watch
+    // 5) Bus watch
     GstBus* bus = gst_element_get_bus(pipeline);
     gst_bus_add_signal_watch(bus);
     g_signal_connect(bus, "message",
                      G_CALLBACK(ArchiveWorker::onBusMessage), this);
     gst_object_unref(bus);
 
-    // 7) Connect the format-location-full signal on our splitmuxsink
-    g_signal_connect(split,
-                     "format-location-full",
-                     G_CALLBACK(ArchiveWorker::formatLocationFullCallback),
-                     this);
-    qDebug() << "[ArchiveWorker] Connected format-location-full on splitmuxsink for cam"
-             << cameraIndex;
-
     qDebug() << "[ArchiveWorker] Pipeline created successfully for cam"
              << cameraIndex;
 }
 
+// Nothing in the pipeline may call into this worker once it is handed off.
+void ArchiveWorker::detachCallbacks_() {
+    // Drop the watch so a rebuilt pipeline does not leave a stale source behind.
+    GstBus* bus = gst_element_get_bus(pipeline);
+    gst_bus_remove_signal_watch(bus);
+    g_signal_handlers_disconnect_by_data(bus, this);
+    gst_object_unref(bus);
+    if (GstElement* src = gst_bin_get_by_name(GST_BIN(pipeline), "source")) {
+        g_signal_handlers_disconnect_by_data(src, this);
+        gst_object_unref(src);
+    }
+    if (split) g_signal_handlers_disconnect_by_data(split, this);
+    if (ringSink_) {
+        GstAppSinkCallbacks none = {};
+        gst_app_sink_set_callbacks(GST_APP_SINK(ringSink_), &none, nullptr, nullptr);
+    }
+    if (parse && videoProbeId_) {
+        GstPad* parseSrc = gst_element_get_static_pad(parse, "src");
+        gst_pad_remove_probe(parseSrc, videoProbeId_);
+        gst_object_unref(parseSrc);
+    }
+    videoProbeId_ = 0;
+}
 
-
-void ArchiveWorker::cleanupPipeline() {
+// Going to NULL can block on an unreachable camera (rtspsrc TEARDOWN, TCP
+// timeouts). The state change runs on a helper thread; after budgetMs the
+// helper keeps the pipeline and releases it when it is done.
+void ArchiveWorker::cleanupPipeline(int budgetMs) {
+    QElapsedTimer t; t.start();
+    stopWriter_(QDateTime::fromMSecsSinceEpoch(lastBufferMs_.load(), Qt::UTC));
     if (pipeline) {
-        gst_element_set_state(pipeline, GST_STATE_NULL);
-        gst_object_unref(pipeline);
+        detachCallbacks_();
+        auto done = std::make_shared<std::promise<void>>();
+        std::future<void> released = done->get_future();
+        std::thread([p = pipeline, done]{
+            gst_element_set_state(p, GST_STATE_NULL);
+            gst_object_unref(p);
+            done->set_value();
+        }).detach();
         pipeline = nullptr;
+        const qint64 leftMs = qMax<qint64>(0, budgetMs - t.elapsed());
+        if (released.wait_for(std::chrono::milliseconds(leftMs)) != std::future_status::ready)
+            qWarning() << "[ArchiveWorker] pipeline teardown exceeded" << budgetMs
+                       << "ms for cam" << cameraIndex << "; finishing in the background";
     }
+    depay = parse = split = ringSink_ = nullptr;
+    // Timestamps restart with the next connection; the old pre-roll is useless.
+    QMutexLocker lk(&ringMutex_);
+    clearRing_();
 }
 
-void ArchiveWorker::run() {
-    createPipeline();
-    if (!pipeline) {
-        qDebug() << "[ArchiveWorker] Pipeline creation failed for cam" << cameraIndex << ". Exiting.";
+QString ArchiveWorker::codec() const {
+    QMutexLocker lk(&curMutex);
+    return codec_;
+}
+
+// rtspsrc pad-added: pick the depayloader/parser matching the stream's SDP
+// caps and link rtspsrc → depay → parse → splitmuxsink (or the ring appsink
+// in event mode). Only the first video stream is recorded.
+void ArchiveWorker::onRtspPadAdded(GstElement* src, GstPad* pad, gpointer user_data) {
+    Q_UNUSED(src);
+    ArchiveWorker* worker = static_cast<ArchiveWorker*>(user_data);
+    if (worker->depay) return;
+
+    GstCaps* caps = gst_pad_get_current_caps(pad);
+    if (!caps) caps = gst_pad_query_caps(pad, nullptr);
+    if (!caps) return;
+    const GstStructure* st = gst_caps_get_structure(caps, 0);
+    const QString media = QString::fromUtf8(gst_structure_get_string(st, "media")).toLower();
+    const QString enc   = QString::fromUtf8(gst_structure_get_string(st, "encoding-name")).toUpper();
+    gst_caps_unref(caps);
+    if (media != "video") return;
+
+    QString codec;
+    if (enc == "H264") codec = "h264";
+    else if (enc == "H265" || enc == "HEVC") codec = "h265";
+    else {
+        qDebug() << "[ArchiveWorker] Unsupported RTP video payload" << enc << "for cam" << worker->cameraIndex;
+        emit worker->recordingError("Unsupported RTP video payload: " + enc.toStdString());
         return;
     }
 
+    const bool h265 = (codec == "h265");
+    GstElement* depay = gst_element_factory_make(h265 ? "rtph265depay" : "rtph264depay", "depay");
+    GstElement* parse = gst_element_factory_make(h265 ? "h265parse"    : "h264parse",    "parse");
+    if (!depay || !parse) {
+        if (depay) gst_object_unref(depay);
+        if (parse) gst_object_unref(parse);
+        emit worker->recordingError("Failed to create depay/parse for " + codec.toStdString());
+        return;
+    }
 
-    GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
-    if (ret == GST_STATE_CHANGE_FAILURE) {
-        emit recordingError("Failed to set GStreamer pipeline to PLAYING");
-        cleanupPipeline();
+    gst_bin_add_many(GST_BIN(worker->pipeline), depay, parse, nullptr);
+    // On failure the pair leaves the bin again, so the next pad-added (or a
+    // second video stream) can try with the same element names.
+    auto discard = [worker, depay, parse](const char* why) {
+        gst_element_set_state(depay, GST_STATE_NULL);
+        gst_element_set_state(parse, GST_STATE_NULL);
+        gst_bin_remove_many(GST_BIN(worker->pipeline), depay, parse, nullptr);
+        emit worker->recordingError(why);
+    };
+    if (worker->eventMode_) {
+        // The writer starts mid-stream: every keyframe must carry SPS/PPS and
+        // buffers must be whole access units so the ring can cut on GOPs.
+        g_object_set(parse, "config-interval", -1, nullptr);
+        GstCaps* au = gst_caps_new_simple(h265 ? "video/x-h265" : "video/x-h264",
+                                          "stream-format", G_TYPE_STRING, h265 ? "hvc1" : "avc",
+                                          "alignment",     G_TYPE_STRING, "au",
+                                          nullptr);
+        g_object_set(worker->ringSink_, "caps", au, nullptr);
+        gst_caps_unref(au);
+    }
+    GstElement* sink = worker->eventMode_ ? worker->ringSink_ : worker->split;
+    if (!gst_element_link_many(depay, parse, sink, nullptr)) {
+        discard("Failed to link depay → parse → sink");
+        return;
+    }
+    gst_element_sync_state_with_parent(parse);
+    gst_element_sync_state_with_parent(depay);
+
+    GstPad* sinkpad = gst_element_get_static_pad(depay, "sink");
+    const bool linked = gst_pad_link(pad, sinkpad) == GST_PAD_LINK_OK;
+    gst_object_unref(sinkpad);
+    if (!linked) {
+        gst_element_unlink(parse, sink);   // frees the splitmuxsink/appsink request pad
+        discard("Failed to link rtspsrc → depay");
         return;
     }
 
-    qDebug() << "[ArchiveWorker] Pipeline running for cam" << cameraIndex;
-    running.store(true);
+    // Stall watchdog input: time of the last parsed video buffer.
+    GstPad* parseSrc = gst_element_get_static_pad(parse, "src");
+    worker->videoProbeId_ = gst_pad_add_probe(parseSrc, GST_PAD_PROBE_TYPE_BUFFER,
+                                              &ArchiveWorker::onVideoBuffer, worker, nullptr);
+    gst_object_unref(parseSrc);
+
+    worker->depay = depay;
+    worker->parse = parse;
+    {
+        QMutexLocker lk(&worker->curMutex);
+        worker->codec_ = codec;
+    }
+    qDebug() << "[ArchiveWorker] Detected" << enc << "stream for cam" << worker->cameraIndex;
+}
+
+GstPadProbeReturn ArchiveWorker::onVideoBuffer(GstPad*, GstPadProbeInfo*, gpointer user_data) {
+    auto* worker = static_cast<ArchiveWorker*>(user_data);
+    worker->lastBufferMs_.store(QDateTime::currentMSecsSinceEpoch());
+    worker->gotData_.store(true);
+    return GST_PAD_PROBE_OK;
+}
+
+// Event mode: every access unit lands in the ring; while an event is being
+// written it is also forwarded to the writer.
+GstFlowReturn ArchiveWorker::onRingSample(GstAppSink* sink, gpointer user_data) {
+    auto* worker = static_cast<ArchiveWorker*>(user_data);
+    GstSample* sample = gst_app_sink_pull_sample(sink);
+    if (!sample) return GST_FLOW_EOS;
+
+    GstBuffer* buf = gst_sample_get_buffer(sample);
+    GstCaps* caps  = gst_sample_get_caps(sample);
+    {
+        QMutexLocker lk(&worker->ringMutex_);
+        if (caps && (!worker->ringCaps_ || !gst_caps_is_equal(caps, worker->ringCaps_)))
+            gst_caps_replace(&worker->ringCaps_, caps);
+
+        const bool key = buf && !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+        if (buf && (key || !worker->ring_.empty())) {   // the ring always starts on a keyframe
+            RingItem item{gst_buffer_ref(buf), QDateTime::currentMSecsSinceEpoch()};
+            worker->ring_.push_back(item);
+            worker->ringBytes_ += gst_buffer_get_size(buf);
+            if (worker->writerActive_) worker->pushToWriter_(item);
+            worker->trimRing_();
+        }
+    }
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+// Drop the oldest whole GOP while the remaining ring still covers
+// preEventSec, or while the ring is over its byte cap. Caller holds ringMutex_.
+void ArchiveWorker::trimRing_() {
+    const qint64 preMs = preEventSec_ * 1000LL;
+    while (ring_.size() > 1) {
+        size_t next = 1;
+        while (next < ring_.size() &&
+               GST_BUFFER_FLAG_IS_SET(ring_[next].buf, GST_BUFFER_FLAG_DELTA_UNIT))
+            ++next;
+        if (next >= ring_.size()) return;   // a single GOP is never split
+        const bool covered = ring_.back().wallMs - ring_[next].wallMs >= preMs;
+        if (!covered && ringBytes_ <= kRingMaxBytes) return;
+        for (size_t i = 0; i < next; ++i) {
+            ringBytes_ -= gst_buffer_get_size(ring_.front().buf);
+            gst_buffer_unref(ring_.front().buf);
+            ring_.pop_front();
+        }
+    }
+}
+
+// Caller holds ringMutex_.
+void ArchiveWorker::clearRing_() {
+    for (const RingItem& it : ring_) gst_buffer_unref(it.buf);
+    ring_.clear();
+    ringBytes_ = 0;
+    gst_caps_replace(&ringCaps_, nullptr);
+}
+
+// Forward one access unit to the writer, rebased so the first one (the ring
+// head keyframe) is at 0. Caller holds ringMutex_.
+void ArchiveWorker::pushToWriter_(const RingItem& item) {
+    GstBuffer* out = gst_buffer_copy(item.buf);   // shares the memory, own timestamps
+    if (writerBasePts_ == GST_CLOCK_TIME_NONE) {
+        writerBasePts_ = GST_BUFFER_DTS_IS_VALID(out) ? GST_BUFFER_DTS(out)
+                       : GST_BUFFER_PTS_IS_VALID(out) ? GST_BUFFER_PTS(out) : 0;
+    }
+    auto rebase = [this](GstClockTime t) {
+        return (t == GST_CLOCK_TIME_NONE) ? t : (t > writerBasePts_ ? t - writerBasePts_ : 0);
+    };
+    GST_BUFFER_PTS(out) = rebase(GST_BUFFER_PTS(out));
+    GST_BUFFER_DTS(out) = rebase(GST_BUFFER_DTS(out));
+    lastPushedMs_.store(item.wallMs);
+    if (gst_app_src_push_buffer(GST_APP_SRC(writerSrc_), out) != GST_FLOW_OK)
+        writerActive_ = false;   // writer is flushing/erroring; run() tears it down
+}
+
+// Build appsrc → splitmuxsink and flush the pre-roll into it. Returns false
+// while there is nothing buffered yet (no keyframe since connect).
+bool ArchiveWorker::startWriter_() {
+    GstCaps* caps = nullptr;
+    {
+        QMutexLocker lk(&ringMutex_);
+        if (ring_.empty() || !ringCaps_) return false;
+        caps = gst_caps_ref(ringCaps_);
+    }
+
+    GstElement* wr  = gst_pipeline_new(nullptr);
+    GstElement* src = gst_element_factory_make("appsrc", "evsrc");
+    GstElement* sink = gst_element_factory_make("splitmuxsink", "split");
+    if (!wr || !src || !sink) {
+        gst_caps_unref(caps);
+        if (wr) gst_object_unref(wr);
+        if (src) gst_object_unref(src);
+        if (sink) gst_object_unref(sink);
+        markFailed_("pipeline_error", "Failed to create event writer elements");
+        return false;
+    }
+    g_object_set(src,
+                 "caps",         caps,
+                 "format",       GST_FORMAT_TIME,
+                 "is-live",      TRUE,
+                 "do-timestamp", FALSE,
+                 "max-bytes",    static_cast<guint64>(kRingMaxBytes),
+                 nullptr);
+    gst_caps_unref(caps);
+    configureSplit_(sink);
+    gst_bin_add_many(GST_BIN(wr), src, sink, nullptr);
+    if (!gst_element_link(src, sink) ||
+        gst_element_set_state(wr, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        gst_element_set_state(wr, GST_STATE_NULL);
+        gst_object_unref(wr);
+        markFailed_("pipeline_error", "Failed to start event writer");
+        return false;
+    }
+
+    writer_ = wr;
+    writerSrc_ = src;
+    split = sink;
+
+    QMutexLocker lk(&ringMutex_);
+    ptsWallBase_ = QDateTime::fromMSecsSinceEpoch(ring_.front().wallMs);
+    writerBasePts_ = GST_CLOCK_TIME_NONE;
+    writerActive_ = true;
+    for (const RingItem& it : ring_) {
+        if (!writerActive_) break;
+        pushToWriter_(it);
+    }
+    qDebug() << "[ArchiveWorker] Event writer started for cam" << cameraIndex
+             << "preroll_ms=" << (ring_.back().wallMs - ring_.front().wallMs)
+             << "preroll_bytes=" << ringBytes_;
+    return true;
+}
+
+// EOS the writer so matroskamux writes its cues, then close the segment.
+// The ring is emptied: the next event's pre-roll must not repeat footage
+// that is already on disk.
+void ArchiveWorker::stopWriter_(const QDateTime& endUtc) {
+    if (!writer_) return;
+    {
+        QMutexLocker lk(&ringMutex_);
+        writerActive_ = false;
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(writerSrc_));
+    GstBus* bus = gst_element_get_bus(writer_);
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, GstClockTime(stopEosTimeoutMs()) * GST_MSECOND,
+        static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    if (msg) gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    closeCurrentSegment_(endUtc);
+    gst_element_set_state(writer_, GST_STATE_NULL);
+    gst_object_unref(writer_);
+    writer_ = writerSrc_ = nullptr;
+    split = nullptr;
+    {
+        QMutexLocker lk(&ringMutex_);
+        clearRing_();
+    }
+    qDebug() << "[ArchiveWorker] Event writer closed for cam" << cameraIndex;
+    emit eventWriterClosed(cameraIndex, endUtc.toMSecsSinceEpoch() * 1000000LL);
+    emit segmentFinalized();
+}
+
+// Worker-thread side of event mode: start the writer for a pending trigger,
+// stop it once the post-event window has passed, surface writer errors.
+void ArchiveWorker::serviceEvents_() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (!writer_ && eventPending_.load()) {
+        if (startWriter_() || now > eventUntilMs_.load()) eventPending_.store(false);
+    }
+    if (!writer_) return;
+
+    GstBus* bus = gst_element_get_bus(writer_);
+    if (GstMessage* msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR)) {
+        GError* err = nullptr;
+        gst_message_parse_error(msg, &err, nullptr);
+        const bool noSpace = err->domain == GST_RESOURCE_ERROR &&
+                             err->code == GST_RESOURCE_ERROR_NO_SPACE_LEFT;
+        qDebug() << "[ArchiveWorker] Event writer error for cam" << cameraIndex << ":" << err->message;
+        emit recordingError(err->message);
+        markFailed_(noSpace ? "disk_full" : "pipeline_error", QString::fromUtf8(err->message));
+        g_error_free(err);
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
 
-    GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
+    bool active;
+    {
+        QMutexLocker lk(&ringMutex_);
+        active = writerActive_;
+    }
+    if (now > eventUntilMs_.load() || !active) {
+        stopWriter_(QDateTime::fromMSecsSinceEpoch(lastPushedMs_.load(), Qt::UTC));
+    }
+}
+
+void ArchiveWorker::markFailed_(const QString& reason, const QString& detail) {
+    {
+        QMutexLocker lk(&curMutex);
+        if (pipelineFailed_.load()) return;   // keep the first cause
+        failReason_ = reason;
+        failDetail_ = detail;
+    }
+    pipelineFailed_.store(true);
+}
+
+// Emit segmentClosed for the file being written, ending at endUtc.
+void ArchiveWorker::closeCurrentSegment_(const QDateTime& endUtc) {
+    QMutexLocker lk(&curMutex);
+    if (currentFilePath.isEmpty() || !currentStartTimeUtc.isValid()) return;
+    const qint64 durMs = qMax<qint64>(0, currentStartTimeUtc.msecsTo(endUtc));
+    const qint64 endNs = endUtc.toMSecsSinceEpoch()*1000000LL;
+    emit segmentClosed(cameraIndex, currentFilePath, endNs, durMs);
+    IoPolicy::dropWritten(currentFilePath);   // not re-read unless played back
+    currentFilePath.clear();
+    currentStartTimeUtc = QDateTime();
+}
+
+// Forget the file being written without closing its row.
+QString ArchiveWorker::takeCurrentSegment_(qint64& startUtcNs) {
+    QMutexLocker lk(&curMutex);
+    const QString path = currentFilePath;
+    startUtcNs = currentStartTimeUtc.isValid()
+        ? currentStartTimeUtc.toMSecsSinceEpoch() * 1000000LL : 0;
+    currentFilePath.clear();
+    currentStartTimeUtc = QDateTime();
+    return path;
+}
+
+void ArchiveWorker::run() {
+    int backoffMs = 1000;
+    bool firstBuild = true;
     while (running.load()) {
-        if (!g_main_context_iteration(g_main_loop_get_context(loop), FALSE)) {
-            QThread::msleep(100); // Fallback if no events
+        createPipeline();
+        if (!pipeline) {
+            qDebug() << "[ArchiveWorker] Pipeline creation failed for cam" << cameraIndex << ". Exiting.";
+            return;
+        }
+
+        // splitmuxsink PTS start at 0 with each connection; the first one is
+        // anchored at masterStart like before, reconnects at their own start.
+        ptsWallBase_ = firstBuild ? masterStart : QDateTime::currentDateTime();
+        firstBuild = false;
+        pipelineFailed_.store(false);
+        gotData_.store(false);
+        lastBufferMs_.store(QDateTime::currentMSecsSinceEpoch());   // stall clock starts at connect
+
+        GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
+        if (ret == GST_STATE_CHANGE_FAILURE) {
+            emit recordingError("Failed to set GStreamer pipeline to PLAYING");
+            markFailed_("camera_offline", "Failed to set pipeline to PLAYING");
+        } else {
+            qDebug() << "[ArchiveWorker] Pipeline running for cam" << cameraIndex;
+        }
+
+        const int stallMs = stallTimeoutMs();
+        GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
+        while (running.load() && !pipelineFailed_.load()) {
+            if (!g_main_context_iteration(g_main_loop_get_context(loop), FALSE)) {
+                QThread::msleep(100); // Fallback if no events
+            }
+            if (eventMode_) serviceEvents_();
+            const qint64 idleMs = QDateTime::currentMSecsSinceEpoch() - lastBufferMs_.load();
+            if (idleMs > stallMs) {
+                markFailed_("camera_offline", QString("No video for %1 ms").arg(idleMs));
+            }
+        }
+        g_main_loop_unref(loop);
+
+        const bool failed = pipelineFailed_.load() && running.load();
+        const QDateTime lastData = QDateTime::fromMSecsSinceEpoch(lastBufferMs_.load(), Qt::UTC);
+        QElapsedTimer stopClock; stopClock.start();   // EOS and teardown share one budget
+        stopWriter_(QDateTime::fromMSecsSinceEpoch(lastPushedMs_.load(), Qt::UTC));
+        // A failed pipeline never sent EOS: the file has no cues or duration,
+        // so its row stays open for ArchiveRecovery instead of being finalized.
+        QString abandoned;
+        qint64 abandonedStartNs = 0;
+        if (failed) abandoned = takeCurrentSegment_(abandonedStartNs);
+        else finalizeOnStop_();
+        cleanupPipeline(int(qMax<qint64>(100, stopEosTimeoutMs() - stopClock.elapsed())));
+        if (!abandoned.isEmpty()) emit segmentAbandoned(cameraIndex, abandoned, abandonedStartNs);
+        if (!failed) break;
+
+        QString reason, detail;
+        {
+            QMutexLocker lk(&curMutex);
+            reason = failReason_;
+            detail = failDetail_;
         }
+        qDebug() << "[ArchiveWorker] Recording interrupted for cam" << cameraIndex
+                 << "reason=" << reason << detail << "retry_in_ms=" << backoffMs;
+        emit recordingInterrupted(cameraIndex, lastData.toMSecsSinceEpoch()*1000000LL, reason, detail);
+
+        // Back off (1 s doubling to 30 s; reset once a connection delivered video).
+        if (gotData_.load()) backoffMs = 1000;
+        for (int waited = 0; waited < backoffMs && running.load(); waited += 100)
+            QThread::msleep(100);
+        backoffMs = qMin(backoffMs * 2, 30000);
     }
-    g_main_loop_unref(loop);
-    cleanupPipeline();
     qDebug() << "[ArchiveWorker] Pipeline stopped for cam" << cameraIndex;
 }
 
 void ArchiveWorker::stop() {
-    running.store(false);
-    if (pipeline) {
-        gst_element_send_event(pipeline, gst_event_new_eos()); // Ensures the  final segment is written
-    }
+    running.store(false);   // run() finalizes on its own thread (finalizeOnStop_)
     qDebug() << "[ArchiveWorker] Stop called for cam" << cameraIndex;
 }
 
+// Clean stop: push EOS through depay/parse into splitmuxsink so the open file
+// gets its Cues, but give up after stopEosTimeoutMs(). A segment that did not
+// finalize stays open in the DB and is repaired by the next start's recovery.
+bool ArchiveWorker::finalizeOnStop_() {
+    if (!pipeline || eventMode_ || !gotData_.load()) return false;
+    QElapsedTimer t; t.start();
+    GstBus* bus = gst_element_get_bus(pipeline);
+    gst_element_send_event(pipeline, gst_event_new_eos());
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, GstClockTime(stopEosTimeoutMs()) * GST_MSECOND,
+        static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    gst_object_unref(bus);
+    const bool eos = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (msg) gst_message_unref(msg);
+
+    if (!eos) {
+        qWarning() << "[ArchiveWorker] EOS not finalized within" << stopEosTimeoutMs()
+                   << "ms for cam" << cameraIndex << "; left for recovery";
+        return false;
+    }
+    closeCurrentSegment_(QDateTime::fromMSecsSinceEpoch(lastBufferMs_.load(), Qt::UTC));
+    qDebug() << "[ArchiveWorker] Finalized on stop for cam" << cameraIndex << "in" << t.elapsed() << "ms";
+    emit segmentFinalized();
+    return true;
+}
+
 void ArchiveWorker::updateSegmentDuration(int seconds) {
     qDebug() << "[ArchiveWorker] Segment duration update scheduled for cam" << cameraIndex << "to" << seconds << "seconds.";
     nextSegmentDuration = seconds;
@@ -165,7 +672,6 @@ void ArchiveWorker::updateSegmentDuration(int seconds) {
 }
 
 gchar* ArchiveWorker::formatLocationFullCallback(GstElement* splitmux, guint fragment_id, GstSample* sample, gpointer user_data) {
-    Q_UNUSED(splitmux);
     Q_UNUSED(fragment_id);
     ArchiveWorker* worker = static_cast<ArchiveWorker*>(user_data);
 
@@ -175,7 +681,7 @@ gchar* ArchiveWorker::formatLocationFullCallback(GstElement* splitmux, guint fra
         if (buffer && GST_BUFFER_PTS_IS_VALID(buffer)) {
             GstClockTime pts = GST_BUFFER_PTS(buffer);
             qint64 ptsMs = pts / 1000000;
-            segmentStartTime = worker->masterStart.addMSecs(ptsMs);
+            segmentStartTime = worker->ptsWallBase_.addMSecs(ptsMs);
             qDebug() << "[ArchiveWorker] PTS for cam" << worker->cameraIndex << ":" << pts << "ns (" << ptsMs << "ms)";
         }
     }
@@ -185,6 +691,14 @@ gchar* ArchiveWorker::formatLocationFullCallback(GstElement* splitmux, guint fra
         qDebug() << "[ArchiveWorker] No valid PTS for cam" << worker->cameraIndex << ", using system time";
     }
 
+    // PTS restart with every rebuilt pipeline: a start that does not move
+    // past the previous segment's is wrong, and its name could collide.
+    if (worker->lastSegmentTimestamp.isValid() && segmentStartTime <= worker->lastSegmentTimestamp) {
+        qWarning() << "[ArchiveWorker] PTS time" << segmentStartTime << "not after previous segment for cam"
+                   << worker->cameraIndex << ", using system time";
+        segmentStartTime = qMax(QDateTime::currentDateTime(), worker->lastSegmentTimestamp.addSecs(1));
+    }
+
     if (worker->lastSegmentTimestamp.isValid()) {
         qint64 diff = worker->lastSegmentTimestamp.msecsTo(segmentStartTime);
         qDebug() << "[ArchiveWorker] Time since last segment for cam" << worker->cameraIndex
@@ -193,14 +707,20 @@ gchar* ArchiveWorker::formatLocationFullCallback(GstElement* splitmux, guint fra
     worker->lastSegmentTimestamp = segmentStartTime;
 
     QString timestamp = segmentStartTime.toString("yyyyMMdd_HHmmss");
-    QString filename = QString("%1/archive_cam%2_%3.mkv")
-                           .arg(worker->archiveDir)
-                           .arg(worker->cameraIndex)
-                           .arg(timestamp);
+    const QString stem = QString("%1/archive_cam%2%3_%4")
+                             .arg(worker->archiveDir)
+                             .arg(worker->cameraIndex)
+                             .arg(worker->subStream_ ? QStringLiteral("_sub") : QString())
+                             .arg(timestamp);
+    // The sink truncates: never hand it a name that already holds footage.
+    QString filename = stem + ".mkv";
+    for (int n = 1; QFileInfo::exists(filename); ++n)
+        filename = QString("%1_%2.mkv").arg(stem).arg(n);
     qDebug() << "[ArchiveWorker] New segment:" << filename;
 
     // --- DB notifications: close previous, open new ---
        const qint64 startNs = segmentStartTime.toUTC().toMSecsSinceEpoch() * 1000000LL;
+       QString segCodec;
        {
            QMutexLocker lk(&worker->curMutex);
            // finalize previous file if present
@@ -211,28 +731,33 @@ gchar* ArchiveWorker::formatLocationFullCallback(GstElement* splitmux, guint fra
                emit worker->segmentClosed(worker->cameraIndex,
                                           worker->currentFilePath,
                                           endNs, endMs);
+               IoPolicy::dropWritten(worker->currentFilePath);
+               // Batched sink: preallocate the next-but-one file like this one
+               // (+10 %); the sink for the next fragment already exists.
+               if (ArchiveBatchSink::enabled()) {
+                   const qint64 est = QFileInfo(worker->currentFilePath).size() * 11 / 10;
+                   GstStructure* props = gst_structure_new("properties",
+                       "prealloc-bytes", G_TYPE_UINT64, guint64(qMax<qint64>(0, est)), nullptr);
+                   g_object_set(splitmux, "sink-properties", props, nullptr);
+                   gst_structure_free(props);
+               }
            }
            // open new
            worker->currentFilePath = filename;
            worker->currentStartTimeUtc = segmentStartTime.toUTC();
+           segCodec = worker->codec_;
        }
-       emit worker->segmentOpened(worker->cameraIndex, filename, startNs);
+       emit worker->segmentOpened(worker->cameraIndex, filename, startNs, segCodec);
        // ---------------------------------------------------
 
     // Apply pending duration update if flagged
     if (worker->pendingDurationUpdate.load()) {
         qint64 maxSizeTimeNs = static_cast<qint64>(worker->nextSegmentDuration) * 1000000000LL;
-        GstElement* sink = gst_bin_get_by_name(GST_BIN(worker->pipeline), "split");
-        if (sink) {
-            g_object_set(sink, "max-size-time", maxSizeTimeNs, NULL);
-            worker->segmentDurationSec.store(worker->nextSegmentDuration);
-            worker->pendingDurationUpdate.store(false);
-            qDebug() << "[ArchiveWorker] Updated segment duration to" << worker->segmentDurationSec.load()
-                     << "seconds for cam" << worker->cameraIndex;
-            gst_object_unref(sink);
-        } else {
-            qDebug() << "[ArchiveWorker] Failed to update segment duration: splitmuxsink not found for cam" << worker->cameraIndex;
-        }
+        g_object_set(splitmux, "max-size-time", maxSizeTimeNs, NULL);
+        worker->segmentDurationSec.store(worker->nextSegmentDuration);
+        worker->pendingDurationUpdate.store(false);
+        qDebug() << "[ArchiveWorker] Updated segment duration to" << worker->segmentDurationSec.load()
+                 << "seconds for cam" << worker->cameraIndex;
     }
 
     {
@@ -253,25 +778,28 @@ void ArchiveWorker::onBusMessage(GstBus* bus, GstMessage* message, gpointer user
         gst_message_parse_error(message, &err, &debug_info);
         qDebug() << "[ArchiveWorker] GST ERROR for cam" << worker->cameraIndex << ":" << err->message;
         emit worker->recordingError(err->message);
+
+        // Classify for the gap journal: sink-side out-of-space vs. source-side
+        // resource errors (camera unreachable) vs. anything else.
+        GstObject* from = GST_MESSAGE_SRC(message);
+        const bool sinkSide = worker->split &&
+            (from == GST_OBJECT(worker->split) || gst_object_has_as_ancestor(from, GST_OBJECT(worker->split)));
+        QString reason = "pipeline_error";
+        if (err->domain == GST_RESOURCE_ERROR && err->code == GST_RESOURCE_ERROR_NO_SPACE_LEFT)
+            reason = "disk_full";
+        else if (err->domain == GST_RESOURCE_ERROR && !sinkSide)
+            reason = "camera_offline";
+        worker->markFailed_(reason, QString::fromUtf8(err->message));
+
         g_error_free(err);
         g_free(debug_info);
-        worker->stop();
         break;
     }
     case GST_MESSAGE_EOS:
-        // finalize the current open segment on EOS
-                {
-                    QMutexLocker lk(&worker->curMutex);
-                    if (!worker->currentFilePath.isEmpty() && worker->currentStartTimeUtc.isValid()) {
-                        const QDateTime nowUtc = QDateTime::currentDateTimeUtc();
-                        const qint64 durMs = worker->currentStartTimeUtc.msecsTo(nowUtc);
-                        const qint64 endNs = nowUtc.toMSecsSinceEpoch()*1000000LL;
-                        emit worker->segmentClosed(worker->cameraIndex,
-                                                   worker->currentFilePath, endNs, durMs);
-                        worker->currentFilePath.clear();
-                        worker->currentStartTimeUtc = QDateTime();
-                    }
-                }
+        // finalize the current open segment on EOS (event mode: run() closes
+        // the writer's segment after draining it)
+        if (!worker->eventMode_)
+            worker->closeCurrentSegment_(QDateTime::currentDateTimeUtc());
         qDebug() << "[ArchiveWorker] GST EOS received for cam" << worker->cameraIndex;
         emit worker->segmentFinalized();
         break;
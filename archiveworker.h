@@ -9,7 +9,9 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <string>
+#include <deque>
 #include <gst/gst.h>
+#include <gst/app/gstappsink.h>
 
 class ArchiveWorker : public QThread {
     Q_OBJECT
@@ -19,17 +21,43 @@ public:
                   const QString& archiveDir,
                   int defaultDurationSec,
                   const QDateTime& masterStart);
+    ~ArchiveWorker() override;
     void run() override;
+    // Non-blocking: the worker thread sends EOS and finalizes the open
+    // segment within stopEosTimeoutMs(); pair with wait().
     void stop();
 
+    // Event recording: keep the last preEventSec of encoded video (GOP
+    // aligned) in memory and only write segments around triggerEvent().
+    // Call before start().
+    void setEventMode(int preEventSec, int postEventSec);
+    bool eventMode() const { return eventMode_; }
+
+    // Sub-stream (scrub track) recorder: files are named archive_camN_sub_*.
+    void setSubStream(bool sub) { subStream_ = sub; }
+    bool subStream() const { return subStream_; }
+
+    static int liveTailClusterMs();
+    static int stallTimeoutMs();   // no video for this long = camera offline
+    static int stopEosTimeoutMs(); // EOS finalize budget on stop (CAMVIGIL_STOP_EOS_MS)
+    QString codec() const;   // "h264"/"h265" once the RTSP caps are known, else empty
+
 public slots:
     void updateSegmentDuration(int seconds);
+    void triggerEvent(const QString& reason);   // thread-safe; no-op in continuous mode
 
 signals:
     void recordingError(const std::string& error);
     void segmentFinalized();
-    void segmentOpened(int camIndex, QString filePath, qint64 startUtcNs);     //meta data to store in db
+    void segmentOpened(int camIndex, QString filePath, qint64 startUtcNs, QString codec); //meta data to store in db
     void segmentClosed(int camIndex, QString filePath, qint64 endUtcNs, qint64 durationMs);//meta data to store in db
+    // The pipeline failed while writing filePath: no EOS, no cues. Emitted
+    // after the pipeline is torn down; the row stays open for repair.
+    void segmentAbandoned(int camIndex, QString filePath, qint64 startUtcNs);
+    // Recording stopped at sinceUtcNs (last video received); the worker is
+    // reconnecting. reason: "camera_offline" | "disk_full" | "pipeline_error".
+    void recordingInterrupted(int camIndex, qint64 sinceUtcNs, QString reason, QString detail);
+    void eventWriterClosed(int camIndex, qint64 endUtcNs);   // event mode: back to ring-only
 
 private:
     std::string cameraUrl;
@@ -41,6 +69,10 @@ private:
     int nextSegmentDuration;
     QDateTime masterStart;
     GstElement *pipeline;
+    GstElement *depay = nullptr;   // created on rtspsrc pad-added from the SDP caps
+    GstElement *parse = nullptr;
+    GstElement *split = nullptr;
+    gulong videoProbeId_ = 0;      // stall watchdog probe on parse's src pad
 
     QMutex updateMutex;
     QWaitCondition updateCondition;
@@ -48,14 +80,58 @@ private:
     QDateTime lastSegmentTimestamp;
 
     void createPipeline();
-    void cleanupPipeline();
+    void configureSplit_(GstElement* sink);
+    void cleanupPipeline(int budgetMs = stopEosTimeoutMs());
+    void detachCallbacks_();
+    void markFailed_(const QString& reason, const QString& detail);
+    void closeCurrentSegment_(const QDateTime& endUtc);
+    QString takeCurrentSegment_(qint64& startUtcNs);
+    bool finalizeOnStop_();
     QString generateSegmentPrefix() const;
 
     static gchar* formatLocationFullCallback(GstElement* splitmux, guint fragment_id, GstSample* sample, gpointer user_data);
     static void onBusMessage(GstBus* bus, GstMessage* message, gpointer user_data);
+    static void onRtspPadAdded(GstElement* src, GstPad* pad, gpointer user_data);
+    static GstPadProbeReturn onVideoBuffer(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstFlowReturn onRingSample(GstAppSink* sink, gpointer user_data);
     QString currentFilePath;
+    QString codec_;
     QDateTime currentStartTimeUtc;
-    QMutex curMutex;
+    mutable QMutex curMutex;
+
+    // Disconnect detection / reconnect
+    std::atomic<qint64> lastBufferMs_{0};     // wall clock of the last video buffer
+    std::atomic<bool>   gotData_{false};      // any video since the pipeline was built
+    std::atomic<bool>   pipelineFailed_{false};
+    QString failReason_, failDetail_;         // guarded by curMutex
+    QDateTime ptsWallBase_;                   // wall clock at splitmuxsink PTS 0
+
+    // Event mode: rtspsrc → depay → parse → appsink (ring); on a trigger a
+    // second pipeline appsrc → splitmuxsink gets the ring, then live data.
+    struct RingItem { GstBuffer* buf; qint64 wallMs; };
+    bool subStream_ = false;
+    bool eventMode_ = false;
+    int preEventSec_ = 10;
+    int postEventSec_ = 20;
+    GstElement* ringSink_ = nullptr;
+    GstElement* writer_ = nullptr;            // worker thread only
+    GstElement* writerSrc_ = nullptr;
+    std::atomic<qint64> eventUntilMs_{0};
+    std::atomic<bool>   eventPending_{false};
+    QMutex ringMutex_;                        // guards everything below
+    std::deque<RingItem> ring_;               // starts on a keyframe
+    qint64 ringBytes_ = 0;
+    GstCaps* ringCaps_ = nullptr;
+    bool writerActive_ = false;
+    GstClockTime writerBasePts_ = GST_CLOCK_TIME_NONE;
+    std::atomic<qint64> lastPushedMs_{0};
+
+    void trimRing_();
+    void clearRing_();
+    void pushToWriter_(const RingItem& item);
+    bool startWriter_();
+    void stopWriter_(const QDateTime& endUtc);
+    void serviceEvents_();
 };
 
 #endif // ARCHIVEWORKER_H
@@ -74,6 +74,12 @@ void CameraManager::saveCameraNames() {
         camObj["url"] = QString::fromStdString(profile.url);
         camObj["suburl"] = QString::fromStdString(profile.suburl);
         camObj["name"] = QString::fromStdString(profile.displayName);
+        if (profile.recordSub) camObj["record_sub"] = true;
+        if (profile.eventRecording()) {
+            camObj["record_mode"]    = "event";
+            camObj["pre_event_sec"]  = profile.preEventSec;
+            camObj["post_event_sec"] = profile.postEventSec;
+        }
         camerasArray.append(camObj);
     }
     json["cameras"] = camerasArray;
@@ -75,7 +75,14 @@ void CameraStreams::loadFromJson() {
         std::string suburl = camObj["suburl"].toString().toStdString();
         std::string name = camObj["name"].toString().toStdString();
         if (existingUrls.find(url) == existingUrls.end()) {
-            cameraUrls.emplace_back(url, suburl, name);
+            CamHWProfile profile(url, suburl, name);
+            profile.recordSub = camObj.value("record_sub").toBool(false);
+            if (camObj.value("record_mode").toString() == "event") {
+                profile.recordMode   = "event";
+                profile.preEventSec  = camObj.value("pre_event_sec").toInt(profile.preEventSec);
+                profile.postEventSec = camObj.value("post_event_sec").toInt(profile.postEventSec);
+            }
+            cameraUrls.push_back(profile);
             existingUrls.insert(url);
             qDebug() << "Loaded Camera:" << QString::fromStdString(name)
                      << "->" << QString::fromStdString(url)
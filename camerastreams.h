@@ -17,7 +17,18 @@ public:
     std::string url;       // Main URL for archiving (high quality)
     std::string suburl;    // Sub URL for streaming (low quality)
     std::string displayName;
-
+    // Recording mode: "continuous" (default) or "event" (pre-event ring,
+    // segments only around triggers). cameras.json: record_mode,
+    // pre_event_sec, post_event_sec.
+    std::string recordMode = "continuous";
+    int preEventSec  = 10;
+    int postEventSec = 20;
+
+    // Also record suburl as a scrub track for fast playback review
+    // (cameras.json: record_sub; CAMVIGIL_RECORD_SUBSTREAM=1 for all cameras).
+    bool recordSub = false;
+
+    bool eventRecording() const { return recordMode == "event"; }
 
     CamHWProfile(const std::string& rtspUrl, const std::string& subUrl, const std::string& name = "")
         : url(rtspUrl), suburl(subUrl), displayName(name) {}
@@ -0,0 +1,209 @@
+#include "db_read_pool.h"
+
+#include <algorithm>
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QThread>
+#include <QSqlError>
+#include <QThreadStorage>
+#include <QVector>
+#include <QDebug>
+
+static int envInt(const char* name, int def, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return ok ? qBound(lo, v, hi) : def;
+}
+
+namespace {
+
+struct Cached {
+    QSqlQuery q;
+    QSharedPointer<bool> busy;         // a Query holds it
+};
+
+struct Conn {
+    QString name;
+    QHash<QString, Cached> stmts;      // by SQL text
+};
+
+QAtomicInteger<int>    gConnections = 0;
+QAtomicInteger<int>    gSerial = 0;
+QAtomicInteger<qint64> gQueries = 0, gTotalUs = 0, gMaxUs = 0;
+
+// One thread's connections; QThreadStorage deletes it when the thread exits.
+struct ThreadConns {
+    QHash<QString, Conn> byPath;       // absolute db path → connection
+    ~ThreadConns() {
+        for (Conn& c : byPath) {
+            c.stmts.clear();           // statements go before their connection
+            {
+                QSqlDatabase db = QSqlDatabase::database(c.name, false);
+                if (db.isOpen()) db.close();
+            }
+            QSqlDatabase::removeDatabase(c.name);
+            gConnections.fetchAndSubRelaxed(1);
+        }
+    }
+};
+
+QThreadStorage<ThreadConns*> gThreadConns;
+
+// Executed Queries not finished yet, from every thread.
+struct OpenRead {
+    QString thread;
+    QString sql;
+    QElapsedTimer since;
+};
+QMutex gOpenMutex;
+QHash<const void*, OpenRead> gOpenReads;
+
+void forgetRead(const void* q) {
+    QMutexLocker lock(&gOpenMutex);
+    gOpenReads.remove(q);
+}
+
+ThreadConns* threadConns() {
+    if (!gThreadConns.hasLocalData()) gThreadConns.setLocalData(new ThreadConns);
+    return gThreadConns.localData();
+}
+
+Conn* connFor(const QSqlDatabase& db) {
+    if (!gThreadConns.hasLocalData()) return nullptr;
+    const QString name = db.connectionName();
+    for (Conn& c : gThreadConns.localData()->byPath)
+        if (c.name == name) return &c;
+    return nullptr;
+}
+
+} // namespace
+
+QSqlDatabase DbReadPool::connection(const QString& dbPath) {
+    if (dbPath.isEmpty()) return QSqlDatabase();
+    ThreadConns* t = threadConns();
+    const QString key = QFileInfo(dbPath).absoluteFilePath();
+    const auto it = t->byPath.constFind(key);
+    if (it != t->byPath.constEnd()) return QSqlDatabase::database(it->name, false);
+
+    const QString name = QStringLiteral("camvigil_ro_%1").arg(gSerial.fetchAndAddRelaxed(1));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), name);
+        db.setDatabaseName(key);
+        db.setConnectOptions(QStringLiteral("QSQLITE_OPEN_READONLY=1;QSQLITE_BUSY_TIMEOUT=5000"));
+        if (db.open()) {
+            const qint64 mmap  = qint64(envInt("CAMVIGIL_DB_MMAP_MB", 256, 0, 4096)) * 1024 * 1024;
+            const int    cache = envInt("CAMVIGIL_DB_CACHE_MB", 16, 1, 1024) * 1024;
+            QSqlQuery q(db);
+            q.exec(QStringLiteral("PRAGMA query_only=1;"));
+            q.exec(QStringLiteral("PRAGMA mmap_size=%1;").arg(mmap));
+            q.exec(QStringLiteral("PRAGMA cache_size=-%1;").arg(cache));   // KiB
+            q.exec(QStringLiteral("PRAGMA temp_store=MEMORY;"));
+            t->byPath.insert(key, Conn{ name, {} });
+            const int n = gConnections.fetchAndAddRelaxed(1) + 1;
+            qInfo() << "[DbReadPool] opened" << key << "connections=" << n;
+            return db;
+        }
+        qWarning() << "[DbReadPool] open failed for" << key << ":" << db.lastError().text();
+    }
+    // Not cached: the file may not exist yet; the next call tries again.
+    QSqlDatabase::removeDatabase(name);
+    return QSqlDatabase();
+}
+
+DbReadPool::Query::Query(const QSqlQuery& q, QSharedPointer<bool> busy)
+    : QSqlQuery(q), busy_(std::move(busy)) {
+    if (busy_) *busy_ = true;
+}
+
+DbReadPool::Query::~Query() {
+    finish();
+    if (busy_) *busy_ = false;
+}
+
+void DbReadPool::Query::finish() {
+    QSqlQuery::finish();
+    forgetRead(this);
+}
+
+DbReadPool::Query DbReadPool::prepared(const QSqlDatabase& db, const QString& sql) {
+    Conn* c = connFor(db);
+    bool cache = c != nullptr;
+    if (c) {
+        auto it = c->stmts.find(sql);
+        if (it != c->stmts.end()) {
+            if (!*it->busy) {
+                it->q.finish();
+                return Query(it->q, it->busy);
+            }
+            cache = false;   // nested use of the same SQL on this thread
+        }
+    }
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    if (!q.prepare(sql)) {
+        qWarning() << "[DbReadPool] prepare:" << q.lastError().text();
+        return Query(q, {});
+    }
+    if (!cache) return Query(q, {});
+    const Cached& added = *c->stmts.insert(sql, Cached{ q, QSharedPointer<bool>::create(false) });
+    return Query(added.q, added.busy);
+}
+
+bool DbReadPool::exec(Query& q) {
+    QElapsedTimer t; t.start();
+    const bool ok = q.exec();
+    const qint64 us = t.nsecsElapsed() / 1000;
+    if (ok && q.isSelect()) {
+        QThread* th = QThread::currentThread();
+        OpenRead r;
+        r.thread = th->objectName().isEmpty()
+                 ? QStringLiteral("thread 0x%1").arg(quintptr(th), 0, 16) : th->objectName();
+        r.sql = q.lastQuery().simplified().left(80);
+        r.since.start();
+        QMutexLocker lock(&gOpenMutex);
+        gOpenReads.insert(&q, r);
+    } else {
+        forgetRead(&q);
+    }
+
+    const qint64 n = gQueries.fetchAndAddRelaxed(1) + 1;
+    gTotalUs.fetchAndAddRelaxed(us);
+    for (qint64 m = gMaxUs.loadRelaxed(); us > m && !gMaxUs.testAndSetRelaxed(m, us);)
+        m = gMaxUs.loadRelaxed();
+    if (n % 1000 == 0) {
+        const Stats s = stats();
+        qInfo() << "[DbReadPool] queries=" << s.queries << "avg_us=" << s.avgUs
+                << "max_us=" << s.maxUs << "connections=" << s.connections;
+    }
+    return ok;
+}
+
+QStringList DbReadPool::openReads() {
+    QVector<QPair<qint64, QString>> byAge;
+    {
+        QMutexLocker lock(&gOpenMutex);
+        for (const OpenRead& r : qAsConst(gOpenReads)) {
+            const qint64 ms = r.since.elapsed();
+            byAge.append({ ms, QStringLiteral("%1: %2 (%3 s)").arg(r.thread, r.sql).arg(ms / 1000) });
+        }
+    }
+    std::sort(byAge.begin(), byAge.end(),
+              [](const QPair<qint64, QString>& a, const QPair<qint64, QString>& b) { return a.first > b.first; });
+    QStringList out;
+    for (const auto& e : qAsConst(byAge)) out << e.second;
+    return out;
+}
+
+DbReadPool::Stats DbReadPool::stats() {
+    Stats s;
+    s.queries     = gQueries.loadRelaxed();
+    s.avgUs       = s.queries > 0 ? gTotalUs.loadRelaxed() / s.queries : 0;
+    s.maxUs       = gMaxUs.loadRelaxed();
+    s.connections = gConnections.loadRelaxed();
+    return s;
+}
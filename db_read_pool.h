@@ -0,0 +1,73 @@
+#pragma once
+#include <QSharedPointer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+/**
+ * DbReadPool
+ * ----------
+ * Read-only SQLite connections to the archive database, one per thread and
+ * file, shared by every reader on that thread (playback, the archive view,
+ * the node API, group lookups). Connections are opened once and closed when
+ * their thread exits, so readers no longer pay connection setup per call
+ * or queue behind one shared handle; WAL lets them all read beside DbWriter.
+ * - Opened with QSQLITE_OPEN_READONLY plus PRAGMA query_only, mmap_size and
+ *   cache_size, temp_store=MEMORY.
+ * - prepared() keeps each SQL text prepared for the life of the connection
+ *   and hands it out as a Query, which finishes the statement (ending its
+ *   read transaction, so it cannot pin the WAL) when it goes out of scope.
+ * - exec() times the statement; count, average and worst latency are
+ *   logged every 1000 queries and available from stats().
+ * - Executed Queries are listed with their thread and age until finished
+ *   (openReads()), so DbWriter can name the reader pinning the WAL.
+ *
+ * Env:
+ *   CAMVIGIL_DB_MMAP_MB   memory-mapped bytes per connection (default 256)
+ *   CAMVIGIL_DB_CACHE_MB  page cache per connection (default 16)
+ */
+class DbReadPool final {
+public:
+    struct Stats {
+        qint64 queries = 0;
+        qint64 avgUs = 0;
+        qint64 maxUs = 0;
+        int    connections = 0;
+    };
+
+    // A pooled statement for one user at a time. Not copyable: keep it in a
+    // local (DbReadPool::Query q = DbReadPool::prepared(...)), not a QSqlQuery.
+    class Query final : public QSqlQuery {
+    public:
+        ~Query();
+        Query(const Query&) = delete;
+        void finish();
+        Query& operator=(const Query&) = delete;
+
+    private:
+        friend class DbReadPool;
+        Query(const QSqlQuery& q, QSharedPointer<bool> busy);
+        QSharedPointer<bool> busy_;   // the cached statement's in-use flag
+    };
+
+    // This thread's connection to `dbPath`; opened on first use. Check isOpen().
+    static QSqlDatabase connection(const QString& dbPath);
+
+    // Statement prepared once per connection and reset for reuse (bind
+    // every placeholder again). While one Query holds it, the same SQL gets a
+    // fresh uncached statement. Not cached if preparing failed; exec() then
+    // fails with the error.
+    static Query prepared(const QSqlDatabase& db, const QString& sql);
+
+    // q.exec() with latency accounting; a SELECT stays in openReads() until
+    // the Query is finished or destroyed.
+    static bool exec(Query& q);
+
+    // Executed, unfinished Queries on any thread, oldest first:
+    // "<thread>: <SQL head> (<age> s)".
+    static QStringList openReads();
+
+    static Stats stats();
+};
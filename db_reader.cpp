@@ -5,88 +5,60 @@
 #include <QFileInfo>
 #include <QDateTime>
 #include <QtDebug>
+#include "archive_limits.h"
+#include "archive_roots.h"
+#include "archive_segment_index.h"
+#include "db_read_pool.h"
+#include "segment_journal.h"
+#include "segment_queries.h"
+#include "archiveworker.h"   // liveTailClusterMs()
 
 DbReader::DbReader(QObject* parent) : QObject(parent) {
     // Ensure queued connections work for custom types
     qRegisterMetaType<RecentSegment>("RecentSegment");
     qRegisterMetaType<QVector<RecentSegment>>("QVector<RecentSegment>");
+    qRegisterMetaType<GapList>("GapList");
+    qRegisterMetaType<EventList>("EventList");
 }
 
 DbReader::~DbReader() {
-    // ensure clean teardown even if window is closed externally
-    if (db_.isValid()) {
-        if (db_.isOpen()) db_.close();
-        db_ = QSqlDatabase();
-        if (!connName_.isEmpty()) QSqlDatabase::removeDatabase(connName_);
-    }
+    db_ = QSqlDatabase();   // the connection belongs to DbReadPool
 }
 
 void DbReader::shutdown() {
     // Must be invoked on the DB thread (use BlockingQueuedConnection)
     qInfo() << "[DB] shutdown() begin";
-    if (db_.isValid()) {
-        if (db_.isOpen()) db_.close();
-        db_ = QSqlDatabase();
-        if (!connName_.isEmpty()) {
-            QSqlDatabase::removeDatabase(connName_);
-            connName_.clear();
-        }
-    }
+    db_ = QSqlDatabase();
     deleteLater(); // delete object on its own thread
     qInfo() << "[DB] shutdown() end";
 }
 
 void DbReader::openAt(const QString& dbPath) {
-    if (!db_.isValid()) {
-        connName_ = QStringLiteral("playback_ro_%1")
-                        .arg(reinterpret_cast<quintptr>(this));
-        db_ = QSqlDatabase::addDatabase("QSQLITE", connName_);
-    } else if (db_.isOpen()) {
-        db_.close();
-    }
-
-    db_.setDatabaseName(dbPath);
-    db_.setConnectOptions(
-        "QSQLITE_OPEN_READONLY=1;"
-        "QSQLITE_ENABLE_SHARED_CACHE=1;"
-        "QSQLITE_BUSY_TIMEOUT=5000"
-    );
-    const bool ok = db_.open();
-    qInfo() << "[DB] RO open:" << QFileInfo(db_.databaseName()).absoluteFilePath();
-    emit opened(ok, ok ? QString() : db_.lastError().text());
+    db_ = DbReadPool::connection(dbPath);
+    const bool ok = db_.isOpen();
+    qInfo() << "[DB] RO open:" << QFileInfo(dbPath).absoluteFilePath();
+    emit opened(ok, ok ? QString() : QStringLiteral("cannot open %1").arg(dbPath));
 }
 
 void DbReader::listCameras() {
     QVector<QPair<int,QString>> out;
-    QSqlQuery q(db_);
-    q.prepare(R"SQL(
+    DbReadPool::Query q = DbReadPool::prepared(db_, R"SQL(
         SELECT c.id, c.name
         FROM cameras c
-        WHERE EXISTS (
-          SELECT 1 FROM segments s
-          WHERE s.status IN (0,1)
-            AND (s.camera_id=c.id OR s.camera_url=c.main_url)
-        )
+        WHERE EXISTS (SELECT 1 FROM recording_days d WHERE d.camera_id=c.id)
         ORDER BY c.name
     )SQL");
-    if (!q.exec()) { emit error(q.lastError().text()); return; }
+    if (!DbReadPool::exec(q)) { emit error(q.lastError().text()); return; }
     while (q.next()) out.push_back({ q.value(0).toInt(), q.value(1).toString() });
     emit camerasReady(out);
 }
 
 void DbReader::listDays(int cameraId) {
     QStringList days;
-    QSqlQuery q(db_);
-    q.prepare(R"SQL(
-        SELECT DISTINCT strftime('%Y-%m-%d',
-                                 datetime(start_utc_ns/1000000000,'unixepoch','localtime'))
-        FROM segments
-        WHERE status IN (0,1)
-          AND (camera_id=:cid OR camera_url=(SELECT main_url FROM cameras WHERE id=:cid))
-        ORDER BY 1
-    )SQL");
+    // recording_days is maintained by DbWriter: a primary-key range, no segment scan.
+    DbReadPool::Query q = DbReadPool::prepared(db_, "SELECT local_day FROM recording_days WHERE camera_id=:cid ORDER BY local_day;");
     q.bindValue(":cid", cameraId);
-    if (!q.exec()) { emit error(q.lastError().text()); return; }
+    if (!DbReadPool::exec(q)) { emit error(q.lastError().text()); return; }
     while (q.next()) days << q.value(0).toString();
     emit daysReady(cameraId, days);
 }
@@ -100,65 +72,36 @@ void DbReader::listSegments(int cameraId, const QString& ymd) {
     const qint64 end_ns   = d1.toSecsSinceEpoch() * 1000000000LL;
 
     QVector<SegmentInfo> segs;
-    QSqlQuery q(db_);
-    q.setForwardOnly(true);
-
-    // NOTE: no "now()" fallback — open-ended rows collapse to start_utc_ns
-    q.prepare(R"SQL(
-      SELECT path, start_utc_ns, eff_end_ns, duration_ms FROM (
-        -- branch 1: rows with camera_id filled (uses idx_segments_camera_time)
-        SELECT
-          s.file_path AS path,
-          s.start_utc_ns,
-          CASE
-            WHEN s.end_utc_ns IS NOT NULL AND s.end_utc_ns > 0 THEN s.end_utc_ns
-            WHEN COALESCE(s.duration_ms,0) > 0 THEN s.start_utc_ns + s.duration_ms*1000000
-            ELSE s.start_utc_ns
-          END AS eff_end_ns,
-          s.duration_ms
-        FROM segments s
-        WHERE s.status IN (0,1)
-          AND s.camera_id = :cid
-          AND s.start_utc_ns < :end_ns
-          AND (
-                CASE
-                  WHEN s.end_utc_ns IS NOT NULL AND s.end_utc_ns > 0 THEN s.end_utc_ns
-                  WHEN COALESCE(s.duration_ms,0) > 0 THEN s.start_utc_ns + s.duration_ms*1000000
-                  ELSE s.start_utc_ns
-                END
-              ) > :start_ns
-
-        UNION ALL
-
-        -- branch 2: legacy rows matched by URL
-        SELECT
-          s.file_path AS path,
-          s.start_utc_ns,
-          CASE
-            WHEN s.end_utc_ns IS NOT NULL AND s.end_utc_ns > 0 THEN s.end_utc_ns
-            WHEN COALESCE(s.duration_ms,0) > 0 THEN s.start_utc_ns + s.duration_ms*1000000
-            ELSE s.start_utc_ns
-          END AS eff_end_ns,
-          s.duration_ms
-        FROM segments s
-        WHERE s.status IN (0,1)
-          AND s.camera_id IS NULL
-          AND s.camera_url = (SELECT main_url FROM cameras WHERE id=:cid)
-          AND s.start_utc_ns < :end_ns
-          AND (
-                CASE
-                  WHEN s.end_utc_ns IS NOT NULL AND s.end_utc_ns > 0 THEN s.end_utc_ns
-                  WHEN COALESCE(s.duration_ms,0) > 0 THEN s.start_utc_ns + s.duration_ms*1000000
-                  ELSE s.start_utc_ns
-                END
-              ) > :start_ns
-      )
-      ORDER BY start_utc_ns
-    )SQL");
+    const qint64 live_ns = (QDateTime::currentMSecsSinceEpoch()
+                            - 2LL * ArchiveWorker::liveTailClusterMs()) * 1000000LL;
+
+    // Recent days come from the recorder's in-memory index, older ones from
+    // the segment journal; same rules as below.
+    QVector<IndexedSegment> hits;
+    if (ArchiveSegmentIndex::query(db_.databaseName(), cameraId, start_ns, end_ns, hits)
+        || SegmentJournal::query(db_.databaseName(), cameraId, start_ns, end_ns, hits)) {
+        segs.reserve(hits.size());
+        for (const IndexedSegment& h : hits) {
+            SegmentInfo s;
+            s.path        = ArchiveRoots::resolve(h.path);
+            s.start_ns    = h.startNs;
+            s.end_ns      = h.shownEndNs(live_ns);
+            s.duration_ms = h.durationMs;
+            s.open        = h.open;
+            s.codec       = h.codec;
+            segs.push_back(s);
+        }
+        emit segmentsReady(cameraId, segs);
+        return;
+    }
+
+    DbReadPool::Query q = DbReadPool::prepared(db_, SegmentQueries::kTimelineMain);
 
     q.bindValue(":cid", cameraId);
     q.bindValue(":start_ns", start_ns);
     q.bindValue(":end_ns", end_ns);
+    q.bindValue(":lo_ns", start_ns - ArchiveLimits::kMaxSpanNs);
+    q.bindValue(":live_ns", live_ns);
 
     qInfo() << "[SQL] listSegments cid=" << cameraId
             << " day=" << ymd
@@ -166,25 +109,121 @@ void DbReader::listSegments(int cameraId, const QString& ymd) {
             << " start_local=" << d0.toString(Qt::ISODate)
             << " end_local="   << d1.toString(Qt::ISODate);
 
-    if (!q.exec()) { emit error(q.lastError().text()); return; }
+    if (!DbReadPool::exec(q)) { emit error(q.lastError().text()); return; }
 
     while (q.next()) {
         SegmentInfo s;
-        s.path        = q.value(0).toString();
+        s.path        = ArchiveRoots::resolve(q.value(0).toString());
         s.start_ns    = q.value(1).toLongLong();
         s.end_ns      = q.value(2).toLongLong();
         s.duration_ms = q.value(3).toLongLong();
+        s.open        = q.value(4).toInt() == 0;
+        s.codec       = q.value(5).toString();
         segs.push_back(s);
     }
     emit segmentsReady(cameraId, segs);
 }
+// Finalized scrub-track (sub-stream) files overlapping the day. Open files are
+// left out: without cues they seek too slowly to be worth scrubbing.
+void DbReader::listSubSegments(int cameraId, const QString& ymd) {
+    const QDate d = QDate::fromString(ymd, "yyyy-MM-dd");
+    const QDateTime d0(d, QTime(0,0,0), Qt::LocalTime);
+    const qint64 start_ns = d0.toSecsSinceEpoch() * 1000000000LL;
+    const qint64 end_ns   = d0.addDays(1).toSecsSinceEpoch() * 1000000000LL;
+
+    SegmentList segs;
+    DbReadPool::Query q = DbReadPool::prepared(db_, SegmentQueries::kTimelineSub);
+    q.bindValue(":cid", cameraId);
+    q.bindValue(":start_ns", start_ns);
+    q.bindValue(":end_ns", end_ns);
+    q.bindValue(":lo_ns", start_ns - ArchiveLimits::kMaxSpanNs);
+    // Databases that never recorded a sub-stream may lack the table: no scrub track.
+    if (DbReadPool::exec(q)) {
+        while (q.next()) {
+            SegmentInfo s;
+            s.path        = ArchiveRoots::resolve(q.value(0).toString());
+            s.start_ns    = q.value(1).toLongLong();
+            s.end_ns      = q.value(2).toLongLong();
+            s.duration_ms = q.value(3).toLongLong();
+            s.codec       = q.value(4).toString();
+            segs.push_back(s);
+        }
+    }
+    emit subSegmentsReady(cameraId, segs);
+}
+
+void DbReader::listGaps(int cameraId, const QString& ymd) {
+    const QDate d = QDate::fromString(ymd, "yyyy-MM-dd");
+    const QDateTime d0(d, QTime(0,0,0), Qt::LocalTime);
+    const qint64 start_ns = d0.toSecsSinceEpoch() * 1000000000LL;
+    const qint64 end_ns   = d0.addDays(1).toSecsSinceEpoch() * 1000000000LL;
+    const qint64 now_ns   = QDateTime::currentMSecsSinceEpoch() * 1000000LL;
+
+    GapList gaps;
+    DbReadPool::Query q = DbReadPool::prepared(db_, R"SQL(
+      SELECT g.start_utc_ns, COALESCE(g.end_utc_ns, :now_ns), g.end_utc_ns IS NULL,
+             g.reason, COALESCE(g.detail,'')
+      FROM gaps g
+      WHERE g.camera_id = :cid
+        AND g.start_utc_ns < :end_ns
+        AND COALESCE(g.end_utc_ns, :now_ns) > :start_ns
+      ORDER BY g.start_utc_ns
+    )SQL");
+    q.bindValue(":cid", cameraId);
+    q.bindValue(":start_ns", start_ns);
+    q.bindValue(":end_ns", end_ns);
+    q.bindValue(":now_ns", now_ns);
+    if (!DbReadPool::exec(q)) { emit error(q.lastError().text()); return; }
+
+    while (q.next()) {
+        GapInfo g;
+        g.start_ns = q.value(0).toLongLong();
+        g.end_ns   = q.value(1).toLongLong();
+        g.open     = q.value(2).toBool();
+        g.reason   = q.value(3).toString();
+        g.detail   = q.value(4).toString();
+        gaps.push_back(g);
+    }
+    emit gapsReady(cameraId, gaps);
+}
+
+void DbReader::listEvents(int cameraId, const QString& ymd) {
+    const QDate d = QDate::fromString(ymd, "yyyy-MM-dd");
+    const QDateTime d0(d, QTime(0,0,0), Qt::LocalTime);
+    const qint64 start_ns = d0.toSecsSinceEpoch() * 1000000000LL;
+    const qint64 end_ns   = d0.addDays(1).toSecsSinceEpoch() * 1000000000LL;
+
+    EventList events;
+    DbReadPool::Query q = DbReadPool::prepared(db_, R"SQL(
+      SELECT e.t_ns, e.type, COALESCE(e.source,''), COALESCE(e.detail,'')
+      FROM events e
+      WHERE e.camera_id = :cid
+        AND e.bucket >= :b0 AND e.bucket <= :b1
+        AND e.t_ns >= :start_ns AND e.t_ns < :end_ns
+      ORDER BY e.t_ns
+    )SQL");
+    q.bindValue(":cid", cameraId);
+    q.bindValue(":b0", start_ns / ArchiveLimits::kEventBucketNs);
+    q.bindValue(":b1", (end_ns - 1) / ArchiveLimits::kEventBucketNs);
+    q.bindValue(":start_ns", start_ns);
+    q.bindValue(":end_ns", end_ns);
+    if (!DbReadPool::exec(q)) { emit error(q.lastError().text()); return; }
+
+    while (q.next()) {
+        EventInfo e;
+        e.t_ns   = q.value(0).toLongLong();
+        e.type   = q.value(1).toString();
+        e.source = q.value(2).toString();
+        e.detail = q.value(3).toString();
+        events.push_back(e);
+    }
+    emit eventsReady(cameraId, events);
+}
+
 void DbReader::listRecentSegments(int limit) {
     QVector<RecentSegment> out;
-    QSqlQuery q(db_);
-    q.setForwardOnly(true);
-
     // Use end_utc_ns if set, else derive from duration_ms, else fall back to start_utc_ns
-    q.prepare(R"SQL(
+    DbReadPool::Query q = DbReadPool::prepared(db_, R"SQL(
       SELECT s.file_path,
              COALESCE(c.name, s.camera_url) AS camera_name,
              s.start_utc_ns,
@@ -202,11 +241,11 @@ void DbReader::listRecentSegments(int limit) {
     )SQL");
     q.bindValue(":lim", limit);
 
-    if (!q.exec()) { emit error(q.lastError().text()); return; }
+    if (!DbReadPool::exec(q)) { emit error(q.lastError().text()); return; }
 
     while (q.next()) {
         RecentSegment r;
-        r.path        = q.value(0).toString();
+        r.path        = ArchiveRoots::resolve(q.value(0).toString());
         r.camera_name = q.value(1).toString();
         r.start_ns    = q.value(2).toLongLong();
         r.end_ns      = q.value(3).toLongLong();
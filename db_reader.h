@@ -1,6 +1,7 @@
 #pragma once
 #include <QObject>
 #include <QSqlDatabase>
+#include <QByteArray>
 #include <QVector>
 #include <QPair>
 #include <QStringList>
@@ -11,6 +12,8 @@ struct SegmentInfo {
     qint64  start_ns;
     qint64  end_ns;
     qint64  duration_ms;
+    bool    open = false;   // status=0: still being written, end_ns is the live edge
+    QString codec;          // "h264" / "h265"
 };
 Q_DECLARE_METATYPE(SegmentInfo)
 using CamList     = QVector<QPair<int, QString>>;
@@ -25,6 +28,27 @@ struct RecentSegment {
     qint64  duration_ms;  // may be 0 if open-ended
 };
 Q_DECLARE_METATYPE(RecentSegment)
+// Journaled recording gap (gaps table). Open gaps end at the query time.
+struct GapInfo {
+    qint64  start_ns = 0;
+    qint64  end_ns   = 0;
+    bool    open     = false;  // camera still not recording
+    QString reason;            // camera_offline / disk_full / pipeline_error / recorder_stopped / recorder_down / schedule_off / schedule_event_only
+    QString detail;
+};
+using GapList = QVector<GapInfo>;
+Q_DECLARE_METATYPE(GapInfo)
+Q_DECLARE_METATYPE(GapList)
+// Logged event (events table): pipeline errors, reconnects, disk and camera alarms.
+struct EventInfo {
+    qint64  t_ns = 0;
+    QString type;              // pipeline_error / recording_interrupted / disk_alarm / alarm / error
+    QString source;            // component or trigger reason
+    QString detail;
+};
+using EventList = QVector<EventInfo>;
+Q_DECLARE_METATYPE(EventInfo)
+Q_DECLARE_METATYPE(EventList)
 class DbReader : public QObject {
     Q_OBJECT
 public:
@@ -38,6 +62,9 @@ public slots:
     void listSegments(int cameraId, const QString& ymd);// segments overlapping that day
     void shutdown();
     void listRecentSegments(int limit = 500);
+    void listGaps(int cameraId, const QString& ymd);    // journaled gaps overlapping that day
+    void listSubSegments(int cameraId, const QString& ymd); // scrub-track files overlapping that day
+    void listEvents(int cameraId, const QString& ymd);  // logged events of that day
 signals:
     void opened(bool ok, QString err);
     void camerasReady(CamList cams);
@@ -45,7 +72,9 @@ signals:
     void segmentsReady(int cameraId, SegmentList segs);
     void error(QString err);
     void recentSegmentsReady(QVector<RecentSegment> segs);
+    void gapsReady(int cameraId, GapList gaps);
+    void subSegmentsReady(int cameraId, SegmentList segs);
+    void eventsReady(int cameraId, EventList events);
 private:
-    QSqlDatabase db_;
-    QString      connName_; // for QSqlDatabase::removeDatabase
+    QSqlDatabase db_;       // this thread's DbReadPool connection
 };
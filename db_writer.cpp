@@ -5,10 +5,33 @@
 #include <QVariant>
 #include <QFileInfo>
 #include <QDir>
+#include <QDateTime>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QTimer>
 #include <QDebug>
+#include <algorithm>
+#include <functional>
+#include "archive_limits.h"
+#include "archive_roots.h"
+#include "archive_segment_index.h"
+#include "db_read_pool.h"
+#include "recording_coverage.h"
+#include "segment_journal.h"
+
+static int envInt(const char* name, int def, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return ok ? qBound(lo, v, hi) : def;
+}
+
+static const qint64 kDayNs = 24LL * 3600 * 1000000000LL;   // segment journal day files are UTC days
 
 DbWriter::DbWriter(QObject* parent) : QObject(parent) {}
 DbWriter::~DbWriter() {
+    flushPending_();
+    if (db_.isOpen()) SegmentJournal::close(segmentsSeq_());
+    stmts_.clear();   // prepared statements go before their connection
     if (db_.isOpen()) db_.close();
 }
 
@@ -21,8 +44,41 @@ bool DbWriter::openAt(const QString& dbFile) {
         exec("PRAGMA journal_mode=WAL;");
         exec("PRAGMA synchronous=NORMAL;");
         exec("PRAGMA foreign_keys=ON;");
+        walLimit_ = qint64(envInt("CAMVIGIL_WAL_CHECKPOINT_MB", 16, 1, 4096)) * 1024 * 1024;
+        exec("PRAGMA wal_autocheckpoint=0;");   // checkpointTick_ does it
+        exec(QStringLiteral("PRAGMA journal_size_limit=%1;").arg(walLimit_));
         if (!ensureSchema()) return false;
-        return migrateSchema_();
+        if (!migrateSchema_()) return false;
+        const qint64 journalStamp = SegmentJournal::open(dbFile);
+        const int restored = SegmentJournal::enabled() ? restoreFromJournal_() : 0;
+        ArchiveSegmentIndex::load(db_);
+
+        bool ok = false;
+        const int batchMs = qEnvironmentVariable("CAMVIGIL_DB_BATCH_MS").toInt(&ok);
+        batchTimer_ = new QTimer(this);   // openAt runs on the DB thread
+        batchTimer_->setSingleShot(true);
+        batchMs_ = ok && batchMs >= 0 ? qMin(batchMs, 5000) : 200;
+        batchTimer_->setInterval(batchMs_);
+        connect(batchTimer_, &QTimer::timeout, this, &DbWriter::flushPending_);
+
+        walPath_ = dbFile + QStringLiteral("-wal");
+        checkpointTimer_ = new QTimer(this);
+        checkpointTimer_->setInterval(envInt("CAMVIGIL_WAL_CHECK_MS", 1000, 100, 60000));
+        connect(checkpointTimer_, &QTimer::timeout, this, &DbWriter::checkpointTick_);
+        checkpointTimer_->start();
+
+        partitionTimer_ = new QTimer(this);
+        partitionTimer_->setInterval(60 * 60 * 1000);
+        connect(partitionTimer_, &QTimer::timeout, this, &DbWriter::rollPartitions_);
+        partitionTimer_->start();
+        QTimer::singleShot(0, this, &DbWriter::rollPartitions_);
+
+        // The journal matches only if the last run closed it at this sequence.
+        if (SegmentJournal::enabled() && restored >= 0) {
+            if (restored == 0 && journalStamp >= 0 && journalStamp == segmentsSeq_()) SegmentJournal::setReady(true);
+            else startJournalRebuild_();
+        }
+        return true;
 }
 
 bool DbWriter::exec(const QString& sql) {
@@ -47,14 +103,66 @@ bool DbWriter::ensureSchema() {
              " session_id TEXT, camera_id INTEGER, camera_url TEXT,"
              " file_path TEXT UNIQUE, start_utc_ns INTEGER, end_utc_ns INTEGER,"
              " duration_ms INTEGER, size_bytes INTEGER, status INTEGER DEFAULT 0,"
-             " pinned INTEGER DEFAULT 0,"
+             " pinned INTEGER DEFAULT 0, codec TEXT DEFAULT 'h264', tier INTEGER DEFAULT 0,"
+             " eff_end_ns INTEGER,"
              " FOREIGN KEY(session_id) REFERENCES sessions(id) ON DELETE CASCADE,"
              " FOREIGN KEY(camera_id) REFERENCES cameras(id) ON DELETE SET NULL );") &&
-        exec("CREATE INDEX IF NOT EXISTS idx_segments_camera_time ON segments(camera_id,start_utc_ns);") &&
         exec("CREATE INDEX IF NOT EXISTS idx_segments_path ON segments(file_path);") &&
         exec("CREATE INDEX IF NOT EXISTS idx_segments_camera_url_time ON segments(camera_url, start_utc_ns);") &&
         exec("CREATE INDEX IF NOT EXISTS idx_segments_start_desc ON segments(start_utc_ns DESC);") &&
-        exec("CREATE INDEX IF NOT EXISTS idx_segments_status_time ON segments(status, start_utc_ns);");
+        exec("CREATE INDEX IF NOT EXISTS idx_segments_status_time ON segments(status, start_utc_ns);") &&
+        exec("CREATE TABLE IF NOT EXISTS retention_policies ("
+             " scope TEXT NOT NULL CHECK(scope IN ('camera','group')), scope_id INTEGER NOT NULL,"
+             " max_bytes INTEGER DEFAULT 0, min_days INTEGER DEFAULT 0,"
+             " PRIMARY KEY(scope, scope_id) );") &&
+        exec("CREATE TABLE IF NOT EXISTS recording_schedules ("
+             " scope TEXT NOT NULL CHECK(scope IN ('camera','group')), scope_id INTEGER NOT NULL,"
+             " spec TEXT NOT NULL, off_mode TEXT NOT NULL DEFAULT 'stop' CHECK(off_mode IN ('stop','event')),"
+             " PRIMARY KEY(scope, scope_id) );") &&
+        // Recording gaps journaled by the recorder; end_utc_ns NULL while still open.
+        exec("CREATE TABLE IF NOT EXISTS gaps ("
+             " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+             " camera_id INTEGER, camera_url TEXT,"
+             " start_utc_ns INTEGER NOT NULL, end_utc_ns INTEGER,"
+             " reason TEXT NOT NULL, detail TEXT );") &&
+        exec("CREATE INDEX IF NOT EXISTS idx_gaps_camera_time ON gaps(camera_id, start_utc_ns);") &&
+        exec("CREATE INDEX IF NOT EXISTS idx_gaps_open ON gaps(camera_url) WHERE end_utc_ns IS NULL;") &&
+        // Sub-stream (scrub track) recordings; kept apart from segments so the
+        // main-stream queries, quotas and playback index are unaffected.
+        exec("CREATE TABLE IF NOT EXISTS sub_segments ("
+             " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+             " camera_id INTEGER, camera_url TEXT,"
+             " file_path TEXT UNIQUE, start_utc_ns INTEGER, end_utc_ns INTEGER,"
+             " duration_ms INTEGER, size_bytes INTEGER, status INTEGER DEFAULT 0,"
+             " codec TEXT DEFAULT 'h264', eff_end_ns INTEGER );") &&
+        exec("CREATE INDEX IF NOT EXISTS idx_sub_segments_url_time ON sub_segments(camera_url, start_utc_ns);") &&
+        // Per camera and local calendar day: what the segments of that day add
+        // up to. Kept current by DbWriter so day pickers and usage totals
+        // never scan segments.
+        exec("CREATE TABLE IF NOT EXISTS recording_days ("
+             " camera_id INTEGER NOT NULL, local_day TEXT NOT NULL,"
+             " first_ns INTEGER, last_ns INTEGER,"
+             " covered_ms INTEGER DEFAULT 0, bytes INTEGER DEFAULT 0,"
+             " coverage BLOB,"
+             " PRIMARY KEY(camera_id, local_day) );") &&
+        // Month tables finalized segments move to once they leave the hot
+        // window; [from_ns, to_ns) is the local month.
+        exec("CREATE TABLE IF NOT EXISTS segment_partitions ("
+             " name TEXT PRIMARY KEY, from_ns INTEGER NOT NULL, to_ns INTEGER NOT NULL );") &&
+        // Logged events (addEvent). Append-only: rowid order is arrival order.
+        // bucket = t_ns / ArchiveLimits::kEventBucketNs leads both indexes, so
+        // inserts land at the end of each camera's range and time queries and
+        // retention are bucket ranges. camera_id 0 = site-wide.
+        exec("CREATE TABLE IF NOT EXISTS events ("
+             " id INTEGER PRIMARY KEY, camera_id INTEGER NOT NULL DEFAULT 0,"
+             " t_ns INTEGER NOT NULL, bucket INTEGER NOT NULL,"
+             " type TEXT NOT NULL, source TEXT, detail TEXT );") &&
+        exec("CREATE INDEX IF NOT EXISTS idx_events_camera_bucket ON events(camera_id, bucket, type);") &&
+        exec("CREATE INDEX IF NOT EXISTS idx_events_bucket_type ON events(bucket, type);") &&
+        // Files whose rows are gone (compacted pieces) but which an open
+        // playback playlist may still reference; unlinked after a delay.
+        exec("CREATE TABLE IF NOT EXISTS retired_files ("
+             " path TEXT PRIMARY KEY, retired_ns INTEGER NOT NULL );");
 }
 
 
@@ -66,6 +174,8 @@ void DbWriter::ensureCamera(const QString& mainUrl, const QString& subUrl, const
     q.addBindValue(mainUrl);
     q.addBindValue(subUrl);
     if (!q.exec()) qWarning() << "[DB] ensureCamera:" << q.lastError().text();
+    camIds_.remove(mainUrl);
+    SegmentJournal::setCameraUrl(cameraId_(mainUrl), mainUrl);
 }
 
 void DbWriter::beginSession(const QString& sessionId, const QString& archiveDir, int segmentSec) {
@@ -76,45 +186,748 @@ void DbWriter::beginSession(const QString& sessionId, const QString& archiveDir,
     q.addBindValue(archiveDir);
     q.addBindValue(segmentSec);
     if (!q.exec()) qWarning() << "[DB] beginSession:" << q.lastError().text();
+    sessionSpanNs_.insert(sessionId, 2LL * qMax(1, segmentSec) * 1000000000LL);
 }
 
-static int cameraIdForUrl(QSqlDatabase& db, const QString& url) {
-    QSqlQuery q(db);
-    q.prepare("SELECT id FROM cameras WHERE main_url=?;");
+// ---------- Batched recorder events ----------
+
+// Prepared once per connection; keyed by the SQL literal's address.
+QSqlQuery& DbWriter::stmt_(const char* sql) {
+    auto it = stmts_.find(sql);
+    if (it == stmts_.end()) {
+        it = stmts_.insert(sql, QSqlQuery(db_));
+        if (!it->prepare(QString::fromLatin1(sql)))
+            qWarning() << "[DB] prepare:" << it->lastError().text() << " sql:" << sql;
+    }
+    return *it;
+}
+
+int DbWriter::cameraId_(const QString& url) {
+    const auto it = camIds_.constFind(url);
+    if (it != camIds_.constEnd()) return *it;
+    QSqlQuery& q = stmt_("SELECT id FROM cameras WHERE main_url=?;");
     q.addBindValue(url);
-    if (q.exec() && q.next()) return q.value(0).toInt();
-    return 0;
+    int id = 0;
+    if (q.exec() && q.next()) id = q.value(0).toInt();
+    q.finish();
+    if (id > 0) camIds_.insert(url, id);
+    return id;
+}
+
+// How far an open row may extend (its eff_end_ns): twice the session's
+// segment length, so a row orphaned by a crash cannot claim the rest of the day.
+qint64 DbWriter::openSpanNs_(const QString& sessionId) const {
+    static const qint64 kDefaultNs = 2 * 300 * 1000000000LL;
+    if (sessionId.isEmpty()) {
+        qint64 widest = 0;
+        for (qint64 ns : sessionSpanNs_) widest = qMax(widest, ns);
+        return widest > 0 ? widest : kDefaultNs;
+    }
+    return sessionSpanNs_.value(sessionId, kDefaultNs);
+}
+
+// ---------- recording_days ----------
+
+// Local calendar day of a UTC timestamp, as listDays reports it.
+static QString localDay(qint64 utcNs) {
+    return QDateTime::fromMSecsSinceEpoch(utcNs / 1000000LL).toString(QStringLiteral("yyyy-MM-dd"));
+}
+
+// Camera, start and end of the given segment rows; read before deleting them.
+QVector<DbWriter::RowKey> DbWriter::rowKeys_(const QVector<qint64>& segmentIds) {
+    QVector<RowKey> keys;
+    QSqlQuery& q = stmt_("SELECT COALESCE(camera_id,0), start_utc_ns, COALESCE(eff_end_ns, start_utc_ns)"
+                         " FROM segments_all WHERE id=?;");
+    for (qint64 id : segmentIds) {
+        q.addBindValue(id);
+        if (q.exec() && q.next())
+            keys.push_back({ id, q.value(0).toInt(), q.value(1).toLongLong(), q.value(2).toLongLong() });
+        q.finish();
+    }
+    return keys;
+}
+
+// (camera id, local day) of every day the given rows touch, so a segment
+// running past midnight also refreshes the next day's coverage.
+QSet<QPair<int, QString>> DbWriter::dayKeys_(const QVector<RowKey>& rows) {
+    QSet<QPair<int, QString>> keys;
+    for (const RowKey& r : rows) {
+        const qint64 lastNs = qBound(r.startNs, r.endNs - 1, r.startNs + ArchiveLimits::kMaxSpanNs);
+        const QDate last = QDateTime::fromMSecsSinceEpoch(lastNs / 1000000LL).date();
+        for (QDate d = QDateTime::fromMSecsSinceEpoch(r.startNs / 1000000LL).date(); d <= last; d = d.addDays(1))
+            keys.insert({ r.cameraId, d.toString(QStringLiteral("yyyy-MM-dd")) });
+    }
+    return keys;
+}
+
+// Recomputes the given days from their segments (an index range per day),
+// including the minute coverage bitmap (RecordingCoverage).
+void DbWriter::refreshDays_(const QSet<QPair<int, QString>>& keys) {
+    for (const auto& key : keys) {
+        const QDateTime d0(QDate::fromString(key.second, QStringLiteral("yyyy-MM-dd")), QTime(0, 0), Qt::LocalTime);
+        QSqlQuery& del = stmt_("DELETE FROM recording_days WHERE camera_id=? AND local_day=?;");
+        del.addBindValue(key.first);
+        del.addBindValue(key.second);
+        if (!del.exec()) { qWarning() << "[DB] recording_days:" << del.lastError().text(); continue; }
+
+        QSqlQuery& ins = stmt_(
+            "INSERT INTO recording_days(camera_id, local_day, first_ns, last_ns, covered_ms, bytes)"
+            " SELECT :cid, :day, MIN(start_utc_ns), MAX(CASE WHEN status=1 THEN eff_end_ns ELSE start_utc_ns END),"
+            "        SUM(COALESCE(duration_ms,0)), SUM(COALESCE(size_bytes,0))"
+            " FROM segments_all"
+            " WHERE camera_id=:cid AND start_utc_ns >= :d0 AND start_utc_ns < :d1"
+            "   AND status IN (0,1)"
+            " HAVING COUNT(*) > 0;");
+        ins.bindValue(":cid", key.first);
+        ins.bindValue(":day", key.second);
+        ins.bindValue(":d0", d0.toMSecsSinceEpoch() * 1000000LL);
+        ins.bindValue(":d1", d0.addDays(1).toMSecsSinceEpoch() * 1000000LL);
+        if (!ins.exec()) { qWarning() << "[DB] recording_days:" << ins.lastError().text(); continue; }
+        if (ins.numRowsAffected() <= 0) { coverageOut_.insert(key, QByteArray()); continue; }
+
+        // Finalized rows overlapping the day, including one running over midnight.
+        const qint64 d0ns = d0.toMSecsSinceEpoch() * 1000000LL;
+        const qint64 d1ns = d0.addDays(1).toMSecsSinceEpoch() * 1000000LL;
+        QSqlQuery& sel = stmt_("SELECT start_utc_ns, eff_end_ns FROM segments_all"
+                               " WHERE camera_id=? AND start_utc_ns >= ? AND start_utc_ns < ?"
+                               "   AND eff_end_ns > ? AND status=1;");
+        sel.addBindValue(key.first);
+        sel.addBindValue(d0ns - ArchiveLimits::kMaxSpanNs);
+        sel.addBindValue(d1ns);
+        sel.addBindValue(d0ns);
+        QVector<QPair<qint64, qint64>> spans;
+        if (sel.exec()) while (sel.next()) spans.push_back({ sel.value(0).toLongLong(), sel.value(1).toLongLong() });
+        sel.finish();
+        const QByteArray bits = RecordingCoverage::build(d0ns, d1ns, spans);
+
+        QSqlQuery& cov = stmt_("UPDATE recording_days SET coverage=? WHERE camera_id=? AND local_day=?;");
+        cov.addBindValue(bits);
+        cov.addBindValue(key.first);
+        cov.addBindValue(key.second);
+        if (!cov.exec()) { qWarning() << "[DB] recording_days coverage:" << cov.lastError().text(); continue; }
+        coverageOut_.insert(key, bits);
+    }
+}
+
+// After a commit: readers' coverage cache gets the days refreshDays_ rebuilt.
+void DbWriter::publishCoverage_() {
+    const QString dbFile = db_.databaseName();
+    for (auto it = coverageOut_.cbegin(); it != coverageOut_.cend(); ++it)
+        RecordingCoverage::publish(dbFile, it.key().first, it.key().second, it.value());
+    coverageOut_.clear();
+}
+
+// ---------- ArchiveSegmentIndex / SegmentJournal ----------
+
+// Publishes the committed state of the given rows to the in-memory index
+// and appends it to the segment journal.
+void DbWriter::reindex_(const QVector<qint64>& segmentIds) {
+    const bool index = ArchiveSegmentIndex::enabled(), journal = SegmentJournal::enabled();
+    if (!index && !journal) return;
+    QHash<int, QVector<IndexedSegment>> journaled;
+    QSqlQuery& q = stmt_("SELECT camera_id, start_utc_ns, eff_end_ns, COALESCE(duration_ms,0),"
+                         "       COALESCE(size_bytes,0), file_path, COALESCE(codec,'h264'), status, COALESCE(tier,0)"
+                         " FROM segments_all WHERE id=? AND status IN (0,1);");
+    for (qint64 id : segmentIds) {
+        q.addBindValue(id);
+        if (q.exec() && q.next()) {
+            IndexedSegment seg;
+            seg.id         = id;
+            seg.startNs    = q.value(1).toLongLong();
+            seg.effEndNs   = q.value(2).toLongLong();
+            seg.durationMs = q.value(3).toLongLong();
+            seg.sizeBytes  = q.value(4).toLongLong();
+            seg.path       = q.value(5).toString();
+            seg.codec      = q.value(6).toString();
+            seg.open       = q.value(7).toInt() == 0;
+            seg.tier       = q.value(8).toInt();
+            if (index) ArchiveSegmentIndex::upsert(q.value(0).toInt(), seg);
+            if (journal) journaled[q.value(0).toInt()].push_back(seg);
+        }
+        q.finish();
+    }
+    for (auto it = journaled.cbegin(); it != journaled.cend(); ++it)
+        SegmentJournal::append(it.key(), it.value());
+}
+
+void DbWriter::unindex_(const QVector<RowKey>& rows) {
+    QHash<int, QVector<QPair<qint64, qint64>>> journaled;
+    for (const RowKey& r : rows) {
+        ArchiveSegmentIndex::remove(r.cameraId, r.startNs, r.id);
+        journaled[r.cameraId].push_back({ r.startNs, r.id });
+    }
+    for (auto it = journaled.cbegin(); it != journaled.cend(); ++it)
+        SegmentJournal::remove(it.key(), it.value());
+}
+
+// AUTOINCREMENT high-water mark of segments: the journal's consistency stamp.
+// It never goes back, so an older database copy under the same name shows.
+qint64 DbWriter::segmentsSeq_() {
+    QSqlQuery& q = stmt_("SELECT COALESCE((SELECT seq FROM sqlite_sequence WHERE name='segments'),0);");
+    const qint64 seq = q.exec() && q.next() ? q.value(0).toLongLong() : -2;
+    q.finish();
+    return seq;
+}
+
+// A new or emptied database gets the journal's finalized rows back, those
+// whose files are still there, with their ids. 1: it ran and the journal
+// must be rebuilt, 0: nothing to restore, -1: failed, journal left as is.
+int DbWriter::restoreFromJournal_() {
+    QSqlQuery& chk = stmt_("SELECT EXISTS(SELECT 1 FROM segments_all);");
+    const bool empty = chk.exec() && chk.next() && chk.value(0).toInt() == 0;
+    chk.finish();
+    if (!empty) return 0;
+    const QVector<SegmentJournal::CameraRows> cams = SegmentJournal::readAll();
+    if (cams.isEmpty()) return 0;
+
+    QElapsedTimer t; t.start();
+    if (!db_.transaction()) { qWarning() << "[DB] restoreFromJournal: begin failed"; return -1; }
+    QSqlQuery cam(db_);
+    cam.prepare("INSERT OR IGNORE INTO cameras(main_url) VALUES(?);");
+    QSqlQuery ins(db_);
+    ins.prepare("INSERT OR IGNORE INTO segments(id, camera_id, camera_url, file_path, start_utc_ns,"
+                " end_utc_ns, duration_ms, size_bytes, status, codec, tier, eff_end_ns)"
+                " VALUES(?,?,?,?,?,?,?,?,1,?,?,?);");
+    QVector<RowKey> rows;
+    int missing = 0;
+    for (const SegmentJournal::CameraRows& c : cams) {
+        cam.addBindValue(c.url);
+        cam.exec();
+        const int cid = cameraId_(c.url);
+        if (cid <= 0) continue;
+        for (const IndexedSegment& s : c.rows) {
+            if (s.open) continue;   // nothing left to tell how far it got
+            if (!QFileInfo::exists(ArchiveRoots::resolve(s.path))) { ++missing; continue; }
+            ins.addBindValue(s.id);
+            ins.addBindValue(cid);
+            ins.addBindValue(c.url);
+            ins.addBindValue(s.path);
+            ins.addBindValue(s.startNs);
+            ins.addBindValue(s.effEndNs);
+            ins.addBindValue(s.durationMs);
+            ins.addBindValue(s.sizeBytes);
+            ins.addBindValue(s.codec);
+            ins.addBindValue(s.tier);
+            ins.addBindValue(s.effEndNs);
+            if (ins.exec() && ins.numRowsAffected() > 0) rows.push_back({ s.id, cid, s.startNs, s.effEndNs });
+        }
+    }
+    refreshDays_(dayKeys_(rows));
+    if (!db_.commit()) {
+        qWarning() << "[DB] restoreFromJournal: commit failed" << db_.lastError().text();
+        db_.rollback();
+        camIds_.clear();
+        coverageOut_.clear();
+        return -1;
+    }
+    publishCoverage_();
+    qInfo() << "[DB] restored" << rows.size() << "segment rows from the segment journal in"
+            << t.elapsed() << "ms;" << missing << "skipped, file missing";
+    return 1;
+}
+
+// Replaces the journal with segments_all: every UTC day a recording_days
+// row touches, one per event-loop turn (rebuildJournal_). query() falls
+// back to SQLite until the last day is written.
+void DbWriter::startJournalRebuild_() {
+    SegmentJournal::setReady(false);
+    SegmentJournal::clear();
+    QSqlQuery c(db_);
+    if (c.exec("SELECT id, main_url FROM cameras;"))
+        while (c.next()) SegmentJournal::setCameraUrl(c.value(0).toInt(), c.value(1).toString());
+
+    QSet<qint64> keys;
+    keys.insert(QDateTime::currentMSecsSinceEpoch() * 1000000LL / kDayNs);   // open rows
+    QSqlQuery d(db_);
+    if (d.exec("SELECT DISTINCT local_day FROM recording_days;")) {
+        while (d.next()) {
+            const QDateTime d0(QDate::fromString(d.value(0).toString(), QStringLiteral("yyyy-MM-dd")),
+                               QTime(0, 0), Qt::LocalTime);
+            keys.insert(d0.toMSecsSinceEpoch() * 1000000LL / kDayNs);
+            keys.insert((d0.addDays(1).toMSecsSinceEpoch() * 1000000LL - 1) / kDayNs);
+        }
+    }
+    journalDays_ = keys.values().toVector();
+    std::sort(journalDays_.begin(), journalDays_.end(), std::greater<qint64>());   // popped from the back
+    journalRows_ = 0;
+    journalClock_.start();
+    QTimer::singleShot(0, this, &DbWriter::rebuildJournal_);
+}
+
+void DbWriter::rebuildJournal_() {
+    flushPending_();
+    if (!db_.isOpen()) return;
+    if (journalDays_.isEmpty()) {
+        SegmentJournal::setReady(true);
+        qInfo() << "[DB] segment journal rebuilt:" << journalRows_ << "rows in"
+                << journalClock_.elapsed() << "ms";
+        return;
+    }
+    const qint64 key = journalDays_.takeLast();
+
+    QSqlQuery& q = stmt_("SELECT camera_id, id, start_utc_ns, eff_end_ns, COALESCE(duration_ms,0),"
+                         "       COALESCE(size_bytes,0), file_path, COALESCE(codec,'h264'), status, COALESCE(tier,0)"
+                         " FROM segments_all"
+                         " WHERE camera_id > 0 AND start_utc_ns >= ? AND start_utc_ns < ? AND status IN (0,1)"
+                         " ORDER BY camera_id, start_utc_ns;");
+    q.addBindValue(key * kDayNs);
+    q.addBindValue((key + 1) * kDayNs);
+    if (!q.exec()) {
+        qWarning() << "[DB] rebuildJournal:" << q.lastError().text();
+        journalDays_.clear();   // stays not ready; SQLite answers
+        return;
+    }
+    QMap<int, QVector<IndexedSegment>> cams;
+    while (q.next()) {
+        IndexedSegment seg;
+        seg.id         = q.value(1).toLongLong();
+        seg.startNs    = q.value(2).toLongLong();
+        seg.effEndNs   = q.value(3).toLongLong();
+        seg.durationMs = q.value(4).toLongLong();
+        seg.sizeBytes  = q.value(5).toLongLong();
+        seg.path       = q.value(6).toString();
+        seg.codec      = q.value(7).toString();
+        seg.open       = q.value(8).toInt() == 0;
+        seg.tier       = q.value(9).toInt();
+        cams[q.value(0).toInt()].push_back(std::move(seg));
+    }
+    q.finish();
+    for (auto it = cams.cbegin(); it != cams.cend(); ++it) {
+        SegmentJournal::writeDay(it.key(), key, it.value());
+        journalRows_ += it.value().size();
+    }
+    QTimer::singleShot(0, this, &DbWriter::rebuildJournal_);
 }
 
 void DbWriter::addSegmentOpened(const QString& sessionId, const QString& cameraUrl,
-                                const QString& filePath, qint64 startUtcNs) {
-    const int camId = cameraIdForUrl(db_, cameraUrl);
-    QSqlQuery q(db_);
-    q.prepare("INSERT OR IGNORE INTO segments(session_id,camera_id,camera_url,file_path,start_utc_ns,status)"
-              " VALUES(?,?,?,?,?,0);");
-    q.addBindValue(sessionId);
-    q.addBindValue(camId);
-    q.addBindValue(cameraUrl);
-    q.addBindValue(filePath);
-    q.addBindValue(startUtcNs);
-    if (!q.exec()) qWarning() << "[DB] addSegmentOpened:" << q.lastError().text();
+                                const QString& filePath, qint64 startUtcNs,
+                                const QString& codec) {
+    Pending ev{ Pending::SegmentOpened };
+    ev.url = cameraUrl; ev.path = filePath; ev.t = startUtcNs;
+    ev.text1 = sessionId; ev.text2 = codec.isEmpty() ? QStringLiteral("h264") : codec;
+    enqueue_(std::move(ev));
+}
+
+// Opens a gap for the camera unless one is already open (the first cause wins).
+void DbWriter::openGap(const QString& cameraUrl, qint64 startUtcNs,
+                       const QString& reason, const QString& detail) {
+    Pending ev{ Pending::GapOpened };
+    ev.url = cameraUrl; ev.t = startUtcNs; ev.text1 = reason; ev.text2 = detail;
+    enqueue_(std::move(ev));
+}
+
+// Schedule boundaries: whatever gap is open ends here and `reason` takes over.
+void DbWriter::reopenGap(const QString& cameraUrl, qint64 atUtcNs,
+                         const QString& reason, const QString& detail) {
+    Pending ev{ Pending::GapReopened };
+    ev.url = cameraUrl; ev.t = atUtcNs; ev.text1 = reason; ev.text2 = detail;
+    enqueue_(std::move(ev));
 }
 
 void DbWriter::finalizeSegmentByPath(const QString& filePath, qint64 endUtcNs, qint64 durationMs) {
-    const qint64 size = QFileInfo(filePath).exists() ? QFileInfo(filePath).size() : 0;
+    Pending ev{ Pending::SegmentFinalized };
+    ev.path = filePath; ev.t = endUtcNs; ev.durationMs = durationMs;
+    const QFileInfo fi(filePath);   // stat outside the batch transaction
+    ev.sizeBytes = fi.exists() ? fi.size() : 0;
+    enqueue_(std::move(ev));
+}
+
+void DbWriter::addSubSegmentOpened(const QString& cameraUrl, const QString& filePath,
+                                   qint64 startUtcNs, const QString& codec) {
+    Pending ev{ Pending::SubOpened };
+    ev.url = cameraUrl; ev.path = filePath; ev.t = startUtcNs;
+    ev.text2 = codec.isEmpty() ? QStringLiteral("h264") : codec;
+    enqueue_(std::move(ev));
+}
+
+void DbWriter::finalizeSubSegmentByPath(const QString& filePath, qint64 endUtcNs, qint64 durationMs) {
+    Pending ev{ Pending::SubFinalized };
+    ev.path = filePath; ev.t = endUtcNs; ev.durationMs = durationMs;
+    ev.sizeBytes = QFileInfo(filePath).size();
+    enqueue_(std::move(ev));
+}
+
+// Recorder events are committed together: at most CAMVIGIL_DB_BATCH_MS after
+// the first one, or at once when kMaxBatch are waiting.
+void DbWriter::enqueue_(Pending&& ev) {
+    static const int kMaxBatch = 128;
+    pending_.push_back(std::move(ev));
+    const int depth = pending_.size();
+    queueDepth_.store(depth, std::memory_order_relaxed);
+    if (depth > maxQueueDepth_.load(std::memory_order_relaxed))
+        maxQueueDepth_.store(depth, std::memory_order_relaxed);
+    if (depth >= kMaxBatch || !batchTimer_) {
+        flushPending_();
+    } else if (!batchTimer_->isActive()) {
+        batchTimer_->start();
+    }
+}
+
+void DbWriter::flush() {
+    retryDelayMs_ = 0;   // shutdown: one more attempt, backoff or not
+    flushPending_();
+}
+
+// A batch that fails to commit stays queued (new events are appended) and is
+// retried with backoff; it is dropped only after kMaxAttempts failures.
+void DbWriter::flushPending_() {
+    static const int kMaxAttempts = 8;
+    if (batchTimer_) batchTimer_->stop();
+    if (pending_.isEmpty() || !db_.isOpen()) return;
+    if (commitFailures_ > 0 && retryClock_.elapsed() < retryDelayMs_) {
+        if (batchTimer_) batchTimer_->start(int(retryDelayMs_ - retryClock_.elapsed()));
+        return;
+    }
+    const int count = pending_.size();
+
+    QElapsedTimer t; t.start();
+    bool ok = db_.transaction();
+    if (ok) {
+        for (const Pending& ev : qAsConst(pending_)) apply_(ev);
+        ok = db_.commit();
+        if (!ok) db_.rollback();
+    }
+    if (!ok) {
+        touched_.clear();
+        coverageOut_.clear();
+        if (++commitFailures_ < kMaxAttempts) {
+            retryDelayMs_ = qMin(10000, 250 << (commitFailures_ - 1));
+            retryClock_.start();
+            qWarning() << "[DB] batch commit failed (attempt" << commitFailures_ << "):"
+                       << db_.lastError().text() << "; retrying" << count << "events in"
+                       << retryDelayMs_ << "ms";
+            if (batchTimer_) batchTimer_->start(retryDelayMs_);
+            return;
+        }
+        qCritical() << "[DB] batch commit failed" << commitFailures_ << "times; dropping" << count
+                    << "recorder events:" << db_.lastError().text();
+        droppedEvents_.fetch_add(count, std::memory_order_relaxed);
+    }
+    commitFailures_ = 0;
+    retryDelayMs_ = 0;
+    const QVector<Pending> batch = std::move(pending_);
+    pending_.clear();
+    queueDepth_.store(0, std::memory_order_relaxed);
+    if (batchTimer_) batchTimer_->setInterval(batchMs_);
+    reindex_(touched_);
+    touched_.clear();
+    publishCoverage_();
+    lastCommit_.start();
+    const qint64 us = t.nsecsElapsed() / 1000;
+    lastCommitUs_.store(us, std::memory_order_relaxed);
+    if (us > maxCommitUs_.load(std::memory_order_relaxed))
+        maxCommitUs_.store(us, std::memory_order_relaxed);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    events_.fetch_add(batch.size(), std::memory_order_relaxed);
+
+    if (!statsClock_.isValid() || statsClock_.elapsed() >= 60 * 1000) {
+        statsClock_.start();
+        const DbWriterStats st = stats();
+        qInfo() << "[DB] batches=" << st.batches << "events=" << st.events
+                << "last_commit_us=" << st.lastCommitUs << "max_commit_us=" << st.maxCommitUs
+                << "max_queue=" << st.maxQueueDepth << "wal_bytes=" << st.walBytes
+                << "checkpoints=" << st.checkpoints << "max_checkpoint_us=" << st.maxCheckpointUs
+                << "dropped_events=" << st.droppedEvents;
+    }
+}
+
+// PASSIVE by size, TRUNCATE when idle; neither waits on the recorders.
+void DbWriter::checkpointTick_() {
+    if (!db_.isOpen()) return;
+    static const int    kIdleMs = envInt("CAMVIGIL_WAL_IDLE_MS", 2000, 100, 600000);
+    static const qint64 kWarnMs = qint64(envInt("CAMVIGIL_WAL_PIN_WARN_SEC", 60, 1, 86400)) * 1000;
+
+    const qint64 wal = QFileInfo(walPath_).size();
+    walBytes_.store(wal, std::memory_order_relaxed);
+    const bool idle = pending_.isEmpty() && (!lastCommit_.isValid() || lastCommit_.elapsed() >= kIdleMs);
+
+    if (wal > walLimit_) {
+        checkpoint_("PASSIVE");
+    } else if (idle && wal > 0 && (!lastTruncate_.isValid() || lastTruncate_.elapsed() >= 60 * 1000)) {
+        // TRUNCATE waits for readers; only try it once nothing pins the log.
+        if (checkpoint_("PASSIVE")) {
+            lastTruncate_.start();
+            checkpoint_("TRUNCATE");
+        }
+    }
+
+    if (pinnedSince_.isValid() && pinnedSince_.elapsed() >= kWarnMs
+        && (!pinnedWarned_.isValid() || pinnedWarned_.elapsed() >= kWarnMs)) {
+        pinnedWarned_.start();
+        // Pooled readers only; a connection of its own (or another process) shows none.
+        const QStringList readers = DbReadPool::openReads();
+        qWarning() << "[DB] WAL checkpoint incomplete for" << pinnedSince_.elapsed() / 1000
+                   << "s: a reader holds an old snapshot; wal_bytes=" << walBytes_.load()
+                   << "open reads:" << (readers.isEmpty() ? QStringLiteral("none pooled")
+                                                          : readers.mid(0, 5).join(QStringLiteral("; ")));
+    }
+}
+
+// true when every WAL frame was copied back and no reader blocked it.
+bool DbWriter::checkpoint_(const char* mode) {
+    QElapsedTimer t; t.start();
     QSqlQuery q(db_);
-    q.prepare("UPDATE segments SET end_utc_ns=?, duration_ms=?, size_bytes=?, status=1 WHERE file_path=?;");
-    q.addBindValue(endUtcNs);
-    q.addBindValue(durationMs);
-    q.addBindValue(size);
-    q.addBindValue(filePath);
-    if (!q.exec()) qWarning() << "[DB] finalizeSegment:" << q.lastError().text();
+    if (!q.exec(QStringLiteral("PRAGMA wal_checkpoint(%1);").arg(QLatin1String(mode))) || !q.next()) {
+        qWarning() << "[DB] wal_checkpoint" << mode << ":" << q.lastError().text();
+        return false;
+    }
+    const int    busy   = q.value(0).toInt();
+    const qint64 frames = q.value(1).toLongLong();   // -1: not in WAL mode
+    const qint64 done   = q.value(2).toLongLong();
+    q.finish();
+    const qint64 us = t.nsecsElapsed() / 1000;
+
+    checkpoints_.fetch_add(1, std::memory_order_relaxed);
+    lastCheckpointUs_.store(us, std::memory_order_relaxed);
+    if (us > maxCheckpointUs_.load(std::memory_order_relaxed))
+        maxCheckpointUs_.store(us, std::memory_order_relaxed);
+    walBytes_.store(QFileInfo(walPath_).size(), std::memory_order_relaxed);
+
+    const bool complete = busy == 0 && done >= frames;
+    if (complete) pinnedSince_.invalidate();
+    else if (!pinnedSince_.isValid()) pinnedSince_.start();
+    walPinnedMs_.store(pinnedSince_.isValid() ? pinnedSince_.elapsed() : 0, std::memory_order_relaxed);
+
+    if ((complete && frames > 0) || us >= 100 * 1000)   // stuck ones: see checkpointTick_
+        qInfo() << "[DB] checkpoint" << mode << "frames=" << done << "/" << frames << "busy=" << busy
+                << "us=" << us << "wal_bytes=" << walBytes_.load(std::memory_order_relaxed);
+    return complete;
+}
+
+void DbWriter::apply_(const Pending& ev) {
+    switch (ev.kind) {
+    case Pending::SegmentOpened: {
+        QSqlQuery& q = stmt_("INSERT OR IGNORE INTO segments(session_id,camera_id,camera_url,file_path,start_utc_ns,"
+                             "                               eff_end_ns,status,codec)"
+                             " VALUES(?,?,?,?,?,?,0,?);");
+        q.addBindValue(ev.text1);
+        q.addBindValue(cameraId_(ev.url));
+        q.addBindValue(ev.url);
+        q.addBindValue(ev.path);
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.t + openSpanNs_(ev.text1));
+        q.addBindValue(ev.text2);
+        if (!q.exec()) qWarning() << "[DB] addSegmentOpened:" << q.lastError().text();
+        else if (q.numRowsAffected() > 0) touched_.push_back(q.lastInsertId().toLongLong());
+
+        // Video is back: the camera's open gap (if any) ends where this segment starts.
+        QSqlQuery& g = stmt_("UPDATE gaps SET end_utc_ns=MAX(start_utc_ns, ?) WHERE camera_url=? AND end_utc_ns IS NULL;");
+        g.addBindValue(ev.t);
+        g.addBindValue(ev.url);
+        if (!g.exec()) qWarning() << "[DB] addSegmentOpened close gap:" << g.lastError().text();
+
+        QSqlQuery& d = stmt_("INSERT INTO recording_days(camera_id, local_day, first_ns, last_ns) VALUES(?,?,?,?)"
+                             " ON CONFLICT(camera_id, local_day) DO UPDATE SET"
+                             " first_ns=MIN(first_ns, excluded.first_ns), last_ns=MAX(last_ns, excluded.last_ns);");
+        d.addBindValue(cameraId_(ev.url));
+        d.addBindValue(localDay(ev.t));
+        d.addBindValue(ev.t);
+        d.addBindValue(ev.t);
+        if (!d.exec()) qWarning() << "[DB] addSegmentOpened day:" << d.lastError().text();
+        break;
+    }
+    case Pending::SegmentFinalized: {
+        QSqlQuery& q = stmt_("UPDATE segments SET end_utc_ns=?,"
+                             " eff_end_ns=CASE WHEN ? > 0 THEN ? ELSE start_utc_ns + ?*1000000 END,"
+                             " duration_ms=?, size_bytes=?, status=1 WHERE file_path=?;");
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.durationMs);
+        q.addBindValue(ev.durationMs);
+        q.addBindValue(ev.sizeBytes);
+        q.addBindValue(ev.path);
+        if (!q.exec()) qWarning() << "[DB] finalizeSegment:" << q.lastError().text();
+
+        QSqlQuery& k = stmt_("SELECT id FROM segments WHERE file_path=?;");
+        k.addBindValue(ev.path);
+        const qint64 id = (k.exec() && k.next()) ? k.value(0).toLongLong() : 0;
+        k.finish();
+        if (id > 0) {
+            refreshDays_(dayKeys_(rowKeys_({ id })));
+            touched_.push_back(id);
+        }
+        break;
+    }
+    case Pending::SubOpened: {
+        QSqlQuery& q = stmt_("INSERT OR IGNORE INTO sub_segments(camera_id,camera_url,file_path,start_utc_ns,"
+                             "                                   eff_end_ns,status,codec)"
+                             " VALUES(?,?,?,?,?,0,?);");
+        q.addBindValue(cameraId_(ev.url));
+        q.addBindValue(ev.url);
+        q.addBindValue(ev.path);
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.t + openSpanNs_(QString()));
+        q.addBindValue(ev.text2);
+        if (!q.exec()) qWarning() << "[DB] addSubSegmentOpened:" << q.lastError().text();
+        break;
+    }
+    case Pending::SubFinalized: {
+        QSqlQuery& q = stmt_("UPDATE sub_segments SET end_utc_ns=?,"
+                             " eff_end_ns=CASE WHEN ? > 0 THEN ? ELSE start_utc_ns + ?*1000000 END,"
+                             " duration_ms=?, size_bytes=?, status=1 WHERE file_path=?;");
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.durationMs);
+        q.addBindValue(ev.durationMs);
+        q.addBindValue(ev.sizeBytes);
+        q.addBindValue(ev.path);
+        if (!q.exec()) qWarning() << "[DB] finalizeSubSegment:" << q.lastError().text();
+        break;
+    }
+    case Pending::GapReopened: {
+        QSqlQuery& q = stmt_("UPDATE gaps SET end_utc_ns=MAX(start_utc_ns, ?) WHERE camera_url=? AND end_utc_ns IS NULL;");
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.url);
+        if (!q.exec()) qWarning() << "[DB] reopenGap close:" << q.lastError().text();
+    }
+        Q_FALLTHROUGH();
+    case Pending::GapOpened: {
+        QSqlQuery& q = stmt_("INSERT INTO gaps(camera_id, camera_url, start_utc_ns, reason, detail)"
+                             " SELECT ?,?,?,?,? WHERE NOT EXISTS"
+                             " (SELECT 1 FROM gaps WHERE camera_url=? AND end_utc_ns IS NULL);");
+        q.addBindValue(cameraId_(ev.url));
+        q.addBindValue(ev.url);
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.text1);
+        q.addBindValue(ev.text2);
+        q.addBindValue(ev.url);
+        if (!q.exec()) qWarning() << "[DB] openGap:" << q.lastError().text();
+        break;
+    }
+    case Pending::Event: {
+        QSqlQuery& q = stmt_("INSERT INTO events(camera_id, t_ns, bucket, type, source, detail)"
+                             " VALUES(?,?,?,?,?,?);");
+        q.addBindValue(ev.url.isEmpty() ? 0 : cameraId_(ev.url));
+        q.addBindValue(ev.t);
+        q.addBindValue(ev.t / ArchiveLimits::kEventBucketNs);
+        q.addBindValue(ev.text1);
+        q.addBindValue(ev.path);
+        q.addBindValue(ev.text2);
+        if (!q.exec()) qWarning() << "[DB] addEvent:" << q.lastError().text();
+        break;
+    }
+    }
+}
+
+DbWriterStats DbWriter::stats() const {
+    DbWriterStats st;
+    st.queueDepth    = queueDepth_.load(std::memory_order_relaxed);
+    st.maxQueueDepth = maxQueueDepth_.load(std::memory_order_relaxed);
+    st.batches       = batches_.load(std::memory_order_relaxed);
+    st.events        = events_.load(std::memory_order_relaxed);
+    st.lastCommitUs  = lastCommitUs_.load(std::memory_order_relaxed);
+    st.maxCommitUs   = maxCommitUs_.load(std::memory_order_relaxed);
+    st.walBytes         = walBytes_.load(std::memory_order_relaxed);
+    st.checkpoints      = checkpoints_.load(std::memory_order_relaxed);
+    st.lastCheckpointUs = lastCheckpointUs_.load(std::memory_order_relaxed);
+    st.maxCheckpointUs  = maxCheckpointUs_.load(std::memory_order_relaxed);
+    st.walPinnedMs      = walPinnedMs_.load(std::memory_order_relaxed);
+    st.droppedEvents    = droppedEvents_.load(std::memory_order_relaxed);
+    return st;
+}
+
+// After an unclean exit no gap was journaled: open one per camera from the
+// end of its last recorded segment.
+int DbWriter::openRecorderDownGaps() {
+    flushPending_();
+    QSqlQuery q(db_);
+    const bool ok = q.exec(
+        "INSERT INTO gaps(camera_id, camera_url, start_utc_ns, reason, detail)"
+        " SELECT s.camera_id, s.camera_url,"
+        "        MAX(CASE WHEN s.end_utc_ns > 0 THEN s.end_utc_ns ELSE s.start_utc_ns END),"
+        "        'recorder_down', 'no clean shutdown recorded'"
+        " FROM segments s"
+        " WHERE NOT EXISTS (SELECT 1 FROM gaps g WHERE g.camera_url=s.camera_url AND g.end_utc_ns IS NULL)"
+        " GROUP BY s.camera_url;");
+    if (!ok) { qWarning() << "[DB] openRecorderDownGaps:" << q.lastError().text(); return 0; }
+    return q.numRowsAffected();
+}
+
+// Scrub-track files that end before their camera's oldest main-stream
+// segment, i.e. whose main footage was purged. Deletes the rows and returns
+// the paths for the caller to unlink.
+QStringList DbWriter::expireSubSegments(int limit) {
+    flushPending_();
+    QStringList paths;
+    QVector<qint64> ids;
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, file_path FROM sub_segments ss"
+              " WHERE ss.status=1 AND ss.end_utc_ns <"
+              "   COALESCE((SELECT MIN(s.start_utc_ns) FROM segments_all s WHERE s.camera_url=ss.camera_url),"
+              "            0)"
+              " ORDER BY ss.start_utc_ns LIMIT ?;");
+    q.addBindValue(qMax(1, limit));
+    if (!q.exec()) { qWarning() << "[DB] expireSubSegments:" << q.lastError().text(); return paths; }
+    while (q.next()) { ids.push_back(q.value(0).toLongLong()); paths << q.value(1).toString(); }
+    q.finish();
+    if (ids.isEmpty() || !db_.transaction()) return {};
+
+    QSqlQuery del(db_);
+    del.prepare("DELETE FROM sub_segments WHERE id=?;");
+    for (qint64 id : ids) { del.addBindValue(id); del.exec(); }
+    if (!db_.commit()) { db_.rollback(); return {}; }
+    return paths;
 }
 
 void DbWriter::markError(const QString& where, const QString& detail) {
-    Q_UNUSED(where); Q_UNUSED(detail);
-    // Hook for future 'events' table.
+    addEvent(QString(), QDateTime::currentMSecsSinceEpoch() * 1000000LL,
+             QStringLiteral("error"), where, detail);
 }
+
+// Batched with the recorder events; cameraUrl empty = site-wide.
+void DbWriter::addEvent(const QString& cameraUrl, qint64 utcNs, const QString& type,
+                        const QString& source, const QString& detail) {
+    Pending ev{ Pending::Event };
+    ev.url = cameraUrl; ev.t = utcNs; ev.text1 = type; ev.path = source; ev.text2 = detail;
+    enqueue_(std::move(ev));
+}
+
+// Events follow their camera's footage out (hour buckets older than its
+// oldest recording day) and are never kept past CAMVIGIL_EVENTS_MAX_DAYS
+// (default 90). At most `limit` rows per call; returns how many went.
+int DbWriter::expireEvents(int limit) {
+    flushPending_();
+    static const int kMaxDays = envInt("CAMVIGIL_EVENTS_MAX_DAYS", 90, 1, 3660);
+    const qint64 nowNs = QDateTime::currentMSecsSinceEpoch() * 1000000LL;
+    const qint64 ageBucket = (nowNs - qint64(kMaxDays) * 24 * 3600 * 1000000000LL) / ArchiveLimits::kEventBucketNs;
+
+    QVector<QPair<int, qint64>> cuts{ { 0, ageBucket } };
+    QSqlQuery c(db_);
+    if (!c.exec("SELECT c.id, (SELECT MIN(d.first_ns) FROM recording_days d WHERE d.camera_id=c.id)"
+                " FROM cameras c;")) {
+        qWarning() << "[DB] expireEvents:" << c.lastError().text();
+        return 0;
+    }
+    while (c.next()) {
+        const qint64 first = c.value(1).isNull() ? 0 : c.value(1).toLongLong() / ArchiveLimits::kEventBucketNs;
+        cuts.push_back({ c.value(0).toInt(), qMax(ageBucket, first) });
+    }
+    c.finish();
+
+    if (!db_.transaction()) return 0;
+    QSqlQuery& del = stmt_("DELETE FROM events WHERE id IN"
+                           " (SELECT id FROM events WHERE camera_id=? AND bucket < ? LIMIT ?);");
+    int left = qMax(1, limit);
+    for (const auto& cut : cuts) {
+        del.addBindValue(cut.first);
+        del.addBindValue(cut.second);
+        del.addBindValue(left);
+        if (!del.exec()) { qWarning() << "[DB] expireEvents:" << del.lastError().text(); continue; }
+        left -= del.numRowsAffected();
+        if (left <= 0) break;
+    }
+    if (!db_.commit()) { db_.rollback(); return 0; }
+    return qMax(1, limit) - left;
+}
+
+// Rows a purge must leave in a partition; purgeBefore drops the table only
+// when this index is empty.
+static const char* const kKeepIndexSql =
+    "CREATE INDEX IF NOT EXISTS %1_keep ON %1(start_utc_ns) WHERE pinned<>0 OR status<>1;";
+
 static bool hasColumn(QSqlDatabase& db, const QString& table, const QString& col) {
     QSqlQuery q(db);
     q.exec(QString("PRAGMA table_info(%1);").arg(table));
@@ -131,25 +944,401 @@ bool DbWriter::migrateSchema_() {
             exec("UPDATE segments SET pinned=0 WHERE pinned IS NULL;");
         }
     }
+    // Per-segment video codec ('h264'/'h265'); rows recorded before this were H.264
+    if (!hasColumn(db_, "segments", "codec")) {
+        if (!exec("ALTER TABLE segments ADD COLUMN codec TEXT DEFAULT 'h264';")) {
+            qWarning() << "[DB] migrate: add codec failed";
+        }
+    }
+    // Storage tier: 0 = as recorded, 1 = thinned to keyframes (ArchiveThinner)
+    if (!hasColumn(db_, "segments", "tier")) {
+        if (!exec("ALTER TABLE segments ADD COLUMN tier INTEGER DEFAULT 0;")) {
+            qWarning() << "[DB] migrate: add tier failed";
+        }
+    }
+    // 1 = ArchiveThinner left the row full-rate (copy failed or saved < 10 %)
+    if (!hasColumn(db_, "segments", "thin_skipped")) {
+        if (!exec("ALTER TABLE segments ADD COLUMN thin_skipped INTEGER DEFAULT 0;")) {
+            qWarning() << "[DB] migrate: add thin_skipped failed";
+        }
+    }
     // Create indexes that depend on the column
     exec("CREATE INDEX IF NOT EXISTS idx_segments_pinned ON segments(pinned);");
+    exec("CREATE INDEX IF NOT EXISTS idx_segments_full_tier ON segments(start_utc_ns) WHERE tier=0;");
+
+    // Effective end of a row, kept next to start_utc_ns so range queries are a
+    // single index range: finalized rows carry their end (else start+duration,
+    // else start); open rows the furthest the live tail may grow (2x segment).
+    bool fillEffEnd = false;
+    for (const char* table : { "segments", "sub_segments" }) {
+        if (hasColumn(db_, table, "eff_end_ns")) continue;
+        if (!exec(QString("ALTER TABLE %1 ADD COLUMN eff_end_ns INTEGER;").arg(table)))
+            qWarning() << "[DB] migrate: add eff_end_ns failed on" << table;
+        fillEffEnd = true;
+    }
+    if (fillEffEnd) {
+        const QString fill("UPDATE %1 SET eff_end_ns = CASE"
+                           " WHEN end_utc_ns > 0 THEN end_utc_ns"
+                           " WHEN COALESCE(duration_ms,0) > 0 THEN start_utc_ns + duration_ms*1000000"
+                           " WHEN status = 0 THEN start_utc_ns + %2*2000000000"
+                           " ELSE start_utc_ns END"
+                           " WHERE eff_end_ns IS NULL;");
+        exec(fill.arg("segments",
+                      "COALESCE((SELECT segment_sec FROM sessions WHERE id=segments.session_id),300)"));
+        exec(fill.arg("sub_segments", "300"));
+    }
+    // Rows from before camera ids were recorded only carry the URL.
+    for (const char* table : { "segments", "sub_segments", "gaps" }) {
+        exec(QString("UPDATE %1 SET camera_id=(SELECT id FROM cameras WHERE main_url=%1.camera_url)"
+                     " WHERE (camera_id IS NULL OR camera_id=0)"
+                     "   AND camera_url IN (SELECT main_url FROM cameras);").arg(table));
+    }
+    exec("CREATE INDEX IF NOT EXISTS idx_segments_camera_span ON segments(camera_id, start_utc_ns, eff_end_ns);");
+    exec("CREATE INDEX IF NOT EXISTS idx_sub_segments_camera_span ON sub_segments(camera_id, start_utc_ns, eff_end_ns);");
+    // Their (camera_id, start_utc_ns) prefix indexes would be picked over them
+    // for range queries, leaving eff_end_ns to be checked row by row.
+    exec("DROP INDEX IF EXISTS idx_segments_camera_time;");
+    exec("DROP INDEX IF EXISTS idx_sub_segments_camera_time;");
+
+    // One full scan to seed recording_days for archives recorded before it existed.
+    QSqlQuery d(db_);
+    if (d.exec("SELECT NOT EXISTS(SELECT 1 FROM recording_days) AND EXISTS(SELECT 1 FROM segments);")
+        && d.next() && d.value(0).toBool()) {
+        const bool seeded = exec(
+            "INSERT OR REPLACE INTO recording_days(camera_id, local_day, first_ns, last_ns, covered_ms, bytes)"
+            " SELECT COALESCE(NULLIF(camera_id,0),(SELECT id FROM cameras WHERE main_url=camera_url),0) AS cid,"
+            "        strftime('%Y-%m-%d', start_utc_ns/1000000000, 'unixepoch', 'localtime') AS day,"
+            "        MIN(start_utc_ns), MAX(COALESCE(end_utc_ns, start_utc_ns)),"
+            "        SUM(COALESCE(duration_ms,0)), SUM(COALESCE(size_bytes,0))"
+            " FROM segments WHERE status IN (0,1) GROUP BY cid, day;");
+        if (!seeded) qWarning() << "[DB] migrate: seeding recording_days failed";
+    }
+
+    loadPartitions_();
+    for (const QString& t : qAsConst(partitions_)) exec(QString(kKeepIndexSql).arg(t));
+    if (!rebuildSegmentsView_()) qWarning() << "[DB] migrate: segments_all view failed";
+
+    // Minute coverage per recording day: build it for days that lack it
+    // (column just added, or a day whose only row was still open).
+    if (!hasColumn(db_, "recording_days", "coverage")
+        && !exec("ALTER TABLE recording_days ADD COLUMN coverage BLOB;"))
+        qWarning() << "[DB] migrate: add coverage failed";
+    QSet<QPair<int, QString>> bare;
+    QSqlQuery c(db_);
+    if (c.exec("SELECT camera_id, local_day FROM recording_days WHERE coverage IS NULL;"))
+        while (c.next()) bare.insert({ c.value(0).toInt(), c.value(1).toString() });
+    c.finish();
+    if (!bare.isEmpty() && db_.transaction()) {
+        refreshDays_(bare);
+        if (!db_.commit()) db_.rollback();
+        qInfo() << "[DB] migrate: built coverage for" << bare.size() << "recording days";
+    }
+    coverageOut_.clear();   // no reader has cached anything yet
     return true;
 }
 
 
+// ---------- month partitions ----------
+
+// First instant of the local month holding utcNs, shifted by addMonths.
+static qint64 monthStartNs(qint64 utcNs, int addMonths = 0) {
+    const QDate d = QDateTime::fromMSecsSinceEpoch(utcNs / 1000000LL).date();
+    const QDateTime m(QDate(d.year(), d.month(), 1).addMonths(addMonths), QTime(0, 0), Qt::LocalTime);
+    return m.toMSecsSinceEpoch() * 1000000LL;
+}
+
+static QString partitionName(qint64 monthFromNs) {
+    return QStringLiteral("segments_p")
+         + QDateTime::fromMSecsSinceEpoch(monthFromNs / 1000000LL).toString(QStringLiteral("yyyyMM"));
+}
+
+void DbWriter::loadPartitions_() {
+    partitions_.clear();
+    QSqlQuery q(db_);
+    if (!q.exec("SELECT from_ns, name FROM segment_partitions"
+                " WHERE name IN (SELECT name FROM sqlite_master WHERE type='table');")) {
+        qWarning() << "[DB] segment_partitions:" << q.lastError().text();
+        return;
+    }
+    while (q.next()) partitions_.insert(q.value(0).toLongLong(), q.value(1).toString());
+}
+
+// Same columns as segments (CREATE ... AS SELECT), no constraints; indexes
+// for the lookups readers and DbWriter make on moved rows.
+bool DbWriter::createPartition_(qint64 monthFromNs) {
+    const QString t = partitionName(monthFromNs);
+    const bool ok =
+        exec(QString("CREATE TABLE IF NOT EXISTS %1 AS SELECT * FROM segments WHERE 0;").arg(t)) &&
+        exec(QString("CREATE UNIQUE INDEX IF NOT EXISTS %1_id ON %1(id);").arg(t)) &&
+        exec(QString("CREATE INDEX IF NOT EXISTS %1_camera_span ON %1(camera_id, start_utc_ns, eff_end_ns);").arg(t)) &&
+        exec(QString("CREATE INDEX IF NOT EXISTS %1_camera_url_time ON %1(camera_url, start_utc_ns);").arg(t)) &&
+        exec(QString("CREATE INDEX IF NOT EXISTS %1_path ON %1(file_path);").arg(t)) &&
+        exec(QString("CREATE INDEX IF NOT EXISTS %1_time ON %1(start_utc_ns);").arg(t)) &&
+        exec(QString(kKeepIndexSql).arg(t));
+    if (!ok) return false;
+
+    QSqlQuery q(db_);
+    q.prepare("INSERT OR REPLACE INTO segment_partitions(name, from_ns, to_ns) VALUES(?,?,?);");
+    q.addBindValue(t);
+    q.addBindValue(monthFromNs);
+    q.addBindValue(monthStartNs(monthFromNs, 1));
+    if (!q.exec()) { qWarning() << "[DB] createPartition:" << q.lastError().text(); return false; }
+    partitions_.insert(monthFromNs, t);
+    return rebuildSegmentsView_();
+}
+
+// segments_all: the hot table plus every partition, by explicit column list.
+// Columns added to segments by a later migration are added to partitions here.
+bool DbWriter::rebuildSegmentsView_() {
+    QStringList cols, types;
+    QSqlQuery ti(db_);
+    ti.exec("PRAGMA table_info(segments);");
+    while (ti.next()) { cols << ti.value(1).toString(); types << ti.value(2).toString(); }
+    if (cols.isEmpty()) return false;
+
+    const QString list = cols.join(',');
+    QStringList parts{ QString("SELECT %1 FROM segments").arg(list) };
+    for (const QString& t : qAsConst(partitions_)) {
+        for (int i = 0; i < cols.size(); ++i)
+            if (!hasColumn(db_, t, cols[i]))
+                exec(QString("ALTER TABLE %1 ADD COLUMN %2 %3;").arg(t, cols[i], types[i]));
+        parts << QString("SELECT %1 FROM %2").arg(list, t);
+    }
+    return exec("DROP VIEW IF EXISTS segments_all;") &&
+           exec("CREATE VIEW segments_all AS " + parts.join(" UNION ALL ") + ";");
+}
+
+// Moves one local day of finalized rows older than the hot window into its
+// month partition, then queues itself for the next day, so a first run over a
+// large archive never holds the DB thread for long.
+void DbWriter::rollPartitions_() {
+    flushPending_();
+    if (!db_.isOpen()) return;
+    static const int kHotMonths = envInt("CAMVIGIL_SEGMENT_HOT_MONTHS", 2, 1, 120);
+    const qint64 hotFromNs = monthStartNs(QDateTime::currentMSecsSinceEpoch() * 1000000LL, 1 - kHotMonths);
+
+    QSqlQuery& q = stmt_("SELECT MIN(start_utc_ns) FROM segments WHERE status=1;");
+    const bool any = q.exec() && q.next() && !q.value(0).isNull();
+    const qint64 oldest = any ? q.value(0).toLongLong() : hotFromNs;
+    q.finish();
+    if (oldest >= hotFromNs) {
+        if (rolledRows_ > 0)
+            qInfo() << "[DB] moved" << rolledRows_ << "segment rows to month partitions; partitions="
+                    << partitions_.size();
+        rolledRows_ = 0;
+        return;
+    }
+
+    const qint64 month = monthStartNs(oldest);
+    const QDateTime d0(QDateTime::fromMSecsSinceEpoch(oldest / 1000000LL).date(), QTime(0, 0), Qt::LocalTime);
+    const qint64 fromNs = d0.toMSecsSinceEpoch() * 1000000LL;
+    const qint64 toNs   = qMin(d0.addDays(1).toMSecsSinceEpoch() * 1000000LL, hotFromNs);
+
+    if (!db_.transaction()) { qWarning() << "[DB] rollPartitions: begin failed"; return; }
+    if (!partitions_.contains(month) && !createPartition_(month)) {
+        db_.rollback();
+        loadPartitions_();
+        return;
+    }
+    const QString t = partitions_.value(month);
+    QSqlQuery mv(db_);
+    mv.prepare(QString("INSERT INTO %1 SELECT * FROM segments"
+                       " WHERE status=1 AND start_utc_ns >= ? AND start_utc_ns < ?;").arg(t));
+    mv.addBindValue(fromNs);
+    mv.addBindValue(toNs);
+    QSqlQuery del(db_);
+    del.prepare("DELETE FROM segments WHERE status=1 AND start_utc_ns >= ? AND start_utc_ns < ?;");
+    del.addBindValue(fromNs);
+    del.addBindValue(toNs);
+    if (!mv.exec() || !del.exec() || !db_.commit()) {
+        qWarning() << "[DB] rollPartitions" << t << ":" << mv.lastError().text() << del.lastError().text();
+        db_.rollback();
+        loadPartitions_();
+        return;
+    }
+    rolledRows_ += del.numRowsAffected();
+    QTimer::singleShot(0, this, &DbWriter::rollPartitions_);
+}
+
+// Runs sql (%1 = table) on the hot table, then on the month partition of
+// startNs if the row has moved there. Rows changed, or -1 on error.
+int DbWriter::execRouted_(const QString& sql, qint64 startNs, const QVariantList& binds) {
+    const QString part = partitions_.value(monthStartNs(startNs));
+    for (const QString& table : { QStringLiteral("segments"), part }) {
+        if (table.isEmpty()) continue;
+        QSqlQuery q(db_);
+        q.prepare(sql.arg(table));
+        for (const QVariant& v : binds) q.addBindValue(v);
+        if (!q.exec()) { qWarning() << "[DB]" << table << ":" << q.lastError().text(); return -1; }
+        if (q.numRowsAffected() > 0) return q.numRowsAffected();
+    }
+    return 0;
+}
+
+// Paths under a root prefix ("…/CamVigilArchives/") as a file_path range
+// [prefix, prefixEnd(prefix)), so checks can use the path indexes.
+static QString prefixEnd(const QString& prefix) {
+    return prefix.chopped(1) + QChar(prefix.back().unicode() + 1);
+}
+
+// The plan's rows its horizons cover (PurgePlan::horizons), removed by time
+// rather than by id: a month partition that ends before every horizon and
+// holds only covered rows is dropped whole, the rest of each root's range is
+// one DELETE per table. If the rows removed are not exactly the plan's
+// covered rows (one was pinned, repaired or moved since), nothing is changed
+// and the caller deletes them by id. Returns the ids removed; the caller
+// unlinks their files.
+QVector<qint64> DbWriter::purgeBefore(const QVector<PurgeHorizon>& horizons,
+                                      const QVector<PurgeVictim>& victims) {
+    flushPending_();
+    QVector<qint64> gone;
+    qint64 firstNs = 0, lastNs = 0;   // earliest and latest horizon
+    for (const PurgeHorizon& h : horizons) {
+        firstNs = firstNs > 0 ? qMin(firstNs, h.beforeNs) : h.beforeNs;
+        lastNs  = qMax(lastNs, h.beforeNs);
+    }
+    QVector<RowKey> rows;
+    for (const PurgeVictim& v : victims) {
+        for (const PurgeHorizon& h : horizons) {
+            if (v.startNs < h.beforeNs && (h.prefix.isEmpty() || v.path.startsWith(h.prefix))) {
+                rows.push_back({ v.id, v.cameraId, v.startNs, v.endNs });
+                break;
+            }
+        }
+    }
+    if (firstNs <= 0 || rows.isEmpty()) return gone;
+
+    // file_path ranges no horizon covers: [from, to), null `to` = no end.
+    QVector<QPair<QString, QString>> covered, uncovered;
+    bool coversAll = false;
+    for (const PurgeHorizon& h : horizons) {
+        if (h.prefix.isEmpty()) coversAll = true;
+        else covered.push_back({ h.prefix, prefixEnd(h.prefix) });
+    }
+    if (!coversAll) {
+        std::sort(covered.begin(), covered.end());
+        QString from(QLatin1String(""));   // sorts before every path
+        for (const auto& c : covered) {
+            if (from < c.first) uncovered.push_back({ from, c.first });
+            if (from < c.second) from = c.second;
+        }
+        uncovered.push_back({ from, QString() });
+    }
+
+    if (!db_.transaction()) { qWarning() << "[DB] purgeBefore: begin failed"; return gone; }
+
+    qint64 removed = 0;
+    bool ok = true;
+    auto rangeDelete = [&](const QString& table) {
+        for (const PurgeHorizon& h : horizons) {
+            QSqlQuery del(db_);
+            del.prepare(QString("DELETE FROM %1 WHERE status=1 AND pinned=0 AND start_utc_ns < ? %2;")
+                        .arg(table, h.prefix.isEmpty() ? QString() : "AND file_path >= ? AND file_path < ?"));
+            del.addBindValue(h.beforeNs);
+            if (!h.prefix.isEmpty()) {
+                del.addBindValue(h.prefix);
+                del.addBindValue(prefixEnd(h.prefix));
+            }
+            if (!del.exec()) {
+                qWarning() << "[DB] purgeBefore" << table << ":" << del.lastError().text();
+                ok = false;
+                return;
+            }
+            removed += del.numRowsAffected();
+        }
+    };
+    // Whole-table drop: nothing a purge keeps (the partial index
+    // <partition>_keep) and no file outside the horizons' roots.
+    auto onlyCovered = [&](const QString& table) {
+        QSqlQuery chk(db_);
+        if (!chk.exec(QString("SELECT EXISTS(SELECT 1 FROM %1 WHERE pinned<>0 OR status<>1);").arg(table))
+            || !chk.next() || chk.value(0).toBool())
+            return false;
+        for (const auto& u : uncovered) {
+            QSqlQuery q(db_);
+            q.prepare(QString("SELECT EXISTS(SELECT 1 FROM %1 WHERE file_path >= ? %2);")
+                      .arg(table, u.second.isNull() ? QString() : "AND file_path < ?"));
+            q.addBindValue(u.first);
+            if (!u.second.isNull()) q.addBindValue(u.second);
+            if (!q.exec() || !q.next() || q.value(0).toBool()) return false;
+        }
+        return true;
+    };
+    rangeDelete(QStringLiteral("segments"));
+
+    QVector<qint64> dropped;
+    for (auto it = partitions_.cbegin(); ok && it != partitions_.cend() && it.key() < lastNs; ++it) {
+        const QString& t = it.value();
+        if (monthStartNs(it.key(), 1) > firstNs || !onlyCovered(t)) { rangeDelete(t); continue; }
+        QSqlQuery cnt(db_);
+        if (!cnt.exec(QString("SELECT COUNT(*) FROM %1;").arg(t)) || !cnt.next()) { ok = false; break; }
+        removed += cnt.value(0).toLongLong();
+        cnt.finish();
+        QSqlQuery reg(db_);
+        reg.prepare("DELETE FROM segment_partitions WHERE name=?;");
+        reg.addBindValue(t);
+        if (!exec(QString("DROP TABLE %1;").arg(t)) || !reg.exec()) { ok = false; break; }
+        dropped.push_back(it.key());
+    }
+    if (ok && removed != rows.size()) {
+        qInfo() << "[DB] purgeBefore: range holds" << removed << "rows, plan" << rows.size()
+                << "; deleting by id";
+        ok = false;
+    }
+    // segments_all must not name a dropped table past this transaction.
+    for (qint64 m : dropped) partitions_.remove(m);
+    if (ok && !dropped.isEmpty() && !rebuildSegmentsView_()) {
+        qWarning() << "[DB] purgeBefore: segments_all rebuild failed; deleting by id";
+        ok = false;
+    }
+    if (!ok) {
+        db_.rollback();
+        if (!dropped.isEmpty()) loadPartitions_();
+        return gone;
+    }
+
+    refreshDays_(dayKeys_(rows));
+    exec("DELETE FROM gaps WHERE end_utc_ns IS NOT NULL AND end_utc_ns <"
+         " (SELECT MIN(s.start_utc_ns) FROM segments_all s WHERE s.camera_url=gaps.camera_url);");
+    if (!db_.commit()) {
+        qWarning() << "[DB] purgeBefore: commit failed" << db_.lastError().text();
+        db_.rollback();
+        coverageOut_.clear();
+        loadPartitions_();
+        return {};
+    }
+    unindex_(rows);
+    publishCoverage_();
+    gone.reserve(rows.size());
+    for (const RowKey& r : rows) gone.push_back(r.id);
+
+    // Freed pages are reused by new rows; with auto_vacuum=INCREMENTAL the file shrinks too.
+    if (!dropped.isEmpty()) {
+        QSqlQuery av(db_);
+        if (av.exec("PRAGMA auto_vacuum;") && av.next() && av.value(0).toInt() == 2) {
+            av.finish();
+            exec("PRAGMA incremental_vacuum;");
+        }
+    }
+    qInfo() << "[DB] purged" << gone.size() << "rows before" << horizons.size() << "root horizons"
+            << "; dropped" << dropped.size() << "month partitions";
+    return gone;
+}
+
 QVector<QPair<qint64, QString>> DbWriter::oldestFinalizedUnpinned(int limit, int cameraId, int minDays) {
+    flushPending_();
     QVector<QPair<qint64, QString>> out;
     QSqlQuery q(db_);
     QString sql = R"SQL(
       SELECT id, file_path
-      FROM segments
+      FROM segments_all
       WHERE status=1 AND pinned=0
         %1
         %2
       ORDER BY start_utc_ns ASC
       LIMIT :lim
     )SQL";
-    const QString cam = cameraId>0 ? "AND (camera_id=:cid OR camera_url=(SELECT main_url FROM cameras WHERE id=:cid))" : "";
+    const QString cam = cameraId>0 ? "AND camera_id=:cid" : "";
     const QString age = minDays>0 ? "AND start_utc_ns < ((strftime('%s','now') - :age)*1000000000)" : "";
     q.prepare(sql.arg(cam, age));
     if (cameraId>0) q.bindValue(":cid", cameraId);
@@ -161,22 +1350,482 @@ QVector<QPair<qint64, QString>> DbWriter::oldestFinalizedUnpinned(int limit, int
 }
 
 bool DbWriter::deleteSegmentRow(qint64 segmentId) {
-    QSqlQuery q(db_);
-    q.prepare("DELETE FROM segments WHERE id=?;");
-    q.addBindValue(segmentId);
-    if (!q.exec()) { qWarning() << "[DB] deleteSegmentRow:" << q.lastError().text(); return false; }
+    flushPending_();
+    const auto rows = rowKeys_({ segmentId });
+    if (rows.isEmpty()) return true;
+    if (execRouted_("DELETE FROM %1 WHERE id=?;", rows.first().startNs, { segmentId }) < 0) return false;
+    refreshDays_(dayKeys_(rows));
+    unindex_(rows);
+    publishCoverage_();
     return true;
 }
 
-bool DbWriter::markPinned(const QString& filePath, bool pinned) {
+// One transaction per batch; returns the ids actually removed. Rows pinned
+// since they were planned are left alone.
+QVector<qint64> DbWriter::deleteSegmentRows(const QVector<qint64>& ids) {
+    flushPending_();
+    QVector<qint64> gone;
+    if (ids.isEmpty()) return gone;
+    if (!db_.transaction()) { qWarning() << "[DB] deleteSegmentRows: begin failed"; return gone; }
+    const auto rows = rowKeys_(ids);
+
+    gone.reserve(rows.size());
+    for (const RowKey& r : rows)
+        if (execRouted_("DELETE FROM %1 WHERE id=? AND pinned=0;", r.startNs, { r.id }) > 0)
+            gone.push_back(r.id);
+    if (!gone.isEmpty()) refreshDays_(dayKeys_(rows));
+    // Gaps wholly older than a camera's oldest footage are history nobody can play.
+    if (!gone.isEmpty())
+        exec("DELETE FROM gaps WHERE end_utc_ns IS NOT NULL AND end_utc_ns <"
+             " (SELECT MIN(s.start_utc_ns) FROM segments_all s WHERE s.camera_url=gaps.camera_url);");
+    if (!db_.commit()) {
+        qWarning() << "[DB] deleteSegmentRows: commit failed" << db_.lastError().text();
+        db_.rollback();
+        coverageOut_.clear();
+        return {};
+    }
+    QVector<RowKey> removed;
+    for (const RowKey& r : rows) if (gone.contains(r.id)) removed.push_back(r);
+    unindex_(removed);
+    publishCoverage_();
+    return gone;
+}
+
+// Oldest full-rate, finalized, unpinned segments that ended before beforeUtcNs.
+QVector<ThinCandidate> DbWriter::thinCandidates(qint64 beforeUtcNs, int limit) {
+    flushPending_();
+    QVector<ThinCandidate> out;
     QSqlQuery q(db_);
-    q.prepare("UPDATE segments SET pinned=? WHERE file_path=?;");
-    q.addBindValue(pinned ? 1 : 0);
-    q.addBindValue(filePath);
-    if (!q.exec()) { qWarning() << "[DB] markPinned:" << q.lastError().text(); return false; }
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, file_path, COALESCE(size_bytes,0) FROM segments_all"
+              " WHERE tier=0 AND status=1 AND pinned=0 AND COALESCE(thin_skipped,0)=0"
+              " AND end_utc_ns < ? ORDER BY start_utc_ns LIMIT ?;");
+    q.addBindValue(beforeUtcNs);
+    q.addBindValue(qMax(1, limit));
+    if (!q.exec()) { qWarning() << "[DB] thinCandidates:" << q.lastError().text(); return out; }
+    while (q.next()) {
+        ThinCandidate c;
+        c.id        = q.value(0).toLongLong();
+        c.path      = q.value(1).toString();
+        c.sizeBytes = q.value(2).toLongLong();
+        out.push_back(c);
+    }
+    return out;
+}
+
+// One transaction per batch: record the thinned size and tier=1. Returns the
+// ids still present and still full-rate; only those files may be replaced.
+QVector<qint64> DbWriter::applyThinned(const QVector<ThinCandidate>& done) {
+    flushPending_();
+    QVector<qint64> ok;
+    if (done.isEmpty()) return ok;
+    if (!db_.transaction()) { qWarning() << "[DB] applyThinned: begin failed"; return ok; }
+
+    QHash<qint64, qint64> sizes;
+    QVector<qint64> ids;
+    for (const auto& c : done) { sizes.insert(c.id, c.sizeBytes); ids.push_back(c.id); }
+    QVector<RowKey> rows;
+    for (const RowKey& r : rowKeys_(ids)) {
+        if (execRouted_("UPDATE %1 SET size_bytes=?, tier=1 WHERE id=? AND tier=0 AND pinned=0;",
+                        r.startNs, { sizes.value(r.id), r.id }) <= 0)
+            continue;
+        ok.push_back(r.id);
+        rows.push_back(r);
+    }
+    refreshDays_(dayKeys_(rows));
+    if (!db_.commit()) {
+        qWarning() << "[DB] applyThinned: commit failed" << db_.lastError().text();
+        db_.rollback();
+        coverageOut_.clear();
+        return {};
+    }
+    reindex_(ok);
+    publishCoverage_();
+    return ok;
+}
+
+// Rows ArchiveThinner keeps full-rate: not a candidate again, tier=0 and the
+// size of the file actually on disk (also undoes applyThinned() for a file
+// whose rename failed).
+int DbWriter::markThinSkipped(const QVector<ThinCandidate>& rows) {
+    flushPending_();
+    if (rows.isEmpty()) return 0;
+    if (!db_.transaction()) { qWarning() << "[DB] markThinSkipped: begin failed"; return 0; }
+
+    QHash<qint64, qint64> sizes;
+    QVector<qint64> ids;
+    for (const auto& c : rows) { sizes.insert(c.id, c.sizeBytes); ids.push_back(c.id); }
+    QVector<qint64> ok;
+    QVector<RowKey> keys;
+    for (const RowKey& r : rowKeys_(ids)) {
+        if (execRouted_("UPDATE %1 SET size_bytes=?, tier=0, thin_skipped=1 WHERE id=? AND pinned=0;",
+                        r.startNs, { sizes.value(r.id), r.id }) <= 0)
+            continue;
+        ok.push_back(r.id);
+        keys.push_back(r);
+    }
+    refreshDays_(dayKeys_(keys));
+    if (!db_.commit()) {
+        qWarning() << "[DB] markThinSkipped: commit failed" << db_.lastError().text();
+        db_.rollback();
+        coverageOut_.clear();
+        return 0;
+    }
+    reindex_(ok);
+    publishCoverage_();
+    return ok.size();
+}
+
+// Short, finalized, unpinned full-rate segments that ended before beforeUtcNs,
+// up to perCamera for each camera in time order (the compactor groups
+// neighbours). Each camera resumes where its previous call stopped and wraps
+// around once it reaches the end, so no camera starves the others.
+QVector<CompactPiece> DbWriter::compactionCandidates(qint64 maxDurationMs, qint64 beforeUtcNs, int perCamera) {
+    flushPending_();
+    QVector<CompactPiece> out;
+    QStringList urls;
+    QSqlQuery cams(db_);
+    cams.setForwardOnly(true);
+    if (!cams.exec("SELECT main_url FROM cameras;")) {
+        qWarning() << "[DB] compactionCandidates:" << cams.lastError().text();
+        return out;
+    }
+    while (cams.next()) urls << cams.value(0).toString();
+
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, camera_url, file_path, COALESCE(codec,'h264'), start_utc_ns, end_utc_ns"
+              " FROM segments"
+              " WHERE camera_url=? AND start_utc_ns >= ?"
+              "   AND status=1 AND pinned=0 AND tier=0 AND end_utc_ns IS NOT NULL"
+              "   AND end_utc_ns < ? AND end_utc_ns - start_utc_ns < ?"
+              " ORDER BY start_utc_ns LIMIT ?;");
+    for (const QString& url : qAsConst(urls)) {
+        q.addBindValue(url);
+        q.addBindValue(compactFrom_.value(url, 0));
+        q.addBindValue(beforeUtcNs);
+        q.addBindValue(maxDurationMs * 1000000LL);
+        q.addBindValue(qMax(2, perCamera));
+        if (!q.exec()) { qWarning() << "[DB] compactionCandidates:" << q.lastError().text(); return out; }
+        int n = 0;
+        qint64 lastStart = 0;
+        while (q.next()) {
+            CompactPiece p;
+            p.id         = q.value(0).toLongLong();
+            p.cameraUrl  = q.value(1).toString();
+            p.path       = q.value(2).toString();
+            p.codec      = q.value(3).toString();
+            p.startUtcNs = q.value(4).toLongLong();
+            p.endUtcNs   = q.value(5).toLongLong();
+            lastStart    = p.startUtcNs;
+            out.push_back(p);
+            ++n;
+        }
+        // A full page restarts at its last piece, which may begin the next run.
+        if (n >= qMax(2, perCamera)) compactFrom_.insert(url, lastStart);
+        else compactFrom_.remove(url);
+    }
+    return out;
+}
+
+// One transaction: insert the merged row (session/camera/codec copied from
+// the first piece) and delete the pieces. Nothing changes unless every piece
+// is still present and unpinned. Returns the new row id, or 0.
+qint64 DbWriter::replaceWithCompacted(const QVector<qint64>& ids, const QString& filePath,
+                                      qint64 startUtcNs, qint64 endUtcNs, qint64 sizeBytes) {
+    flushPending_();
+    if (ids.isEmpty()) return 0;
+    if (!db_.transaction()) { qWarning() << "[DB] replaceWithCompacted: begin failed"; return 0; }
+
+    auto fail = [this](const QString& why) -> qint64 {
+        qWarning() << "[DB] replaceWithCompacted:" << why;
+        db_.rollback();
+        coverageOut_.clear();
+        return 0;
+    };
+
+    QSqlQuery chk(db_);
+    chk.prepare("SELECT COUNT(*) FROM segments WHERE id=? AND pinned=0 AND tier=0;");
+    for (qint64 id : ids) {
+        chk.addBindValue(id);
+        if (!chk.exec() || !chk.next() || chk.value(0).toInt() != 1)
+            return fail(QString("piece %1 changed").arg(id));
+    }
+
+    QSqlQuery ins(db_);
+    ins.prepare("INSERT INTO segments(session_id,camera_id,camera_url,file_path,start_utc_ns,end_utc_ns,"
+                "                     eff_end_ns,duration_ms,size_bytes,status,codec)"
+                " SELECT session_id,camera_id,camera_url,?,?,?,?,?,?,1,codec FROM segments WHERE id=?;");
+    ins.addBindValue(filePath);
+    ins.addBindValue(startUtcNs);
+    ins.addBindValue(endUtcNs);
+    ins.addBindValue(endUtcNs);
+    ins.addBindValue((endUtcNs - startUtcNs) / 1000000LL);
+    ins.addBindValue(sizeBytes);
+    ins.addBindValue(ids.first());
+    if (!ins.exec()) return fail(ins.lastError().text());
+    const qint64 newId = ins.lastInsertId().toLongLong();
+
+    // The pieces' files are unlinked later (takeRetiredFiles), not now.
+    QSqlQuery ret(db_);
+    ret.prepare("INSERT OR REPLACE INTO retired_files(path, retired_ns)"
+                " SELECT file_path, ? FROM segments WHERE id=?;");
+    QSqlQuery del(db_);
+    del.prepare("DELETE FROM segments WHERE id=?;");
+    const qint64 nowNs = QDateTime::currentMSecsSinceEpoch() * 1000000LL;
+    const auto rows = rowKeys_(ids);
+    for (qint64 id : ids) {
+        ret.addBindValue(nowNs);
+        ret.addBindValue(id);
+        if (!ret.exec()) return fail(ret.lastError().text());
+        del.addBindValue(id);
+        if (!del.exec()) return fail(del.lastError().text());
+    }
+    refreshDays_(dayKeys_(rows));
+    if (!db_.commit()) return fail(db_.lastError().text());
+    unindex_(rows);
+    reindex_({ newId });
+    publishCoverage_();
+    return newId;
+}
+
+// Retired files older than beforeNs; their rows are removed, so the caller
+// owns the unlink.
+QStringList DbWriter::takeRetiredFiles(qint64 beforeNs) {
+    flushPending_();
+    QStringList out;
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    q.prepare("SELECT path FROM retired_files WHERE retired_ns < ?;");
+    q.addBindValue(beforeNs);
+    if (!q.exec()) { qWarning() << "[DB] takeRetiredFiles:" << q.lastError().text(); return out; }
+    while (q.next()) out << q.value(0).toString();
+    if (out.isEmpty()) return out;
+    QSqlQuery del(db_);
+    del.prepare("DELETE FROM retired_files WHERE retired_ns < ?;");
+    del.addBindValue(beforeNs);
+    if (!del.exec()) { qWarning() << "[DB] takeRetiredFiles:" << del.lastError().text(); return {}; }
+    return out;
+}
+
+bool DbWriter::markPinned(const QString& filePath, bool pinned) {
+    flushPending_();
+    // By path only: hot table first, then the partitions, newest first.
+    QStringList tables{ QStringLiteral("segments") };
+    for (auto it = partitions_.cend(); it != partitions_.cbegin();) tables << *--it;
+    for (const QString& t : tables) {
+        QSqlQuery q(db_);
+        q.prepare(QString("UPDATE %1 SET pinned=? WHERE file_path=?;").arg(t));
+        q.addBindValue(pinned ? 1 : 0);
+        q.addBindValue(filePath);
+        if (!q.exec()) { qWarning() << "[DB] markPinned:" << q.lastError().text(); return false; }
+        if (q.numRowsAffected() > 0) break;
+    }
     return true;
 }
 
 void DbWriter::checkpointWal() {
-    exec("PRAGMA wal_checkpoint(TRUNCATE);");
+    flushPending_();
+    if (!db_.isOpen()) return;
+    if (checkpoint_("TRUNCATE")) lastTruncate_.start();
+}
+
+PurgePlan DbWriter::planPurge(const RootNeeds& needs, int defaultMinDays, bool applyQuotas) {
+    flushPending_();
+    PurgePlanner::Input in;
+    in.needs          = needs;
+    in.defaultMinDays = defaultMinDays;
+    in.applyQuotas    = applyQuotas;
+    in.nowUtcNs       = QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() * 1000000LL;
+    return PurgePlanner(db_).plan(in);
+}
+
+QHash<QString, CameraWriteStat> DbWriter::cameraWriteStats() {
+    flushPending_();
+    QHash<QString, CameraWriteStat> out;
+    const qint64 sinceNs = (QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() - 24LL*3600*1000) * 1000000LL;
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    q.prepare("SELECT camera_url, SUM(size_bytes)*1000/SUM(duration_ms) FROM segments"
+              " WHERE status=1 AND duration_ms>0 AND size_bytes>0 AND start_utc_ns>=?"
+              " GROUP BY camera_url;");
+    q.addBindValue(sinceNs);
+    if (!q.exec()) { qWarning() << "[DB] cameraWriteStats:" << q.lastError().text(); return out; }
+    while (q.next()) out[q.value(0).toString()].bytesPerSec = q.value(1).toLongLong();
+
+    QSqlQuery l(db_);
+    l.setForwardOnly(true);
+    if (!l.exec("SELECT camera_url, file_path FROM segments"
+                " WHERE id IN (SELECT MAX(id) FROM segments GROUP BY camera_url);")) {
+        qWarning() << "[DB] cameraWriteStats last:" << l.lastError().text();
+        return out;
+    }
+    while (l.next()) out[l.value(0).toString()].lastPath = l.value(1).toString();
+    return out;
+}
+
+bool DbWriter::setRetentionPolicy(const QString& scope, int scopeId, qint64 maxBytes, int minDays) {
+    QSqlQuery q(db_);
+    if (maxBytes <= 0 && minDays <= 0) {
+        q.prepare("DELETE FROM retention_policies WHERE scope=? AND scope_id=?;");
+        q.addBindValue(scope);
+        q.addBindValue(scopeId);
+    } else {
+        q.prepare("INSERT OR REPLACE INTO retention_policies(scope,scope_id,max_bytes,min_days)"
+                  " VALUES(?,?,?,?);");
+        q.addBindValue(scope);
+        q.addBindValue(scopeId);
+        q.addBindValue(qMax<qint64>(0, maxBytes));
+        q.addBindValue(qMax(0, minDays));
+    }
+    if (!q.exec()) { qWarning() << "[DB] setRetentionPolicy:" << q.lastError().text(); return false; }
+    return true;
+}
+
+// A camera's own schedule wins; otherwise the windows of all its groups are
+// merged and any group asking for event-only keeps it in event mode.
+QHash<QString, CameraSchedule> DbWriter::recordingSchedules() {
+    QHash<QString, CameraSchedule> out;
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT c.main_url, r.spec, r.off_mode FROM recording_schedules r"
+                " JOIN cameras c ON r.scope='camera' AND c.id=r.scope_id;")) {
+        qWarning() << "[DB] recordingSchedules:" << q.lastError().text();
+        return out;
+    }
+    while (q.next()) out.insert(q.value(0).toString(), { q.value(1).toString(), q.value(2).toString() });
+
+    QSqlQuery g(db_);
+    g.setForwardOnly(true);
+    if (!g.exec("SELECT c.main_url, r.spec, r.off_mode FROM recording_schedules r"
+                " JOIN camera_group_members m ON r.scope='group' AND m.group_id=r.scope_id"
+                " JOIN cameras c ON c.id=m.camera_id ORDER BY r.scope_id;")) {
+        return out;   // grouping schema not set up: camera schedules only
+    }
+    QSet<QString> own;
+    for (auto it = out.cbegin(); it != out.cend(); ++it) own.insert(it.key());
+    while (g.next()) {
+        const QString url = g.value(0).toString();
+        if (own.contains(url)) continue;
+        auto it = out.find(url);
+        if (it == out.end()) {
+            out.insert(url, { g.value(1).toString(), g.value(2).toString() });
+            continue;
+        }
+        it->spec += QLatin1Char(';') + g.value(1).toString();
+        if (g.value(2).toString() == QLatin1String("event")) it->offMode = QStringLiteral("event");
+    }
+    return out;
+}
+
+bool DbWriter::setRecordingSchedule(const QString& scope, int scopeId,
+                                    const QString& spec, const QString& offMode) {
+    QSqlQuery q(db_);
+    if (spec.trimmed().isEmpty()) {
+        q.prepare("DELETE FROM recording_schedules WHERE scope=? AND scope_id=?;");
+        q.addBindValue(scope);
+        q.addBindValue(scopeId);
+    } else {
+        q.prepare("INSERT OR REPLACE INTO recording_schedules(scope,scope_id,spec,off_mode)"
+                  " VALUES(?,?,?,?);");
+        q.addBindValue(scope);
+        q.addBindValue(scopeId);
+        q.addBindValue(spec.trimmed());
+        q.addBindValue(offMode == QLatin1String("event") ? offMode : QStringLiteral("stop"));
+    }
+    if (!q.exec()) { qWarning() << "[DB] setRecordingSchedule:" << q.lastError().text(); return false; }
+    return true;
+}
+
+// Open main-stream rows of other sessions, then every open sub-stream row:
+// sub_segments has no session, so call this before any recorder starts.
+QVector<SegmentRepair> DbWriter::openSegmentsForRecovery(const QString& excludeSessionId) {
+    flushPending_();
+    QVector<SegmentRepair> out;
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, file_path, start_utc_ns FROM segments"
+              " WHERE status=0 AND COALESCE(session_id,'')<>? ORDER BY start_utc_ns;");
+    q.addBindValue(excludeSessionId);
+    if (!q.exec()) { qWarning() << "[DB] openSegmentsForRecovery:" << q.lastError().text(); return out; }
+    while (q.next()) {
+        SegmentRepair r;
+        r.id         = q.value(0).toLongLong();
+        r.path       = q.value(1).toString();
+        r.startUtcNs = q.value(2).toLongLong();
+        out.push_back(r);
+    }
+    QSqlQuery s(db_);
+    s.setForwardOnly(true);
+    if (!s.exec("SELECT id, file_path, start_utc_ns FROM sub_segments WHERE status=0 ORDER BY start_utc_ns;")) {
+        qWarning() << "[DB] openSegmentsForRecovery sub:" << s.lastError().text();
+        return out;
+    }
+    while (s.next()) {
+        SegmentRepair r;
+        r.id         = s.value(0).toLongLong();
+        r.path       = s.value(1).toString();
+        r.startUtcNs = s.value(2).toLongLong();
+        r.sub        = true;
+        out.push_back(r);
+    }
+    return out;
+}
+
+qint64 DbWriter::openSegmentId(const QString& filePath, bool sub) {
+    flushPending_();
+    QSqlQuery& q = sub ? stmt_("SELECT id FROM sub_segments WHERE file_path=? AND status=0;")
+                       : stmt_("SELECT id FROM segments WHERE file_path=? AND status=0;");
+    q.addBindValue(filePath);
+    if (!q.exec()) { qWarning() << "[DB] openSegmentId:" << q.lastError().text(); return 0; }
+    const qint64 id = q.next() ? q.value(0).toLongLong() : 0;
+    q.finish();
+    return id;
+}
+
+int DbWriter::applySegmentRepairs(const QVector<SegmentRepair>& repairs) {
+    flushPending_();
+    if (repairs.isEmpty()) return 0;
+    if (!db_.transaction()) { qWarning() << "[DB] applySegmentRepairs: begin failed"; return 0; }
+    QVector<qint64> ids;
+    for (const auto& r : repairs) if (!r.sub) ids.push_back(r.id);
+    // An open row's end is only its expected span; the repaired end may reach another day.
+    auto rows = rowKeys_(ids);
+    for (RowKey& k : rows)
+        for (const auto& r : repairs)
+            if (!r.sub && !r.drop && r.id == k.id) k.endNs = qMax(k.endNs, r.endUtcNs);
+
+    QSqlQuery upd(db_), del(db_), subUpd(db_), subDel(db_);
+    const QString updSql("UPDATE %1 SET end_utc_ns=?, eff_end_ns=?, duration_ms=?, size_bytes=?, status=1"
+                         " WHERE id=? AND status=0;");
+    const QString delSql("DELETE FROM %1 WHERE id=? AND status=0;");
+    upd.prepare(updSql.arg("segments"));
+    del.prepare(delSql.arg("segments"));
+    subUpd.prepare(updSql.arg("sub_segments"));
+    subDel.prepare(delSql.arg("sub_segments"));
+
+    int applied = 0;
+    for (const auto& r : repairs) {
+        QSqlQuery& q = r.sub ? (r.drop ? subDel : subUpd) : (r.drop ? del : upd);
+        if (!r.drop) {
+            q.addBindValue(r.endUtcNs);
+            q.addBindValue(r.endUtcNs);
+            q.addBindValue(r.durationMs);
+            q.addBindValue(r.sizeBytes);
+        }
+        q.addBindValue(r.id);
+        if (!q.exec()) { qWarning() << "[DB] applySegmentRepairs id=" << r.id << q.lastError().text(); continue; }
+        ++applied;
+    }
+    refreshDays_(dayKeys_(rows));
+    if (!db_.commit()) {
+        qWarning() << "[DB] applySegmentRepairs: commit failed" << db_.lastError().text();
+        db_.rollback();
+        coverageOut_.clear();
+        return 0;
+    }
+    unindex_(rows);
+    reindex_(ids);   // repaired rows come back finalized; dropped ones stay out
+    publishCoverage_();
+    return applied;
 }
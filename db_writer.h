@@ -1,30 +1,224 @@
 #pragma once
 #include <QObject>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QString>
 #include <QVector>
+#include <QVariant>
 #include <QPair>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <atomic>
+#include "purge_planner.h"
+
+class QTimer;
+
+// Open (status=0) row left behind by a previous run, plus the values
+// crash recovery measured for it. drop=true removes the row instead.
+struct SegmentRepair {
+    qint64  id = 0;
+    QString path;
+    qint64  startUtcNs = 0;
+    qint64  endUtcNs = 0;
+    qint64  durationMs = 0;
+    qint64  sizeBytes = 0;
+    bool    drop = false;
+    bool    sub = false;     // sub_segments row (scrub track)
+};
+
+// Recent bitrate and newest file of one camera, for multi-root placement.
+struct CameraWriteStat {
+    qint64  bytesPerSec = 0;
+    QString lastPath;
+};
+
+// Segment for the keyframe-only tier: before thinning sizeBytes is the
+// recorded size, afterwards the size of the thinned copy.
+struct ThinCandidate {
+    qint64  id = 0;
+    QString path;
+    qint64  sizeBytes = 0;
+};
+
+// Resolved weekly schedule of one camera (see RecordingSchedule).
+struct CameraSchedule {
+    QString spec;                        // merged windows; empty = always
+    QString offMode = QStringLiteral("stop"); // outside the windows: stop | event
+};
+
+// Finalized short segment the compactor may merge with its neighbours.
+struct CompactPiece {
+    qint64  id = 0;
+    QString cameraUrl;
+    QString path;
+    QString codec;
+    qint64  startUtcNs = 0;
+    qint64  endUtcNs = 0;
+};
+
+// Recorder-event batching counters; readable from any thread.
+struct DbWriterStats {
+    int    queueDepth = 0;       // events waiting for the next commit
+    int    maxQueueDepth = 0;
+    qint64 batches = 0;
+    qint64 events = 0;
+    qint64 lastCommitUs = 0;
+    qint64 maxCommitUs = 0;
+    qint64 walBytes = 0;         // -wal file size at the last check
+    qint64 checkpoints = 0;
+    qint64 lastCheckpointUs = 0;
+    qint64 maxCheckpointUs = 0;
+    qint64 walPinnedMs = 0;      // how long checkpoints have been left incomplete
+    qint64 droppedEvents = 0;    // events discarded after repeated commit failures
+};
+
+/**
+ * Segment/gap events from the recorders (open, finalize, gap open/reopen)
+ * and logged events (addEvent, markError) are queued and committed in one
+ * transaction every CAMVIGIL_DB_BATCH_MS (default 200) or at 128 events,
+ * with statements prepared once per connection. Every other slot commits
+ * the queue first, so readers on this connection always see them. flush()
+ * forces a commit (shutdown).
+ *
+ * WAL checkpoints are scheduled here instead of inside commits
+ * (wal_autocheckpoint=0): every CAMVIGIL_WAL_CHECK_MS (default 1000) a
+ * PASSIVE checkpoint runs once the -wal file passes CAMVIGIL_WAL_CHECKPOINT_MB
+ * (default 16, also the journal_size_limit), and after CAMVIGIL_WAL_IDLE_MS
+ * (default 2000) without commits a complete PASSIVE one is followed by
+ * TRUNCATE. A checkpoint that stays incomplete for CAMVIGIL_WAL_PIN_WARN_SEC
+ * (default 60) means a reader holds an old snapshot; it is logged with the
+ * oldest unfinished DbReadPool reads.
+ *
+ * `segments` is the hot partition: open rows and the last
+ * CAMVIGIL_SEGMENT_HOT_MONTHS (default 2) local months. Older finalized rows
+ * are moved, a day per transaction, into per-month tables segments_pYYYYMM
+ * (listed in segment_partitions); readers use the view segments_all. A purge
+ * whose horizons all pass a month drops its table (purgeBefore).
+ *
+ * Committed segment rows are also appended to the binary SegmentJournal. It
+ * is rebuilt from segments_all when the last run did not close it cleanly,
+ * and refills a new, empty database.
+ */
 class DbWriter : public QObject {
     Q_OBJECT
 public:
     explicit DbWriter(QObject* parent=nullptr);
     ~DbWriter();
 
+    DbWriterStats stats() const;
+
 public slots:
     bool openAt(const QString& dbFile);
     void ensureCamera(const QString& mainUrl, const QString& subUrl, const QString& name);
     void beginSession(const QString& sessionId, const QString& archiveDir, int segmentSec);
     void addSegmentOpened(const QString& sessionId, const QString& cameraUrl,
-                          const QString& filePath, qint64 startUtcNs);
+                          const QString& filePath, qint64 startUtcNs,
+                          const QString& codec = QString());
     void finalizeSegmentByPath(const QString& filePath, qint64 endUtcNs, qint64 durationMs);
+    void addSubSegmentOpened(const QString& cameraUrl, const QString& filePath,
+                             qint64 startUtcNs, const QString& codec = QString());
+    void finalizeSubSegmentByPath(const QString& filePath, qint64 endUtcNs, qint64 durationMs);
+    QStringList expireSubSegments(int limit);
     void markError(const QString& where, const QString& detail);
+    void addEvent(const QString& cameraUrl, qint64 utcNs, const QString& type,
+                  const QString& source, const QString& detail = QString());
+    int  expireEvents(int limit);
+    void openGap(const QString& cameraUrl, qint64 startUtcNs,
+                 const QString& reason, const QString& detail = QString());
+    void reopenGap(const QString& cameraUrl, qint64 atUtcNs,
+                   const QString& reason, const QString& detail = QString());
+    int  openRecorderDownGaps();
     QVector<QPair<qint64, QString>> oldestFinalizedUnpinned(int limit, int cameraId = 0, int minDays = 0);
     bool deleteSegmentRow(qint64 segmentId);
+    QVector<qint64> deleteSegmentRows(const QVector<qint64>& ids);
     bool markPinned(const QString& filePath, bool pinned);
+    QVector<ThinCandidate> thinCandidates(qint64 beforeUtcNs, int limit);
+    QVector<qint64> applyThinned(const QVector<ThinCandidate>& done);
+    int markThinSkipped(const QVector<ThinCandidate>& rows);
+    QVector<CompactPiece> compactionCandidates(qint64 maxDurationMs, qint64 beforeUtcNs, int perCamera);
+    qint64 replaceWithCompacted(const QVector<qint64>& ids, const QString& filePath,
+                                qint64 startUtcNs, qint64 endUtcNs, qint64 sizeBytes);
+    QStringList takeRetiredFiles(qint64 beforeNs);
     void checkpointWal();
+    PurgePlan planPurge(const RootNeeds& needs, int defaultMinDays, bool applyQuotas);
+    QHash<QString, CameraWriteStat> cameraWriteStats();
+    bool setRetentionPolicy(const QString& scope, int scopeId, qint64 maxBytes, int minDays);
+    QHash<QString, CameraSchedule> recordingSchedules();   // by camera main_url
+    bool setRecordingSchedule(const QString& scope, int scopeId,
+                              const QString& spec, const QString& offMode);
+    QVector<SegmentRepair> openSegmentsForRecovery(const QString& excludeSessionId);
+    qint64 openSegmentId(const QString& filePath, bool sub = false);   // status=0 row, 0 if none
+    int applySegmentRepairs(const QVector<SegmentRepair>& repairs);
+    QVector<qint64> purgeBefore(const QVector<PurgeHorizon>& horizons, const QVector<PurgeVictim>& victims);
+    void flush();
 private:
+    struct Pending {
+        enum Kind { SegmentOpened, SegmentFinalized, SubOpened, SubFinalized,
+                    GapOpened, GapReopened, Event } kind;
+        QString url, path;         // path: event source for Event
+        QString text1, text2;      // session/reason/event type, codec/detail
+        qint64  t = 0;             // start or end, ns
+        qint64  durationMs = 0;
+        qint64  sizeBytes = 0;
+    };
+
     bool ensureSchema();
     bool migrateSchema_();
     bool exec(const QString& sql);
+    void enqueue_(Pending&& ev);
+    void flushPending_();
+    void checkpointTick_();
+    bool checkpoint_(const char* mode);
+    void apply_(const Pending& ev);
+    QSqlQuery& stmt_(const char* sql);
+    int cameraId_(const QString& url);
+    qint64 openSpanNs_(const QString& sessionId) const;
+    struct RowKey { qint64 id; int cameraId; qint64 startNs; qint64 endNs; };
+    QVector<RowKey> rowKeys_(const QVector<qint64>& segmentIds);
+    QSet<QPair<int, QString>> dayKeys_(const QVector<RowKey>& rows);
+    void refreshDays_(const QSet<QPair<int, QString>>& keys);
+    void publishCoverage_();
+    void reindex_(const QVector<qint64>& segmentIds);
+    void unindex_(const QVector<RowKey>& rows);
+    qint64 segmentsSeq_();
+    int  restoreFromJournal_();
+    void startJournalRebuild_();
+    void rebuildJournal_();
+    void loadPartitions_();
+    bool createPartition_(qint64 monthFromNs);
+    bool rebuildSegmentsView_();
+    void rollPartitions_();
+    int  execRouted_(const QString& sql, qint64 startNs, const QVariantList& binds);
+
     QSqlDatabase db_;
+    QVector<Pending> pending_;
+    QVector<qint64> touched_;      // segment ids the open batch changed (index refresh)
+    QHash<QPair<int, QString>, QByteArray> coverageOut_;   // refreshed days, published after commit
+    QTimer* batchTimer_ = nullptr;
+    int     batchMs_ = 200;              // CAMVIGIL_DB_BATCH_MS
+    QTimer* checkpointTimer_ = nullptr;
+    QTimer* partitionTimer_ = nullptr;
+    QMap<qint64, QString> partitions_;   // month start (ns) -> table, oldest first
+    qint64 rolledRows_ = 0;
+    QHash<QString, qint64> compactFrom_;   // camera url -> start the next candidate page resumes at
+    QVector<qint64> journalDays_;        // UTC day keys the journal rebuild has left
+    qint64 journalRows_ = 0;
+    QElapsedTimer journalClock_;
+    QString walPath_;
+    qint64  walLimit_ = 16 * 1024 * 1024;   // CAMVIGIL_WAL_CHECKPOINT_MB
+    QElapsedTimer lastCommit_, lastTruncate_, pinnedSince_, pinnedWarned_;
+    QHash<const char*, QSqlQuery> stmts_;
+    QHash<QString, int> camIds_;
+    QHash<QString, qint64> sessionSpanNs_;
+    QElapsedTimer statsClock_;
+    std::atomic<int>    queueDepth_{0}, maxQueueDepth_{0};
+    std::atomic<qint64> batches_{0}, events_{0}, lastCommitUs_{0}, maxCommitUs_{0};
+    std::atomic<qint64> walBytes_{0}, checkpoints_{0}, lastCheckpointUs_{0}, maxCheckpointUs_{0},
+                        walPinnedMs_{0}, droppedEvents_{0};
+    int commitFailures_ = 0;            // consecutive failed batch commits
+    int retryDelayMs_ = 0;              // backoff before the next attempt
+    QElapsedTimer retryClock_;
 };
@@ -7,6 +7,8 @@
 #include <QDebug>
 #include <QtGlobal>
 
+#include "db_read_pool.h"
+
 GroupRepository::GroupRepository(const QString& dbPath)
     : m_dbPath(dbPath)
 {
@@ -143,13 +145,13 @@ bool GroupRepository::ensureSchemaGroups()
 QVector<CameraGroupInfo> GroupRepository::listGroups()
 {
     QVector<CameraGroupInfo> out;
-    if (!open()) {
+    const QSqlDatabase db = DbReadPool::connection(m_dbPath);
+    if (!db.isOpen()) {
         return out;
     }
 
-    QSqlQuery q(m_db);
-    q.prepare(QStringLiteral("SELECT id, name FROM camera_groups ORDER BY name;"));
-    if (!q.exec()) {
+    DbReadPool::Query q = DbReadPool::prepared(db, QStringLiteral("SELECT id, name FROM camera_groups ORDER BY name;"));
+    if (!DbReadPool::exec(q)) {
         qWarning() << "[GroupRepository] listGroups error:" << q.lastError().text();
         return out;
     }
@@ -278,21 +280,18 @@ int GroupRepository::findCameraIdByMainUrl(const QString& mainUrl)
     if (trimmedUrl.isEmpty()) {
         return -1;
     }
-    if (!open()) {
+    const QSqlDatabase db = DbReadPool::connection(m_dbPath);
+    if (!db.isOpen()) {
         return -1;
     }
 
-    QSqlQuery q(m_db);
-    q.prepare(QStringLiteral("SELECT id FROM cameras WHERE main_url=?;"));
+    DbReadPool::Query q = DbReadPool::prepared(db, QStringLiteral("SELECT id FROM cameras WHERE main_url=?;"));
     q.addBindValue(trimmedUrl);
-    if (!q.exec()) {
+    if (!DbReadPool::exec(q)) {
         qWarning() << "[GroupRepository] findCameraIdByMainUrl error:" << q.lastError().text();
         return -1;
     }
-    if (q.next()) {
-        return q.value(0).toInt();
-    }
-    return -1;
+    return q.next() ? q.value(0).toInt() : -1;
 }
 
 QVector<int> GroupRepository::listCameraIdsForGroup(int groupId)
@@ -301,16 +300,16 @@ QVector<int> GroupRepository::listCameraIdsForGroup(int groupId)
     if (groupId <= 0) {
         return out;
     }
-    if (!open()) {
+    const QSqlDatabase db = DbReadPool::connection(m_dbPath);
+    if (!db.isOpen()) {
         return out;
     }
 
-    QSqlQuery q(m_db);
-    q.prepare(QStringLiteral(
+    DbReadPool::Query q = DbReadPool::prepared(db, QStringLiteral(
         "SELECT camera_id FROM camera_group_members "
         "WHERE group_id=? ORDER BY camera_id;"));
     q.addBindValue(groupId);
-    if (!q.exec()) {
+    if (!DbReadPool::exec(q)) {
         qWarning() << "[GroupRepository] listCameraIdsForGroup error:" << q.lastError().text();
         return out;
     }
@@ -327,16 +326,16 @@ QVector<int> GroupRepository::listGroupIdsForCamera(int cameraId)
     if (cameraId <= 0) {
         return out;
     }
-    if (!open()) {
+    const QSqlDatabase db = DbReadPool::connection(m_dbPath);
+    if (!db.isOpen()) {
         return out;
     }
 
-    QSqlQuery q(m_db);
-    q.prepare(QStringLiteral(
+    DbReadPool::Query q = DbReadPool::prepared(db, QStringLiteral(
         "SELECT group_id FROM camera_group_members "
         "WHERE camera_id=? ORDER BY group_id;"));
     q.addBindValue(cameraId);
-    if (!q.exec()) {
+    if (!DbReadPool::exec(q)) {
         qWarning() << "[GroupRepository] listGroupIdsForCamera error:" << q.lastError().text();
         return out;
     }
@@ -413,15 +412,15 @@ bool GroupRepository::setCameraGroups(int cameraId, const QVector<int>& groupIds
 QVector<CameraRowInfo> GroupRepository::listAllCameras()
 {
     QVector<CameraRowInfo> out;
-    if (!open()) {
+    const QSqlDatabase db = DbReadPool::connection(m_dbPath);
+    if (!db.isOpen()) {
         return out;
     }
 
-    QSqlQuery q(m_db);
-    q.prepare(QStringLiteral(
+    DbReadPool::Query q = DbReadPool::prepared(db, QStringLiteral(
         "SELECT id, COALESCE(name, ''), COALESCE(main_url, '') "
         "FROM cameras ORDER BY name, id;"));
-    if (!q.exec()) {
+    if (!DbReadPool::exec(q)) {
         qWarning() << "[GroupRepository] listAllCameras error:" << q.lastError().text();
         return out;
     }
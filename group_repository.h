@@ -48,6 +48,6 @@ private:
     bool ensureSchemaCameras();         // ensure base cameras table exists if needed
     bool ensureSchemaGroupsInternal();  // create group tables
 
-    // Local connection handle for this repository.
+    // Read-write handle, opened on the first write; reads go through DbReadPool.
     QSqlDatabase m_db;
 };
@@ -0,0 +1,115 @@
+#include "io_policy.h"
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThreadPool>
+#include <QDebug>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const qint64 kTailBytes = 1024 * 1024;   // matroska Cues live at the end
+
+bool IoPolicy::enabled() {
+    static const bool on = qEnvironmentVariable("CAMVIGIL_IO_POLICY", QStringLiteral("1")) != QLatin1String("0");
+    return on;
+}
+
+qint64 IoPolicy::readAheadBytes() {
+    bool ok = false;
+    const int mb = qEnvironmentVariable("CAMVIGIL_READAHEAD_MB").toInt(&ok);
+    return qint64((ok && mb > 0) ? qBound(1, mb, 512) : 16) * 1024 * 1024;
+}
+
+// One thread: fdatasync of finished segments must not pile up on the disk
+// the cameras are writing to.
+static QThreadPool* dropPool() {
+    static QThreadPool* p = [] {
+        auto* tp = new QThreadPool;
+        tp->setMaxThreadCount(1);
+        tp->setExpiryTimeout(-1);
+        return tp;
+    }();
+    return p;
+}
+
+static QThreadPool* readPool() {
+    static QThreadPool* p = [] {
+        auto* tp = new QThreadPool;
+        tp->setMaxThreadCount(2);
+        return tp;
+    }();
+    return p;
+}
+
+void IoPolicy::dropWritten(const QString& path) {
+#if defined(Q_OS_LINUX)
+    if (!enabled() || path.isEmpty()) return;
+    dropPool()->start([path] {
+        static QAtomicInteger<qint64> files = 0, bytes = 0, syncMs = 0;
+        const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        QElapsedTimer t; t.start();
+        // DONTNEED skips dirty pages: write them back first.
+        ::fdatasync(fd);
+        const qint64 ms = t.elapsed();
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        const qint64 size = ::lseek(fd, 0, SEEK_END);
+        ::close(fd);
+
+        const qint64 n = files.fetchAndAddRelaxed(1) + 1;
+        bytes.fetchAndAddRelaxed(qMax<qint64>(0, size));
+        syncMs.fetchAndAddRelaxed(ms);
+        if (n % 100 == 0) {
+            qInfo() << "[IoPolicy] dropped" << n << "files"
+                    << "bytes=" << bytes.loadRelaxed()
+                    << "avg_sync_ms=" << syncMs.loadRelaxed() / n;
+        }
+    });
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+void IoPolicy::readAhead(const QString& path, qint64 headBytes) {
+#if defined(Q_OS_LINUX)
+    if (!enabled() || path.isEmpty()) return;
+    const qint64 head = headBytes > 0 ? headBytes : readAheadBytes();
+    readPool()->start([path, head] {
+        const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        const qint64 size = ::lseek(fd, 0, SEEK_END);
+        ::posix_fadvise(fd, 0, qMin(head, size), POSIX_FADV_WILLNEED);
+        if (size > head)
+            ::posix_fadvise(fd, qMax(head, size - kTailBytes), 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    });
+#else
+    Q_UNUSED(path); Q_UNUSED(headBytes);
+#endif
+}
+
+bool IoPolicy::syncFile(const QString& path) {
+#if defined(Q_OS_LINUX)
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    const bool ok = ::fdatasync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    QFile f(path);
+    return f.open(QIODevice::ReadWrite) && f.flush();
+#endif
+}
+
+void IoPolicy::dropRange(int fd, qint64 offset, qint64 len) {
+#if defined(Q_OS_LINUX)
+    if (!enabled() || fd < 0 || len <= 0) return;
+    ::posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+#else
+    Q_UNUSED(fd); Q_UNUSED(offset); Q_UNUSED(len);
+#endif
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * IoPolicy
+ * --------
+ * Page-cache hints so recording does not evict footage that is being
+ * reviewed.
+ * - Recorder: a finished file is flushed and dropped from the page cache
+ *   (fdatasync + POSIX_FADV_DONTNEED) on one background thread; it is only
+ *   re-read by playback/export, which ask for it explicitly.
+ * - Playback/export: readAhead() asks the kernel to load the head and the
+ *   Cues (tail) of the next file while the current one plays.
+ * - API downloads drop what they served (dropRange), so remote pulls of old
+ *   footage do not displace local playback.
+ * All calls are hints: no-ops when disabled or unsupported, never fail.
+ *
+ * Env:
+ *   CAMVIGIL_IO_POLICY     1 = on (default), 0 = leave the page cache alone
+ *   CAMVIGIL_READAHEAD_MB  head bytes prefetched per file (default 16)
+ */
+class IoPolicy final {
+public:
+    static bool   enabled();
+    static qint64 readAheadBytes();
+
+    // Flush `path` and drop its pages; asynchronous, serialized.
+    static void dropWritten(const QString& path);
+
+    // Prefetch the first `headBytes` (default readAheadBytes()) and the last
+    // MiB of `path`; asynchronous.
+    static void readAhead(const QString& path, qint64 headBytes = -1);
+
+    // Drop [offset, offset+len) of an open descriptor after a one-off read.
+    static void dropRange(int fd, qint64 offset, qint64 len);
+
+    // Not a hint: flush `path` to disk before it replaces another file.
+    // Synchronous, ignores CAMVIGIL_IO_POLICY; false if the flush failed.
+    static bool syncFile(const QString& path);
+};
@@ -5,8 +5,16 @@
  *   curl -H "Authorization: Bearer $TOKEN" http://$NODE:8080/api/v1/node/info
  *   curl -H "Authorization: Bearer $TOKEN" http://$NODE:8080/api/v1/cameras
  *   curl -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/recordings?camera_id=1&from=2024-05-01T00:00:00Z&to=2024-05-01T23:59:59Z"
+ *   curl -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/gaps?camera_id=1&from=2024-05-01T00:00:00Z&to=2024-05-01T23:59:59Z"
+ *   curl -X POST -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/events?camera_id=1&reason=motion"
+ *   curl -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/events?camera_id=1&type=alarm,pipeline_error&from=2024-05-01T00:00:00Z"
+ *   curl -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/coverage?camera_id=1,2,3&from=2024-05-01&to=2024-05-31"
+ *   curl -X POST -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/retention?scope=camera&id=1&max_bytes=2000000000000&min_days=14"
+ *   curl -X POST -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/schedules?scope=group&id=2&off_mode=event" --data-urlencode "spec=mon-fri 18:00-08:00; sat,sun 00:00-24:00" -G
  *   curl -H "Authorization: Bearer $TOKEN" -H "Range: bytes=0-1023" http://$NODE:8080/media/segments/12345 -o first-kb.bin
  *   curl -I -H "Authorization: Bearer $TOKEN" http://$NODE:8080/media/segments/12345
+ *   curl -H "Authorization: Bearer $TOKEN" "http://$NODE:8080/api/v1/recordings?camera_id=1&stream=sub"
+ *   curl -H "Authorization: Bearer $TOKEN" http://$NODE:8080/media/sub_segments/678 -o scrub.mkv
  */
 #include "node_api_server.h"
 
@@ -24,7 +32,9 @@
 #include <QElapsedTimer>
 #include <QDebug>
 
+#include "io_policy.h"
 #include "node_core_service.h"
+#include "recording_schedule.h"
 
 namespace {
 
@@ -308,6 +318,8 @@ NodeApiServer::HttpResponsePayload NodeApiServer::handleRequest(const HttpReques
             c["rtsp_sub"] = cam.rtspSub;
             c["is_recording"] = cam.isRecording;
             c["live_proxy_rtsp"] = cam.liveProxyRtsp;
+            c["codec"] = cam.codec;
+            c["gap_reason"] = cam.gapReason;
             arr.append(c);
         }
         QJsonObject payload;
@@ -324,18 +336,23 @@ NodeApiServer::HttpResponsePayload NodeApiServer::handleRequest(const HttpReques
         const QDateTime from = QDateTime::fromString(query.queryItemValue("from"), Qt::ISODate);
         const QDateTime to = QDateTime::fromString(query.queryItemValue("to"), Qt::ISODate);
 
-        QVector<NodeSegment> segments = m_core->listSegments(cameraId, from, to);
+        const bool sub = query.queryItemValue("stream") == QLatin1String("sub");
+
+        QVector<NodeSegment> segments = m_core->listSegments(cameraId, from, to, sub);
 
         QJsonArray arr;
         for (const auto& seg : segments) {
             QJsonObject s;
             s["segment_id"] = static_cast<double>(seg.segmentId);
+            s["stream"] = sub ? QStringLiteral("sub") : QStringLiteral("main");
             s["camera_id"] = seg.cameraId;
             s["start"] = seg.start.toString(Qt::ISODate);
             s["end"] = seg.end.toString(Qt::ISODate);
             s["duration_sec"] = seg.durationSec;
             s["size_bytes"] = static_cast<double>(seg.sizeBytes);
             s["file_path"] = seg.filePath;
+            s["codec"] = seg.codec;
+            s["keyframe_only"] = seg.keyframeOnly;
             arr.append(s);
         }
         QJsonObject payload;
@@ -343,7 +360,171 @@ NodeApiServer::HttpResponsePayload NodeApiServer::handleRequest(const HttpReques
         return jsonPayload(200, QByteArray(), payload, req.requestId);
     }
 
-    if ((method == "GET" || method == "HEAD") && path.startsWith("/media/segments/")) {
+    if (method == "GET" && path == "/api/v1/gaps") {
+        if (!m_core) {
+            return jsonError(500, "core_unavailable", "NodeCoreService unavailable", req.requestId);
+        }
+        QUrlQuery query(req.url);
+        const int cameraId = query.queryItemValue("camera_id").toInt();
+        const QDateTime from = QDateTime::fromString(query.queryItemValue("from"), Qt::ISODate);
+        const QDateTime to = QDateTime::fromString(query.queryItemValue("to"), Qt::ISODate);
+
+        QVector<NodeGap> gaps = m_core->listGaps(cameraId, from, to);
+
+        QJsonArray arr;
+        for (const auto& gap : gaps) {
+            QJsonObject g;
+            g["camera_id"] = gap.cameraId;
+            g["start"] = gap.start.toString(Qt::ISODate);
+            g["end"] = gap.end.isValid() ? QJsonValue(gap.end.toString(Qt::ISODate)) : QJsonValue();
+            g["open"] = !gap.end.isValid();
+            g["reason"] = gap.reason;
+            g["detail"] = gap.detail;
+            arr.append(g);
+        }
+        QJsonObject payload;
+        payload["gaps"] = arr;
+        return jsonPayload(200, QByteArray(), payload, req.requestId);
+    }
+
+    if (method == "GET" && path == "/api/v1/coverage") {
+        if (!m_core) {
+            return jsonError(500, "core_unavailable", "NodeCoreService unavailable", req.requestId);
+        }
+        QUrlQuery query(req.url);
+        QVector<int> cameraIds;
+        for (const QString& id : query.queryItemValue("camera_id").split(',', Qt::SkipEmptyParts)) {
+            if (id.toInt() > 0) cameraIds.append(id.toInt());
+        }
+        const QDate from = QDate::fromString(query.queryItemValue("from"), Qt::ISODate);
+        const QDate to = QDate::fromString(query.queryItemValue("to"), Qt::ISODate);
+
+        QVector<NodeDayCoverage> coverage = m_core->listCoverage(cameraIds, from, to);
+
+        QJsonArray arr;
+        for (const auto& day : coverage) {
+            QJsonObject c;
+            c["camera_id"] = day.cameraId;
+            c["day"] = day.day.toString(Qt::ISODate);
+            c["covered_minutes"] = day.coveredMinutes;
+            c["bitmap"] = QString::fromLatin1(day.bitmap.toBase64());
+            arr.append(c);
+        }
+        QJsonObject payload;
+        payload["coverage"] = arr;
+        return jsonPayload(200, QByteArray(), payload, req.requestId);
+    }
+
+    if (method == "GET" && path == "/api/v1/events") {
+        if (!m_core) {
+            return jsonError(500, "core_unavailable", "NodeCoreService unavailable", req.requestId);
+        }
+        QUrlQuery query(req.url);
+        const int cameraId = query.queryItemValue("camera_id").toInt();
+        const QDateTime from = QDateTime::fromString(query.queryItemValue("from"), Qt::ISODate);
+        const QDateTime to = QDateTime::fromString(query.queryItemValue("to"), Qt::ISODate);
+        const QStringList types = query.queryItemValue("type").split(',', Qt::SkipEmptyParts);
+        bool limitOk = false;
+        int limit = query.queryItemValue("limit").toInt(&limitOk);
+        if (!limitOk || limit <= 0) limit = 1000;
+
+        QVector<NodeEvent> events = m_core->listEvents(cameraId, from, to, types, limit);
+
+        QJsonArray arr;
+        for (const auto& ev : events) {
+            QJsonObject e;
+            e["event_id"] = static_cast<double>(ev.eventId);
+            e["camera_id"] = ev.cameraId;
+            e["time"] = ev.time.toString(Qt::ISODate);
+            e["type"] = ev.type;
+            e["source"] = ev.source;
+            e["detail"] = ev.detail;
+            arr.append(e);
+        }
+        QJsonObject payload;
+        payload["events"] = arr;
+        return jsonPayload(200, QByteArray(), payload, req.requestId);
+    }
+
+    if (method == "POST" && path == "/api/v1/events") {
+        if (!m_core) {
+            return jsonError(500, "core_unavailable", "NodeCoreService unavailable", req.requestId);
+        }
+        QUrlQuery query(req.url);
+        const int cameraId = query.queryItemValue("camera_id").toInt();
+        QString reason = query.queryItemValue("reason");
+        if (reason.isEmpty()) reason = QStringLiteral("api");
+
+        const int rc = m_core->triggerEvent(cameraId, reason);
+        if (rc < 0) {
+            return jsonError(404, "camera_not_found", "Unknown camera_id", req.requestId);
+        }
+        if (rc == 0) {
+            return jsonError(409, "not_event_mode", "Camera records continuously", req.requestId);
+        }
+        QJsonObject payload;
+        payload["camera_id"] = cameraId;
+        payload["reason"] = reason;
+        payload["accepted"] = true;
+        return jsonPayload(202, QByteArray(), payload, req.requestId);
+    }
+
+    if (method == "POST" && path == "/api/v1/retention") {
+        if (!m_core) {
+            return jsonError(500, "core_unavailable", "NodeCoreService unavailable", req.requestId);
+        }
+        QUrlQuery query(req.url);
+        const QString scope = query.queryItemValue("scope");
+        const int scopeId = query.queryItemValue("id").toInt();
+        const qint64 maxBytes = qMax<qint64>(0, query.queryItemValue("max_bytes").toLongLong());
+        const int minDays = qMax(0, query.queryItemValue("min_days").toInt());
+        if ((scope != "camera" && scope != "group") || scopeId <= 0) {
+            return jsonError(400, "bad_request", "scope must be camera|group and id > 0", req.requestId);
+        }
+        if (!m_core->setRetentionPolicy(scope, scopeId, maxBytes, minDays)) {
+            return jsonError(500, "db_error", "Retention policy not saved", req.requestId);
+        }
+        QJsonObject payload;
+        payload["scope"] = scope;
+        payload["id"] = scopeId;
+        payload["max_bytes"] = static_cast<double>(maxBytes);
+        payload["min_days"] = minDays;
+        payload["removed"] = maxBytes == 0 && minDays == 0;
+        return jsonPayload(200, QByteArray(), payload, req.requestId);
+    }
+
+    if (method == "POST" && path == "/api/v1/schedules") {
+        if (!m_core) {
+            return jsonError(500, "core_unavailable", "NodeCoreService unavailable", req.requestId);
+        }
+        QUrlQuery query(req.url);
+        const QString scope = query.queryItemValue("scope");
+        const int scopeId = query.queryItemValue("id").toInt();
+        const QString spec = query.queryItemValue("spec", QUrl::FullyDecoded);
+        const QString offMode = query.hasQueryItem("off_mode")
+            ? query.queryItemValue("off_mode") : QStringLiteral("stop");
+        bool specOk = false;
+        RecordingSchedule::parse(spec, &specOk);
+        if ((scope != "camera" && scope != "group") || scopeId <= 0
+            || (offMode != "stop" && offMode != "event") || !specOk) {
+            return jsonError(400, "bad_request",
+                             "scope must be camera|group, id > 0, off_mode stop|event and spec valid",
+                             req.requestId);
+        }
+        if (!m_core->setRecordingSchedule(scope, scopeId, spec, offMode)) {
+            return jsonError(500, "db_error", "Recording schedule not saved", req.requestId);
+        }
+        QJsonObject payload;
+        payload["scope"] = scope;
+        payload["id"] = scopeId;
+        payload["spec"] = spec.trimmed();
+        payload["off_mode"] = offMode;
+        payload["removed"] = spec.trimmed().isEmpty();
+        return jsonPayload(200, QByteArray(), payload, req.requestId);
+    }
+
+    if ((method == "GET" || method == "HEAD")
+        && (path.startsWith("/media/segments/") || path.startsWith("/media/sub_segments/"))) {
         const QString idStr = path.section('/', 3, 3);
         bool ok = false;
         const qint64 segId = idStr.toLongLong(&ok);
@@ -351,7 +532,8 @@ NodeApiServer::HttpResponsePayload NodeApiServer::handleRequest(const HttpReques
             return jsonError(400, "invalid_segment_id", "Segment id must be numeric", req.requestId);
         }
         const bool isHead = (method == "HEAD");
-        return handleMediaRequest(req, segId, isHead);
+        const bool sub = path.startsWith("/media/sub_segments/");
+        return handleMediaRequest(req, segId, isHead, sub);
     }
 
     if (method == "GET" && path == "/api/v1/health") {
@@ -376,13 +558,14 @@ NodeApiServer::HttpResponsePayload NodeApiServer::handleRequest(const HttpReques
 
 NodeApiServer::HttpResponsePayload NodeApiServer::handleMediaRequest(const HttpRequestContext& req,
                                                                      qint64 segmentId,
-                                                                     bool isHead)
+                                                                     bool isHead,
+                                                                     bool subStream)
 {
     if (!m_core) {
         return jsonError(500, "core_unavailable", "NodeCoreService unavailable", req.requestId);
     }
     bool found = false;
-    const NodeSegment seg = m_core->segmentById(segmentId, &found);
+    const NodeSegment seg = m_core->segmentById(segmentId, &found, subStream);
     if (!found || seg.filePath.isEmpty()) {
         return jsonError(404, "segment_not_found", "Segment not found", req.requestId);
     }
@@ -436,6 +619,8 @@ NodeApiServer::HttpResponsePayload NodeApiServer::handleMediaRequest(const HttpR
 
     resp.body = f.read(length);
     resp.explicitContentLength = resp.body.size();
+    // One-off remote pull: keep it from displacing footage cached for playback.
+    IoPolicy::dropRange(f.handle(), start, resp.body.size());
     if (resp.body.size() != length) {
         qWarning() << "[NodeApiServer] Short read while serving segment" << segmentId
                    << "expected" << length << "bytes got" << resp.body.size();
@@ -449,10 +634,12 @@ QByteArray statusTextFor(int status)
 {
     switch (status) {
     case 200: return QByteArray("OK");
+    case 202: return QByteArray("Accepted");
     case 206: return QByteArray("Partial Content");
     case 400: return QByteArray("Bad Request");
     case 401: return QByteArray("Unauthorized");
     case 404: return QByteArray("Not Found");
+    case 409: return QByteArray("Conflict");
     case 416: return QByteArray("Range Not Satisfiable");
     case 500: return QByteArray("Internal Server Error");
     default: return QByteArray("Error");
@@ -56,7 +56,8 @@ private:
     HttpResponsePayload handleRequest(const HttpRequestContext& req);
     HttpResponsePayload handleMediaRequest(const HttpRequestContext& req,
                                            qint64 segmentId,
-                                           bool isHead);
+                                           bool isHead,
+                                           bool subStream = false);
     HttpResponsePayload jsonPayload(int status,
                                     const QByteArray& statusText,
                                     const QJsonValue& value,
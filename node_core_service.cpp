@@ -7,10 +7,19 @@
 #include <QSqlError>
 #include <QVariant>
 #include <QFileInfo>
+#include <QThread>
 
+#include "archive_limits.h"
+#include "archive_roots.h"
+#include "archive_segment_index.h"
 #include "archivemanager.h"
 #include "storageservice.h"
 #include "node_restreamer.h"
+#include "recording_coverage.h"
+#include "recording_schedule.h"
+#include "segment_journal.h"
+#include "segment_queries.h"
+#include "db_read_pool.h"
 #include "db_reader.h"
 #include "db_writer.h"
 
@@ -32,34 +41,18 @@ NodeCoreService::NodeCoreService(DbReader* dbReader,
 {
     if (m_archiveManager) {
         m_dbPath = m_archiveManager->databasePath();
-        if (!m_dbPath.isEmpty()) {
-            m_dbConnName = QStringLiteral("node_core_ro_%1")
-                               .arg(reinterpret_cast<quintptr>(this));
-            m_db = QSqlDatabase::addDatabase("QSQLITE", m_dbConnName);
-            m_db.setDatabaseName(m_dbPath);
-            m_db.setConnectOptions(
-                "QSQLITE_OPEN_READONLY=1;"
-                "QSQLITE_ENABLE_SHARED_CACHE=1;"
-                "QSQLITE_BUSY_TIMEOUT=2000");
-            if (!m_db.open()) {
-                qWarning() << "[NodeCoreService] DB open failed for" << m_dbPath
-                           << ":" << m_db.lastError().text();
-            }
+        if (!m_dbPath.isEmpty() && !readDb_().isOpen()) {
+            qWarning() << "[NodeCoreService] DB open failed for" << m_dbPath;
         }
     }
 }
 
-NodeCoreService::~NodeCoreService()
+NodeCoreService::~NodeCoreService() = default;
+
+// Calls arrive on the API server's threads; each gets its own pooled connection.
+QSqlDatabase NodeCoreService::readDb_() const
 {
-    if (m_db.isValid()) {
-        if (m_db.isOpen()) {
-            m_db.close();
-        }
-        m_db = QSqlDatabase();
-    }
-    if (!m_dbConnName.isEmpty()) {
-        QSqlDatabase::removeDatabase(m_dbConnName);
-    }
+    return DbReadPool::connection(m_dbPath);
 }
 
 namespace {
@@ -77,9 +70,12 @@ NodeInfo NodeCoreService::getNodeInfo() const
     info.uptimeSeconds = m_startupTime.secsTo(now);
 
     if (m_archiveManager) {
-        const QString root = m_archiveManager->archiveRoot();
-        QStorageInfo s(root);
-        if (s.isValid()) {
+        for (const QString& root : m_archiveManager->archiveRoots()) {
+            QStorageInfo s(root);
+            if (!s.isValid()) {
+                qWarning() << "[NodeCoreService] StorageInfo invalid for" << root;
+                continue;
+            }
             NodeInfo::StorageInfo si;
             si.mountPoint = root;
             si.totalBytes = static_cast<quint64>(s.bytesTotal());
@@ -89,8 +85,6 @@ NodeInfo NodeCoreService::getNodeInfo() const
                                  ? (static_cast<double>(freeBytes) / si.totalBytes) * 100.0
                                  : 0.0;
             info.storage.append(si);
-        } else {
-            qWarning() << "[NodeCoreService] StorageInfo invalid for" << root;
         }
     } else if (m_storageService) {
         NodeInfo::StorageInfo si;
@@ -103,12 +97,12 @@ NodeInfo NodeCoreService::getNodeInfo() const
     info.totalCameras = 0;
     info.recordingCameras = 0;
 
-    if (m_db.isValid() && m_db.isOpen()) {
-        QSqlQuery q(m_db);
+    if (isDatabaseOk()) {
+        QSqlQuery q(readDb_());
         if (q.exec(QStringLiteral("SELECT COUNT(*) FROM cameras;")) && q.next()) {
             info.totalCameras = q.value(0).toInt();
         }
-        if (q.exec(QStringLiteral("SELECT COUNT(DISTINCT camera_id) FROM segments WHERE status IN (0,1);"))
+        if (q.exec(QStringLiteral("SELECT COUNT(DISTINCT camera_id) FROM recording_days WHERE camera_id>0;"))
             && q.next()) {
             info.recordingCameras = q.value(0).toInt();
         }
@@ -120,13 +114,19 @@ NodeInfo NodeCoreService::getNodeInfo() const
 QVector<NodeCamera> NodeCoreService::listCameras() const
 {
     QVector<NodeCamera> list;
-    if (!m_db.isValid() || !m_db.isOpen()) {
+    if (!isDatabaseOk()) {
         qWarning() << "[NodeCoreService] listCameras(): DB not open";
         return list;
     }
 
-    QSqlQuery q(m_db);
-    if (!q.exec(QStringLiteral("SELECT id, name, main_url, sub_url FROM cameras ORDER BY id;"))) {
+    QSqlQuery q(readDb_());
+    if (!q.exec(QStringLiteral(
+            "SELECT c.id, c.name, c.main_url, c.sub_url,"
+            " (SELECT s.codec FROM segments s WHERE s.camera_id=c.id"
+            "  ORDER BY s.start_utc_ns DESC LIMIT 1),"
+            " (SELECT g.reason FROM gaps g WHERE g.camera_url=c.main_url AND g.end_utc_ns IS NULL"
+            "  ORDER BY g.start_utc_ns DESC LIMIT 1)"
+            " FROM cameras c ORDER BY c.id;"))) {
         qWarning() << "[NodeCoreService] listCameras query failed:" << q.lastError().text();
         return list;
     }
@@ -137,7 +137,9 @@ QVector<NodeCamera> NodeCoreService::listCameras() const
         cam.name = q.value(1).toString();
         cam.rtspMain = q.value(2).toString();
         cam.rtspSub = q.value(3).toString();
-        cam.isRecording = true; // TODO: derive from ArchiveManager worker state.
+        cam.codec = q.value(4).toString();
+        cam.gapReason = q.value(5).toString();
+        cam.isRecording = cam.gapReason.isEmpty();   // an open journaled gap = not recording
         if (m_restreamer) {
             cam.liveProxyRtsp = m_restreamer->proxyUrlForCamera(cam.id);
         }
@@ -149,10 +151,11 @@ QVector<NodeCamera> NodeCoreService::listCameras() const
 
 QVector<NodeSegment> NodeCoreService::listSegments(int cameraId,
                                                    const QDateTime& from,
-                                                   const QDateTime& to) const
+                                                   const QDateTime& to,
+                                                   bool subStream) const
 {
     QVector<NodeSegment> segs;
-    if (!m_db.isValid() || !m_db.isOpen()) {
+    if (!isDatabaseOk()) {
         qWarning() << "[NodeCoreService] listSegments(): DB not open";
         return segs;
     }
@@ -170,37 +173,39 @@ QVector<NodeSegment> NodeCoreService::listSegments(int cameraId,
 
     const qint64 fromNs = fromUtc.toSecsSinceEpoch() * 1000000000LL;
     const qint64 toNs = toUtc.toSecsSinceEpoch() * 1000000000LL;
+    const qint64 nowNs = QDateTime::currentMSecsSinceEpoch() * 1000000LL;
+
+    // Main-stream ranges are answered from the recorder's in-memory index,
+    // or else its segment journal.
+    QVector<IndexedSegment> hits;
+    if (!subStream && (ArchiveSegmentIndex::query(m_dbPath, cameraId, fromNs, toNs, hits)
+                       || SegmentJournal::query(m_dbPath, cameraId, fromNs, toNs, hits))) {
+        segs.reserve(hits.size());
+        for (const IndexedSegment& h : hits) {
+            NodeSegment seg;
+            seg.segmentId = h.id;
+            seg.cameraId = cameraId;
+            seg.start = nsToDateTime(h.startNs);
+            seg.end = nsToDateTime(h.shownEndNs(nowNs));
+            seg.durationSec = h.durationMs / 1000;
+            seg.sizeBytes = static_cast<quint64>(h.sizeBytes);
+            seg.filePath = ArchiveRoots::resolve(h.path);
+            seg.codec = h.codec;
+            seg.keyframeOnly = h.tier == 1;
+            segs.append(seg);
+        }
+        return segs;
+    }
 
-    QSqlQuery q(m_db);
-    q.setForwardOnly(true);
-    q.prepare(R"SQL(
-        SELECT id, camera_id, start_utc_ns,
-               CASE
-                 WHEN end_utc_ns IS NOT NULL AND end_utc_ns > 0 THEN end_utc_ns
-                 WHEN COALESCE(duration_ms,0) > 0 THEN start_utc_ns + duration_ms*1000000
-                 ELSE start_utc_ns
-               END AS eff_end,
-               duration_ms,
-               size_bytes,
-               file_path
-        FROM segments
-        WHERE status IN (0,1)
-          AND (camera_id = :cid OR camera_url = (SELECT main_url FROM cameras WHERE id=:cid))
-          AND start_utc_ns < :to_ns
-          AND (
-                CASE
-                  WHEN end_utc_ns IS NOT NULL AND end_utc_ns > 0 THEN end_utc_ns
-                  WHEN COALESCE(duration_ms,0) > 0 THEN start_utc_ns + duration_ms*1000000
-                  ELSE start_utc_ns
-                END
-              ) > :from_ns
-        ORDER BY start_utc_ns
-    )SQL");
+    DbReadPool::Query q = DbReadPool::prepared(readDb_(), subStream ? SegmentQueries::kApiSub
+                                                                    : SegmentQueries::kApiMain);
     q.bindValue(":cid", cameraId);
     q.bindValue(":from_ns", fromNs);
     q.bindValue(":to_ns", toNs);
+    q.bindValue(":lo_ns", fromNs - ArchiveLimits::kMaxSpanNs);
+    q.bindValue(":now_ns", nowNs);
 
-    if (!q.exec()) {
+    if (!DbReadPool::exec(q)) {
         qWarning() << "[NodeCoreService] listSegments query failed:" << q.lastError().text();
         return segs;
     }
@@ -215,13 +220,229 @@ QVector<NodeSegment> NodeCoreService::listSegments(int cameraId,
         seg.end = nsToDateTime(endNs);
         seg.durationSec = q.value(4).toLongLong() / 1000;
         seg.sizeBytes = static_cast<quint64>(q.value(5).toLongLong());
-        seg.filePath = q.value(6).toString();
+        seg.filePath = ArchiveRoots::resolve(q.value(6).toString());
+        seg.codec = q.value(7).toString();
+        seg.keyframeOnly = q.value(8).toInt() == 1;
         segs.append(seg);
     }
 
     return segs;
 }
 
+QVector<NodeGap> NodeCoreService::listGaps(int cameraId,
+                                           const QDateTime& from,
+                                           const QDateTime& to) const
+{
+    QVector<NodeGap> gaps;
+    if (!isDatabaseOk()) {
+        qWarning() << "[NodeCoreService] listGaps(): DB not open";
+        return gaps;
+    }
+    if (cameraId <= 0) {
+        qWarning() << "[NodeCoreService] listGaps(): invalid cameraId";
+        return gaps;
+    }
+
+    const QDateTime fromUtc = from.isValid()
+        ? from.toUTC()
+        : QDateTime::currentDateTimeUtc().addDays(-1);
+    const QDateTime toUtc = to.isValid()
+        ? to.toUTC()
+        : QDateTime::currentDateTimeUtc();
+    const qint64 fromNs = fromUtc.toSecsSinceEpoch() * 1000000000LL;
+    const qint64 toNs = toUtc.toSecsSinceEpoch() * 1000000000LL;
+
+    DbReadPool::Query q = DbReadPool::prepared(readDb_(), QStringLiteral(
+        "SELECT start_utc_ns, end_utc_ns, reason, COALESCE(detail,'') FROM gaps"
+        " WHERE camera_id = :cid"
+        "   AND start_utc_ns < :to_ns"
+        "   AND (end_utc_ns IS NULL OR end_utc_ns > :from_ns)"
+        " ORDER BY start_utc_ns"));
+    q.bindValue(":cid", cameraId);
+    q.bindValue(":from_ns", fromNs);
+    q.bindValue(":to_ns", toNs);
+    if (!DbReadPool::exec(q)) {
+        qWarning() << "[NodeCoreService] listGaps query failed:" << q.lastError().text();
+        return gaps;
+    }
+
+    while (q.next()) {
+        NodeGap g;
+        g.cameraId = cameraId;
+        g.start = nsToDateTime(q.value(0).toLongLong());
+        if (!q.value(1).isNull()) {
+            g.end = nsToDateTime(q.value(1).toLongLong());
+        }
+        g.reason = q.value(2).toString();
+        g.detail = q.value(3).toString();
+        gaps.append(g);
+    }
+    return gaps;
+}
+
+QVector<NodeEvent> NodeCoreService::listEvents(int cameraId,
+                                               const QDateTime& from,
+                                               const QDateTime& to,
+                                               const QStringList& types,
+                                               int limit) const
+{
+    QVector<NodeEvent> events;
+    if (!isDatabaseOk()) {
+        qWarning() << "[NodeCoreService] listEvents(): DB not open";
+        return events;
+    }
+
+    const QDateTime fromUtc = from.isValid()
+        ? from.toUTC()
+        : QDateTime::currentDateTimeUtc().addDays(-1);
+    const QDateTime toUtc = to.isValid()
+        ? to.toUTC()
+        : QDateTime::currentDateTimeUtc();
+    const qint64 fromNs = fromUtc.toSecsSinceEpoch() * 1000000000LL;
+    const qint64 toNs = toUtc.toSecsSinceEpoch() * 1000000000LL;
+    if (toNs <= fromNs) {
+        return events;
+    }
+
+    // Fixed SQL per camera filter so the pooled statement is reused; the type
+    // filter is a ",a,b," list matched with instr().
+    QString sql = QStringLiteral(
+        "SELECT id, camera_id, t_ns, type, COALESCE(source,''), COALESCE(detail,'') FROM events"
+        " WHERE %1 bucket >= :b0 AND bucket <= :b1"
+        "   AND t_ns >= :from_ns AND t_ns < :to_ns"
+        "   AND (:types = '' OR instr(:types, ',' || type || ',') > 0)"
+        " ORDER BY t_ns LIMIT :lim");
+    sql = sql.arg(cameraId > 0 ? QStringLiteral("camera_id = :cid AND") : QString());
+    DbReadPool::Query q = DbReadPool::prepared(readDb_(), sql);
+    if (cameraId > 0) {
+        q.bindValue(":cid", cameraId);
+    }
+    q.bindValue(":b0", fromNs / ArchiveLimits::kEventBucketNs);
+    q.bindValue(":b1", (toNs - 1) / ArchiveLimits::kEventBucketNs);
+    q.bindValue(":from_ns", fromNs);
+    q.bindValue(":to_ns", toNs);
+    q.bindValue(":types", types.isEmpty() ? QString() : "," + types.join(',') + ",");
+    q.bindValue(":lim", qBound(1, limit, 10000));
+    if (!DbReadPool::exec(q)) {
+        qWarning() << "[NodeCoreService] listEvents query failed:" << q.lastError().text();
+        return events;
+    }
+
+    while (q.next()) {
+        NodeEvent e;
+        e.eventId = q.value(0).toLongLong();
+        e.cameraId = q.value(1).toInt();
+        e.time = nsToDateTime(q.value(2).toLongLong());
+        e.type = q.value(3).toString();
+        e.source = q.value(4).toString();
+        e.detail = q.value(5).toString();
+        events.append(e);
+    }
+    return events;
+}
+
+QVector<NodeDayCoverage> NodeCoreService::listCoverage(const QVector<int>& cameraIds,
+                                                       const QDate& from,
+                                                       const QDate& to) const
+{
+    QVector<NodeDayCoverage> out;
+    if (!isDatabaseOk()) {
+        qWarning() << "[NodeCoreService] listCoverage(): DB not open";
+        return out;
+    }
+
+    const QDate toDay = to.isValid() ? to : QDate::currentDate();
+    const QDate fromDay = from.isValid() ? from : toDay.addDays(-6);
+    QVector<int> ids = cameraIds;
+    if (ids.isEmpty()) {
+        for (const NodeCamera& cam : listCameras()) {
+            ids.append(cam.id);
+        }
+    }
+
+    const QSqlDatabase db = readDb_();
+    for (int cid : ids) {
+        const RecordingCoverage::DayMap days = RecordingCoverage::days(
+            db, cid, fromDay.toString(Qt::ISODate), toDay.toString(Qt::ISODate));
+        for (auto it = days.cbegin(); it != days.cend(); ++it) {
+            NodeDayCoverage c;
+            c.cameraId = cid;
+            c.day = QDate::fromString(it.key(), Qt::ISODate);
+            c.coveredMinutes = RecordingCoverage::coveredMinutes(it.value());
+            c.bitmap = it.value();
+            out.append(c);
+        }
+    }
+    return out;
+}
+
+int NodeCoreService::triggerEvent(int cameraId, const QString& reason)
+{
+    if (!m_archiveManager || !isDatabaseOk() || cameraId <= 0) {
+        return -1;
+    }
+    DbReadPool::Query q = DbReadPool::prepared(readDb_(), QStringLiteral("SELECT main_url FROM cameras WHERE id=:cid"));
+    q.bindValue(":cid", cameraId);
+    if (!DbReadPool::exec(q) || !q.next()) {
+        return -1;
+    }
+    const QString url = q.value(0).toString();
+    q.finish();   // pooled statement: release the read snapshot
+
+    bool ok = false;
+    ArchiveManager* am = m_archiveManager;
+    const auto call = [&]{ ok = am->triggerEvent(url, reason); };
+    if (QThread::currentThread() == am->thread()) {
+        call();
+    } else {
+        QMetaObject::invokeMethod(am, call, Qt::BlockingQueuedConnection);
+    }
+    qInfo() << "[NodeCoreService] event" << reason << "camera" << cameraId << (ok ? "accepted" : "ignored");
+    return ok ? 1 : 0;
+}
+
+bool NodeCoreService::setRetentionPolicy(const QString& scope, int scopeId, qint64 maxBytes, int minDays)
+{
+    if (!m_dbWriter || scopeId <= 0
+        || (scope != QLatin1String("camera") && scope != QLatin1String("group"))) {
+        return false;
+    }
+    bool ok = false;
+    DbWriter* writer = m_dbWriter;
+    const auto call = [&]{ ok = writer->setRetentionPolicy(scope, scopeId, maxBytes, minDays); };
+    if (QThread::currentThread() == writer->thread()) {
+        call();
+    } else {
+        QMetaObject::invokeMethod(writer, call, Qt::BlockingQueuedConnection);
+    }
+    qInfo() << "[NodeCoreService] retention" << scope << scopeId << "max_bytes" << maxBytes
+            << "min_days" << minDays << (ok ? "saved" : "failed");
+    return ok;
+}
+
+bool NodeCoreService::setRecordingSchedule(const QString& scope, int scopeId,
+                                           const QString& spec, const QString& offMode)
+{
+    bool specOk = false;
+    RecordingSchedule::parse(spec, &specOk);
+    if (!m_dbWriter || scopeId <= 0 || !specOk
+        || (scope != QLatin1String("camera") && scope != QLatin1String("group"))
+        || (offMode != QLatin1String("stop") && offMode != QLatin1String("event"))) {
+        return false;
+    }
+    bool ok = false;
+    DbWriter* writer = m_dbWriter;
+    const auto call = [&]{ ok = writer->setRecordingSchedule(scope, scopeId, spec, offMode); };
+    if (QThread::currentThread() == writer->thread()) {
+        call();
+    } else {
+        QMetaObject::invokeMethod(writer, call, Qt::BlockingQueuedConnection);
+    }
+    qInfo() << "[NodeCoreService] schedule" << scope << scopeId << spec << offMode
+            << (ok ? "saved" : "failed");
+    return ok;
+}
+
 QString NodeCoreService::resolveSegmentPath(qint64 segmentId) const
 {
     bool found = false;
@@ -232,7 +453,7 @@ QString NodeCoreService::resolveSegmentPath(qint64 segmentId) const
     return QFileInfo(seg.filePath).absoluteFilePath();
 }
 
-NodeSegment NodeCoreService::segmentById(qint64 segmentId, bool* found) const
+NodeSegment NodeCoreService::segmentById(qint64 segmentId, bool* found, bool subStream) const
 {
     if (found) {
         *found = false;
@@ -242,11 +463,13 @@ NodeSegment NodeCoreService::segmentById(qint64 segmentId, bool* found) const
         return seg;
     }
 
-    QSqlQuery q(m_db);
-    q.prepare(QStringLiteral("SELECT id, camera_id, start_utc_ns, end_utc_ns, duration_ms, size_bytes, file_path "
-                             "FROM segments WHERE id=:id;"));
+    DbReadPool::Query q = DbReadPool::prepared(readDb_(), subStream
+        ? QStringLiteral("SELECT id, camera_id, start_utc_ns, end_utc_ns, duration_ms, size_bytes, file_path,"
+                         " COALESCE(codec,'h264'), 0 FROM sub_segments WHERE id=:id;")
+        : QStringLiteral("SELECT id, camera_id, start_utc_ns, end_utc_ns, duration_ms, size_bytes, file_path,"
+                         " COALESCE(codec,'h264'), COALESCE(tier,0) FROM segments_all WHERE id=:id;"));
     q.bindValue(":id", segmentId);
-    if (!q.exec()) {
+    if (!DbReadPool::exec(q)) {
         qWarning() << "[NodeCoreService] segmentById query failed:" << q.lastError().text();
         return seg;
     }
@@ -266,7 +489,10 @@ NodeSegment NodeCoreService::segmentById(qint64 segmentId, bool* found) const
     }
     seg.durationSec = q.value(4).toLongLong() / 1000;
     seg.sizeBytes = static_cast<quint64>(q.value(5).toLongLong());
-    seg.filePath = q.value(6).toString();
+    seg.filePath = ArchiveRoots::resolve(q.value(6).toString());
+    seg.codec = q.value(7).toString();
+    seg.keyframeOnly = q.value(8).toInt() == 1;
+    q.finish();
     if (found) {
         *found = true;
     }
@@ -275,7 +501,7 @@ NodeSegment NodeCoreService::segmentById(qint64 segmentId, bool* found) const
 
 bool NodeCoreService::isDatabaseOk() const
 {
-    return m_db.isValid() && m_db.isOpen();
+    return readDb_().isOpen();
 }
 
 bool NodeCoreService::isRtspOk() const
@@ -288,7 +514,7 @@ int NodeCoreService::cameraCount() const
     if (!isDatabaseOk()) {
         return 0;
     }
-    QSqlQuery q(m_db);
+    QSqlQuery q(readDb_());
     if (q.exec(QStringLiteral("SELECT COUNT(*) FROM cameras;")) && q.next()) {
         return q.value(0).toInt();
     }
@@ -2,6 +2,8 @@
 
 #include <QObject>
 #include <QVector>
+#include <QByteArray>
+#include <QDate>
 #include <QDateTime>
 #include <QSqlDatabase>
 
@@ -40,6 +42,8 @@ struct NodeCamera {
     QString rtspSub;
     bool isRecording = false;
     QString liveProxyRtsp;
+    QString codec;   // codec of the most recent segment ("h264"/"h265"), empty if none
+    QString gapReason; // reason of the open recording gap, empty while recording
 };
 
 struct NodeSegment {
@@ -50,6 +54,32 @@ struct NodeSegment {
     qint64 durationSec = 0;
     quint64 sizeBytes = 0;
     QString filePath;
+    QString codec;
+    bool keyframeOnly = false;   // thinned to the long-term tier
+};
+
+struct NodeGap {
+    int cameraId = 0;
+    QDateTime start;
+    QDateTime end;       // invalid while the gap is still open
+    QString reason;      // camera_offline / disk_full / pipeline_error / recorder_stopped / recorder_down / schedule_off / schedule_event_only
+    QString detail;
+};
+
+struct NodeEvent {
+    qint64 eventId = 0;
+    int cameraId = 0;    // 0 = site-wide
+    QDateTime time;
+    QString type;        // pipeline_error / recording_interrupted / disk_alarm / alarm / error
+    QString source;
+    QString detail;
+};
+
+struct NodeDayCoverage {
+    int cameraId = 0;
+    QDate day;              // local
+    int coveredMinutes = 0;
+    QByteArray bitmap;      // bit i = minute i after local midnight (RecordingCoverage)
 };
 
 class NodeCoreService : public QObject {
@@ -66,11 +96,36 @@ public:
 
     NodeInfo getNodeInfo() const;
     QVector<NodeCamera> listCameras() const;
+    // subStream = true lists the low-resolution scrub track (sub_segments).
     QVector<NodeSegment> listSegments(int cameraId,
                                       const QDateTime& from,
-                                      const QDateTime& to) const;
+                                      const QDateTime& to,
+                                      bool subStream = false) const;
+    QVector<NodeGap> listGaps(int cameraId,
+                              const QDateTime& from,
+                              const QDateTime& to) const;
+    // cameraId 0 = every camera and site-wide events; empty types = all types.
+    QVector<NodeEvent> listEvents(int cameraId,
+                                  const QDateTime& from,
+                                  const QDateTime& to,
+                                  const QStringList& types,
+                                  int limit) const;
+    // cameraIds empty = every camera. from/to are local days, inclusive.
+    QVector<NodeDayCoverage> listCoverage(const QVector<int>& cameraIds,
+                                          const QDate& from,
+                                          const QDate& to) const;
+    // Event-mode cameras only: 1 = recording started/extended, 0 = camera
+    // records continuously, -1 = unknown camera.
+    int triggerEvent(int cameraId, const QString& reason);
+    // Per-camera/per-group quota (scope "camera" | "group"); maxBytes and
+    // minDays both 0 removes it. Applied by the next purge run.
+    bool setRetentionPolicy(const QString& scope, int scopeId, qint64 maxBytes, int minDays);
+    // Weekly recording windows (RecordingSchedule spec) for a camera or
+    // group; offMode "stop" | "event". An empty spec removes the schedule.
+    // False on a bad scope or spec. Picked up at the next minute boundary.
+    bool setRecordingSchedule(const QString& scope, int scopeId, const QString& spec, const QString& offMode);
     QString resolveSegmentPath(qint64 segmentId) const;
-    NodeSegment segmentById(qint64 segmentId, bool* found = nullptr) const;
+    NodeSegment segmentById(qint64 segmentId, bool* found = nullptr, bool subStream = false) const;
     bool isDatabaseOk() const;
     bool isRtspOk() const;
     int cameraCount() const;
@@ -84,9 +139,8 @@ private:
     NodeRestreamer* m_restreamer{};
     NodeConfig m_cfg;
     QDateTime m_startupTime;
-    QString m_dbConnName;
-    QSqlDatabase m_db;
-    QString m_dbPath;
+    QString m_dbPath;       // read through DbReadPool
 
+    QSqlDatabase readDb_() const;
     static QDateTime nsToDateTime(qint64 ns);
 };
@@ -102,7 +102,7 @@ void NodeServicesBootstrap::registerAllCameras()
         if (cam.rtspMain.isEmpty()) {
             continue;
         }
-        m_restreamer->registerCamera(cam.id, cam.rtspMain);
+        m_restreamer->registerCamera(cam.id, cam.rtspMain, cam.codec == QStringLiteral("h265"));
     }
 }
 
@@ -1,5 +1,6 @@
 #include "playback_exporter.h"
 #include "storageservice.h"
+#include "io_policy.h"
 
 #include <QDir>
 #include <QFile>
@@ -8,6 +9,7 @@
 #include <QTextStream>
 #include <QDateTime>
 #include <QStorageInfo>
+#include <algorithm>
 
 static inline double secFromNs(qint64 ns){ return double(ns)/1e9; }
 
@@ -35,6 +37,12 @@ void PlaybackExporter::startPrepare(){
     // Build parts plan
     const auto parts = computeParts_();
     if (parts.isEmpty()) { emit error("Selection overlaps no files"); return; }
+    // Stream copy cannot join H.264 and H.265 parts: a mixed selection has
+    // every part re-encoded to opts_.vcodec, then joined by copy.
+    mixed_ = std::any_of(parts.begin(), parts.end(),
+                         [&parts](const ClipPart& p){ return p.codec != parts.first().codec; });
+    hevc_ = !mixed_ && parts.first().codec == "h265";
+    if (mixed_) emit log("[Export] mixed H.264/H.265 selection: re-encoding every part");
 
     // Work temp dir
     QTemporaryDir tmp;
@@ -135,7 +143,7 @@ QVector<ClipPart> PlaybackExporter::computeParts_() const {
         const qint64 b = std::min(fs.end_ns,   selAbsB);
         if (b > a) {
             const bool whole = (a == fs.start_ns) && (b == fs.end_ns);
-            out.push_back(ClipPart{ fs.path, a - fs.start_ns, b - fs.start_ns, whole });
+            out.push_back(ClipPart{ fs.path, a - fs.start_ns, b - fs.start_ns, whole, fs.codec });
         }
         if (fs.end_ns >= selAbsB) break;
     }
@@ -178,8 +186,10 @@ bool PlaybackExporter::buildInputs_(const QVector<ClipPart>& parts,
     for (int i=0;i<N;++i) {
         if (abort_.load()) return false;
         const auto& part = parts[i];
+        // ffmpeg works on this part while the next one loads.
+        if (i + 1 < N) IoPolicy::readAhead(parts[i + 1].path);
 
-        if (part.wholeFile) {
+        if (part.wholeFile && !mixed_) {
             inputPaths->push_back(QFileInfo(part.path).absoluteFilePath());
             continue;
         }
@@ -190,7 +200,7 @@ bool PlaybackExporter::buildInputs_(const QVector<ClipPart>& parts,
         inputPaths->push_back(cut);
 
         QStringList args; args << "-hide_banner" << "-y";
-        if (opts_.precise) {
+        if (opts_.precise || mixed_) {
             const double coarse = std::max(0.0, ss - 3.0);
             args << "-ss" << QString::number(coarse, 'f', 3)
                  << "-i"  << part.path
@@ -247,6 +257,7 @@ bool PlaybackExporter::concat_(const QString& listPath, const QString& outPath){
         if (opts_.copyAudio) args << "-c:a" << "copy";
     } else {
         args << "-c" << "copy";
+        if (hevc_) args << "-tag:v" << "hvc1"; // QuickTime/browsers expect hvc1 for HEVC in MP4
     }
     args << outPath;
 
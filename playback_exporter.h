@@ -26,6 +26,7 @@ struct ClipPart {
     qint64  inStartNs;
     qint64  inEndNs;
     bool    wholeFile;
+    QString codec;      // "h264"/"h265" from the segment row
 };
 
 class PlaybackExporter final : public QObject {
@@ -64,6 +65,8 @@ private:
 
     // Persistent between phases
     QString preparedPath_;
+    bool    hevc_{false};  // H.265 parts: stream copy into MP4 needs the hvc1 tag
+    bool    mixed_{false}; // H.264 and H.265 parts: each is re-encoded before the join
 
     QVector<ClipPart> computeParts_() const;
     QString uniqueOutBaseName_() const;         // basename without dir
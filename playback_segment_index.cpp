@@ -35,7 +35,7 @@ void PlaybackSegmentIndex::build(const SegmentList& segs, qint64 dayStartNs, qin
                     ++printed;
                 }
         if (b <= a) continue; // drop zero/neg
-        FileSeg fs{ s.path, a, b };
+        FileSeg fs{ s.path, a, b, s.open, s.codec };
         raw.push_back(fs);
     }
 
@@ -59,7 +59,7 @@ void PlaybackSegmentIndex::build(const SegmentList& segs, qint64 dayStartNs, qin
         // Clamp overlaps to monotonic progression (prefer earlier segment)
         qint64 start = qMax(fs.start_ns, lastEnd); // avoid negative "gaps" on overlaps
         if (fs.end_ns > start) {
-            list_.push_back({ fs.path, start, fs.end_ns });
+            list_.push_back({ fs.path, start, fs.end_ns, fs.growing, fs.codec });
             lastEnd = fs.end_ns;
         }
     }
@@ -127,9 +127,13 @@ int PlaybackSegmentIndex::nextSegmentIndexAfter(qint64 wall_ns) const
 void PlaybackSegmentIndex::exportForStitching(QVector<QString>& paths,
                                               QVector<qint64>&  wallStarts,
                                               QVector<qint64>&  offsets,
-                                              QVector<qint64>&  durations) const
+                                              QVector<qint64>&  durations,
+                                              QVector<bool>*    growing,
+                                              QVector<QString>* codecs) const
 {
     paths.clear(); wallStarts.clear(); offsets.clear(); durations.clear();
+    if (growing) { growing->clear(); growing->reserve(list_.size()); }
+    if (codecs)  { codecs->clear();  codecs->reserve(list_.size()); }
     paths.reserve(list_.size());
     wallStarts.reserve(list_.size());
     offsets.reserve(list_.size());
@@ -143,6 +147,20 @@ void PlaybackSegmentIndex::exportForStitching(QVector<QString>& paths,
         const qint64 dur = s.duration_ns();
         durations << dur;
         acc      += dur;
+        if (growing) *growing << s.growing;
+        if (codecs)  *codecs  << s.codec;
+    }
+}
+
+void PlaybackSegmentIndex::applyJournal(const GapList& journal)
+{
+    for (auto& g : gaps_) {
+        g.reason.clear();
+        qint64 best = 0;
+        for (const auto& j : journal) {
+            const qint64 ov = qMin(g.end_ns, j.end_ns) - qMax(g.start_ns, j.start_ns);
+            if (ov > best) { best = ov; g.reason = j.reason; }
+        }
     }
 }
 
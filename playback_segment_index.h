@@ -10,17 +10,22 @@
 // - Records "significant" gaps (> gapThresholdNs), tolerates tiny jitter.
 // - Fast wall-clock -> (segment, offset) mapping.
 // - Exports arrays for the stitching player (paths, wallStarts, offsets, durations).
+// - Open (still recording) files are kept as "growing": their end is the live edge.
+// - Gaps can be labelled from the gaps journal (camera offline / disk full / ...).
 class PlaybackSegmentIndex final {
 public:
     struct FileSeg {
         QString path;
         qint64  start_ns = 0;     // wall-clock ns (UTC epoch)
         qint64  end_ns   = 0;     // exclusive
+        bool    growing  = false; // being written; end_ns advances on rebuild
+        QString codec;            // "h264"/"h265" (decoder selection)
         qint64  duration_ns() const { return qMax<qint64>(0, end_ns - start_ns); }
     };
     struct Gap {
         qint64 start_ns = 0;      // gap start (exclusive end of previous seg)
         qint64 end_ns   = 0;      // gap end   (start of next seg)
+        QString reason;           // from the recorder's gap journal; empty if not journaled
         qint64 duration_ns() const { return qMax<qint64>(0, end_ns - start_ns); }
     };
 
@@ -39,6 +44,7 @@ public:
     qint64 dayEnd()   const { return t1_; }
     qint64 firstNs()  const { return list_.isEmpty() ? t0_ : list_.first().start_ns; }
     qint64 lastNs()   const { return list_.isEmpty() ? t0_ : list_.last().end_ns;  }
+    bool   hasGrowingTail() const { return !list_.isEmpty() && list_.last().growing; }
 
     qint64 totalCoveredNs() const;
     qint64 totalSpanNs()    const { return qMax<qint64>(0, t1_ - t0_); }
@@ -54,10 +60,17 @@ public:
     //  - wallStarts: start times since dayStart() (ns)
     //  - offsets:    cumulative "virtual" offsets (gapless) per segment (ns)
     //  - durations:  segment durations (ns)
+    //  - growing:    optional, true for files still being written
+    //  - codecs:     optional, per-file video codec
     void exportForStitching(QVector<QString>& paths,
                             QVector<qint64>&  wallStarts,
                             QVector<qint64>&  offsets,
-                            QVector<qint64>&  durations) const;
+                            QVector<qint64>&  durations,
+                            QVector<bool>*    growing = nullptr,
+                            QVector<QString>* codecs  = nullptr) const;
+
+    // Label gaps with the recorder's journaled reason (largest overlap wins).
+    void applyJournal(const GapList& journal);
 
     // Log a human-readable dump.
     void debugDump(const char* tag = "SegIndex") const;
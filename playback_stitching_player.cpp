@@ -1,5 +1,6 @@
 #include "playback_stitching_player.h"
 #include "playback_video_player_gst.h"
+#include "io_policy.h"
 #include <QMetaObject>
 #include <QDebug>
 
@@ -22,9 +23,12 @@ void PlaybackStitchingPlayer::attachPlayer(PlaybackVideoPlayerGst* p) {
 void PlaybackStitchingPlayer::setPlaylist(QVector<SegmentMeta> metas, qint64 day_start_ns) {
     qInfo() << "[Stitch] setPlaylist called with" << metas.size() << "segments";
     
-    paths_.clear(); wallStarts_.clear(); offsets_.clear(); durations_.clear();
+    paths_.clear(); wallStarts_.clear(); offsets_.clear(); durations_.clear(); growing_.clear(); codecs_.clear();
     totalVirt_ = 0; curIdx_ = -1; dayStartNs_ = day_start_ns;
     isPlaying_ = false; // Reset playing state
+    lastInSegPos_ = 0; awaitingGrowth_ = false;
+    subPaths_.clear(); subStarts_.clear(); subDurations_.clear(); subCodecs_.clear();
+    subIdx_ = -1; onSub_ = false;
 
     paths_.reserve(metas.size());
     wallStarts_.reserve(metas.size());
@@ -36,6 +40,8 @@ void PlaybackStitchingPlayer::setPlaylist(QVector<SegmentMeta> metas, qint64 day
         wallStarts_<< m.wall_start_ns;
         offsets_   << m.offset_ns;
         durations_ << m.duration_ns;
+        growing_   << m.growing;
+        codecs_    << m.codec;
         totalVirt_  = qMax(totalVirt_, m.offset_ns + m.duration_ns);
     }
     
@@ -43,6 +49,56 @@ void PlaybackStitchingPlayer::setPlaylist(QVector<SegmentMeta> metas, qint64 day
             << "total duration:" << (totalVirt_ / 1e9) << "seconds";
 }
 
+void PlaybackStitchingPlayer::updatePlaylist(QVector<SegmentMeta> metas, qint64 day_start_ns) {
+    if (day_start_ns != dayStartNs_ || curIdx_ < 0 || curIdx_ >= paths_.size()) {
+        const bool wasPlaying = isPlaying_;
+        setPlaylist(metas, day_start_ns);
+        if (wasPlaying) emit stateChanged(false);
+        return;
+    }
+
+    const QString curPath = paths_[curIdx_];
+    paths_.clear(); wallStarts_.clear(); offsets_.clear(); durations_.clear(); growing_.clear(); codecs_.clear();
+    totalVirt_ = 0;
+    int newIdx = -1;
+    for (const auto& m : metas) {
+        if (m.path == curPath) newIdx = paths_.size();
+        paths_     << m.path;
+        wallStarts_<< m.wall_start_ns;
+        offsets_   << m.offset_ns;
+        durations_ << m.duration_ns;
+        growing_   << m.growing;
+        codecs_    << m.codec;
+        totalVirt_  = qMax(totalVirt_, m.offset_ns + m.duration_ns);
+    }
+    if (newIdx < 0) {
+        // Current file dropped out of the day (purged); stop cleanly.
+        qInfo() << "[Stitch] updatePlaylist: current segment gone, stopping";
+        stop();
+        return;
+    }
+    curIdx_ = newIdx;
+
+    if (onSub_ || !awaitingGrowth_ || !isPlaying_) return;
+
+    // Parked at the live edge: continue into the next file, or reopen the
+    // same (grown) file at the last position.
+    static constexpr qint64 kMinGrowthNs = 1000000000LL;
+    if (curIdx_ + 1 < paths_.size()) {
+        awaitingGrowth_ = false;
+        openIndex(curIdx_ + 1);
+        playerSeek(0);
+        playerPlay();
+    } else if (durations_[curIdx_] > lastInSegPos_ + kMinGrowthNs) {
+        awaitingGrowth_ = false;
+        const qint64 resumeAt = lastInSegPos_;
+        openIndex(curIdx_);
+        playerSeek(resumeAt);
+        playerPlay();
+        qInfo() << "[Stitch] live tail resumed at" << resumeAt << "ns in segment" << curIdx_;
+    }
+}
+
 void PlaybackStitchingPlayer::play() {
     qInfo() << "[Stitch] play() called - hasPlaylist:" << hasPlaylist() 
             << "isPlaying:" << isPlaying_;
@@ -52,6 +108,18 @@ void PlaybackStitchingPlayer::play() {
         return;
     }
     
+    if (awaitingGrowth_) {
+        // Nothing new to decode yet; updatePlaylist() resumes once the tail grows.
+        isPlaying_ = true;
+        emit stateChanged(true);
+        return;
+    }
+    if (!isPlaying_ && wantScrub_() && curIdx_ >= 0 && openScrubAt_(lastWall_)) {
+        playerPlay();
+        isPlaying_ = true;
+        emit stateChanged(true);
+        return;
+    }
     if (!isPlaying_) {
             // Start at the beginning unless already opened
             if (curIdx_ < 0) playAtVirtual(0);
@@ -67,6 +135,10 @@ void PlaybackStitchingPlayer::pause() {
         return;
     }
     
+    if (onSub_) {
+        // Paused frames come from the main stream.
+        openMainAt_(lastWall_, false);
+    }
     playerPause();
     isPlaying_ = false;
     emit stateChanged(false);
@@ -76,13 +148,98 @@ void PlaybackStitchingPlayer::stop() {
     qInfo() << "[Stitch] stop() called";
     playerStop();
     curIdx_ = -1;
+    onSub_ = false;
+    subIdx_ = -1;
     isPlaying_ = false;
+    awaitingGrowth_ = false;
     emit stateChanged(false);
 }
 
 void PlaybackStitchingPlayer::setRate(double r) {
     rate_ = (r == 0.0 ? 1.0 : r);
     playerSetRate(rate_);
+    if (isPlaying_) retrack_();
+}
+
+void PlaybackStitchingPlayer::setScrubPlaylist(QVector<SegmentMeta> metas) {
+    subPaths_.clear(); subStarts_.clear(); subDurations_.clear(); subCodecs_.clear();
+    for (const auto& m : metas) {
+        subPaths_     << m.path;
+        subStarts_    << m.wall_start_ns;
+        subDurations_ << m.duration_ns;
+        subCodecs_    << m.codec;
+    }
+    if (onSub_ && subIndexAt_(lastWall_) < 0) openMainAt_(lastWall_, isPlaying_);
+    qInfo() << "[Stitch] scrub track:" << subPaths_.size() << "files";
+}
+
+void PlaybackStitchingPlayer::setScrubbing(bool on) {
+    scrubbing_ = on;
+    // Drag released at 1x: settle on the main stream where the drag ended.
+    if (!on && onSub_ && !wantScrub_()) openMainAt_(lastWall_, isPlaying_);
+}
+
+int PlaybackStitchingPlayer::subIndexAt_(qint64 wall_ns) const {
+    int lo = 0, hi = subStarts_.size() - 1;
+    while (lo <= hi) {
+        const int mid = (lo + hi) / 2;
+        if (wall_ns < subStarts_[mid]) hi = mid - 1;
+        else if (wall_ns >= subStarts_[mid] + subDurations_[mid]) lo = mid + 1;
+        else return mid;
+    }
+    return -1;
+}
+
+bool PlaybackStitchingPlayer::openScrubAt_(qint64 wall_ns) {
+    const int idx = subIndexAt_(wall_ns);
+    if (idx < 0) return false;
+    if (!onSub_ || idx != subIdx_) {
+        subIdx_ = idx;
+        onSub_ = true;
+        playerOpen(subPaths_[idx], subCodecs_.value(idx));
+        playerSetRate(rate_);
+        prefetchAfter_(subPaths_, idx);
+    }
+    // Keep the main index in step so switching back lands on the right file.
+    int mainIdx = 0; qint64 inMain = 0;
+    if (computeIndexFromWall(wall_ns, mainIdx, inMain)) curIdx_ = mainIdx;
+    awaitingGrowth_ = false;
+    lastWall_ = wall_ns;
+    playerSeek(wall_ns - subStarts_[idx]);
+    return true;
+}
+
+void PlaybackStitchingPlayer::openMainAt_(qint64 wall_ns, bool play) {
+    onSub_ = false;
+    subIdx_ = -1;
+    int idx = 0; qint64 inSeg = 0;
+    if (!computeIndexFromWall(wall_ns, idx, inSeg)) {
+        idx = -1;
+        for (int i = 0; i < wallStarts_.size(); ++i)
+            if (wall_ns < wallStarts_[i]) { idx = i; inSeg = 0; break; }
+        if (idx < 0) {
+            playerStop();
+            curIdx_ = -1;
+            if (play) {
+                isPlaying_ = false;
+                emit stateChanged(false);
+                emit reachedEnd();
+            }
+            return;
+        }
+    }
+    openIndex(idx);
+    playerSeek(inSeg);
+    if (play) playerPlay();
+}
+
+void PlaybackStitchingPlayer::retrack_() {
+    if (curIdx_ < 0 && !onSub_) return;
+    if (wantScrub_() && !onSub_) {
+        if (openScrubAt_(lastWall_)) playerPlay();
+    } else if (!wantScrub_() && onSub_) {
+        openMainAt_(lastWall_, isPlaying_);
+    }
 }
 
 void PlaybackStitchingPlayer::playAtVirtual(qint64 virt_ns) {
@@ -105,7 +262,8 @@ void PlaybackStitchingPlayer::playAtVirtual(qint64 virt_ns) {
     }
 
     qInfo() << "[Stitch] Opening segment" << idx << "at position" << inSeg;
-    if (idx != curIdx_) openIndex(idx);
+    if (idx != curIdx_ || onSub_) { onSub_ = false; subIdx_ = -1; openIndex(idx); }
+    awaitingGrowth_ = false;
     playerSeek(inSeg);
     playerPlay();
     
@@ -115,6 +273,14 @@ void PlaybackStitchingPlayer::playAtVirtual(qint64 virt_ns) {
 
 void PlaybackStitchingPlayer::seekWall(qint64 wall_ns) {
     if (paths_.isEmpty() || !player_) return;
+    if (wantScrub_() && openScrubAt_(wall_ns)) {
+        playerPlay();
+        if (!isPlaying_) { isPlaying_ = true; emit stateChanged(true); }
+        return;
+    }
+    const bool fromSub = onSub_;
+    onSub_ = false;
+    subIdx_ = -1;
     qint64 inSeg=0;
     int idx=0;
     if (!computeIndexFromWall(wall_ns, idx, inSeg)) {
@@ -122,10 +288,12 @@ void PlaybackStitchingPlayer::seekWall(qint64 wall_ns) {
         for (int i=0;i<wallStarts_.size();++i) {
             if (wall_ns < wallStarts_[i]) { idx=i; inSeg=0; goto OPEN; }
         }
+        onSub_ = fromSub;   // nothing opened; the sub-stream file is still loaded
         return;
     }
 OPEN:
-    if (idx != curIdx_) openIndex(idx);
+    if (idx != curIdx_ || fromSub) openIndex(idx);
+    awaitingGrowth_ = false;
     playerSeek(inSeg);
     playerPlay();
     // reflect actual playing state so Pause works immediately after a drag seek
@@ -138,6 +306,14 @@ OPEN:
 void PlaybackStitchingPlayer::onPlayerEos() {
     qInfo() << "[Stitch] onPlayerEos - current segment:" << curIdx_ 
             << "total segments:" << paths_.size();
+
+    if (onSub_) {
+        // Next sub-stream file if it continues where this one ended, else main.
+        const qint64 at = qMax(subStarts_[subIdx_] + subDurations_[subIdx_], lastWall_);
+        if (wantScrub_() && openScrubAt_(at)) playerPlay();
+        else openMainAt_(at, true);
+        return;
+    }
     
     const int next = curIdx_ + 1;
     if (next >= 0 && next < paths_.size()) {
@@ -146,6 +322,10 @@ void PlaybackStitchingPlayer::onPlayerEos() {
         playerSeek(0);
         playerPlay();
         // Keep isPlaying_ = true since we're continuing to next segment
+    } else if (curIdx_ >= 0 && curIdx_ < growing_.size() && growing_[curIdx_]) {
+        // Caught up with the recorder: park until the next playlist refresh.
+        qInfo() << "[Stitch] Reached live edge of growing segment" << curIdx_;
+        awaitingGrowth_ = true;
     } else {
         qInfo() << "[Stitch] Reached end of playlist";
         isPlaying_ = false;
@@ -155,17 +335,41 @@ void PlaybackStitchingPlayer::onPlayerEos() {
 }
 
 void PlaybackStitchingPlayer::onPlayerPos(qint64 in_seg_pos_ns) {
+    if (onSub_) {
+        if (subIdx_ < 0 || subIdx_ >= subStarts_.size()) return;
+        lastWall_ = subStarts_[subIdx_] + in_seg_pos_ns;
+        emit wallPositionNs(lastWall_ - dayStartNs_);
+        return;
+    }
     if (curIdx_ < 0 || curIdx_ >= offsets_.size()) return;
+    if (openClock_.isValid()) {
+        if (isPlaying_)
+            qInfo() << "[Stitch] start latency ms=" << openClock_.elapsed()
+                    << "io_policy=" << IoPolicy::enabled();
+        openClock_.invalidate();
+    }
+    lastInSegPos_ = in_seg_pos_ns;
     const qint64 virt = offsets_[curIdx_] + in_seg_pos_ns;
     const qint64 wall = virtualToWall(virt); // absolute within day
+    lastWall_ = wall;
     emit wallPositionNs(wall - dayStartNs_);
 }
 
 void PlaybackStitchingPlayer::openIndex(int idx) {
     curIdx_ = idx;
+    lastInSegPos_ = 0;
+    awaitingGrowth_ = false;
     emit segmentChanged(curIdx_);
-    playerOpen(paths_[curIdx_]);
+    openClock_.start();
+    playerOpen(paths_[curIdx_], codecs_.value(curIdx_));
     playerSetRate(rate_);
+    if (!growing_.value(curIdx_)) prefetchAfter_(paths_, curIdx_);
+}
+
+// Warm the page cache with the file that plays next, so the segment switch
+// does not wait on the disk the cameras are writing to.
+void PlaybackStitchingPlayer::prefetchAfter_(const QVector<QString>& paths, int idx) {
+    if (idx + 1 < paths.size()) IoPolicy::readAhead(paths[idx + 1]);
 }
 
 bool PlaybackStitchingPlayer::computeIndexFromWall(qint64 wall_ns, int& idx, qint64& in_seg_ns) const {
@@ -209,10 +413,10 @@ qint64 PlaybackStitchingPlayer::virtualToWall(qint64 virt_ns) const {
 }
 
 // ---------- Player invocations (queued) ----------
-void PlaybackStitchingPlayer::playerOpen(const QString& path) {
+void PlaybackStitchingPlayer::playerOpen(const QString& path, const QString& codec) {
     if (!player_) return;
     QMetaObject::invokeMethod(player_, "open", Qt::QueuedConnection,
-                              Q_ARG(QString, path));
+                              Q_ARG(QString, path), Q_ARG(QString, codec));
 }
 void PlaybackStitchingPlayer::playerPlay() {
     if (!player_) return;
@@ -3,6 +3,7 @@
 #include <QString>
 #include <QVector>
 #include <QMetaType>
+#include <QElapsedTimer>
 class PlaybackVideoPlayerGst;
 
 // Global metatype (must be declared at global scope)
@@ -11,6 +12,8 @@ struct SegmentMeta {
     qint64  wall_start_ns;  // absolute wall time within the day (ns from midnight local)
     qint64  offset_ns;      // virtual (gapless) base offset
     qint64  duration_ns;    // length to play
+    bool    growing = false; // file still being recorded (live tail)
+    QString codec;           // "h264"/"h265"; selects the player's decoder
 };
 Q_DECLARE_METATYPE(SegmentMeta)
 
@@ -18,6 +21,11 @@ Q_DECLARE_METATYPE(SegmentMeta)
  * Gapless stitching controller that plays a day’s worth of clips
  * as a continuous virtual timeline (gaps skipped).
  *
+ * Scrub track: when the camera also recorded its sub-stream, timeline drags
+ * and rates of 2x and above play the sub-stream files instead (cheap to
+ * decode); pausing, 1x or leaving the sub-stream's coverage switches back to
+ * the main stream at the same wall-clock position.
+ *
  * Thread model:
  * - This object is moved to its own QThread by the owner.
  * - It calls the GStreamer player via queued invokeMethod (player is in its own thread).
@@ -35,6 +43,9 @@ public:
 public slots:
     void attachPlayer(PlaybackVideoPlayerGst* player);
     void setPlaylist(QVector<SegmentMeta> metas, qint64 day_start_ns);
+    // Refresh of the same day (live tail): keeps the current segment/state and
+    // resumes playback parked at the live edge once the playlist has grown.
+    void updatePlaylist(QVector<SegmentMeta> metas, qint64 day_start_ns);
 
     void play();                 // start from beginning (virtual 0)
     void pause();
@@ -45,6 +56,10 @@ public slots:
 
     void setRate(double r);
 
+    // Sub-stream files for the same day (wall_start_ns/duration_ns used).
+    void setScrubPlaylist(QVector<SegmentMeta> metas);
+    void setScrubbing(bool on);           // timeline drag in progress
+
 signals:
     void errorText(QString);
     void reachedEnd();
@@ -64,8 +79,15 @@ private:
     bool computeIndexFromVirtual(qint64 virt_ns, int& idx, qint64& in_seg_ns) const;
     qint64 virtualToWall(qint64 virt_ns) const;
 
+    // scrub track
+    bool wantScrub_() const { return !subPaths_.isEmpty() && (scrubbing_ || rate_ >= 2.0); }
+    int  subIndexAt_(qint64 wall_ns) const;
+    bool openScrubAt_(qint64 wall_ns);    // false if the sub-stream doesn't cover wall_ns
+    void openMainAt_(qint64 wall_ns, bool play);
+    void retrack_();                      // move to the track the current mode wants
+
     // invoke helpers (queued to player thread)
-    void playerOpen(const QString& path);
+    void playerOpen(const QString& path, const QString& codec);
     void playerPlay();
     void playerPause();
     void playerStop();
@@ -78,11 +100,26 @@ private:
     QVector<qint64>  wallStarts_;
     QVector<qint64>  offsets_;    // virtual offset base per segment
     QVector<qint64>  durations_;
+    QVector<bool>    growing_;
+    QVector<QString> codecs_;
     qint64           totalVirt_ = 0;
     qint64           dayStartNs_ = 0;
 
     int              curIdx_ = -1;
     double           rate_   = 1.0;
     bool             isPlaying_ = false; // NEW: track play/pause state
+    qint64           lastInSegPos_ = 0;     // last reported position in current file
+    bool             awaitingGrowth_ = false; // EOS hit on the growing tail; wait for refresh
+
+    QVector<QString> subPaths_;
+    QVector<qint64>  subStarts_;        // absolute wall ns
+    QVector<qint64>  subDurations_;
+    QVector<QString> subCodecs_;
+    int              subIdx_ = -1;
+    bool             onSub_ = false;    // player currently has a sub-stream file open
+    bool             scrubbing_ = false;
+    qint64           lastWall_ = 0;     // absolute wall ns of the last reported position
+    QElapsedTimer    openClock_;        // open → first position: playback start latency
+    void prefetchAfter_(const QVector<QString>& paths, int idx);
 };
 Q_DECLARE_METATYPE(QVector<SegmentMeta>)
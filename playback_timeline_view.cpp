@@ -191,12 +191,18 @@ dragging_ = true;
 dragKind_ = DragKind::Playhead;
 dragTick_.restart(); // start throttle window
 setPlayheadNs(t);
+emit scrubbingChanged(true);
 emit seekRequested(t); // immediate jump on press
 
 }
 
 void PlaybackTimelineView::mouseReleaseEvent(QMouseEvent* e) {
-if (e->button()==Qt::LeftButton) { dragging_ = false; dragKind_ = DragKind::None; }
+if (e->button()!=Qt::LeftButton) return;
+if (dragging_ && dragKind_ == DragKind::Playhead) {
+    emit scrubbingChanged(false);
+    emit seekRequested(playheadNs_); // settle exactly where the drag ended
+}
+dragging_ = false; dragKind_ = DragKind::None;
 }
 
 void PlaybackTimelineView::leaveEvent(QEvent*) {
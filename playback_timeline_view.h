@@ -19,6 +19,7 @@ qint64 selectionEndNs()   const { return selEndNs_; }
 signals:
 void hoverTimeNs(qint64 t_ns);
 void seekRequested(qint64 t_ns);
+void scrubbingChanged(bool active); // playhead drag started / ended
 void selectionChanged(qint64 start_ns, qint64 end_ns); //trim selection
 protected:
 void paintEvent(QPaintEvent*) override;
@@ -31,8 +31,14 @@ void PlaybackVideoPlayerGst::setWindowHandle(quintptr wid) {
     bindOverlay();
 }
 
-bool PlaybackVideoPlayerGst::open(const QString& path) {
-    qInfo() << "[Player] Opening file:" << path;
+bool PlaybackVideoPlayerGst::open(const QString& path, const QString& codec) {
+    qInfo() << "[Player] Opening file:" << path << "codec:" << codec;
+
+    // Parser/decoder are fixed at build time; rebuild when the codec changes.
+    const QString want = codec.isEmpty() ? QStringLiteral("h264") : codec.toLower();
+    if (pipeline && want != codec_) teardown();
+    codec_ = want;
+    const bool h265 = (codec_ == "h265");
 
     // First-time pipeline build
     if (!pipeline) {
@@ -46,10 +52,11 @@ bool PlaybackVideoPlayerGst::open(const QString& path) {
         else demux = mk("decodebin");
 
         // Buffers around decode to smooth playback during seeks
-        // filesrc ! demux ! queue_demux ! h264parse ! avdec_h264 ! queue_post ! videoconvert ! sink
+        // filesrc ! demux ! queue_demux ! h26xparse ! h26xdec ! queue_post ! videoconvert ! sink
         queue_demux = mk("queue");
-        parser      = mk("h264parse");
-        decoder     = mk("vaapih264dec");
+        parser      = mk(h265 ? "h265parse" : "h264parse");
+        decoder     = mk(h265 ? "vaapih265dec" : "vaapih264dec");
+        if (!decoder) decoder = mk(h265 ? "avdec_h265" : "avdec_h264");
         queue_post  = mk("queue");
         vconv       = mk("videoconvert");
         videosink   = mk("glimagesink");
@@ -12,7 +12,7 @@ class QTimer;
  * -------------------------
  * Thin GStreamer file player that renders into a native window (winId).
  * - call setWindowHandle(renderWinId) once you have a video host widget
- * - open(path) → preroll (PAUSED)
+ * - open(path[, codec]) → preroll (PAUSED); codec "h264"/"h265" picks parser/decoder
  * - play(), pause(), stop()
  * - seekNs(t), setRate(r)
  */
@@ -33,7 +33,7 @@ signals:
 
 public slots:                         // make invokable across threads
     void setWindowHandle(quintptr wid);
-    bool open(const QString& path);
+    bool open(const QString& path, const QString& codec = QString());
     void play();
     void pause();
     void stop();
@@ -58,6 +58,7 @@ private:
     GstElement* videosink     = nullptr;
     quintptr    winHandle     = 0;
     double      rate_         = 1.0;
+    QString     codec_;                 // codec the current pipeline was built for
     QTimer* busTimer = nullptr;
     GstBus* bus = nullptr;
 };
@@ -19,6 +19,7 @@
 #include <QMessageBox>
 #include <QApplication>
 #include <QSet>
+#include <QTimer>
 #include <algorithm>
 
 PlaybackWindow::PlaybackWindow(QWidget* parent)
@@ -77,10 +78,16 @@ PlaybackWindow::PlaybackWindow(QWidget* parent)
     setLayout(root);
     initPlayer_();
     initStitch_();
+    // Re-query today's segments so the open (growing) file extends the
+    // timeline and the stitcher can follow the live edge.
+    liveTailTimer_ = new QTimer(this);
+    connect(liveTailTimer_, &QTimer::timeout, this, &PlaybackWindow::refreshLiveTail_);
+    liveTailTimer_->start(5000);
     // Ensure queued connections can deliver these types
     qRegisterMetaType<SegmentInfo>("SegmentInfo");
     qRegisterMetaType<CamList>("CamList");
     qRegisterMetaType<SegmentList>("SegmentList");
+    qRegisterMetaType<GapList>("GapList");
 
     connect(controls, &PlaybackControlsWidget::groupChanged,
             this, &PlaybackWindow::onUiGroupChanged);
@@ -113,6 +120,11 @@ PlaybackWindow::PlaybackWindow(QWidget* parent)
              const qint64 wall = dayStartNs_ + t;
              QMetaObject::invokeMethod(stitch_, "seekWall", Qt::QueuedConnection, Q_ARG(qint64, wall));
          });
+        // Timeline drag → scrub track (sub-stream) while the playhead moves
+        connect(timelineView, &PlaybackTimelineView::scrubbingChanged, this, [this](bool on){
+            if (!stitch_) return;
+            QMetaObject::invokeMethod(stitch_, "setScrubbing", Qt::QueuedConnection, Q_ARG(bool, on));
+        });
 
             // Note: Side controls connections moved to initStitch_() to ensure proper timing
             // ---------- Trim/Export wiring ----------
@@ -362,6 +374,10 @@ void PlaybackWindow::openDb(const QString& dbPath) {
                     &PlaybackWindow::onDaysReady, Qt::QueuedConnection);
             connect(db, &DbReader::segmentsReady, this,
                     &PlaybackWindow::onSegmentsReady, Qt::QueuedConnection);
+            connect(db, &DbReader::gapsReady, this,
+                    &PlaybackWindow::onGapsReady, Qt::QueuedConnection);
+            connect(db, &DbReader::subSegmentsReady, this,
+                    &PlaybackWindow::onSubSegmentsReady, Qt::QueuedConnection);
             connect(db, &DbReader::error,         this,
                     [](const QString& e){ qWarning() << "[Playback] DB error:" << e; });
         }
@@ -637,6 +653,8 @@ void PlaybackWindow::onDaysReady(int cameraId, const QStringList& ymdList) {
 }
 void PlaybackWindow::onUiDateChanged(const QDate&) { /* no-op by design */ }
 void PlaybackWindow::onSegmentsReady(int cameraId, const SegmentList& segs) {
+    const bool liveRefresh = liveRefreshPending_;
+    liveRefreshPending_ = false;
     if (cameraId != selectedCamId) return;
     if (!controls) return;
     const QDate day = currentDay_.isValid() ? currentDay_ : QDate::currentDate();
@@ -671,11 +689,17 @@ void PlaybackWindow::onSegmentsReady(int cameraId, const SegmentList& segs) {
     // Build segment index (detect gaps, normalize)
     segIndex_.build(segs, dayStartNs_, dayEndNs_);
     segIndex_.debugDump("SegIndex");
+    if (db && !segIndex_.gaps().isEmpty()) {
+        QMetaObject::invokeMethod(db, "listGaps", Qt::QueuedConnection,
+                                  Q_ARG(int, cameraId), Q_ARG(QString, day.toString("yyyy-MM-dd")));
+    }
 
     // Export to metas for stitching (virtual timeline)
     QVector<QString> paths;
     QVector<qint64>  wallStarts, offsets, durations;
-    segIndex_.exportForStitching(paths, wallStarts, offsets, durations);
+    QVector<bool>    growing;
+    QVector<QString> codecs;
+    segIndex_.exportForStitching(paths, wallStarts, offsets, durations, &growing, &codecs);
 
     QVector<SegmentMeta> metas;
     metas.reserve(paths.size());
@@ -683,14 +707,21 @@ void PlaybackWindow::onSegmentsReady(int cameraId, const SegmentList& segs) {
         metas.push_back({ paths[i],
                           dayStartNs_ + wallStarts[i],
                           offsets[i],
-                         durations[i] });
+                         durations[i],
+                          growing[i],
+                          codecs[i] });
     }
-    // Feed stitching engine
+    // Feed stitching engine (a live-tail refresh keeps the current position)
     if (stitch_) {
-        QMetaObject::invokeMethod(stitch_, "setPlaylist", Qt::QueuedConnection,
+        QMetaObject::invokeMethod(stitch_, liveRefresh ? "updatePlaylist" : "setPlaylist",
+                                  Qt::QueuedConnection,
                                   Q_ARG(QVector<SegmentMeta>, metas),
                                   Q_ARG(qint64, dayStartNs_));
     }
+    if (db && !metas.isEmpty()) {
+        QMetaObject::invokeMethod(db, "listSubSegments", Qt::QueuedConnection,
+                                  Q_ARG(int, cameraId), Q_ARG(QString, day.toString("yyyy-MM-dd")));
+    }
     qInfo() << "[PW] sideControls=" << sideControls << " enable=" << !metas.isEmpty()
                 << " metas=" << metas.size();
         if (sideControls) sideControls->setEnabledControls(!metas.isEmpty());
@@ -708,6 +739,35 @@ void PlaybackWindow::onSegmentsReady(int cameraId, const SegmentList& segs) {
                     }
                 }
 }
+void PlaybackWindow::onGapsReady(int cameraId, const GapList& gaps) {
+    if (cameraId != selectedCamId) return;
+    segIndex_.applyJournal(gaps);
+    for (const auto& g : segIndex_.gaps()) {
+        qInfo() << "[PW] gap" << g.start_ns << ".." << g.end_ns
+                << "dur_s=" << g.duration_ns() / 1000000000LL
+                << "reason=" << (g.reason.isEmpty() ? QStringLiteral("unjournaled") : g.reason);
+    }
+}
+void PlaybackWindow::onSubSegmentsReady(int cameraId, const SegmentList& segs) {
+    if (cameraId != selectedCamId || !stitch_) return;
+    QVector<SegmentMeta> metas;
+    metas.reserve(segs.size());
+    for (const auto& s : segs) {
+        if (s.end_ns <= s.start_ns) continue;
+        metas.push_back({ s.path, s.start_ns, 0, s.end_ns - s.start_ns, false, s.codec });
+    }
+    QMetaObject::invokeMethod(stitch_, "setScrubPlaylist", Qt::QueuedConnection,
+                              Q_ARG(QVector<SegmentMeta>, metas));
+}
+void PlaybackWindow::refreshLiveTail_() {
+    if (!db || selectedCamId <= 0 || liveRefreshPending_) return;
+    if (!currentDay_.isValid() || currentDay_ != QDate::currentDate()) return;
+    if (segIndex_.empty()) return; // nothing loaded yet (Go not pressed)
+    liveRefreshPending_ = true;
+    QMetaObject::invokeMethod(db, "listSegments", Qt::QueuedConnection,
+                              Q_ARG(int, selectedCamId),
+                              Q_ARG(QString, currentDay_.toString("yyyy-MM-dd")));
+}
 void PlaybackWindow::runGoFor(const QString& camName, const QDate& day) {
     if (!timelineCtl) return;
     // keep UI in sync
@@ -21,6 +21,7 @@ class PlaybackVideoPlayerGst;
 class QThread;
 class PlaybackStitchingPlayer;
 class PlaybackExporter;
+class QTimer;
 
 struct PlaybackGroup {
     int id = -1;
@@ -87,6 +88,11 @@ private:
     QString lastCamName_;
     void runGoFor(const QString& camName, const QDate& day);
 
+    // --- Live tail (today's recording keeps growing) ---
+    QTimer* liveTailTimer_{nullptr};
+    bool    liveRefreshPending_ = false;
+    void    refreshLiveTail_();
+
     // --- Trim/Export UI state ---
     struct TrimRange { bool enabled=false; qint64 start_ns=0; qint64 end_ns=0; };
     TrimRange trim_;
@@ -109,6 +115,8 @@ private slots:
     void onCamerasReady(const CamList& cams);
     void onDaysReady(int cameraId, const QStringList& ymdList);
     void onSegmentsReady(int cameraId, const SegmentList& segs);
+    void onGapsReady(int cameraId, const GapList& gaps);
+    void onSubSegmentsReady(int cameraId, const SegmentList& segs);
     void onUiCameraChanged(const QString& camName);
     void onUiDateChanged(const QDate& date);
     void onUiGroupChanged(int index);
@@ -0,0 +1,218 @@
+#include "purge_planner.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QFileInfo>
+#include <QStringList>
+#include <QDebug>
+#include <QtGlobal>
+
+static const qint64 kDayNs = 24LL * 3600 * 1000000000LL;
+
+// Rows recorded before camera_id was populated only carry the URL.
+// camera_id is backfilled for legacy rows by DbWriter::migrateSchema_().
+static const char* kCamExpr = "s.camera_id";
+
+static QString camFilter(const QVector<int>& ids) {
+    QStringList l;
+    for (int id : ids) l << QString::number(id);
+    const QString in = l.join(',');
+    return QString("s.camera_id IN (%1)").arg(in);
+}
+
+void PurgePlanner::loadPolicies_() {
+    cameraPolicy_.clear();
+    groupPolicy_.clear();
+    groupMembers_.clear();
+
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    if (q.exec("SELECT scope, scope_id, COALESCE(max_bytes,0), COALESCE(min_days,0)"
+               " FROM retention_policies;")) {
+        while (q.next()) {
+            Policy p;
+            p.maxBytes = q.value(2).toLongLong();
+            p.minDays  = q.value(3).toInt();
+            if (q.value(0).toString() == QLatin1String("group"))
+                groupPolicy_.insert(q.value(1).toInt(), p);
+            else
+                cameraPolicy_.insert(q.value(1).toInt(), p);
+        }
+    } else {
+        qWarning() << "[PurgePlanner] policies:" << q.lastError().text();
+    }
+
+    if (groupPolicy_.isEmpty()) return;
+    QSqlQuery m(db_);
+    m.setForwardOnly(true);
+    if (!m.exec("SELECT group_id, camera_id FROM camera_group_members;")) {
+        qWarning() << "[PurgePlanner] group members:" << m.lastError().text();
+        return;
+    }
+    while (m.next()) {
+        const int gid = m.value(0).toInt();
+        if (groupPolicy_.contains(gid)) groupMembers_[gid].push_back(m.value(1).toInt());
+    }
+}
+
+void PurgePlanner::computeCutoffs_(const Input& in) {
+    cameraCutoffNs_.clear();
+    defaultCutoffNs_ = in.defaultMinDays > 0 ? in.nowUtcNs - in.defaultMinDays * kDayNs
+                                             : in.nowUtcNs;
+
+    QHash<int, int> days;
+    for (auto it = cameraPolicy_.cbegin(); it != cameraPolicy_.cend(); ++it)
+        days[it.key()] = qMax(days.value(it.key(), 0), it.value().minDays);
+    for (auto it = groupMembers_.cbegin(); it != groupMembers_.cend(); ++it) {
+        const int gd = groupPolicy_.value(it.key()).minDays;
+        for (int cid : it.value()) days[cid] = qMax(days.value(cid, 0), gd);
+    }
+    for (auto it = days.cbegin(); it != days.cend(); ++it) {
+        const int d = qMax(it.value(), in.defaultMinDays);
+        cameraCutoffNs_.insert(it.key(), d > 0 ? in.nowUtcNs - d * kDayNs : in.nowUtcNs);
+    }
+}
+
+qint64 PurgePlanner::cutoffFor_(int cameraId) const {
+    return cameraCutoffNs_.value(cameraId, defaultCutoffNs_);
+}
+
+QHash<int, qint64> PurgePlanner::usageByCamera_() {
+    QHash<int, qint64> out;
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    // Per-day totals kept by DbWriter; camera_id there is already resolved.
+    if (!q.exec("SELECT camera_id, SUM(bytes) FROM recording_days GROUP BY camera_id;")) {
+        qWarning() << "[PurgePlanner] usage:" << q.lastError().text();
+        return out;
+    }
+    while (q.next()) out.insert(q.value(0).toInt(), q.value(1).toLongLong());
+    return out;
+}
+
+qint64 PurgePlanner::take_(const QString& where, const QString& prefix, qint64 bytes,
+                           PurgePlan& plan, bool quota) {
+    if (bytes <= 0) return 0;
+
+    // Nothing starting at/after the latest cutoff can ever qualify.
+    qint64 horizon = defaultCutoffNs_;
+    for (qint64 c : cameraCutoffNs_) horizon = qMax(horizon, c);
+
+    QSqlQuery q(db_);
+    q.setForwardOnly(true);
+    q.prepare(QString("SELECT s.id, %1, s.file_path, COALESCE(s.size_bytes,0), s.start_utc_ns,"
+                      " COALESCE(s.eff_end_ns, s.start_utc_ns)"
+                      " FROM segments_all s"
+                      " WHERE s.status=1 AND s.pinned=0 AND s.start_utc_ns < :horizon %2 %3"
+                      " ORDER BY s.start_utc_ns ASC;")
+              .arg(kCamExpr, where,
+                   prefix.isEmpty() ? QString() : "AND substr(s.file_path,1,:plen)=:prefix"));
+    q.bindValue(":horizon", horizon);
+    if (!prefix.isEmpty()) {
+        q.bindValue(":plen", prefix.size());
+        q.bindValue(":prefix", prefix);
+    }
+    if (!q.exec()) {
+        qWarning() << "[PurgePlanner] candidates:" << q.lastError().text();
+        return 0;
+    }
+
+    // Oldest-first over every camera of the root: all its rows before the last
+    // one taken (or all of them if the scan ran out) are in the plan, bar the
+    // min-days floors.
+    qint64 lastStartNs = 0;
+    bool exhausted = true;
+
+    qint64 taken = 0;
+    while (q.next()) {
+        if (taken >= bytes) { exhausted = false; break; }
+        const qint64 id = q.value(0).toLongLong();
+        if (chosen_.contains(id)) continue;
+        const int cid = q.value(1).toInt();
+        if (q.value(4).toLongLong() >= cutoffFor_(cid)) continue;
+
+        PurgeVictim v;
+        v.id        = id;
+        v.cameraId  = cid;
+        v.path      = q.value(2).toString();
+        v.sizeBytes = q.value(3).toLongLong();
+        if (v.sizeBytes <= 0) v.sizeBytes = QFileInfo(v.path).size();  // pre-size_bytes rows
+        v.startNs   = q.value(4).toLongLong();
+        v.endNs     = q.value(5).toLongLong();
+        lastStartNs = v.startNs;
+
+        chosen_.insert(id);
+        plan.victims.push_back(v);
+        taken += v.sizeBytes;
+    }
+    if (where.isEmpty()) {
+        qint64 floorNs = defaultCutoffNs_;
+        for (qint64 c : cameraCutoffNs_) floorNs = qMin(floorNs, c);
+        plan.horizons.push_back({ prefix, exhausted ? floorNs : qMin(floorNs, lastStartNs) });
+    }
+    if (quota) plan.quotaBytes += taken; else plan.spaceBytes += taken;
+    return taken;
+}
+
+PurgePlan PurgePlanner::plan(const Input& in) {
+    PurgePlan plan;
+    chosen_.clear();
+    loadPolicies_();
+    computeCutoffs_(in);
+
+    // 1) Quotas: each camera/group gives back exactly its own overage.
+    bool anyQuota = false;
+    for (const auto& p : cameraPolicy_) anyQuota |= p.maxBytes > 0;
+    for (const auto& p : groupPolicy_)  anyQuota |= p.maxBytes > 0;
+
+    if (in.applyQuotas && anyQuota) {
+        QHash<int, qint64> usage = usageByCamera_();
+
+        for (auto it = cameraPolicy_.cbegin(); it != cameraPolicy_.cend(); ++it) {
+            const qint64 over = usage.value(it.key()) - it.value().maxBytes;
+            if (it.value().maxBytes <= 0 || over <= 0) continue;
+            const qint64 got = take_("AND " + camFilter({ it.key() }), QString(), over, plan, true);
+            usage[it.key()] -= got;
+            if (got < over)
+                qInfo() << "[PurgePlanner] camera" << it.key() << "over quota by" << over - got
+                        << "bytes inside its min-days window";
+        }
+
+        for (auto it = groupPolicy_.cbegin(); it != groupPolicy_.cend(); ++it) {
+            const QVector<int> members = groupMembers_.value(it.key());
+            if (it.value().maxBytes <= 0 || members.isEmpty()) continue;
+            qint64 used = 0;
+            for (int cid : members) used += usage.value(cid);
+            const qint64 over = used - it.value().maxBytes;
+            if (over <= 0) continue;
+
+            // Oldest-first across the group; tally per camera so later groups
+            // sharing members see the reduced usage.
+            const int before = plan.victims.size();
+            const qint64 got = take_("AND " + camFilter(members), QString(), over, plan, true);
+            for (int i = before; i < plan.victims.size(); ++i)
+                usage[plan.victims[i].cameraId] -= plan.victims[i].sizeBytes;
+            if (got < over)
+                qInfo() << "[PurgePlanner] group" << it.key() << "over quota by" << over - got
+                        << "bytes inside its min-days window";
+        }
+    }
+
+    // 2) Free space, per root: whatever the quota pass did not already cover there.
+    for (const auto& rn : in.needs) {
+        const QString prefix = rn.first.isEmpty() ? QString() : rn.first + "/";
+        qint64 need = rn.second;
+        for (const auto& v : plan.victims)
+            if (prefix.isEmpty() || v.path.startsWith(prefix)) need -= v.sizeBytes;
+        if (need <= 0) continue;
+        const qint64 got = take_(QString(), prefix, need, plan, false);
+        plan.shortBytes += qMax<qint64>(0, need - got);
+    }
+
+    qInfo() << "[PurgePlanner] victims=" << plan.victims.size()
+            << "quota_bytes=" << plan.quotaBytes
+            << "space_bytes=" << plan.spaceBytes
+            << "short_bytes=" << plan.shortBytes
+            << "horizons=" << plan.horizons.size();
+    return plan;
+}
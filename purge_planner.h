@@ -0,0 +1,88 @@
+#pragma once
+#include <QSqlDatabase>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QPair>
+
+// Free-space shortfall per archive root: (root dir, bytes). Empty dir = whole archive.
+using RootNeeds = QVector<QPair<QString, qint64>>;
+
+// One row selected for deletion.
+struct PurgeVictim {
+    qint64  id = 0;
+    int     cameraId = 0;
+    QString path;
+    qint64  sizeBytes = 0;
+    qint64  startNs = 0;
+    qint64  endNs = 0;
+};
+
+// Every finalized unpinned row under `prefix` ("" = whole archive) that
+// starts before `beforeNs` is in the plan.
+struct PurgeHorizon {
+    QString prefix;
+    qint64  beforeNs = 0;
+};
+
+struct PurgePlan {
+    QVector<PurgeVictim> victims;     // ordered: quota victims first, then oldest-first
+    QVector<PurgeHorizon> horizons;   // one per root the free-space pass ran on
+    qint64 quotaBytes  = 0;           // planned to satisfy camera/group quotas
+    qint64 spaceBytes  = 0;           // planned to reach the free-space target
+    qint64 shortBytes  = 0;           // free-space need left unmet (min-days floors / pinned)
+    qint64 totalBytes() const { return quotaBytes + spaceBytes; }
+};
+
+/**
+ * PurgePlanner
+ * ------------
+ * Computes, from segments.size_bytes, exactly which finalized unpinned rows to
+ * drop so that in one pass:
+ *   1) every camera and group is within its byte quota,
+ *   2) each archive root frees at least its shortfall,
+ * without ever touching footage younger than the camera's minimum retention.
+ *
+ * The free-space pass takes a root's rows oldest first, so everything on that
+ * root older than some instant is in the plan: one PurgeHorizon per root,
+ * which lets the purge remove that range by time (DbWriter::purgeBefore).
+ *
+ * Policies live in `retention_policies` (scope 'camera'|'group', scope_id,
+ * max_bytes, min_days; 0 = unset). A camera's floor is the max of its own,
+ * its groups' and the global default min_days.
+ *
+ * Runs on the DbWriter thread (uses its connection); read-only.
+ */
+class PurgePlanner final {
+public:
+    struct Input {
+        RootNeeds needs;                 // free-space shortfall per root (empty = quotas only)
+        int    defaultMinDays = 0;     // RetentionCfg::perCameraMinDays
+        bool   applyQuotas    = true;  // evaluate per-camera/group byte quotas
+        qint64 nowUtcNs       = 0;
+    };
+
+    explicit PurgePlanner(const QSqlDatabase& db) : db_(db) {}
+    PurgePlan plan(const Input& in);
+
+private:
+    struct Policy { qint64 maxBytes = 0; int minDays = 0; };
+
+    QSqlDatabase              db_;
+    QHash<int, Policy>        cameraPolicy_;
+    QHash<int, Policy>        groupPolicy_;
+    QHash<int, QVector<int>>  groupMembers_;
+    QHash<int, qint64>        cameraCutoffNs_;   // rows starting at/after this are protected
+    qint64                    defaultCutoffNs_ = 0;
+    QSet<qint64>              chosen_;
+
+    void   loadPolicies_();
+    void   computeCutoffs_(const Input& in);
+    qint64 cutoffFor_(int cameraId) const;
+    QHash<int, qint64> usageByCamera_();
+
+    // Append oldest eligible rows matching `where` until `bytes` is covered.
+    qint64 take_(const QString& where, const QString& prefix, qint64 bytes,
+                 PurgePlan& plan, bool quota);
+};
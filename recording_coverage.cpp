@@ -0,0 +1,103 @@
+#include "recording_coverage.h"
+
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QDebug>
+
+#include "db_read_pool.h"
+
+static const qint64 kMinuteNs = 60LL * 1000000000LL;
+
+namespace {
+
+struct CameraEntry {
+    quint64 generation = 0;    // bumped by every publish, loaded or not
+    bool    loaded = false;
+    RecordingCoverage::DayMap days;
+};
+
+using Key = QPair<QString, int>;   // absolute database path, camera id
+
+QMutex gMutex;
+QHash<Key, CameraEntry> gCameras;
+
+} // namespace
+
+QByteArray RecordingCoverage::build(qint64 dayStartNs, qint64 dayEndNs,
+                                    const QVector<QPair<qint64, qint64>>& spans) {
+    const int minutes = int((dayEndNs - dayStartNs + kMinuteNs - 1) / kMinuteNs);
+    QByteArray bits((qMax(0, minutes) + 7) / 8, '\0');
+    for (const auto& s : spans) {
+        const qint64 a = qMax(s.first, dayStartNs);
+        const qint64 b = qMin(s.second, dayEndNs);
+        if (b <= a) continue;
+        const int first = int((a - dayStartNs) / kMinuteNs);
+        const int last  = int((b - 1 - dayStartNs) / kMinuteNs);
+        for (int m = first; m <= last && m < minutes; ++m)
+            bits[m / 8] = char(quint8(bits[m / 8]) | (1u << (m % 8)));
+    }
+    return bits;
+}
+
+int RecordingCoverage::coveredMinutes(const QByteArray& bits) {
+    int n = 0;
+    for (char c : bits)
+        for (quint8 b = quint8(c); b; b &= quint8(b - 1)) ++n;
+    return n;
+}
+
+void RecordingCoverage::publish(const QString& dbFile, int cameraId, const QString& day,
+                                const QByteArray& bits) {
+    const Key key{ QFileInfo(dbFile).absoluteFilePath(), cameraId };
+    QMutexLocker lock(&gMutex);
+    CameraEntry& cam = gCameras[key];
+    ++cam.generation;
+    if (!cam.loaded) return;   // the next reader loads it from the database
+    if (bits.isEmpty()) cam.days.remove(day);
+    else cam.days.insert(day, bits);
+}
+
+RecordingCoverage::DayMap RecordingCoverage::days(const QSqlDatabase& db, int cameraId,
+                                                  const QString& fromDay, const QString& toDay) {
+    const Key key{ QFileInfo(db.databaseName()).absoluteFilePath(), cameraId };
+    DayMap all;
+    bool cached = false;
+    quint64 generation = 0;
+    {
+        QMutexLocker lock(&gMutex);
+        const CameraEntry& cam = gCameras[key];
+        cached = cam.loaded;
+        if (cached) all = cam.days;
+        generation = cam.generation;
+    }
+
+    if (!cached) {
+        DbReadPool::Query q = DbReadPool::prepared(db, QStringLiteral(
+            "SELECT local_day, coverage FROM recording_days WHERE camera_id=:cid;"));
+        q.bindValue(":cid", cameraId);
+        if (!DbReadPool::exec(q)) {
+            qWarning() << "[Coverage] load:" << q.lastError().text();
+            return {};
+        }
+        while (q.next()) all.insert(q.value(0).toString(), q.value(1).toByteArray());
+        q.finish();
+
+        // Cache only if no publish raced the read; otherwise the next call reloads.
+        QMutexLocker lock(&gMutex);
+        CameraEntry& cam = gCameras[key];
+        if (!cam.loaded && cam.generation == generation) {
+            cam.days = all;
+            cam.loaded = true;
+        }
+    }
+
+    DayMap out;
+    for (auto it = qAsConst(all).lowerBound(fromDay); it != all.cend() && it.key() <= toDay; ++it)
+        out.insert(it.key(), it.value());
+    return out;
+}
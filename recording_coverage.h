@@ -0,0 +1,40 @@
+#pragma once
+#include <QByteArray>
+#include <QMap>
+#include <QPair>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+/**
+ * RecordingCoverage
+ * -----------------
+ * Per camera and local day, one bit per minute from local midnight: set when
+ * a finalized main-stream segment overlaps that minute. 180 bytes for a
+ * normal day (DST days have 1380 or 1500 minutes); byte i/8, bit i%8 (LSB
+ * first). Lets timelines and overviews show availability for many cameras
+ * and weeks without reading segment rows.
+ * - Stored in recording_days.coverage; DbWriter rebuilds a day's bitmap
+ *   whenever it refreshes that day, and publishes it here after the commit.
+ * - Readers get a camera's whole day map from a process-wide cache, loaded
+ *   from recording_days on first use and kept current by those publishes.
+ */
+class RecordingCoverage final {
+public:
+    using DayMap = QMap<QString, QByteArray>;   // "yyyy-MM-dd" -> bitmap
+
+    // Bitmap of [dayStartNs, dayEndNs) covered by the given [start, end) spans.
+    static QByteArray build(qint64 dayStartNs, qint64 dayEndNs,
+                            const QVector<QPair<qint64, qint64>>& spans);
+    static int coveredMinutes(const QByteArray& bits);
+
+    // Writer side, after commit. Empty bits: the day has no recordings left.
+    static void publish(const QString& dbFile, int cameraId, const QString& day,
+                        const QByteArray& bits);
+
+    // Days of cameraId in [fromDay, toDay] (inclusive, "yyyy-MM-dd") that
+    // have recordings. `db` is the caller's DbReadPool connection.
+    static DayMap days(const QSqlDatabase& db, int cameraId,
+                       const QString& fromDay, const QString& toDay);
+};
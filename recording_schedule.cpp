@@ -0,0 +1,94 @@
+#include "recording_schedule.h"
+
+#include <QStringList>
+#include <QTime>
+#include <QDebug>
+
+static const int kDayMin  = 24 * 60;
+static const int kWeekMin = 7 * kDayMin;
+
+static int dayIndex(const QString& s) {
+    static const char* names[] = { "mon", "tue", "wed", "thu", "fri", "sat", "sun" };
+    for (int i = 0; i < 7; ++i)
+        if (s == QLatin1String(names[i])) return i;
+    return -1;
+}
+
+// "HH:MM" → minutes since midnight; "24:00" is allowed as an end.
+static int parseClock(const QString& s) {
+    const QStringList hm = s.split(':');
+    if (hm.size() != 2) return -1;
+    bool okH = false, okM = false;
+    const int h = hm[0].toInt(&okH), m = hm[1].toInt(&okM);
+    if (!okH || !okM || m < 0 || m > 59 || h < 0 || h > 24 || (h == 24 && m != 0)) return -1;
+    return h * 60 + m;
+}
+
+// "mon-fri,sun" → bit per day; 0 on a bad token.
+static int parseDays(const QString& s) {
+    if (s == QLatin1String("daily") || s == QLatin1String("*")) return 0x7f;
+    int mask = 0;
+    for (const QString& tok : s.split(',', Qt::SkipEmptyParts)) {
+        const QStringList r = tok.split('-');
+        const int a = dayIndex(r.value(0));
+        const int b = r.size() == 2 ? dayIndex(r[1]) : a;
+        if (a < 0 || b < 0 || r.size() > 2) return 0;
+        for (int d = a; ; d = (d + 1) % 7) {
+            mask |= 1 << d;
+            if (d == b) break;
+        }
+    }
+    return mask;
+}
+
+RecordingSchedule RecordingSchedule::parse(const QString& spec, bool* ok) {
+    RecordingSchedule s;
+    if (ok) *ok = true;
+    const QString norm = spec.trimmed().toLower();
+    if (norm.isEmpty() || norm == QLatin1String("always")) return s;
+
+    QBitArray bits(kWeekMin);
+    for (const QString& w : norm.split(';', Qt::SkipEmptyParts)) {
+        const QStringList parts = w.simplified().split(' ');
+        const int days = parts.size() == 2 ? parseDays(parts[0]) : 0;
+        const QStringList range = parts.value(1).split('-');
+        const int from = range.size() == 2 ? parseClock(range[0]) : -1;
+        const int to   = range.size() == 2 ? parseClock(range[1]) : -1;
+        if (!days || from < 0 || from >= kDayMin || to < 0) {
+            qWarning() << "[Schedule] bad window" << w.trimmed() << "in" << spec;
+            if (ok) *ok = false;
+            return RecordingSchedule();
+        }
+        // An end at or before the start runs into the next day.
+        const int len = to > from ? to - from : kDayMin - from + to;
+        for (int d = 0; d < 7; ++d) {
+            if (!(days & (1 << d))) continue;
+            const int start = d * kDayMin + from;
+            for (int m = 0; m < len; ++m) bits.setBit((start + m) % kWeekMin);
+        }
+    }
+    s.alwaysOn_ = bits.count(true) == kWeekMin;
+    if (!s.alwaysOn_) s.minutes_ = bits;
+    return s;
+}
+
+int RecordingSchedule::minuteOfWeek_(const QDateTime& local) {
+    const QTime t = local.time();
+    return (local.date().dayOfWeek() - 1) * kDayMin + t.hour() * 60 + t.minute();
+}
+
+bool RecordingSchedule::activeAt(const QDateTime& local) const {
+    return alwaysOn_ || minutes_.testBit(minuteOfWeek_(local));
+}
+
+QDateTime RecordingSchedule::nextChange(const QDateTime& from) const {
+    if (alwaysOn_ || minutes_.count(true) == 0) return QDateTime();
+    const bool now = activeAt(from);
+    QDateTime t = from.addSecs(-from.time().second());
+    t = t.addMSecs(-t.time().msec());
+    for (int k = 0; k < kWeekMin; ++k) {
+        t = t.addSecs(60);
+        if (activeAt(t) != now) return t;
+    }
+    return QDateTime();
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <QBitArray>
+#include <QDateTime>
+#include <QString>
+
+/**
+ * RecordingSchedule
+ * -----------------
+ * Weekly recording windows at minute resolution, in local time.
+ * - Spec: windows separated by ';', each "<days> <HH:MM>-<HH:MM>", e.g.
+ *   "mon-fri 18:00-08:00; sat,sun 00:00-24:00". Days are mon..sun, lists
+ *   and ranges (ranges may wrap: "fri-mon"). An end at or before the start
+ *   runs past midnight into the next day.
+ * - An empty spec (or "always") records around the clock.
+ * - Schedules live in `recording_schedules` (scope 'camera'|'group',
+ *   scope_id, spec, off_mode 'stop'|'event'); a camera's own row wins over
+ *   its groups, whose windows are merged. Outside the windows off_mode
+ *   'stop' stops the recorder, 'event' keeps it in event-only mode.
+ */
+class RecordingSchedule final {
+public:
+    // Invalid specs yield an always-on schedule and ok=false.
+    static RecordingSchedule parse(const QString& spec, bool* ok = nullptr);
+
+    bool alwaysOn() const { return alwaysOn_; }
+    bool activeAt(const QDateTime& local) const;
+
+    // Next time activeAt() flips after `from`; invalid if it never does.
+    QDateTime nextChange(const QDateTime& from) const;
+
+private:
+    static int minuteOfWeek_(const QDateTime& local);   // Monday 00:00 = 0
+
+    QBitArray minutes_;        // 7 * 1440, set = record
+    bool      alwaysOn_ = true;
+};
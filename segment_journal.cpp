@@ -0,0 +1,325 @@
+#include "segment_journal.h"
+
+#include <QDate>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QReadLocker>
+#include <QReadWriteLock>
+#include <QWriteLocker>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+#include "archive_limits.h"
+
+static const qint64 kDayNs = 24LL * 3600 * 1000000000LL;
+
+namespace {
+
+struct Record {
+    qint64  id;
+    qint64  startNs;
+    qint64  effEndNs;
+    qint64  durationMs;
+    qint64  sizeBytes;
+    quint32 pathOffset;   // into the day's .paths file
+    quint16 pathLength;
+    quint8  codec;        // 0 = h264, 1 = h265
+    quint8  tier;
+    quint8  flags;        // kOpen | kRemoved
+    quint8  reserved[7];
+    quint32 magic;
+    quint32 check;        // FNV-1a of the bytes before it
+};
+static_assert(sizeof(Record) == 64, "journal records are 64 bytes");
+
+const quint32 kMagic   = 0x314a5353;   // "SSJ1"
+const quint8  kOpen    = 0x01;
+const quint8  kRemoved = 0x02;
+const qint64  kRecordBytes = qint64(sizeof(Record));
+
+QReadWriteLock    gLock;               // readers vs. day rewrites; guards gDbFile, gDir
+QString           gDbFile, gDir;       // written on DbWriter's thread only
+std::atomic<bool> gReady{false};
+
+quint32 fnv1a(const void* data, size_t n) {
+    const quint8* p = static_cast<const quint8*>(data);
+    quint32 h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 16777619u; }
+    return h;
+}
+
+QString dayBase(const QString& dir, int cameraId, qint64 dayKey) {
+    return QStringLiteral("%1/%2/%3").arg(dir).arg(cameraId)
+        .arg(QDate(1970, 1, 1).addDays(dayKey).toString(QStringLiteral("yyyyMMdd")));
+}
+
+// Live rows of one day file pair, in start order. `records`: valid records
+// read, dead ones included.
+QVector<IndexedSegment> loadDay(const QString& base, int* records = nullptr) {
+    static const QString h264 = QStringLiteral("h264"), h265 = QStringLiteral("h265");
+    QVector<IndexedSegment> rows;
+    if (records) *records = 0;
+
+    // Records first: a path is always written before the record naming it.
+    QFile rec(base + QStringLiteral(".rec"));
+    if (!rec.open(QIODevice::ReadOnly)) return rows;
+    qint64 n = rec.size() / kRecordBytes;          // a torn last record is ignored
+    if (n == 0) return rows;
+    QByteArray recCopy;
+    const uchar* r = rec.map(0, n * kRecordBytes);
+    if (!r) {
+        recCopy = rec.read(n * kRecordBytes);
+        n = recCopy.size() / kRecordBytes;
+        r = reinterpret_cast<const uchar*>(recCopy.constData());
+    }
+
+    QFile paths(base + QStringLiteral(".paths"));
+    QByteArray pathCopy;
+    const uchar* p = nullptr;
+    qint64 pathBytes = 0;
+    if (paths.open(QIODevice::ReadOnly) && paths.size() > 0) {
+        pathBytes = paths.size();
+        p = paths.map(0, pathBytes);
+        if (!p) {
+            pathCopy = paths.readAll();
+            pathBytes = pathCopy.size();
+            p = reinterpret_cast<const uchar*>(pathCopy.constData());
+        }
+    }
+
+    QHash<qint64, Record> live;
+    live.reserve(int(n));
+    int valid = 0;
+    for (qint64 i = 0; i < n; ++i) {
+        Record x;
+        std::memcpy(&x, r + i * kRecordBytes, sizeof x);
+        if (x.magic != kMagic || x.check != fnv1a(&x, offsetof(Record, check))) continue;
+        ++valid;
+        if (x.flags & kRemoved) live.remove(x.id);
+        else live.insert(x.id, x);
+    }
+    if (records) *records = valid;
+
+    rows.reserve(live.size());
+    for (const Record& x : qAsConst(live)) {
+        if (qint64(x.pathOffset) + x.pathLength > pathBytes) continue;   // paths file lost its tail
+        IndexedSegment s;
+        s.id         = x.id;
+        s.startNs    = x.startNs;
+        s.effEndNs   = x.effEndNs;
+        s.durationMs = x.durationMs;
+        s.sizeBytes  = x.sizeBytes;
+        s.path       = QString::fromUtf8(reinterpret_cast<const char*>(p) + x.pathOffset, x.pathLength);
+        s.codec      = x.codec == 1 ? h265 : h264;
+        s.open       = x.flags & kOpen;
+        s.tier       = x.tier;
+        rows.push_back(std::move(s));
+    }
+    std::sort(rows.begin(), rows.end(), [](const IndexedSegment& a, const IndexedSegment& b) {
+        return a.startNs != b.startNs ? a.startNs < b.startNs : a.id < b.id;
+    });
+    return rows;
+}
+
+// Appends rows (or tombstones for them) to the day file pair at `base`.
+// Paths go out and are flushed before the records that point at them.
+bool appendRows(const QString& base, const QVector<IndexedSegment>& rows, bool removed) {
+    QFile paths(base + QStringLiteral(".paths")), rec(base + QStringLiteral(".rec"));
+    if (!paths.open(QIODevice::WriteOnly | QIODevice::Append)
+        || !rec.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "[SegJournal] open" << base << ":" << paths.errorString() << rec.errorString();
+        return false;
+    }
+    // A record torn by a crash would shift every later one.
+    if (const qint64 torn = rec.size() % kRecordBytes) rec.resize(rec.size() - torn);
+
+    QByteArray pathOut, recOut;
+    recOut.reserve(int(rows.size() * kRecordBytes));
+    const qint64 base0 = paths.size();
+    for (const IndexedSegment& s : rows) {
+        const QByteArray path = removed ? QByteArray() : s.path.toUtf8();
+        if (path.size() > 0xFFFF || base0 + pathOut.size() > 0xFFFFFFFFLL) continue;
+        Record x{};
+        x.id         = s.id;
+        x.startNs    = s.startNs;
+        x.effEndNs   = s.effEndNs;
+        x.durationMs = s.durationMs;
+        x.sizeBytes  = s.sizeBytes;
+        x.pathOffset = quint32(base0 + pathOut.size());
+        x.pathLength = quint16(path.size());
+        x.codec      = s.codec == QLatin1String("h265") ? 1 : 0;
+        x.tier       = quint8(s.tier);
+        x.flags      = quint8((removed ? kRemoved : 0) | (s.open ? kOpen : 0));
+        x.magic      = kMagic;
+        x.check      = fnv1a(&x, offsetof(Record, check));
+        pathOut += path;
+        recOut.append(reinterpret_cast<const char*>(&x), int(sizeof x));
+    }
+    if (paths.write(pathOut) != pathOut.size() || !paths.flush()
+        || rec.write(recOut) != recOut.size()) {
+        qWarning() << "[SegJournal] write" << base << ":" << paths.errorString() << rec.errorString();
+        return false;
+    }
+    return true;
+}
+
+void removeDay(const QString& base) {
+    QWriteLocker lock(&gLock);
+    QFile::remove(base + QStringLiteral(".rec"));
+    QFile::remove(base + QStringLiteral(".paths"));
+}
+
+} // namespace
+
+bool SegmentJournal::enabled() {
+    static const bool on = qEnvironmentVariable("CAMVIGIL_SEGMENT_JOURNAL", QStringLiteral("1")) != QLatin1String("0");
+    return on;
+}
+
+qint64 SegmentJournal::open(const QString& dbFile) {
+    if (!enabled()) return -1;
+    const QString abs = QFileInfo(dbFile).absoluteFilePath();
+    const QString dir = QFileInfo(abs).absolutePath() + QStringLiteral("/segment_journal");
+    QDir().mkpath(dir);
+    gReady.store(false, std::memory_order_release);
+    {
+        QWriteLocker lock(&gLock);
+        gDbFile = abs;
+        gDir = dir;
+    }
+
+    // The marker only lives between a clean close and the next open.
+    qint64 stamp = -1;
+    QFile clean(dir + QStringLiteral("/CLEAN"));
+    if (clean.open(QIODevice::ReadOnly)) {
+        bool ok = false;
+        const qint64 v = clean.readAll().trimmed().toLongLong(&ok);
+        if (ok) stamp = v;
+        clean.close();
+        clean.remove();
+    }
+    return stamp;
+}
+
+void SegmentJournal::close(qint64 stamp) {
+    if (gDir.isEmpty() || !gReady.exchange(false)) return;
+    QFile clean(gDir + QStringLiteral("/CLEAN"));
+    if (!clean.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || clean.write(QByteArray::number(stamp) + '\n') < 0)
+        qWarning() << "[SegJournal] close:" << clean.errorString();
+}
+
+void SegmentJournal::setReady(bool ready) {
+    gReady.store(ready && !gDir.isEmpty(), std::memory_order_release);
+}
+
+void SegmentJournal::clear() {
+    if (gDir.isEmpty()) return;
+    QWriteLocker lock(&gLock);
+    QDir(gDir).removeRecursively();
+    QDir().mkpath(gDir);
+}
+
+void SegmentJournal::setCameraUrl(int cameraId, const QString& url) {
+    if (gDir.isEmpty() || cameraId <= 0 || url.isEmpty()) return;
+    const QString dir = QStringLiteral("%1/%2").arg(gDir).arg(cameraId);
+    QDir().mkpath(dir);
+    QFile f(dir + QStringLiteral("/camera.url"));
+    if (f.open(QIODevice::ReadOnly) && QString::fromUtf8(f.readAll()) == url) return;
+    f.close();
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(url.toUtf8()) < 0)
+        qWarning() << "[SegJournal] camera.url" << cameraId << ":" << f.errorString();
+}
+
+void SegmentJournal::append(int cameraId, const QVector<IndexedSegment>& rows) {
+    if (gDir.isEmpty() || cameraId <= 0 || rows.isEmpty()) return;
+    QMap<qint64, QVector<IndexedSegment>> days;
+    for (const IndexedSegment& s : rows) days[s.startNs / kDayNs].push_back(s);
+    QDir().mkpath(QStringLiteral("%1/%2").arg(gDir).arg(cameraId));
+    for (auto it = days.cbegin(); it != days.cend(); ++it)
+        appendRows(dayBase(gDir, cameraId, it.key()), it.value(), false);
+}
+
+void SegmentJournal::remove(int cameraId, const QVector<QPair<qint64, qint64>>& rows) {
+    if (gDir.isEmpty() || cameraId <= 0 || rows.isEmpty()) return;
+    QMap<qint64, QVector<IndexedSegment>> days;
+    for (const auto& r : rows) {
+        IndexedSegment s;
+        s.startNs = r.first;
+        s.id = r.second;
+        days[s.startNs / kDayNs].push_back(s);
+    }
+    for (auto it = days.cbegin(); it != days.cend(); ++it) {
+        const QString base = dayBase(gDir, cameraId, it.key());
+        if (!QFile::exists(base + QStringLiteral(".rec"))) continue;
+        appendRows(base, it.value(), true);
+
+        // Purges empty whole days; thinning and compaction leave dead records.
+        int records = 0;
+        const QVector<IndexedSegment> live = loadDay(base, &records);
+        if (live.isEmpty()) removeDay(base);
+        else if (records > 2 * live.size() + 64) writeDay(cameraId, it.key(), live);
+    }
+}
+
+void SegmentJournal::writeDay(int cameraId, qint64 dayKey, const QVector<IndexedSegment>& rows) {
+    if (gDir.isEmpty() || cameraId <= 0) return;
+    const QString base = dayBase(gDir, cameraId, dayKey);
+    if (rows.isEmpty()) { removeDay(base); return; }
+
+    QDir().mkpath(QStringLiteral("%1/%2").arg(gDir).arg(cameraId));
+    const QString next = base + QStringLiteral(".new");
+    QFile::remove(next + QStringLiteral(".rec"));
+    QFile::remove(next + QStringLiteral(".paths"));
+    if (!appendRows(next, rows, false)) return;
+
+    // Both files change together for readers.
+    QWriteLocker lock(&gLock);
+    for (const char* ext : { ".rec", ".paths" }) {
+        QFile::remove(base + QLatin1String(ext));
+        if (!QFile::rename(next + QLatin1String(ext), base + QLatin1String(ext)))
+            qWarning() << "[SegJournal] replace" << base + QLatin1String(ext) << "failed";
+    }
+}
+
+QVector<SegmentJournal::CameraRows> SegmentJournal::readAll() {
+    QVector<CameraRows> out;
+    if (gDir.isEmpty()) return out;
+    const QDir root(gDir);
+    for (const QString& cam : root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)) {
+        const QDir dir(root.filePath(cam));
+        QFile url(dir.filePath(QStringLiteral("camera.url")));
+        if (!url.open(QIODevice::ReadOnly)) continue;
+        CameraRows c;
+        c.url = QString::fromUtf8(url.readAll());
+        for (const QString& f : dir.entryList({ QStringLiteral("????????.rec") }, QDir::Files, QDir::Name)) {
+            if (!QDate::fromString(f.left(8), QStringLiteral("yyyyMMdd")).isValid()) continue;
+            c.rows += loadDay(dir.filePath(f.left(8)));
+        }
+        if (!c.rows.isEmpty()) out.push_back(std::move(c));
+    }
+    return out;
+}
+
+bool SegmentJournal::query(const QString& dbFile, int cameraId, qint64 fromNs, qint64 toNs,
+                           QVector<IndexedSegment>& out) {
+    if (!gReady.load(std::memory_order_acquire) || toNs <= fromNs) return false;
+    QReadLocker lock(&gLock);
+    if (gDir.isEmpty() || QFileInfo(dbFile).absoluteFilePath() != gDbFile) return false;
+
+    out.clear();
+    // A row may start up to kMaxSpanNs before the range and still overlap it.
+    const qint64 lo = fromNs - ArchiveLimits::kMaxSpanNs;
+    for (qint64 key = lo / kDayNs; key <= (toNs - 1) / kDayNs; ++key) {
+        for (const IndexedSegment& s : loadDay(dayBase(gDir, cameraId, key)))
+            if (s.overlaps(fromNs, toNs)) out.push_back(s);
+    }
+    return true;
+}
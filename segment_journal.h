@@ -0,0 +1,56 @@
+#pragma once
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+#include "archive_segment_index.h"   // IndexedSegment
+
+/**
+ * SegmentJournal
+ * --------------
+ * Append-only binary copy of the main-stream segment rows, a pair of files
+ * per camera and UTC day under <db dir>/segment_journal/<camera id>/:
+ *   yyyyMMdd.rec    64-byte records: id, start, eff_end_ns, duration, size,
+ *                   path offset/length, codec, tier, flags (host byte order)
+ *   yyyyMMdd.paths  the file paths the records point into
+ * A row's latest record wins and removals append a tombstone; a day is
+ * rewritten without the dead records once they outnumber the live ones.
+ * - DbWriter appends after each commit, next to the ArchiveSegmentIndex
+ *   update, so the journal never shows rows SQLite does not have.
+ * - Readers map a day's records (QFile::map) instead of running SQL; it
+ *   answers the ranges older than the in-memory index.
+ * - SQLite stays authoritative. When the journal was not closed cleanly at
+ *   the same segments sequence, DbWriter rebuilds it from segments_all a day
+ *   at a time and query() returns false until that is done. An empty
+ *   database is filled back from the journal (readAll()).
+ *
+ * Env:
+ *   CAMVIGIL_SEGMENT_JOURNAL   1 = on (default), 0 = SQLite only
+ */
+class SegmentJournal final {
+public:
+    struct CameraRows {
+        QString url;                       // cameras.main_url
+        QVector<IndexedSegment> rows;      // live rows, start order
+    };
+
+    static bool enabled();
+
+    // Writer side (DbWriter's thread). open() returns the stamp close() left,
+    // or -1 after an unclean exit; the journal is not ready until setReady().
+    static qint64 open(const QString& dbFile);
+    static void close(qint64 stamp);
+    static void setReady(bool ready);
+    static void clear();
+    static void setCameraUrl(int cameraId, const QString& url);
+    static void append(int cameraId, const QVector<IndexedSegment>& rows);
+    static void remove(int cameraId, const QVector<QPair<qint64, qint64>>& rows);   // (startNs, id)
+    static void writeDay(int cameraId, qint64 dayKey, const QVector<IndexedSegment>& rows);   // startNs / day
+    static QVector<CameraRows> readAll();
+
+    // Same contract as ArchiveSegmentIndex::query: false = not ready or
+    // another database, ask SQLite.
+    static bool query(const QString& dbFile, int cameraId, qint64 fromNs, qint64 toNs,
+                      QVector<IndexedSegment>& out);
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+/**
+ * Segment range queries
+ * ---------------------
+ * The per-camera range lookups behind the playback timeline (DbReader) and
+ * the node API (NodeCoreService). Each is a single index range on
+ * (camera_id, start_utc_ns, eff_end_ns): a row overlaps [from, to) when it
+ * starts in [from - kMaxSpanNs, to) and its eff_end_ns is past from.
+ * tests/query_plan checks SQLite plans them on the *_camera_span indexes.
+ *
+ * Open rows (status=0) grow up to the live edge, capped by their stored
+ * eff_end_ns (2x the session's segment length) so a stale row from a crash
+ * can't swallow the range.
+ */
+namespace SegmentQueries {
+
+// DbReader::listSegments. Binds :cid, :start_ns, :end_ns, :lo_ns, :live_ns.
+inline constexpr char kTimelineMain[] = R"SQL(
+  SELECT s.file_path,
+         s.start_utc_ns,
+         CASE WHEN s.status = 0 THEN MAX(s.start_utc_ns, MIN(:live_ns, s.eff_end_ns))
+              ELSE s.eff_end_ns END AS eff_end_ns,
+         s.duration_ms,
+         s.status,
+         COALESCE(s.codec,'h264')
+  FROM segments_all s
+  WHERE s.camera_id = :cid
+    AND s.start_utc_ns >= :lo_ns AND s.start_utc_ns < :end_ns
+    AND s.eff_end_ns > :start_ns
+    AND s.status IN (0,1)
+  ORDER BY s.start_utc_ns
+)SQL";
+
+// DbReader::listSubSegments: finalized scrub-track files only.
+// Binds :cid, :start_ns, :end_ns, :lo_ns.
+inline constexpr char kTimelineSub[] = R"SQL(
+  SELECT file_path, start_utc_ns, end_utc_ns, duration_ms, COALESCE(codec,'h264')
+  FROM sub_segments
+  WHERE camera_id = :cid
+    AND start_utc_ns >= :lo_ns AND start_utc_ns < :end_ns
+    AND eff_end_ns > :start_ns
+    AND status = 1
+  ORDER BY start_utc_ns
+)SQL";
+
+// NodeCoreService::listSegments. Binds :cid, :from_ns, :to_ns, :lo_ns, :now_ns.
+inline constexpr char kApiMain[] = R"SQL(
+    SELECT id, camera_id, start_utc_ns,
+           CASE WHEN status = 0 THEN MAX(start_utc_ns, MIN(:now_ns, eff_end_ns))
+                ELSE eff_end_ns END AS eff_end,
+           duration_ms,
+           size_bytes,
+           file_path,
+           COALESCE(codec,'h264'),
+           COALESCE(tier,0)
+    FROM segments_all
+    WHERE camera_id = :cid
+      AND start_utc_ns >= :lo_ns AND start_utc_ns < :to_ns
+      AND eff_end_ns > :from_ns
+      AND status IN (0,1)
+    ORDER BY start_utc_ns
+)SQL";
+
+// Scrub track: no partitions and no thinning tier. Same binds as kApiMain.
+inline constexpr char kApiSub[] = R"SQL(
+    SELECT id, camera_id, start_utc_ns,
+           CASE WHEN status = 0 THEN MAX(start_utc_ns, MIN(:now_ns, eff_end_ns))
+                ELSE eff_end_ns END AS eff_end,
+           duration_ms,
+           size_bytes,
+           file_path,
+           COALESCE(codec,'h264'),
+           0
+    FROM sub_segments
+    WHERE camera_id = :cid
+      AND start_utc_ns >= :lo_ns AND start_utc_ns < :to_ns
+      AND eff_end_ns > :from_ns
+      AND status IN (0,1)
+    ORDER BY start_utc_ns
+)SQL";
+
+} // namespace SegmentQueries
@@ -7,6 +7,7 @@
 #include <QTimer>
 #include <QDateTime>
 #include <QFileInfo>
+#include <QSet>
 
 StorageDetailsWidget::StorageDetailsWidget(ArchiveManager* archiveManager, QWidget *parent)
     : QWidget(parent), archiveManager(archiveManager)
@@ -67,10 +68,20 @@ void StorageDetailsWidget::updateStorageInfo() {
         return;
     }
 
-    storageDeviceStatusLabel->setText(root);
-    QStorageInfo storage(root);
-    const qint64 total = storage.bytesTotal();
-    const qint64 avail = storage.bytesAvailable();
+    // Sum every archive root; a distinct filesystem is only counted once.
+    const QStringList roots = archiveManager->archiveRoots();
+    storageDeviceStatusLabel->setText(roots.size() > 1
+        ? QString("%1 (+%2 more)").arg(root).arg(roots.size() - 1)
+        : root);
+    qint64 total = 0, avail = 0;
+    QSet<QByteArray> devices;
+    for (const QString& r : roots.isEmpty() ? QStringList{ root } : roots) {
+        QStorageInfo storage(r);
+        if (!storage.isValid() || devices.contains(storage.device())) continue;
+        devices.insert(storage.device());
+        total += storage.bytesTotal();
+        avail += storage.bytesAvailable();
+    }
     const qint64 used  = (total > 0) ? (total - avail) : 0;
 
     const qint64 totalGB = total / (1024LL * 1024LL * 1024LL);
@@ -0,0 +1,21 @@
+# Benchmark, not part of `make check`: ./bench_batch_sink [dir]
+QT -= gui
+
+CONFIG += c++17 console link_pkgconfig
+CONFIG -= app_bundle
+
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+PKGCONFIG += gstreamer-1.0 gstreamer-base-1.0
+# Same switch as the application: adds the io_uring run
+packagesExist(liburing) {
+    PKGCONFIG += liburing
+    DEFINES += CAMVIGIL_HAVE_URING
+}
+
+TARGET = bench_batch_sink
+INCLUDEPATH += ../..
+
+SOURCES += \
+    bench_batch_sink.cpp \
+    ../../archive_batch_sink.cpp
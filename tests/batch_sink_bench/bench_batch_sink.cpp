@@ -0,0 +1,222 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <gst/gst.h>
+
+#include "archive_batch_sink.h"
+
+/*
+ * ArchiveBatchSink benchmark
+ * --------------------------
+ * Feeds several cameras' worth of matroskamux-shaped output (a 12-byte block
+ * header, then the frame; a keyframe every 50 frames; a header rewrite at
+ * offset 0 before EOS) into a segment sink, one streaming thread per camera,
+ * and reports for each sink
+ *   - write syscalls: write/pwrite from /proc/self/io plus io_uring_enter,
+ *   - CPU time (user + system) per GiB written,
+ *   - p99 and worst time a camera thread spends in one gst_pad_push(),
+ *   - throughput, up to a final syncfs().
+ * Without --run it runs itself once per sink: filesink, camvigilbatchsink on
+ * pwrite (CAMVIGIL_SINK_URING=0) and, when built with liburing, on io_uring.
+ * Point [dir] at the archive disk.
+ *
+ *   bench_batch_sink [dir]
+ *
+ * Env:
+ *   CAMVIGIL_BENCH_CAMERAS  concurrent cameras (default 8)
+ *   CAMVIGIL_BENCH_FILES    segments per camera (default 4)
+ *   CAMVIGIL_BENCH_SEG_MB   size of every segment (default 64)
+ */
+
+static const qint64 kMiB = 1024 * 1024;
+
+static int envInt(const char* name, int def, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return ok ? qBound(lo, v, hi) : def;
+}
+
+// Frame payloads are slices of one read-only block; no allocation per push.
+static const QByteArray& noise() {
+    static const QByteArray b = [] {
+        QByteArray n(256 * 1024, Qt::Uninitialized);
+        quint32 x = 2463534242u;
+        for (char& ch : n) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; ch = char(x); }
+        return n;
+    }();
+    return b;
+}
+
+static bool push(GstPad* src, gsize size, std::vector<qint64>& us) {
+    GstBuffer* buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                                 const_cast<char*>(noise().constData()),
+                                                 gsize(noise().size()), 0, size, nullptr, nullptr);
+    QElapsedTimer t; t.start();
+    const GstFlowReturn r = gst_pad_push(src, buf);
+    us.push_back(t.nsecsElapsed() / 1000);
+    return r == GST_FLOW_OK;
+}
+
+static bool pushSegment(GstPad* src, guint64 start) {
+    GstSegment seg;
+    gst_segment_init(&seg, GST_FORMAT_BYTES);
+    seg.start = start;
+    return gst_pad_push_event(src, gst_event_new_segment(&seg));
+}
+
+// One segment file through a `factory` sink; appends every push time to `us`.
+static bool writeSegment(const char* factory, const QString& path, int mb, std::vector<qint64>& us) {
+    GstElement* sink = gst_element_factory_make(factory, nullptr);
+    if (!sink) return false;
+    g_object_set(sink, "location", path.toUtf8().constData(), "sync", FALSE, nullptr);
+    GstPad* src = gst_pad_new("src", GST_PAD_SRC);
+    GstPad* sinkPad = gst_element_get_static_pad(sink, "sink");
+    GstCaps* caps = gst_caps_new_empty_simple("video/x-matroska");
+
+    bool ok = gst_pad_link(src, sinkPad) == GST_PAD_LINK_OK
+           && gst_pad_set_active(src, TRUE)
+           && gst_element_set_state(sink, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE
+           && gst_pad_push_event(src, gst_event_new_stream_start("bench"))
+           && gst_pad_push_event(src, gst_event_new_caps(caps))
+           && pushSegment(src, 0);
+
+    const qint64 total = mb * kMiB;
+    qint64 pos = 0;
+    for (int frame = 0; ok && pos < total; ++frame) {
+        const gsize size = frame % 50 == 0 ? 150 * 1024 : 15 * 1024;
+        ok = push(src, 12, us) && push(src, size, us);
+        pos += 12 + qint64(size);
+    }
+    // matroskamux seeks back and rewrites its header on EOS.
+    ok = ok && pushSegment(src, 0) && push(src, 64, us)
+            && gst_pad_push_event(src, gst_event_new_eos());
+
+    gst_element_set_state(sink, GST_STATE_NULL);
+    gst_caps_unref(caps);
+    gst_object_unref(sinkPad);
+    gst_object_unref(src);
+    gst_object_unref(sink);
+    return ok;
+}
+
+// write(2)-family calls made by this process so far.
+static qint64 writeSyscalls() {
+    QFile f(QStringLiteral("/proc/self/io"));
+    if (!f.open(QIODevice::ReadOnly)) return 0;
+    for (const QByteArray& line : f.readAll().split('\n'))
+        if (line.startsWith("syscw:")) return line.mid(6).trimmed().toLongLong();
+    return 0;
+}
+
+static qint64 cpuMs() {
+    rusage r {};
+    ::getrusage(RUSAGE_SELF, &r);
+    return (qint64(r.ru_utime.tv_sec) + r.ru_stime.tv_sec) * 1000
+         + (qint64(r.ru_utime.tv_usec) + r.ru_stime.tv_usec) / 1000;
+}
+
+// One measurement. Prints
+// "RESULT <syscalls> <cpu ms per GiB> <push p99 µs> <push max µs> <MiB/s>".
+static int runOnce(const QString& mode, const QString& dir) {
+    gst_init(nullptr, nullptr);
+    const bool batched = mode != QLatin1String("filesink");
+    if (batched && !ArchiveBatchSink::registerElement()) return 1;
+    const char* factory = batched ? ArchiveBatchSink::factoryName() : "filesink";
+    const int cameras = envInt("CAMVIGIL_BENCH_CAMERAS", 8, 1, 256);
+    const int files   = envInt("CAMVIGIL_BENCH_FILES", 4, 1, 1000);
+    const int segMb   = envInt("CAMVIGIL_BENCH_SEG_MB", 64, 1, 4096);
+    if (!QDir().mkpath(dir)) return 1;
+
+    std::vector<std::vector<qint64>> pushUs(size_t(cameras));
+    std::atomic<bool> failed{false};
+    const qint64 syscalls0 = writeSyscalls();
+    const qint64 cpu0 = cpuMs();
+    QElapsedTimer wall; wall.start();
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < cameras; ++c) {
+        threads.emplace_back([&, c] {
+            for (int f = 0; f < files && !failed.load(); ++f) {
+                const QString path = QStringLiteral("%1/cam%2_%3.mkv").arg(dir).arg(c).arg(f);
+                if (!writeSegment(factory, path, segMb, pushUs[size_t(c)])) failed = true;
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    const int dfd = ::open(QFile::encodeName(dir).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0) { ::syncfs(dfd); ::close(dfd); }
+    const qint64 ms = qMax<qint64>(1, wall.elapsed());
+    const qint64 cpu = cpuMs() - cpu0;
+    const qint64 syscalls = writeSyscalls() - syscalls0 + ArchiveBatchSink::stats().ringEnters;
+    QDir(dir).removeRecursively();
+    if (failed) {
+        qCritical() << "[Bench]" << mode << "failed to write a segment";
+        return 1;
+    }
+
+    std::vector<qint64> us;
+    for (const auto& v : pushUs) us.insert(us.end(), v.begin(), v.end());
+    std::sort(us.begin(), us.end());
+    const double mib = double(cameras) * files * segMb;
+    QTextStream(stdout) << "RESULT " << syscalls << ' ' << qint64(cpu * 1024 / mib) << ' '
+                        << (us.empty() ? 0 : us[size_t(0.99 * double(us.size() - 1))]) << ' '
+                        << (us.empty() ? 0 : us.back()) << ' ' << qint64(mib * 1000 / ms) << '\n';
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments().mid(1);
+    if (args.size() == 3 && args[0] == QLatin1String("--run"))
+        return runOnce(args[1], args[2]);
+
+    QTemporaryDir tmp(QDir(args.value(0, QDir::tempPath())).filePath(QStringLiteral("camvigil-bench-XXXXXX")));
+    if (!tmp.isValid()) {
+        qCritical() << "[Bench] cannot create a work dir under" << args.value(0, QDir::tempPath());
+        return 1;
+    }
+
+    QStringList modes{ QStringLiteral("filesink"), QStringLiteral("pwrite") };
+#if defined(CAMVIGIL_HAVE_URING)
+    modes << QStringLiteral("io_uring");
+#endif
+    QTextStream out(stdout);
+    out << "sink      write_syscalls  cpu_ms_per_GiB  push_p99_us  push_max_us  MiB_s\n";
+    for (const QString& mode : qAsConst(modes)) {
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert(QStringLiteral("CAMVIGIL_SINK_URING"),
+                   mode == QLatin1String("io_uring") ? QStringLiteral("1") : QStringLiteral("0"));
+        QProcess p;
+        p.setProcessEnvironment(env);
+        p.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        p.start(QCoreApplication::applicationFilePath(),
+                { QStringLiteral("--run"), mode, tmp.path() + QLatin1Char('/') + mode });
+        if (!p.waitForFinished(-1) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) {
+            qCritical() << "[Bench] run failed:" << mode;
+            return 1;
+        }
+        QStringList cols;
+        for (const QString& line : QString::fromLatin1(p.readAllStandardOutput()).split(QLatin1Char('\n')))
+            if (line.startsWith(QLatin1String("RESULT "))) cols = line.mid(7).split(QLatin1Char(' '));
+        if (cols.size() != 5) return 1;
+        out << qSetFieldWidth(8) << mode << qSetFieldWidth(16) << cols[0] << cols[1]
+            << qSetFieldWidth(13) << cols[2] << cols[3] << qSetFieldWidth(7) << cols[4]
+            << qSetFieldWidth(0) << '\n';
+        out.flush();
+    }
+    return 0;
+}
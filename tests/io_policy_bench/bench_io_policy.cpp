@@ -0,0 +1,204 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "io_policy.h"
+
+/*
+ * IoPolicy benchmark
+ * ------------------
+ * Replays a cold archive segment by segment while a recorder writes new
+ * segments to the same disk, and reports
+ *   - playback start latency: open + first MiB + last MiB (the Cues) of each
+ *     segment, which is what the stitching player reads on a segment switch;
+ *   - recorder write throughput over the same interval.
+ * Without --run it writes the archive once, runs itself with
+ * CAMVIGIL_IO_POLICY=0 and =1 and prints one row for each. Point [dir] at the
+ * archive disk: tmpfs has no page cache to manage.
+ *
+ *   bench_io_policy [dir]
+ *
+ * Env:
+ *   CAMVIGIL_BENCH_SEGMENTS  archive segments replayed (default 20)
+ *   CAMVIGIL_BENCH_SEG_MB    size of every segment (default 32)
+ *   CAMVIGIL_BENCH_PLAY_MS   playback time per segment (default 1000)
+ *   CAMVIGIL_BENCH_LIVE_MB   recorder output kept on disk, as a ring (default 4096)
+ */
+
+static const qint64 kMiB = 1024 * 1024;
+
+static int envInt(const char* name, int def, int lo, int hi) {
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return ok ? qBound(lo, v, hi) : def;
+}
+
+// 1 MiB of xorshift noise, so no filesystem can compress or dedup it.
+static const QByteArray& chunk() {
+    static const QByteArray c = [] {
+        QByteArray b(int(kMiB), Qt::Uninitialized);
+        quint32 x = 2463534242u;
+        for (char& ch : b) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; ch = char(x); }
+        return b;
+    }();
+    return c;
+}
+
+static bool writeArchive(const QString& path, int mb) {
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    for (int i = 0; i < mb; ++i)
+        if (f.write(chunk()) != kMiB) return false;
+    f.close();
+    return IoPolicy::syncFile(path);
+}
+
+// The archive is flushed, so DONTNEED leaves every run starting cold.
+static void evict(const QString& path) {
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+// Open, head and Cues of `path`, in µs; -1 if it can't be opened.
+static qint64 startUs(const QString& path) {
+    QElapsedTimer t; t.start();
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) return -1;
+    f.read(kMiB);
+    f.seek(qMax<qint64>(0, f.size() - kMiB));
+    f.read(kMiB);
+    return t.nsecsElapsed() / 1000;
+}
+
+// Reads the rest of `path` spread over `playMs`, like a decoder would.
+static void play(const QString& path, int playMs) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) return;
+    const qint64 chunks = qMax<qint64>(1, f.size() / kMiB);
+    QElapsedTimer t; t.start();
+    for (qint64 i = 0; i < chunks; ++i) {
+        f.read(kMiB);
+        const qint64 wait = playMs * (i + 1) / chunks - t.elapsed();
+        if (wait > 0) QThread::msleep(quint64(wait));
+    }
+}
+
+static double percentileMs(std::vector<qint64> us, double p) {
+    if (us.empty()) return 0;
+    std::sort(us.begin(), us.end());
+    return us[size_t(p * double(us.size() - 1))] / 1000.0;
+}
+
+// One measurement with the CAMVIGIL_IO_POLICY this process was started with.
+// Prints "RESULT <start p50 ms> <start p95 ms> <write MiB/s>".
+static int runOnce(const QString& root) {
+    const int segMb     = envInt("CAMVIGIL_BENCH_SEG_MB", 32, 2, 4096);
+    const int playMs    = envInt("CAMVIGIL_BENCH_PLAY_MS", 1000, 0, 60000);
+    const int liveFiles = qMax(1, envInt("CAMVIGIL_BENCH_LIVE_MB", 4096, 1, 1 << 20) / segMb);
+
+    const QDir archive(root + QStringLiteral("/archive"));
+    QStringList files;
+    for (const QString& name : archive.entryList(QDir::Files, QDir::Name)) {
+        files << archive.filePath(name);
+        evict(files.last());
+    }
+    const QString liveDir = root + QStringLiteral("/live_%1").arg(int(IoPolicy::enabled()));
+    QDir(liveDir).removeRecursively();
+    if (files.isEmpty() || !QDir().mkpath(liveDir)) return 1;
+
+    std::atomic<bool> stop{false};
+    std::atomic<qint64> written{0};
+    QThread* recorder = QThread::create([&] {
+        for (int n = 0; !stop.load(); ++n) {
+            const QString path = QStringLiteral("%1/live_%2.mkv").arg(liveDir).arg(n % liveFiles);
+            QFile f(path);
+            if (!f.open(QIODevice::WriteOnly)) return;
+            for (int c = 0; c < segMb && !stop.load(); ++c) {
+                if (f.write(chunk()) != kMiB) return;
+                written += kMiB;
+            }
+            f.close();
+            IoPolicy::dropWritten(path);
+        }
+    });
+
+    std::vector<qint64> starts;
+    QElapsedTimer wall; wall.start();
+    recorder->start();
+    for (int i = 0; i < files.size(); ++i) {
+        const qint64 us = startUs(files[i]);
+        if (us >= 0) starts.push_back(us);
+        if (i + 1 < files.size()) IoPolicy::readAhead(files[i + 1]);
+        play(files[i], playMs);
+    }
+    stop = true;
+    recorder->wait();
+    const qint64 ms = qMax<qint64>(1, wall.elapsed());
+    delete recorder;
+    QDir(liveDir).removeRecursively();
+
+    QTextStream(stdout) << "RESULT " << percentileMs(starts, 0.5) << ' ' << percentileMs(starts, 0.95)
+                        << ' ' << (written.load() / double(kMiB)) * 1000.0 / ms << '\n';
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments().mid(1);
+    if (args.size() == 2 && args[0] == QLatin1String("--run"))
+        return runOnce(args[1]);
+
+    const int segments = envInt("CAMVIGIL_BENCH_SEGMENTS", 20, 2, 10000);
+    const int segMb    = envInt("CAMVIGIL_BENCH_SEG_MB", 32, 2, 4096);
+    QTemporaryDir tmp(QDir(args.value(0, QDir::tempPath())).filePath(QStringLiteral("camvigil-bench-XXXXXX")));
+    if (!tmp.isValid() || !QDir().mkpath(tmp.path() + QStringLiteral("/archive"))) {
+        qCritical() << "[Bench] cannot create a work dir under" << args.value(0, QDir::tempPath());
+        return 1;
+    }
+    qInfo() << "[Bench] writing" << segments << "archive segments of" << segMb << "MiB to" << tmp.path();
+    for (int i = 0; i < segments; ++i) {
+        const QString path = QStringLiteral("%1/archive/seg_%2.mkv").arg(tmp.path()).arg(i, 5, 10, QLatin1Char('0'));
+        if (!writeArchive(path, segMb)) {
+            qCritical() << "[Bench] write failed:" << path;
+            return 1;
+        }
+    }
+
+    QTextStream out(stdout);
+    out << "io_policy  start_p50_ms  start_p95_ms  write_MiB_s\n";
+    for (const char* policy : { "0", "1" }) {
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert(QStringLiteral("CAMVIGIL_IO_POLICY"), QLatin1String(policy));
+        QProcess p;
+        p.setProcessEnvironment(env);
+        p.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        p.start(QCoreApplication::applicationFilePath(), { QStringLiteral("--run"), tmp.path() });
+        if (!p.waitForFinished(-1) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) {
+            qCritical() << "[Bench] run failed with CAMVIGIL_IO_POLICY=" << policy;
+            return 1;
+        }
+        QStringList cols;
+        for (const QString& line : QString::fromLatin1(p.readAllStandardOutput()).split(QLatin1Char('\n')))
+            if (line.startsWith(QLatin1String("RESULT "))) cols = line.mid(7).split(QLatin1Char(' '));
+        if (cols.size() != 3) return 1;
+        out << qSetFieldWidth(9) << policy << qSetFieldWidth(14) << cols[0] << cols[1]
+            << qSetFieldWidth(13) << cols[2] << qSetFieldWidth(0) << '\n';
+        out.flush();
+    }
+    return 0;
+}
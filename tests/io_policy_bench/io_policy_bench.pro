@@ -0,0 +1,14 @@
+# Benchmark, not part of `make check`: ./bench_io_policy [dir]
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+TARGET = bench_io_policy
+INCLUDEPATH += ../..
+
+SOURCES += \
+    bench_io_policy.cpp \
+    ../../io_policy.cpp
@@ -0,0 +1,22 @@
+QT += testlib sql
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+TARGET = tst_purge_partitions
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_purge_partitions.cpp \
+    ../../archive_segment_index.cpp \
+    ../../db_read_pool.cpp \
+    ../../db_writer.cpp \
+    ../../purge_planner.cpp \
+    ../../recording_coverage.cpp \
+    ../../segment_journal.cpp
+
+HEADERS += \
+    ../../db_writer.h
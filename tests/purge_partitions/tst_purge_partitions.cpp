@@ -0,0 +1,156 @@
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+#include "archive_roots.h"
+#include "db_writer.h"
+
+// DbWriter only uses ArchiveRoots to find journaled files again; the real one
+// would pull ArchiveManager (and GStreamer) into the test.
+QString ArchiveRoots::resolve(const QString& path) { return path; }
+
+static const QString kUrl = QStringLiteral("rtsp://cam1/main");
+
+// Noon local time on a day of 2024, well past the hot months.
+static qint64 at(int month, int day) {
+    return QDateTime(QDate(2024, month, day), QTime(12, 0), Qt::LocalTime).toMSecsSinceEpoch() * 1000000LL;
+}
+
+class TestPurgePartitions : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void oldMonthIsDroppedWhole();
+    void otherRootKeepsItsMonth();
+    void pinnedRowKeepsItsMonth();
+
+private:
+    QString addSegment_(const QString& root, qint64 startNs);
+    void rollPartitions_();
+    QStringList tables_();
+    int rows_(const QString& table);
+
+    QTemporaryDir* dir_ = nullptr;
+    DbWriter* db_ = nullptr;
+    QString rootA_, rootB_;
+};
+
+void TestPurgePartitions::initTestCase() {
+    qputenv("CAMVIGIL_SEGMENT_JOURNAL", "0");
+}
+
+void TestPurgePartitions::init() {
+    dir_ = new QTemporaryDir;
+    QVERIFY(dir_->isValid());
+    rootA_ = dir_->filePath(QStringLiteral("a"));
+    rootB_ = dir_->filePath(QStringLiteral("b"));
+    QVERIFY(QDir().mkpath(rootA_) && QDir().mkpath(rootB_));
+    db_ = new DbWriter;
+    QVERIFY(db_->openAt(dir_->filePath(QStringLiteral("camvigil.sqlite"))));
+    db_->ensureCamera(kUrl, QString(), QStringLiteral("cam1"));
+    db_->beginSession(QStringLiteral("s1"), rootA_, 60);
+}
+
+void TestPurgePartitions::cleanup() {
+    delete db_;
+    db_ = nullptr;
+    QSqlDatabase::removeDatabase(QStringLiteral("camvigil_db"));
+    delete dir_;
+    dir_ = nullptr;
+}
+
+// A finalized one-minute, 1000-byte segment under `root`.
+QString TestPurgePartitions::addSegment_(const QString& root, qint64 startNs) {
+    const QString path = QStringLiteral("%1/%2.mkv").arg(root).arg(startNs);
+    QFile f(path);
+    if (f.open(QIODevice::WriteOnly)) f.write(QByteArray(1000, 'x'));
+    f.close();
+    db_->addSegmentOpened(QStringLiteral("s1"), kUrl, path, startNs, QStringLiteral("h264"));
+    db_->finalizeSegmentByPath(path, startNs + 60000000000LL, 60000);
+    return path;
+}
+
+// DbWriter moves old rows from the first event-loop turn after openAt(), a
+// day per turn; reopening starts that over the rows added since.
+void TestPurgePartitions::rollPartitions_() {
+    delete db_;
+    QSqlDatabase::removeDatabase(QStringLiteral("camvigil_db"));
+    db_ = new DbWriter;
+    QVERIFY(db_->openAt(dir_->filePath(QStringLiteral("camvigil.sqlite"))));
+    QTRY_VERIFY(tables_().contains(QStringLiteral("segments_p202401")));
+    QTRY_VERIFY(tables_().contains(QStringLiteral("segments_p202402")));
+    QTRY_COMPARE(rows_(QStringLiteral("segments")), 0);
+}
+
+QStringList TestPurgePartitions::tables_() {
+    QStringList out;
+    QSqlQuery q(QSqlDatabase::database(QStringLiteral("camvigil_db")));
+    if (q.exec(QStringLiteral("SELECT name FROM sqlite_master WHERE type='table';")))
+        while (q.next()) out << q.value(0).toString();
+    return out;
+}
+
+int TestPurgePartitions::rows_(const QString& table) {
+    QSqlQuery q(QSqlDatabase::database(QStringLiteral("camvigil_db")));
+    return q.exec(QStringLiteral("SELECT COUNT(*) FROM %1;").arg(table)) && q.next() ? q.value(0).toInt() : -1;
+}
+
+void TestPurgePartitions::oldMonthIsDroppedWhole() {
+    for (int day : { 10, 11, 12 }) addSegment_(rootA_, at(1, day));
+    for (int day : { 10, 11, 12 }) addSegment_(rootA_, at(2, day));
+    rollPartitions_();
+
+    // January plus the first February row: the horizon is that row's start.
+    const PurgePlan plan = db_->planPurge({ { rootA_, 4000 } }, 0, false);
+    QCOMPARE(plan.victims.size(), 4);
+    QCOMPARE(plan.horizons.size(), 1);
+    QCOMPARE(plan.horizons[0].prefix, rootA_ + QLatin1Char('/'));
+    QCOMPARE(plan.horizons[0].beforeNs, at(2, 10));
+
+    const QVector<qint64> gone = db_->purgeBefore(plan.horizons, plan.victims);
+    QCOMPARE(gone.size(), 3);
+    QVERIFY(!tables_().contains(QStringLiteral("segments_p202401")));
+    QVERIFY(tables_().contains(QStringLiteral("segments_p202402")));
+    QCOMPARE(rows_(QStringLiteral("segments_all")), 3);
+
+    QSqlQuery reg(QSqlDatabase::database(QStringLiteral("camvigil_db")));
+    QVERIFY(reg.exec(QStringLiteral("SELECT COUNT(*) FROM segment_partitions WHERE name='segments_p202401';")));
+    QVERIFY(reg.next());
+    QCOMPARE(reg.value(0).toInt(), 0);
+}
+
+void TestPurgePartitions::otherRootKeepsItsMonth() {
+    for (int day : { 10, 11 }) addSegment_(rootA_, at(1, day));
+    addSegment_(rootB_, at(1, 12));
+    for (int day : { 10, 11 }) addSegment_(rootA_, at(2, day));
+    rollPartitions_();
+
+    // Only root a is short; its January rows go, root b's stays.
+    const PurgePlan plan = db_->planPurge({ { rootA_, 3000 } }, 0, false);
+    QCOMPARE(plan.horizons.size(), 1);
+    const QVector<qint64> gone = db_->purgeBefore(plan.horizons, plan.victims);
+    QCOMPARE(gone.size(), 2);
+    QVERIFY(tables_().contains(QStringLiteral("segments_p202401")));
+    QCOMPARE(rows_(QStringLiteral("segments_p202401")), 1);
+    QCOMPARE(rows_(QStringLiteral("segments_p202402")), 2);
+}
+
+void TestPurgePartitions::pinnedRowKeepsItsMonth() {
+    for (int day : { 10, 11 }) addSegment_(rootA_, at(1, day));
+    const QString pinned = addSegment_(rootA_, at(1, 12));
+    for (int day : { 10, 11 }) addSegment_(rootA_, at(2, day));
+    rollPartitions_();
+    QVERIFY(db_->markPinned(pinned, true));
+
+    const PurgePlan plan = db_->planPurge({ { rootA_, 3000 } }, 0, false);
+    const QVector<qint64> gone = db_->purgeBefore(plan.horizons, plan.victims);
+    QCOMPARE(gone.size(), 2);
+    QVERIFY(tables_().contains(QStringLiteral("segments_p202401")));
+    QCOMPARE(rows_(QStringLiteral("segments_p202401")), 1);
+}
+
+QTEST_GUILESS_MAIN(TestPurgePartitions)
+#include "tst_purge_partitions.moc"
@@ -0,0 +1,13 @@
+QT += testlib sql
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+TARGET = tst_query_plan
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_query_plan.cpp
@@ -0,0 +1,111 @@
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#include "segment_queries.h"
+
+// The segments / sub_segments tables and every index DbWriter leaves on them
+// after migrateSchema_(), plus one month partition and the segments_all view.
+static const char* const kSchema[] = {
+    "CREATE TABLE segments ("
+    " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    " session_id TEXT, camera_id INTEGER, camera_url TEXT,"
+    " file_path TEXT UNIQUE, start_utc_ns INTEGER, end_utc_ns INTEGER,"
+    " duration_ms INTEGER, size_bytes INTEGER, status INTEGER DEFAULT 0,"
+    " pinned INTEGER DEFAULT 0, codec TEXT DEFAULT 'h264', tier INTEGER DEFAULT 0,"
+    " eff_end_ns INTEGER, thin_skipped INTEGER DEFAULT 0 );",
+    "CREATE INDEX idx_segments_path ON segments(file_path);",
+    "CREATE INDEX idx_segments_camera_url_time ON segments(camera_url, start_utc_ns);",
+    "CREATE INDEX idx_segments_start_desc ON segments(start_utc_ns DESC);",
+    "CREATE INDEX idx_segments_status_time ON segments(status, start_utc_ns);",
+    "CREATE INDEX idx_segments_pinned ON segments(pinned);",
+    "CREATE INDEX idx_segments_full_tier ON segments(start_utc_ns) WHERE tier=0;",
+    "CREATE INDEX idx_segments_camera_span ON segments(camera_id, start_utc_ns, eff_end_ns);",
+
+    "CREATE TABLE sub_segments ("
+    " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    " camera_id INTEGER, camera_url TEXT,"
+    " file_path TEXT UNIQUE, start_utc_ns INTEGER, end_utc_ns INTEGER,"
+    " duration_ms INTEGER, size_bytes INTEGER, status INTEGER DEFAULT 0,"
+    " codec TEXT DEFAULT 'h264', eff_end_ns INTEGER );",
+    "CREATE INDEX idx_sub_segments_url_time ON sub_segments(camera_url, start_utc_ns);",
+    "CREATE INDEX idx_sub_segments_camera_span ON sub_segments(camera_id, start_utc_ns, eff_end_ns);",
+
+    "CREATE TABLE segments_p202401 AS SELECT * FROM segments WHERE 0;",
+    "CREATE UNIQUE INDEX segments_p202401_id ON segments_p202401(id);",
+    "CREATE INDEX segments_p202401_camera_span ON segments_p202401(camera_id, start_utc_ns, eff_end_ns);",
+    "CREATE INDEX segments_p202401_camera_url_time ON segments_p202401(camera_url, start_utc_ns);",
+    "CREATE INDEX segments_p202401_path ON segments_p202401(file_path);",
+    "CREATE INDEX segments_p202401_time ON segments_p202401(start_utc_ns);",
+    "CREATE VIEW segments_all AS SELECT * FROM segments UNION ALL SELECT * FROM segments_p202401;",
+};
+
+class TestQueryPlan : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void rangeQueriesUseCameraSpan_data();
+    void rangeQueriesUseCameraSpan();
+
+private:
+    QStringList plan_(const QString& sql);
+};
+
+void TestQueryPlan::initTestCase() {
+    QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"));
+    db.setDatabaseName(QStringLiteral(":memory:"));
+    QVERIFY2(db.open(), qPrintable(db.lastError().text()));
+    QSqlQuery q(db);
+    for (const char* sql : kSchema)
+        QVERIFY2(q.exec(QString::fromLatin1(sql)), qPrintable(q.lastError().text()));
+}
+
+void TestQueryPlan::cleanupTestCase() {
+    const QString name = QSqlDatabase::database().connectionName();
+    QSqlDatabase::database().close();
+    QSqlDatabase::removeDatabase(name);
+}
+
+// The detail column of EXPLAIN QUERY PLAN, one entry per step.
+QStringList TestQueryPlan::plan_(const QString& sql) {
+    QStringList steps;
+    QSqlQuery q;
+    if (!q.exec(QStringLiteral("EXPLAIN QUERY PLAN ") + sql)) {
+        qWarning() << q.lastError().text();
+        return steps;
+    }
+    while (q.next()) steps << q.value(3).toString();
+    return steps;
+}
+
+void TestQueryPlan::rangeQueriesUseCameraSpan_data() {
+    QTest::addColumn<QString>("sql");
+    QTest::addColumn<QStringList>("indexes");   // one per table the query reads
+    const QStringList mainIdx{ "idx_segments_camera_span", "segments_p202401_camera_span" };
+    const QStringList subIdx{ "idx_sub_segments_camera_span" };
+    QTest::newRow("timeline main") << QString(SegmentQueries::kTimelineMain) << mainIdx;
+    QTest::newRow("timeline sub")  << QString(SegmentQueries::kTimelineSub)  << subIdx;
+    QTest::newRow("api main")      << QString(SegmentQueries::kApiMain)      << mainIdx;
+    QTest::newRow("api sub")       << QString(SegmentQueries::kApiSub)       << subIdx;
+}
+
+void TestQueryPlan::rangeQueriesUseCameraSpan() {
+    QFETCH(QString, sql);
+    QFETCH(QStringList, indexes);
+    const QStringList steps = plan_(sql);
+    QVERIFY(!steps.isEmpty());
+    const QString all = steps.join(QLatin1String(" | "));
+
+    for (const QString& idx : qAsConst(indexes))
+        QVERIFY2(all.contains(QStringLiteral("USING INDEX %1 (camera_id=? AND start_utc_ns>? AND start_utc_ns<?)").arg(idx)),
+                 qPrintable(all));
+    for (const QString& step : steps) {
+        QVERIFY2(!step.startsWith(QLatin1String("SCAN ")), qPrintable(all));
+        QVERIFY2(!step.contains(QLatin1String("TEMP B-TREE")), qPrintable(all));
+    }
+}
+
+QTEST_GUILESS_MAIN(TestQueryPlan)
+#include "tst_query_plan.moc"
@@ -0,0 +1,14 @@
+QT += testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+TARGET = tst_recording_schedule
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_recording_schedule.cpp \
+    ../../recording_schedule.cpp
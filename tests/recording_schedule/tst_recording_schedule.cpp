@@ -0,0 +1,106 @@
+#include <QtTest>
+
+#include "recording_schedule.h"
+
+// 2024-05-06 is a Monday.
+static QDateTime at(int day, int h, int m, int s = 0) {
+    return QDateTime(QDate(2024, 5, 6).addDays(day), QTime(h, m, s), Qt::LocalTime);
+}
+
+class TestRecordingSchedule : public QObject {
+    Q_OBJECT
+private slots:
+    void emptyAndAlwaysRecordAroundTheClock();
+    void badSpecFallsBackToAlwaysOn_data();
+    void badSpecFallsBackToAlwaysOn();
+    void overnightWindowRunsIntoNextDay();
+    void dayRangesWrapAroundTheWeek();
+    void endOfDayIsInclusive();
+    void windowsCoveringTheWeekAreAlwaysOn();
+    void nextChangeFindsTheBoundary();
+    void nextChangeIsInvalidWhenAlwaysOn();
+};
+
+void TestRecordingSchedule::emptyAndAlwaysRecordAroundTheClock() {
+    for (const QString& spec : { QString(), QStringLiteral("  "), QStringLiteral("Always") }) {
+        bool ok = false;
+        const RecordingSchedule s = RecordingSchedule::parse(spec, &ok);
+        QVERIFY(ok);
+        QVERIFY(s.alwaysOn());
+        QVERIFY(s.activeAt(at(2, 3, 17)));
+    }
+}
+
+void TestRecordingSchedule::badSpecFallsBackToAlwaysOn_data() {
+    QTest::addColumn<QString>("spec");
+    QTest::newRow("unknown day")    << "mon-fry 08:00-17:00";
+    QTest::newRow("no range")       << "mon 08:00";
+    QTest::newRow("bad minute")     << "mon 08:60-17:00";
+    QTest::newRow("start at 24")    << "mon 24:00-08:00";
+    QTest::newRow("past 24")        << "mon 08:00-24:30";
+    QTest::newRow("one bad of two") << "mon 08:00-17:00; tue 8-17";
+}
+
+void TestRecordingSchedule::badSpecFallsBackToAlwaysOn() {
+    QFETCH(QString, spec);
+    bool ok = true;
+    const RecordingSchedule s = RecordingSchedule::parse(spec, &ok);
+    QVERIFY(!ok);
+    QVERIFY(s.alwaysOn());
+}
+
+void TestRecordingSchedule::overnightWindowRunsIntoNextDay() {
+    bool ok = false;
+    const RecordingSchedule s = RecordingSchedule::parse("mon-fri 18:00-08:00", &ok);
+    QVERIFY(ok);
+    QVERIFY(!s.alwaysOn());
+    QVERIFY(!s.activeAt(at(0, 12, 0)));    // Monday noon
+    QVERIFY(!s.activeAt(at(0, 17, 59)));
+    QVERIFY(s.activeAt(at(0, 18, 0)));
+    QVERIFY(s.activeAt(at(1, 7, 59)));     // Tuesday morning, from Monday night
+    QVERIFY(!s.activeAt(at(1, 8, 0)));
+    QVERIFY(s.activeAt(at(5, 7, 0)));      // Saturday morning, from Friday night
+    QVERIFY(!s.activeAt(at(5, 9, 0)));
+    QVERIFY(!s.activeAt(at(0, 7, 0)));     // Monday morning: Sunday night is off
+}
+
+void TestRecordingSchedule::dayRangesWrapAroundTheWeek() {
+    const RecordingSchedule s = RecordingSchedule::parse("fri-mon 10:00-11:00; wed 12:00-13:00");
+    QVERIFY(s.activeAt(at(4, 10, 30)));    // Friday
+    QVERIFY(s.activeAt(at(6, 10, 30)));    // Sunday
+    QVERIFY(s.activeAt(at(0, 10, 30)));    // Monday
+    QVERIFY(!s.activeAt(at(1, 10, 30)));   // Tuesday
+    QVERIFY(s.activeAt(at(2, 12, 15)));    // Wednesday, second window
+    QVERIFY(!s.activeAt(at(2, 10, 30)));
+}
+
+void TestRecordingSchedule::endOfDayIsInclusive() {
+    const RecordingSchedule s = RecordingSchedule::parse("SAT 00:00-24:00");
+    QVERIFY(!s.activeAt(at(4, 23, 59)));   // Friday
+    QVERIFY(s.activeAt(at(5, 0, 0)));
+    QVERIFY(s.activeAt(at(5, 23, 59)));
+    QVERIFY(!s.activeAt(at(6, 0, 0)));     // Sunday
+}
+
+void TestRecordingSchedule::windowsCoveringTheWeekAreAlwaysOn() {
+    QVERIFY(RecordingSchedule::parse("daily 00:00-24:00").alwaysOn());
+    QVERIFY(RecordingSchedule::parse("mon-sun 06:00-18:00; * 18:00-06:00").alwaysOn());
+    QVERIFY(!RecordingSchedule::parse("daily 00:00-23:59").alwaysOn());
+}
+
+void TestRecordingSchedule::nextChangeFindsTheBoundary() {
+    const RecordingSchedule s = RecordingSchedule::parse("mon-fri 18:00-08:00");
+    QCOMPARE(s.nextChange(at(0, 12, 0, 30)), at(0, 18, 0));
+    QCOMPARE(s.nextChange(at(0, 18, 0)), at(1, 8, 0));
+    // Friday night runs to Saturday 08:00, then nothing until Monday 18:00.
+    QCOMPARE(s.nextChange(at(4, 20, 0)), at(5, 8, 0));
+    QCOMPARE(s.nextChange(at(5, 8, 0)), at(7, 18, 0));
+}
+
+void TestRecordingSchedule::nextChangeIsInvalidWhenAlwaysOn() {
+    QVERIFY(!RecordingSchedule::parse(QString()).nextChange(at(0, 0, 0)).isValid());
+    QVERIFY(!RecordingSchedule::parse("daily 00:00-24:00").nextChange(at(0, 0, 0)).isValid());
+}
+
+QTEST_APPLESS_MAIN(TestRecordingSchedule)
+#include "tst_recording_schedule.moc"
@@ -0,0 +1,10 @@
+# Unit tests: qmake tests/tests.pro && make && make check
+# Benchmarks (*_bench) build with them but are run by hand.
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    batch_sink_bench \
+    io_policy_bench \
+    purge_partitions \
+    query_plan \
+    recording_schedule